@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "aci/arena.h"
+
+#define ARENA_ROUND(len) \
+    (((len) + ACI_ARENA_ALIGN - 1) & ~((size_t)ACI_ARENA_ALIGN - 1))
+
+/*
+ * An allocation that did not fit in the block of an
+ * arena, freed on the next reset
+ *
+ * @next: Next spilled allocation
+ * @len: Number of bytes in 'data'
+ * @data: Bytes handed out
+ */
+struct aci_arena_spill {
+    struct aci_arena_spill *next;
+    size_t len;
+    _Alignas(ACI_ARENA_ALIGN) char data[];
+};
+
+/*
+ * Returns the block size that holds 'len' bytes, in
+ * powers of two from ACI_ARENA_INIT up to ACI_ARENA_KEEP
+ */
+static size_t
+arena_block_size(size_t len)
+{
+    size_t size = ACI_ARENA_INIT;
+
+    while (size < len && size < ACI_ARENA_KEEP) {
+        size *= 2;
+    }
+
+    return size;
+}
+
+/*
+ * Raise the high-water mark to what is in use
+ */
+static void
+arena_note_peak(struct aci_arena *arena)
+{
+    size_t total;
+
+    total = arena->used + arena->spilled;
+    if (total > arena->peak) {
+        arena->peak = total;
+    }
+}
+
+void *
+aci_arena_alloc(struct aci_arena *arena, size_t len)
+{
+    struct aci_arena_spill *spill;
+    void *p;
+
+    if (arena == NULL || len > SIZE_MAX / 2) {
+        return NULL;
+    }
+
+    len = ARENA_ROUND((len > 0) ? len : 1);
+    if (arena->base == NULL) {
+        if ((arena->base = malloc(ACI_ARENA_INIT)) == NULL)
+            return NULL;
+        arena->size = ACI_ARENA_INIT;
+    }
+
+    if (arena->size - arena->used >= len) {
+        p = arena->base + arena->used;
+        arena->used += len;
+        return p;
+    }
+
+    if ((spill = malloc(sizeof(*spill) + len)) == NULL) {
+        return NULL;
+    }
+
+    spill->len = len;
+    spill->next = arena->spill;
+    arena->spill = spill;
+    arena->spilled += len;
+    return spill->data;
+}
+
+struct aci_arena_mark
+aci_arena_mark(const struct aci_arena *arena)
+{
+    struct aci_arena_mark mark;
+
+    mark.used = arena->used;
+    mark.spill = arena->spill;
+    return mark;
+}
+
+void
+aci_arena_release(struct aci_arena *arena, struct aci_arena_mark mark)
+{
+    struct aci_arena_spill *spill;
+
+    arena_note_peak(arena);
+    while ((spill = arena->spill) != NULL && spill != mark.spill) {
+        arena->spill = spill->next;
+        arena->spilled -= spill->len;
+        free(spill);
+    }
+
+    if (mark.used < arena->used) {
+        arena->used = mark.used;
+    }
+}
+
+void
+aci_arena_reset(struct aci_arena *arena)
+{
+    struct aci_arena_spill *spill;
+    size_t size;
+    char *base;
+
+    if (arena == NULL) {
+        return;
+    }
+
+    arena_note_peak(arena);
+    arena->used = 0;
+    while ((spill = arena->spill) != NULL) {
+        arena->spill = spill->next;
+        free(spill);
+    }
+
+    /* Make room for the largest request seen so far */
+    arena->spilled = 0;
+    if (arena->peak <= arena->size || arena->size >= ACI_ARENA_KEEP) {
+        return;
+    }
+
+    size = arena_block_size(arena->peak);
+    if ((base = malloc(size)) != NULL) {
+        free(arena->base);
+        arena->base = base;
+        arena->size = size;
+    }
+}
+
+void
+aci_arena_free(struct aci_arena *arena)
+{
+    if (arena == NULL) {
+        return;
+    }
+
+    aci_arena_reset(arena);
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = 0;
+}
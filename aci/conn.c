@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aci/conn.h"
+
+/*
+ * Append bytes to the output queue of a connection
+ */
+static int
+conn_queue(struct aci_conn *conn, const char *p, size_t len)
+{
+    struct aci_outbuf *ob;
+    size_t room;
+
+    ob = TAILQ_LAST(&conn->outq, aci_outq);
+    while (len > 0) {
+        if (ob == NULL || ob->tail == ACI_OUTBUF_LEN) {
+            if ((ob = malloc(sizeof(*ob))) == NULL) {
+                errno = -ENOMEM;
+                return -1;
+            }
+
+            ob->head = 0;
+            ob->tail = 0;
+            TAILQ_INSERT_TAIL(&conn->outq, ob, link);
+        }
+
+        room = ACI_OUTBUF_LEN - ob->tail;
+        if (room > len) {
+            room = len;
+        }
+
+        memcpy(&ob->data[ob->tail], p, room);
+        ob->tail += room;
+        conn->backlog += room;
+        p += room;
+        len -= room;
+    }
+
+    return 0;
+}
+
+/*
+ * Put as many of 'len' bytes as there is room for
+ * into the receive ring of a client.
+ *
+ * Returns the number of bytes put
+ */
+static size_t
+conn_shm_put(struct aci_conn *conn, const void *buf, size_t len)
+{
+    struct aci_ring *ring;
+    size_t room;
+
+    ring = &conn->shm->region->rx;
+    if (aci_ring_broken(ring)) {
+        conn->error = 1;
+        return 0;
+    }
+
+    room = ACI_RING_SIZE - aci_ring_avail(ring);
+    if (room > len) {
+        room = len;
+    }
+
+    if (room == 0 || aci_ring_put(ring, buf, room) != room) {
+        return 0;
+    }
+
+    return room;
+}
+
+/*
+ * Move the output queue of a shared-memory connection
+ * into the receive ring of its client. Whatever does
+ * not fit stays queued and the client is asked to kick
+ * the daemon once it made room.
+ */
+static int
+conn_shm_flush(struct aci_conn *conn)
+{
+    struct aci_ring *ring;
+    struct aci_outbuf *ob;
+    size_t n;
+
+    ring = &conn->shm->region->rx;
+    while ((ob = TAILQ_FIRST(&conn->outq)) != NULL) {
+        n = conn_shm_put(conn, &ob->data[ob->head], ob->tail - ob->head);
+        if (conn->error) {
+            errno = -EPIPE;
+            return -1;
+        }
+
+        if (n == 0) {
+            if (aci_ring_full(ring))
+                break;
+            continue;
+        }
+
+        ob->head += n;
+        conn->backlog -= n;
+        if (ob->head < ob->tail) {
+            continue;
+        }
+
+        TAILQ_REMOVE(&conn->outq, ob, link);
+        free(ob);
+    }
+
+    aci_ring_kick(ring, conn->shm->rx_efd);
+    return 0;
+}
+
+/*
+ * Push bytes into the receive ring of a client, queueing
+ * whatever the ring is short on room for
+ */
+static ssize_t
+conn_shm_send(struct aci_conn *conn, const void *buf, size_t len, int flags)
+{
+    const char *p = buf;
+    size_t n = 0;
+
+    if (conn->error) {
+        errno = -EPIPE;
+        return -1;
+    }
+
+    /* Nothing queued, the ring may take it all directly */
+    if (conn->backlog == 0) {
+        n = conn_shm_put(conn, p, len);
+        if (conn->error) {
+            errno = -EPIPE;
+            return -1;
+        }
+    }
+
+    if (n == len) {
+        if (!(flags & MSG_MORE))
+            aci_ring_kick(&conn->shm->region->rx, conn->shm->rx_efd);
+        return len;
+    }
+
+    if (conn_queue(conn, p + n, len - n) < 0) {
+        conn->error = 1;
+        return -1;
+    }
+
+    return (conn_shm_flush(conn) < 0) ? -1 : (ssize_t)len;
+}
+
+ssize_t
+aci_conn_send(struct aci_conn *conn, const void *buf, size_t len, int flags)
+{
+    const char *p = buf;
+    ssize_t n = 0;
+
+    if (conn == NULL || buf == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (conn->shm != NULL) {
+        return conn_shm_send(conn, buf, len, flags);
+    }
+
+    if (conn->error) {
+        errno = -EPIPE;
+        return -1;
+    }
+
+    /* Nothing queued, the socket may take it all directly */
+    if (conn->backlog == 0) {
+        n = send(conn->fd, p, len, flags | MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            conn->error = 1;
+            errno = -errno;
+            return -1;
+        }
+
+        n = (n < 0) ? 0 : n;
+    }
+
+    if (conn_queue(conn, p + n, len - n) < 0) {
+        conn->error = 1;
+        return -1;
+    }
+
+    return len;
+}
+
+int
+aci_conn_flush(struct aci_conn *conn)
+{
+    struct aci_outbuf *ob;
+    ssize_t n;
+
+    if (conn == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (conn->shm != NULL) {
+        return conn_shm_flush(conn);
+    }
+
+    conn->stalled = 0;
+    while ((ob = TAILQ_FIRST(&conn->outq)) != NULL) {
+        n = send(conn->fd, &ob->data[ob->head], ob->tail - ob->head,
+            MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+
+        if (n < 0) {
+            conn->error = 1;
+            errno = -errno;
+            return -1;
+        }
+
+        ob->head += n;
+        conn->backlog -= n;
+        if (ob->head < ob->tail) {
+            break;
+        }
+
+        TAILQ_REMOVE(&conn->outq, ob, link);
+        free(ob);
+    }
+
+    return conn->error ? -1 : 0;
+}
+
+int
+aci_conn_stash(struct aci_conn *conn, const void *buf, size_t len)
+{
+    size_t cap;
+    char *p;
+
+    if (conn == NULL || buf == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    cap = (conn->incap > 0) ? conn->incap : 4096;
+    while (cap < conn->inlen + len) {
+        cap *= 2;
+    }
+
+    if (cap != conn->incap) {
+        if ((p = realloc(conn->inbuf, cap)) == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        conn->inbuf = p;
+        conn->incap = cap;
+    }
+
+    memcpy(conn->inbuf + conn->inlen, buf, len);
+    conn->inlen += len;
+    return 0;
+}
+
+void
+aci_conn_consume(struct aci_conn *conn, size_t len)
+{
+    if (conn == NULL || len > conn->inlen) {
+        return;
+    }
+
+    conn->inlen -= len;
+    memmove(conn->inbuf, conn->inbuf + len, conn->inlen);
+
+    /* Don't sit on the room a large packet needed */
+    if (conn->inlen == 0 && conn->incap > ACI_INBUF_KEEP) {
+        free(conn->inbuf);
+        conn->inbuf = NULL;
+        conn->incap = 0;
+    }
+}
+
+int
+aci_conn_init(struct aci_conn *conn)
+{
+    int flags;
+
+    if (conn == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    TAILQ_INIT(&conn->outq);
+    conn->backlog = 0;
+    if ((flags = fcntl(conn->fd, F_GETFL)) < 0 ||
+        fcntl(conn->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+aci_conn_drop(struct aci_conn *conn)
+{
+    struct aci_outbuf *ob;
+
+    if (conn == NULL) {
+        return;
+    }
+
+    while ((ob = TAILQ_FIRST(&conn->outq)) != NULL) {
+        TAILQ_REMOVE(&conn->outq, ob, link);
+        free(ob);
+    }
+
+    free(conn->inbuf);
+    conn->inbuf = NULL;
+    conn->inlen = 0;
+    conn->incap = 0;
+    conn->backlog = 0;
+    aci_arena_free(&conn->arena);
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include "aci/handoff.h"
+
+int
+aci_handoff_send(int fd, const struct aci_handoff_reply *reply,
+    const int *fdv, int fdc)
+{
+    char cbuf[CMSG_SPACE(ACI_HANDOFF_FDS * sizeof(int))];
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t n;
+
+    if (reply == NULL || fdc < 0 || fdc > ACI_HANDOFF_FDS) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    iov.iov_base = (void *)reply;
+    iov.iov_len = sizeof(*reply);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (fdc > 0) {
+        memset(cbuf, 0, sizeof(cbuf));
+        msg.msg_control = cbuf;
+        msg.msg_controllen = CMSG_SPACE(fdc * sizeof(int));
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fdc * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fdv, fdc * sizeof(int));
+    }
+
+    /* The reply is tiny, it either goes out whole or not at all */
+    do {
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+
+    if (n != sizeof(*reply)) {
+        errno = (n < 0) ? -errno : -EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+aci_handoff_take(const char *path, struct aci_handoff_reply *reply,
+    int *fdv, int max)
+{
+    char cbuf[CMSG_SPACE(ACI_HANDOFF_FDS * sizeof(int))];
+    struct sockaddr_un un;
+    struct cmsghdr *cmsg;
+    struct aci_pkt pkt;
+    struct msghdr msg;
+    struct iovec iov;
+    int fd, fdc = 0;
+    ssize_t n;
+
+    if (path == NULL || reply == NULL || fdv == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strncpy(un.sun_path, path, sizeof(un.sun_path) - 1);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr *)&un, sizeof(un)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.op = ACI_CMD_HANDOFF;
+    if (send(fd, &pkt, sizeof(pkt), MSG_NOSIGNAL) != sizeof(pkt)) {
+        close(fd);
+        return -1;
+    }
+
+    iov.iov_base = reply;
+    iov.iov_len = sizeof(*reply);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    do {
+        n = recvmsg(fd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+
+    close(fd);
+    if (n != sizeof(*reply)) {
+        errno = (n < 0) ? -errno : -EPIPE;
+        return -1;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+
+        fdc = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (fdc > max) {
+            for (int i = 0; i < fdc; ++i)
+                close(((int *)CMSG_DATA(cmsg))[i]);
+            errno = -EMSGSIZE;
+            return -1;
+        }
+
+        memcpy(fdv, CMSG_DATA(cmsg), fdc * sizeof(int));
+    }
+
+    return fdc;
+}
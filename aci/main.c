@@ -27,30 +27,216 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+#include <sys/sendfile.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/un.h>
 #include <sys/types.h>
 #include <stdint.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
+#include <signal.h>
 #include "drum/drum.h"
+#include "drum/index.h"
 #include "aci/state.h"
+#include "aci/conn.h"
+#include "aci/shm.h"
 #include "aci/proto.h"
+#include "aci/query.h"
+#include "aci/uring.h"
+#include "aci/repl.h"
+#include "aci/watch.h"
+#include "aci/handoff.h"
 
 #define IPC_BACKLOG 32
 #define POLL_FD_COUNT 16
+#define IPC_MAX_FDS 4
+#define IPC_BUFSIZE 16384
 #define IPC_PATH "/tmp/odb.d"
 #define DRUM_MODE 0700
 
+/* Expired keys reclaimed per drum each time around the loop */
+#define EXPIRE_BUDGET 256
+
+/* Replication, see repl_*() */
+#define REPL_FOLLOWERS 4
+#define REPL_RETRY 1000     /* ms between attempts to reach the leader */
+#define REPL_SNDTIMEO 1     /* s a follower may stall the leader for */
+
+/* Backups and exports, see backup_step() */
+#define BACKUP_JOBS 4
+#define BACKUP_CHUNK (4 * 1024 * 1024)  /* bytes per job per loop */
+#define BACKUP_PATHLEN 192
+#define BACKUP_META UINT32_MAX
+
+/* Bytes of buckets compaction goes through per drum each loop */
+#define COMPACT_CHUNK (4 * 1024 * 1024)
+
+/* Rows read from segments in one go */
+#define READ_BATCH 16
+#define READ_BUFLEN 4096
+
+/* io_uring event loop sizing */
+#define URING_ENTRIES 256
+#define URING_PBUFS 64
+#define URING_CMSG_LEN CMSG_SPACE(IPC_MAX_FDS * sizeof(int))
+#define URING_RECV_LEN \
+    (sizeof(struct io_uring_recvmsg_out) + URING_CMSG_LEN + IPC_BUFSIZE)
+
+/* Operation tags in the low byte of io_uring user data */
+#define URING_ACCEPT 1
+#define URING_RECV   2
+#define URING_EVENT  3
+#define URING_CANCEL 4
+#define URING_REPL   5
+#define URING_WRITE  6
+#define URING_DATA(CONN, TAG) (((uint64_t)(CONN)->id << 8) | (TAG))
+
+/*
+ * A batch of index entries whose data is read in one
+ * go before being sent as rows
+ *
+ * @ents: Entries of the batch
+ * @bufs: Data of each entry once read
+ * @count: Number of entries
+ */
+struct read_batch {
+    struct drum_index_ent *ents[READ_BATCH];
+    struct drum_version vers[READ_BATCH];
+    char *bufs[READ_BATCH];
+    size_t count;
+};
+
+/*
+ * A value being stored in chunks on a connection,
+ * see ACI_CMD_STORE_BEGIN
+ *
+ * @drum: Drum the value goes to
+ * @up: Bucket reserved for the value
+ * @error: First error a chunk ran into [errno value]
+ */
+struct aci_upload {
+    struct drum *drum;
+    struct drum_upload up;
+    int error;
+};
+
+/*
+ * A drum as it was when a backup began
+ *
+ * @drum: Drum being copied
+ * @segs: Number of segments it had
+ * @end: Size its active segment had
+ */
+struct backup_drum {
+    struct drum *drum;
+    uint32_t segs;
+    off_t end;
+};
+
+/*
+ * A point-in-time copy of drums [ACI_CMD_BACKUP or
+ * ACI_CMD_EXPORT] made a chunk per turn of the event
+ * loop. Segments are only ever appended to, so copying
+ * each drum up to where it ended when the copy began
+ * gives a consistent copy while stores go on.
+ *
+ * @conn: ID of the connection it is for [zero if free]
+ * @op: ACI_CMD_BACKUP or ACI_CMD_EXPORT
+ * @drums: Drums being copied
+ * @ndrums: Number of drums
+ * @cur: Drum being copied
+ * @seg: Segment being copied [BACKUP_META for settings]
+ * @off: Offset reached within the segment
+ * @len: Bytes of the segment to copy [-1 if not started]
+ * @dst: Segment being written [ACI_CMD_BACKUP]
+ * @path: Directory the copy goes to [ACI_CMD_BACKUP]
+ */
+struct backup_job {
+    uint32_t conn;
+    aci_op_t op;
+    struct backup_drum *drums;
+    size_t ndrums;
+    size_t cur;
+    uint32_t seg;
+    off_t off;
+    off_t len;
+    int dst;
+    char path[BACKUP_PATHLEN];
+};
+
+/*
+ * A follower connected to the replication socket
+ *
+ * @fd: Follower socket [-1 if the slot is free]
+ * @live: Caught up, records are shipped as they are stored
+ */
+struct repl_follower {
+    int fd;
+    int live;
+};
+
 static char *drum_dir = NULL;
+static const char *ipc_path = IPC_PATH;
 static struct pollfd fds[POLL_FD_COUNT];
+static struct aci_conn *conns[POLL_FD_COUNT];
 static struct aci_state state;
+static uint32_t next_conn_id = 0;
+
+/* io_uring engine, see run_uring() */
+static int use_uring = 0;
+static int accept_oneshot = 0;
+static int uring_cancels = 0;
+static struct aci_uring ev_ring;
+static struct aci_uring io_ring;
+static struct msghdr recv_msg;
+static char *read_pool = NULL;
+
+/* Copies of drums being made */
+static struct backup_job backups[BACKUP_JOBS];
+
+/* Connections that have watched anything */
+static int watchers = 0;
+
+/* Leader side of replication */
+static const char *repl_path = NULL;
+static int repl_sock = -1;
+static struct repl_follower followers[REPL_FOLLOWERS];
+static uint64_t repl_beat = 0;
+
+/* Handing off to a new daemon, see handoff_run() */
+static int listen_fd = -1;
+static uint32_t handoff_conn = 0;
+static uint64_t handoff_deadline = 0;
+
+/* Taken over from an old daemon, see handoff_take() */
+static int hot_listen = -1;
+static int hot_repl = -1;
+static int hot_conns[ACI_HANDOFF_FDS];
+static int hot_nconns = 0;
+static void *hot_image = NULL;
+static size_t hot_image_len = 0;
+static void *hot_watch = NULL;
+static size_t hot_watch_len = 0;
+
+/* Follower side of replication */
+static const char *leader_path = NULL;
+static int leader_fd = -1;
+static int leader_synced = 0;
+static uint64_t leader_retry = 0;
+static uint64_t leader_seq = 0;
+static uint64_t leader_stamp = 0;
+static uint64_t repl_applied = 0;
 
 /*
  * Allocate a new drum
@@ -60,10 +246,11 @@ static struct aci_state state;
 struct drum *
 drum_alloc(const char *name, const char *path)
 {
+    const struct drum_image *img;
     struct drum *drum;
     size_t name_len;
 
-    drum = malloc(sizeof(*drum));
+    drum = calloc(1, sizeof(*drum));
     if (drum == NULL) {
         return NULL;
     }
@@ -75,9 +262,59 @@ drum_alloc(const char *name, const char *path)
 
     drum->path = strdup(path);
     memcpy(drum->name, name, name_len);
+
+    /* The image handed over by an old daemon saves a replay */
+    img = drum_image_find(hot_image, hot_image_len, drum->name);
+    if (img != NULL && drum_image_open(drum, img) == 0) {
+        return drum;
+    }
+
+    if (drum_open(drum) < 0) {
+        printf("error: failed to open segments of \"%s\"\n", path);
+        free((void *)drum->path);
+        free(drum);
+        return NULL;
+    }
+
     return drum;
 }
 
+/*
+ * Look up a drum by name
+ */
+static struct drum *
+drum_lookup(const char *name)
+{
+    struct drum *drum;
+
+    TAILQ_FOREACH(drum, &state.drum_list, link) {
+        if (strncmp(drum->name, name, DRUM_NAMELEN) == 0) {
+            return drum;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Add a drum to the list, which is kept in name order
+ * so that QUERY walks drums alike on every daemon
+ */
+static void
+drum_list_add(struct drum *drum)
+{
+    struct drum *next;
+
+    TAILQ_FOREACH(next, &state.drum_list, link) {
+        if (strncmp(next->name, drum->name, DRUM_NAMELEN) > 0) {
+            TAILQ_INSERT_BEFORE(next, drum, link);
+            return;
+        }
+    }
+
+    TAILQ_INSERT_TAIL(&state.drum_list, drum, link);
+}
+
 /*
  * Enumerate each available drum
  */
@@ -118,7 +355,7 @@ drum_enumerate(void)
             exit(1);
         }
         printf("[ drum %zu ] @ %s\n", state.drum_count, pathbuf);
-        TAILQ_INSERT_TAIL(&state.drum_list, drum, link);
+        drum_list_add(drum);
     }
 
     closedir(dir);
@@ -126,14 +363,16 @@ drum_enumerate(void)
 
 /*
  * Allocate a file descriptor from the pollfd
- * list.
+ * list on behalf of a connection.
  */
 static struct pollfd *
-poll_fd_alloc(int fd)
+poll_fd_alloc(int fd, struct aci_conn *conn)
 {
     for (int i = 0; i < POLL_FD_COUNT; ++i) {
         if (fds[i].fd == -1) {
             fds[i].fd = fd;
+            fds[i].revents = 0;
+            conns[i] = conn;
             return &fds[i];
         }
     }
@@ -142,205 +381,3745 @@ poll_fd_alloc(int fd)
 }
 
 /*
- * Accept an IPC connection
+ * Reclaim the versions no snapshot can see anymore
  */
 static void
-ipc_accept(int ssockfd)
+aci_gc(void)
 {
-    struct sockaddr_un client;
-    struct pollfd *fd;
-    socklen_t client_len;
-    int client_fd;
+    struct drum *drum;
 
-    client_len = sizeof(client);
-    client_fd = accept(
-        ssockfd,
-        (struct sockaddr *)&client,
-        &client_len
-    );
+    TAILQ_FOREACH(drum, &state.drum_list, link) {
+        drum_gc(drum);
+    }
+}
 
-    if (client_fd < 0) {
-        perror("accept");
-        return;
+/*
+ * Returns true if a connection may read from a
+ * snapshot, which must be one it holds
+ */
+static int
+conn_snap_held(const struct aci_conn *conn, uint64_t snap)
+{
+    if (snap == 0) {
+        return 1;
     }
 
-    if ((fd = poll_fd_alloc(client_fd)) == NULL) {
-        close(client_fd);
-        return;
+    for (uint8_t i = 0; i < conn->nsnaps; ++i) {
+        if (conn->snaps[i] == snap)
+            return 1;
     }
 
-    fd->events = POLLIN;
+    return 0;
 }
 
 /*
- * Send a list of drum paths to the requesting
- * client
+ * Look up a live connection by its ID, completions
+ * for connections that have since closed find none.
+ */
+static struct aci_conn *
+conn_lookup(uint32_t id)
+{
+    for (int i = 0; i < POLL_FD_COUNT; ++i) {
+        if (conns[i] != NULL && conns[i]->id == id) {
+            return conns[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Queue the cancellation of a multishot operation
  */
 static void
-aci_send_drums(int client_fd)
+uring_cancel(uint64_t user_data)
 {
-    char pad[DRUM_NAMELEN];
-    struct drum *drum;
+    struct io_uring_sqe *sqe;
 
-    memset(pad, EOF, sizeof(pad));
-    TAILQ_FOREACH(drum, &state.drum_list, link) {
-        send(client_fd, drum->name, DRUM_NAMELEN, 0);
+    if ((sqe = aci_uring_sqe(&ev_ring)) == NULL) {
+        return;
     }
 
-    /* EOF pad denotes end of list */
-    send(client_fd, pad, sizeof(pad), 0);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = URING_CANCEL;
+    ++uring_cancels;
 }
 
+/*
+ * Queue a multishot poll on the eventfd of a
+ * shared-memory connection
+ */
 static void
-aci_create_drum(const char *name)
+uring_arm_event(struct aci_conn *conn)
 {
-    struct drum *drum;
-    char path[256];
+    struct io_uring_sqe *sqe;
 
-    if (name == NULL || drum_dir == NULL) {
+    if ((sqe = aci_uring_sqe(&ev_ring)) == NULL) {
         return;
     }
 
-    snprintf(path, sizeof(path), "%s/%s", drum_dir, name);
-    drum = drum_alloc(name, path);
-    if (drum == NULL) {
-        printf("error: failed to allocate \"%s\" [drum]\n", path);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = conn->shm->tx_efd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = URING_DATA(conn, URING_EVENT);
+}
+
+/*
+ * Queue a poll for input on a replication socket
+ */
+static void
+uring_arm_repl(int fd)
+{
+    struct io_uring_sqe *sqe;
+
+    if ((sqe = aci_uring_sqe(&ev_ring)) == NULL) {
         return;
     }
 
-    mkdir(path, DRUM_MODE);
-    TAILQ_INSERT_TAIL(&state.drum_list, drum, link);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = ((uint64_t)fd << 8) | URING_REPL;
 }
 
+/*
+ * Queue an accept on the listening socket, multishot
+ * unless the kernel turned that down before
+ */
 static void
-aci_handle_create(struct aci_pkt *pkt)
+uring_arm_accept(int ssockfd)
 {
-    char name[128];
+    struct io_uring_sqe *sqe;
+    int slot;
 
-    if (pkt == NULL) {
+    if ((sqe = aci_uring_sqe(&ev_ring)) == NULL) {
         return;
     }
 
-    memcpy(name, pkt->data, pkt->length);
-    switch (pkt->type) {
-    case ACI_TYPE_DRUM:
-        aci_create_drum(name);
-        break;
-    default:
-        break;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = ssockfd;
+    if ((slot = aci_uring_file(&ev_ring, ssockfd)) >= 0) {
+        sqe->fd = slot;
+        sqe->flags = IOSQE_FIXED_FILE;
+    }
+
+    if (!accept_oneshot) {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
     }
+
+    sqe->user_data = URING_ACCEPT;
 }
 
+/*
+ * Queue a multishot receive on a client socket, with
+ * the data landing in provided buffers
+ */
 static void
-ipc_read(int client_fd, uint16_t poll_idx)
+uring_arm_recv(struct aci_conn *conn)
 {
-    struct aci_pkt *pkt;
-    char buf[256];
-    ssize_t len;
+    struct io_uring_sqe *sqe;
 
-    len = recv(client_fd, buf, sizeof(buf), 0);
-    if (len <= 0) {
-        printf("client closed connection\n");
-        close(client_fd);
-        fds[poll_idx].fd = -1;
+    if ((sqe = aci_uring_sqe(&ev_ring)) == NULL) {
         return;
     }
 
-    pkt = (struct aci_pkt *)buf;
-    switch (pkt->op) {
-    case ACI_CMD_NOP:
-        break;
-    case ACI_CMD_QUERY:
-        aci_send_drums(client_fd);
-        break;
-    case ACI_CMD_CREATE:
-        aci_handle_create(pkt);
-        break;
-    default:
-        printf("got unknown operation\n");
-    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = conn->fd;
+    sqe->addr = (uintptr_t)&recv_msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = URING_DATA(conn, URING_RECV);
 }
 
+/*
+ * Queue a poll for a client socket to take more of
+ * its output queue
+ */
 static void
-run(void)
+uring_arm_write(struct aci_conn *conn)
 {
-    struct sockaddr_un un;
-    int ssockfd, error;
-    int pollret;
-
-    memset(&un, 0, sizeof(un));
-    memcpy(un.sun_path, IPC_PATH, sizeof(IPC_PATH));
-    un.sun_family = AF_UNIX;
+    struct io_uring_sqe *sqe;
 
-    /* Open a server side socket */
-    ssockfd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (ssockfd < 0) {
-        perror("ssockfd");
+    if ((sqe = aci_uring_sqe(&ev_ring)) == NULL) {
         return;
     }
 
-    error = bind(
-        ssockfd,
-        (struct sockaddr *)&un,
-        sizeof(un)
-    );
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = conn->fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = URING_DATA(conn, URING_WRITE);
+    conn->writing = 1;
+}
 
-    if (error < 0) {
-        perror("bind");
-        return;
+/*
+ * Returns true if 'fd' is a replication socket being
+ * watched. These take a pollfd slot with no connection.
+ */
+static int
+repl_watched(int fd)
+{
+    for (int i = 1; i < POLL_FD_COUNT; ++i) {
+        if (fds[i].fd == fd && conns[i] == NULL)
+            return 1;
     }
 
-    error = listen(ssockfd, IPC_BACKLOG);
-    if (error < 0) {
-        perror("listen");
-        return;
+    return 0;
+}
+
+/*
+ * Start watching a replication socket for input
+ *
+ * Returns zero on success
+ */
+static int
+repl_watch(int fd)
+{
+    struct pollfd *pfd;
+
+    if ((pfd = poll_fd_alloc(fd, NULL)) == NULL) {
+        return -1;
     }
 
-    fds[0].fd = ssockfd;
-    fds[0].events = POLLIN;
+    pfd->events = POLLIN;
+    if (use_uring) {
+        uring_arm_repl(fd);
+    }
 
-    /* Read through events */
-    for (;;) {
-        pollret = poll(fds, POLL_FD_COUNT, 500);
-        if (pollret < 0) {
-            perror("poll");
+    return 0;
+}
+
+/*
+ * Stop watching a replication socket and close it
+ */
+static void
+repl_unwatch(int fd)
+{
+    for (int i = 1; i < POLL_FD_COUNT; ++i) {
+        if (fds[i].fd == fd && conns[i] == NULL)
+            fds[i].fd = -1;
+    }
+
+    if (use_uring) {
+        uring_cancel(((uint64_t)fd << 8) | URING_REPL);
+    }
+
+    close(fd);
+}
+
+static void
+repl_follower_drop(struct repl_follower *f)
+{
+    printf("follower disconnected\n");
+    repl_unwatch(f->fd);
+    f->fd = -1;
+    f->live = 0;
+}
+
+/*
+ * Ship a frame to every follower that is caught up.
+ * Followers that cannot keep up are dropped and catch
+ * up again once they reconnect.
+ */
+static void
+repl_ship(struct aci_repl_frame *frame, const char *key, const void *data)
+{
+    for (int i = 0; i < REPL_FOLLOWERS; ++i) {
+        if (followers[i].fd < 0 || !followers[i].live) {
             continue;
         }
 
-        if (fds[0].revents & POLLIN) {
-            ipc_accept(ssockfd);
+        if (aci_repl_send(followers[i].fd, frame, key, data) < 0) {
+            repl_follower_drop(&followers[i]);
         }
+    }
+}
 
-        for (int i = 1; i < POLL_FD_COUNT; ++i) {
-            if (fds[i].fd < 0) {
-                continue;
-            }
-
-            ipc_read(fds[i].fd, i);
-        }
+/*
+ * Fill in a frame describing a drum
+ */
+static void
+repl_frame_init(struct aci_repl_frame *frame, aci_repl_op_t op,
+    const struct drum *drum)
+{
+    memset(frame, 0, sizeof(*frame));
+    frame->op = op;
+    frame->stamp = drum_clock();
+    if (drum != NULL) {
+        memcpy(frame->drum, drum->name, DRUM_NAMELEN);
+        frame->flags = drum->flags;
     }
 }
 
-int
-main(int argc, char **argv)
+/*
+ * Tear down a connection and release every pollfd
+ * slot it holds.
+ */
+static void
+conn_close(struct aci_conn *conn)
 {
-    pid_t child;
+    if (conn->nsnaps > 0) {
+        for (uint8_t i = 0; i < conn->nsnaps; ++i)
+            drum_snap_release(conn->snaps[i]);
+        aci_gc();
+    }
 
-    if (argc < 2) {
-        printf("fatal: expected drum directory as argument\n");
-        return -1;
+    for (int i = 0; i < POLL_FD_COUNT; ++i) {
+        if (conns[i] == conn) {
+            fds[i].fd = -1;
+            conns[i] = NULL;
+        }
     }
 
-    drum_dir = argv[1];
-    if (access(drum_dir, F_OK) != 0) {
-        printf("fatal: could not access \"%s\"\n", drum_dir);
-        return -1;
+    /* Multishot operations hold the files open otherwise */
+    if (use_uring) {
+        uring_cancel(URING_DATA(conn, URING_RECV));
+        if (conn->shm != NULL)
+            uring_cancel(URING_DATA(conn, URING_EVENT));
+        if (conn->writing)
+            uring_cancel(URING_DATA(conn, URING_WRITE));
     }
 
-    TAILQ_INIT(&state.drum_list);
-    drum_enumerate();
+    if (conn->watch != NULL) {
+        free(conn->watch);
+        --watchers;
+    }
+
+    aci_conn_drop(conn);
+    aci_shm_free(conn->shm);
+    if (conn->upload != NULL) {
+        drum_upload_abort(conn->upload->drum, &conn->upload->up);
+        free(conn->upload);
+    }
+
+    close(conn->fd);
+    free(conn);
+}
+
+/*
+ * Returns true if a connection has nothing in flight
+ * and holds no state beyond its socket and what it
+ * watches, so that it may be passed to a new daemon.
+ * Shared-memory channels and snapshots can't be.
+ */
+static int
+conn_idle(const struct aci_conn *conn)
+{
+    if (conn->inlen > 0 || conn->backlog > 0 || conn->writing ||
+        conn->stalled || aci_watch_pending(conn->watch)) {
+        return 0;
+    }
+
+    if (conn->upload != NULL || conn->shm != NULL || conn->nsnaps > 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < BACKUP_JOBS; ++i) {
+        if (backups[i].conn == conn->id)
+            return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Returns true if a connection is not to be read from
+ * while the daemon hands off; whatever the client
+ * sends next is left in the socket for the new daemon.
+ * The new daemon itself is still read from so that we
+ * notice when it goes away.
+ */
+static int
+conn_held(const struct aci_conn *conn)
+{
+    if (handoff_conn == 0 || conn->id == handoff_conn) {
+        return 0;
+    }
+
+    return conn_idle(conn);
+}
+
+/*
+ * Follow the output queue of a connection after it was
+ * written to or drained. A client that lets more than
+ * ACI_CONN_HIWAT bytes of replies pile up is not read
+ * from until it takes them down to ACI_CONN_LOWAT, so
+ * one slow reader cannot make the daemon buffer without
+ * bound or hold up everyone else. Shared-memory
+ * clients are held the same way, their transmit ring
+ * is left unread instead of the socket.
+ *
+ * Returns -1 if the connection was closed
+ */
+static int
+conn_update(struct aci_conn *conn)
+{
+    short events;
+
+    if (conn->error) {
+        printf("client stopped taking replies\n");
+        conn_close(conn);
+        return -1;
+    }
+
+    if (!conn->throttled &&
+        (conn->backlog > ACI_CONN_HIWAT || conn_held(conn))) {
+        conn->throttled = 1;
+        if (use_uring && conn->shm == NULL)
+            uring_cancel(URING_DATA(conn, URING_RECV));
+    } else if (conn->throttled && conn->backlog < ACI_CONN_LOWAT &&
+        !conn_held(conn)) {
+        conn->throttled = 0;
+        if (use_uring && conn->shm == NULL)
+            uring_arm_recv(conn);
+    }
+
+    /* Flushed when the client kicks us, the socket only tells of hangups */
+    if (conn->shm != NULL) {
+        return 0;
+    }
+
+    if (use_uring) {
+        if ((conn->backlog > 0 || conn->stalled) && !conn->writing)
+            uring_arm_write(conn);
+        return 0;
+    }
+
+    events = conn->throttled ? 0 : POLLIN;
+    if (conn->backlog > 0 || conn->stalled) {
+        events |= POLLOUT;
+    }
+
+    for (int i = 0; i < POLL_FD_COUNT; ++i) {
+        if (conns[i] == conn && fds[i].fd == conn->fd)
+            fds[i].events = events;
+    }
+
+    return 0;
+}
+
+/*
+ * Tell every watching connection about a change, it
+ * is sent to them on the next turn of the event loop
+ *
+ * @key: Key that changed [empty for ACI_EVENT_CREATE]
+ */
+static void
+watch_note(uint8_t op, uint64_t seq, const struct drum *drum, const char *key)
+{
+    struct aci_conn *conn;
+
+    if (watchers == 0) {
+        return;
+    }
+
+    for (int i = 0; i < POLL_FD_COUNT; ++i) {
+        conn = conns[i];
+        if (conn == NULL || fds[i].fd != conn->fd || conn->watch == NULL)
+            continue;
+
+        aci_watch_note(conn->watch, op, seq, drum->name, key, strlen(key));
+    }
+}
+
+/*
+ * Send out the changes queued for each watching
+ * connection. Those with a backlog are left alone until
+ * they take it down, their changes coalesce meanwhile.
+ */
+static void
+watch_run(void)
+{
+    struct aci_conn *conn;
+
+    if (watchers == 0) {
+        return;
+    }
+
+    for (int i = 0; i < POLL_FD_COUNT; ++i) {
+        conn = conns[i];
+        if (conn == NULL || fds[i].fd != conn->fd ||
+            !aci_watch_pending(conn->watch)) {
+            continue;
+        }
+
+        if (conn->backlog < ACI_WATCH_HIWAT) {
+            aci_watch_flush(conn);
+            conn_update(conn);
+        }
+    }
+}
+
+/*
+ * Set up a connection for a newly accepted client
+ */
+static struct aci_conn *
+ipc_conn_new(int client_fd)
+{
+    struct aci_conn *conn;
+    struct pollfd *fd;
+
+    if ((conn = calloc(1, sizeof(*conn))) == NULL) {
+        close(client_fd);
+        return NULL;
+    }
+
+    conn->fd = client_fd;
+    conn->id = ++next_conn_id;
+    if (aci_conn_init(conn) < 0) {
+        close(client_fd);
+        free(conn);
+        return NULL;
+    }
+
+    if ((fd = poll_fd_alloc(client_fd, conn)) == NULL) {
+        close(client_fd);
+        free(conn);
+        return NULL;
+    }
+
+    fd->events = POLLIN;
+    return conn;
+}
+
+/*
+ * Accept an IPC connection
+ */
+static void
+ipc_accept(int ssockfd)
+{
+    struct sockaddr_un client;
+    socklen_t client_len;
+    int client_fd;
+
+    client_len = sizeof(client);
+    client_fd = accept(
+        ssockfd,
+        (struct sockaddr *)&client,
+        &client_len
+    );
+
+    if (client_fd < 0) {
+        perror("accept");
+        return;
+    }
+
+    ipc_conn_new(client_fd);
+}
+
+/*
+ * Send a list of drum paths to the requesting
+ * client
+ */
+static void
+aci_send_drums(struct aci_conn *conn)
+{
+    char pad[DRUM_NAMELEN];
+    struct drum *drum;
+
+    memset(pad, EOF, sizeof(pad));
+    TAILQ_FOREACH(drum, &state.drum_list, link) {
+        aci_conn_send(conn, drum->name, DRUM_NAMELEN, 0);
+    }
+
+    /* EOF pad denotes end of list */
+    aci_conn_send(conn, pad, sizeof(pad), 0);
+}
+
+static void
+aci_create_drum(const char *name, uint32_t flags)
+{
+    struct aci_repl_frame frame;
+    struct drum *drum;
+    char path[256];
+
+    if (name == NULL || drum_dir == NULL) {
+        return;
+    }
+
+    if (drum_lookup(name) != NULL) {
+        printf("error: drum \"%s\" already exists\n", name);
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", drum_dir, name);
+    mkdir(path, DRUM_MODE);
+    if (drum_init(path, flags) < 0) {
+        printf("error: failed to init \"%s\" [drum]\n", path);
+        return;
+    }
+
+    drum = drum_alloc(name, path);
+    if (drum == NULL) {
+        printf("error: failed to allocate \"%s\" [drum]\n", path);
+        return;
+    }
+
+    ++state.drum_count;
+    drum_list_add(drum);
+
+    repl_frame_init(&frame, ACI_REPL_CREATE, drum);
+    repl_ship(&frame, NULL, NULL);
+    watch_note(ACI_EVENT_CREATE, drum_seq_last(), drum, "");
+}
+
+static void
+aci_handle_create(struct aci_pkt *pkt)
+{
+    struct aci_create *create;
+    char name[DRUM_NAMELEN + 1];
+
+    if (pkt == NULL || pkt->length < sizeof(*create)) {
+        return;
+    }
+
+    if (leader_path != NULL) {
+        printf("error: followers are read-only\n");
+        return;
+    }
+
+    create = (struct aci_create *)pkt->data;
+    memset(name, 0, sizeof(name));
+    memcpy(name, create->name, DRUM_NAMELEN);
+    switch (pkt->type) {
+    case ACI_TYPE_DRUM:
+        aci_create_drum(name, create->flags);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Send a single row with its key and data to the client
+ */
+static void
+aci_send_row(struct aci_conn *conn, const char *key, size_t key_len,
+    const void *data, uint32_t len, uint8_t flags, uint8_t type)
+{
+    char buf[sizeof(struct aci_row) + DRUM_KEYLEN_MAX];
+    struct aci_row *row;
+
+    row = (struct aci_row *)buf;
+    row->length = len;
+    row->flags = flags;
+    row->type = type;
+    row->keylen = key_len;
+    memcpy(buf + sizeof(*row), key, key_len);
+    aci_conn_send(conn, buf, sizeof(*row) + key_len,
+        (len > 0) ? MSG_MORE : 0);
+    if (len > 0) {
+        aci_conn_send(conn, data, len, 0);
+    }
+}
+
+/*
+ * Send a row keyed by an index entry
+ */
+static void
+aci_send_ent_row(struct aci_conn *conn, const struct drum_index_ent *ent,
+    const void *data, uint32_t len, uint8_t flags, uint8_t type)
+{
+    char key[DRUM_KEYLEN_MAX + 1];
+    size_t key_len;
+
+    key_len = drum_index_key(ent, key);
+    aci_send_row(conn, key, key_len, data, len, flags, type);
+}
+
+/*
+ * Send the final row of a reply
+ *
+ * @key: NUL terminated key of the row [NULL for none]
+ */
+static inline void
+aci_send_end(struct aci_conn *conn, const char *key, uint8_t flags)
+{
+    aci_send_row(conn, key, (key != NULL) ? strlen(key) : 0, NULL, 0,
+        ACI_ROW_END | flags, ACI_TYPE_NONE);
+}
+
+/*
+ * Read the version of an index entry a snapshot sees
+ * and send it as a row
+ */
+static int
+aci_send_ent(struct aci_conn *conn, struct drum *drum, struct drum_index_ent *ent,
+    uint64_t snap, uint8_t flags)
+{
+    struct drum_version v;
+    char *buf;
+
+    if (drum_version_of(ent, snap, &v) < 0) {
+        return -1;
+    }
+
+    if ((buf = aci_arena_alloc(&conn->arena, v.len)) == NULL) {
+        return -1;
+    }
+
+    if (drum_read_version(drum, &v, buf) != v.len) {
+        return -1;
+    }
+
+    aci_send_ent_row(conn, ent, buf, v.len, flags, v.type);
+    return 0;
+}
+
+/*
+ * Set up the ring and registered buffers used for
+ * segment reads. Reads stay on pread() if any of it
+ * is unavailable.
+ */
+static void
+read_init(void)
+{
+    struct iovec iov[READ_BATCH];
+
+    if (aci_uring_init(&io_ring, READ_BATCH) < 0) {
+        return;
+    }
+
+    read_pool = aligned_alloc(READ_BUFLEN, READ_BATCH * READ_BUFLEN);
+    if (read_pool == NULL) {
+        aci_uring_free(&io_ring);
+        return;
+    }
+
+    for (int i = 0; i < READ_BATCH; ++i) {
+        iov[i].iov_base = read_pool + i * READ_BUFLEN;
+        iov[i].iov_len = READ_BUFLEN;
+    }
+
+    if (aci_uring_buffers(&io_ring, iov, READ_BATCH) < 0) {
+        free(read_pool);
+        read_pool = NULL;
+        aci_uring_free(&io_ring);
+    }
+}
+
+/*
+ * Read the data of every entry in a batch. With the
+ * io_uring engine, entries that fit a registered buffer
+ * are read with a single submission against registered
+ * segment files; anything else, as well as values of
+ * DRUM_F_DIRECT drums, goes through drum_read_version()
+ * into memory from 'arena'.
+ *
+ * Returns the number of leading entries read in full
+ */
+static size_t
+read_batch_fill(struct drum *drum, struct read_batch *batch,
+    struct aci_arena *arena)
+{
+    struct drum_version *v;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    size_t nread = batch->count;
+    unsigned queued = 0;
+    int fd, slot;
+    off_t off;
+
+    for (size_t i = 0; i < batch->count; ++i) {
+        v = &batch->vers[i];
+        batch->bufs[i] = NULL;
+        if (read_pool != NULL && v->len <= READ_BUFLEN &&
+            (drum->flags & DRUM_F_DIRECT) == 0 &&
+            drum_locate(drum, v, &fd, &off) == 0 &&
+            (sqe = aci_uring_sqe(&io_ring)) != NULL) {
+            batch->bufs[i] = read_pool + i * READ_BUFLEN;
+
+            sqe->opcode = IORING_OP_READ_FIXED;
+            sqe->fd = fd;
+            if ((slot = aci_uring_file(&io_ring, fd)) >= 0) {
+                sqe->fd = slot;
+                sqe->flags = IOSQE_FIXED_FILE;
+            }
+
+            sqe->addr = (uintptr_t)batch->bufs[i];
+            sqe->len = v->len;
+            sqe->off = off;
+            sqe->buf_index = i;
+            sqe->user_data = i;
+            ++queued;
+            continue;
+        }
+
+        batch->bufs[i] = aci_arena_alloc(arena, v->len);
+        if (batch->bufs[i] == NULL ||
+            drum_read_version(drum, v, batch->bufs[i]) != v->len) {
+            if (i < nread)
+                nread = i;
+        }
+    }
+
+    if (queued > 0 && aci_uring_submit(&io_ring, queued) < 0) {
+        return 0;
+    }
+
+    while (queued > 0) {
+        if ((cqe = aci_uring_cqe(&io_ring)) == NULL) {
+            if (aci_uring_submit(&io_ring, 1) < 0)
+                return 0;
+            continue;
+        }
+
+        v = &batch->vers[cqe->user_data];
+        if (cqe->res < 0 || (size_t)cqe->res != v->len) {
+            if (cqe->user_data < nread)
+                nread = cqe->user_data;
+        }
+
+        aci_uring_seen(&io_ring);
+        --queued;
+    }
+
+    return nread;
+}
+
+/*
+ * Read a batch and send it as rows, then empty it. The
+ * data read goes back to the arena once sent, so a long
+ * scan only ever holds one batch.
+ *
+ * Returns -1 if any entry failed to be read
+ */
+static int
+read_batch_send(struct aci_conn *conn, struct drum *drum,
+    struct read_batch *batch)
+{
+    struct aci_arena_mark mark;
+    struct drum_version *v;
+    size_t nread, count;
+
+    count = batch->count;
+    mark = aci_arena_mark(&conn->arena);
+    nread = read_batch_fill(drum, batch, &conn->arena);
+    for (size_t i = 0; i < nread; ++i) {
+        v = &batch->vers[i];
+        aci_send_ent_row(conn, batch->ents[i], batch->bufs[i], v->len,
+            0, v->type);
+    }
+
+    aci_arena_release(&conn->arena, mark);
+    batch->count = 0;
+    return (nread != count) ? -1 : 0;
+}
+
+/*
+ * Store a value to a drum and ship it to any followers
+ *
+ * Returns zero or an errno value
+ */
+static int
+aci_put(struct drum *drum, const char *key, uint8_t type, const void *data,
+    size_t len, uint64_t expire)
+{
+    struct aci_repl_frame frame;
+
+    if (drum_store(drum, key, type, data, len, expire) < 0) {
+        return (errno < 0) ? -errno : errno;
+    }
+
+    repl_frame_init(&frame, ACI_REPL_STORE, drum);
+    frame.type = type;
+    frame.seq = drum_seq_last();
+    frame.expire = expire;
+    frame.keylen = strlen(key);
+    frame.length = len;
+    repl_ship(&frame, key, data);
+    watch_note(ACI_EVENT_STORE, frame.seq, drum, key);
+    return 0;
+}
+
+/*
+ * Make a single store and ship it to any followers
+ *
+ * Returns zero or an errno value
+ */
+static int
+aci_store(struct aci_pkt *pkt)
+{
+    struct aci_store_ttl *ttl;
+    struct aci_store *store;
+    struct drum *drum;
+    char key[DRUM_KEYLEN_MAX + 1];
+    const char *name, *data;
+    uint64_t expire = 0;
+    size_t hdr_len, key_len;
+
+    if (leader_path != NULL) {
+        return EROFS;
+    }
+
+    hdr_len = sizeof(*store);
+    if (pkt->op == ACI_CMD_STORE_TTL) {
+        hdr_len = sizeof(*ttl);
+    }
+
+    if (pkt->length < hdr_len) {
+        return EINVAL;
+    }
+
+    if (pkt->op == ACI_CMD_STORE_TTL) {
+        ttl = (struct aci_store_ttl *)pkt->data;
+        if (ttl->ttl != 0)
+            expire = drum_clock() + ttl->ttl;
+        name = ttl->drum;
+        key_len = ttl->keylen;
+        data = ttl->data;
+    } else {
+        store = (struct aci_store *)pkt->data;
+        name = store->drum;
+        key_len = store->keylen;
+        data = store->data;
+    }
+
+    /* The value follows the key and may not be empty */
+    if (aci_key_get(data, key_len, pkt->length - hdr_len, key) < 0 ||
+        pkt->length - hdr_len == key_len) {
+        return EINVAL;
+    }
+
+    if ((drum = drum_lookup(name)) == NULL) {
+        return ENOENT;
+    }
+
+    data += key_len;
+    hdr_len += key_len;
+    return aci_put(drum, key, pkt->type, data, pkt->length - hdr_len,
+        expire);
+}
+
+static void
+aci_handle_store(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    struct aci_status status;
+
+    status.error = aci_store(pkt);
+    aci_conn_send(conn, &status, sizeof(status), 0);
+}
+
+/*
+ * Make each store of a batch in turn and send back
+ * the result of every one of them
+ */
+static void
+aci_handle_batch(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    struct aci_batch_reply reply;
+    int32_t *error;
+    struct aci_pkt *op;
+    size_t off, size;
+
+    /* Check the whole batch before making any of it */
+    reply.count = 0;
+    for (off = 0; off < pkt->length; off += size) {
+        op = (struct aci_pkt *)(pkt->data + off);
+        if (pkt->length - off < sizeof(*op) ||
+            op->length > pkt->length - off - sizeof(*op)) {
+            reply.count = 0;
+            break;
+        }
+
+        if (op->op != ACI_CMD_STORE && op->op != ACI_CMD_STORE_TTL) {
+            reply.count = 0;
+            break;
+        }
+
+        if (++reply.count > ACI_BATCH_OPS) {
+            reply.count = 0;
+            break;
+        }
+
+        size = sizeof(*op) + op->length;
+    }
+
+    error = aci_arena_alloc(&conn->arena, reply.count * sizeof(*error));
+    if (error == NULL) {
+        reply.count = 0;
+    }
+
+    off = 0;
+    for (uint32_t i = 0; i < reply.count; ++i) {
+        op = (struct aci_pkt *)(pkt->data + off);
+        error[i] = aci_store(op);
+        off += sizeof(*op) + op->length;
+    }
+
+    size = reply.count * sizeof(*error);
+    aci_conn_send(conn, &reply, sizeof(reply), (size > 0) ? MSG_MORE : 0);
+    if (size > 0) {
+        aci_conn_send(conn, error, size, 0);
+    }
+}
+
+/*
+ * Look up a key, reclaiming it first if it has expired
+ *
+ * Returns NULL if the key does not exist
+ */
+static struct drum_index_ent *
+aci_live(struct drum *drum, const char *key)
+{
+    struct drum_index_ent *ent;
+
+    ent = drum_index_lookup(drum->index, key);
+    if (ent != NULL && drum_index_expired(ent, drum_clock())) {
+        drum_remove(drum, ent);
+        ent = NULL;
+    }
+
+    return ent;
+}
+
+/*
+ * Add to the integer value of a key. Values held in a
+ * column are read from it, so hot counters never touch
+ * their segments for the read.
+ *
+ * Returns zero or an errno value
+ */
+static int
+update_incr(struct drum *drum, const char *key, struct drum_index_ent *ent,
+    int64_t delta, int64_t *res)
+{
+    struct drum_column *col;
+    uint64_t expire = 0;
+    int64_t value = 0;
+
+    if (ent != NULL) {
+        if (ent->type != ACI_TYPE_INTEGER || ent->len != sizeof(value)) {
+            return EINVAL;
+        }
+
+        col = drum_column_of(drum, ACI_TYPE_INTEGER);
+        if ((col == NULL || drum_column_get(col, ent, &value) < 0) &&
+            drum_read(drum, ent, &value) != sizeof(value)) {
+            return EIO;
+        }
+
+        expire = ent->expire;
+    }
+
+    if ((delta > 0 && value > INT64_MAX - delta) ||
+        (delta < 0 && value < INT64_MIN - delta)) {
+        return ERANGE;
+    }
+
+    *res = value + delta;
+    return aci_put(drum, key, ACI_TYPE_INTEGER, res, sizeof(*res), expire);
+}
+
+/*
+ * Add data to the end of the string value of a key
+ *
+ * Returns zero or an errno value
+ */
+static int
+update_append(struct aci_conn *conn, struct drum *drum, const char *key,
+    struct drum_index_ent *ent, const char *data, size_t len)
+{
+    uint64_t expire = 0;
+    size_t old_len = 0;
+    char *buf;
+
+    if (ent != NULL) {
+        if (ent->type != ACI_TYPE_STRING) {
+            return EINVAL;
+        }
+
+        old_len = ent->len;
+        expire = ent->expire;
+    }
+
+    /* Followers could not be sent the value */
+    if (repl_path != NULL && old_len + len > ACI_REPL_DATA_MAX) {
+        return EFBIG;
+    }
+
+    if ((buf = aci_arena_alloc(&conn->arena, old_len + len)) == NULL) {
+        return ENOMEM;
+    }
+
+    if (ent != NULL && drum_read(drum, ent, buf) != old_len) {
+        return EIO;
+    }
+
+    memcpy(buf + old_len, data, len);
+    return aci_put(drum, key, ACI_TYPE_STRING, buf, old_len + len, expire);
+}
+
+/*
+ * Store a value only if the newest version of a key is
+ * 'seq'. On a mismatch the current value is read into
+ * 'res' to be sent back.
+ *
+ * Returns zero or an errno value
+ */
+static int
+update_cas(struct aci_conn *conn, struct drum *drum, const char *key,
+    struct drum_index_ent *ent, uint64_t seq, uint8_t type,
+    const char *data, size_t len, struct aci_update_reply *reply,
+    char **res)
+{
+    if (ent == NULL && seq == 0) {
+        return aci_put(drum, key, type, data, len, 0);
+    }
+
+    if (ent != NULL && ent->seq == seq) {
+        return aci_put(drum, key, type, data, len, 0);
+    }
+
+    if (ent != NULL) {
+        *res = aci_arena_alloc(&conn->arena, ent->len);
+        if (*res == NULL || drum_read(drum, ent, *res) != ent->len) {
+            return EIO;
+        }
+
+        reply->type = ent->type;
+        reply->length = ent->len;
+    }
+
+    return ESTALE;
+}
+
+/*
+ * Change the value of a key in place [ACI_CMD_INCR,
+ * ACI_CMD_APPEND or ACI_CMD_CAS]. The daemon runs one
+ * request at a time, so nothing can be stored to the
+ * key between reading and replacing its value.
+ */
+static void
+aci_handle_update(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    struct aci_update_reply reply;
+    struct drum_index_ent *ent;
+    struct aci_incr *incr;
+    struct aci_cas *cas;
+    struct drum *drum = NULL;
+    char key[DRUM_KEYLEN_MAX + 1];
+    const char *data = NULL;
+    char *value = NULL;
+    size_t hdr_len, key_len = 0, len;
+    int64_t counter;
+
+    memset(&reply, 0, sizeof(reply));
+    incr = (struct aci_incr *)pkt->data;
+    cas = (struct aci_cas *)pkt->data;
+    switch (pkt->op) {
+    case ACI_CMD_INCR:
+        hdr_len = sizeof(*incr);
+        break;
+    case ACI_CMD_CAS:
+        hdr_len = sizeof(*cas);
+        break;
+    default:
+        hdr_len = sizeof(struct aci_store);
+        break;
+    }
+
+    /* Every payload starts with the drum, the key follows the header */
+    if (leader_path != NULL) {
+        reply.error = EROFS;
+    } else if (pkt->length < hdr_len) {
+        reply.error = EINVAL;
+    } else {
+        key_len = (uint8_t)pkt->data[hdr_len - 1];
+        data = pkt->data + hdr_len;
+        if (aci_key_get(data, key_len, pkt->length - hdr_len, key) < 0) {
+            reply.error = EINVAL;
+        } else if ((drum = drum_lookup(pkt->data)) == NULL) {
+            reply.error = ENOENT;
+        }
+    }
+
+    if (reply.error != 0) {
+        aci_conn_send(conn, &reply, sizeof(reply), 0);
+        return;
+    }
+
+    data += key_len;
+    len = pkt->length - hdr_len - key_len;
+    ent = aci_live(drum, key);
+    switch (pkt->op) {
+    case ACI_CMD_INCR:
+        reply.error = update_incr(drum, key, ent, incr->delta, &counter);
+        if (reply.error == 0) {
+            value = (char *)&counter;
+            reply.type = ACI_TYPE_INTEGER;
+            reply.length = sizeof(counter);
+        }
+        break;
+    case ACI_CMD_CAS:
+        if (len == 0) {
+            reply.error = EINVAL;
+            break;
+        }
+
+        reply.error = update_cas(conn, drum, key, ent, cas->seq, pkt->type,
+            data, len, &reply, &value);
+        break;
+    default:
+        if (pkt->type != ACI_TYPE_STRING || len == 0) {
+            reply.error = EINVAL;
+            break;
+        }
+
+        reply.error = update_append(conn, drum, key, ent, data, len);
+        break;
+    }
+
+    /* Hand out the version the key is at either way */
+    if (reply.error == 0) {
+        reply.seq = drum_seq_last();
+    } else if ((ent = drum_index_lookup(drum->index, key)) != NULL) {
+        reply.seq = ent->seq;
+    }
+
+    if (value == NULL) {
+        reply.length = 0;
+    }
+
+    aci_conn_send(conn, &reply, sizeof(reply),
+        (reply.length > 0) ? MSG_MORE : 0);
+    if (reply.length > 0) {
+        aci_conn_send(conn, value, reply.length, 0);
+    }
+}
+
+/*
+ * Reserve room in a drum for a value that is to come
+ * in chunks
+ */
+static void
+aci_handle_store_begin(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    struct aci_store_begin *begin;
+    struct aci_status status;
+    struct aci_upload *upload;
+    struct drum *drum;
+    char key[DRUM_KEYLEN_MAX + 1];
+    uint64_t expire = 0;
+
+    status.error = 0;
+    begin = (struct aci_store_begin *)pkt->data;
+    if (leader_path != NULL) {
+        status.error = EROFS;
+    } else if (conn->upload != NULL) {
+        status.error = EBUSY;
+    } else if (pkt->length < sizeof(*begin) ||
+        aci_key_get(begin->key, begin->keylen, pkt->length - sizeof(*begin),
+        key) < 0 || begin->length == 0) {
+        status.error = EINVAL;
+    } else if (begin->length > ACI_UPLOAD_MAX) {
+        status.error = EFBIG;
+    } else if ((drum = drum_lookup(begin->drum)) == NULL) {
+        status.error = ENOENT;
+    } else if (repl_path != NULL && begin->length > ACI_REPL_DATA_MAX) {
+        /* Followers could not be sent the value */
+        status.error = EFBIG;
+    }
+
+    if (status.error != 0) {
+        aci_conn_send(conn, &status, sizeof(status), 0);
+        return;
+    }
+
+    if ((upload = calloc(1, sizeof(*upload))) == NULL) {
+        status.error = ENOMEM;
+        aci_conn_send(conn, &status, sizeof(status), 0);
+        return;
+    }
+
+    if (begin->ttl != 0) {
+        expire = drum_clock() + begin->ttl;
+    }
+
+    if (drum_upload_begin(drum, &upload->up, key, pkt->type, begin->length,
+            expire) < 0) {
+        status.error = (errno < 0) ? -errno : errno;
+        free(upload);
+    } else {
+        upload->drum = drum;
+        conn->upload = upload;
+    }
+
+    aci_conn_send(conn, &status, sizeof(status), 0);
+}
+
+/*
+ * Write the next chunk of a value straight to its drum.
+ * Nothing is sent back; a failure is kept for the commit
+ * to report, and the chunks after it are thrown away.
+ */
+static void
+aci_handle_store_chunk(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    struct aci_upload *upload;
+
+    if ((upload = conn->upload) == NULL) {
+        printf("got chunk outside of a store\n");
+        return;
+    }
+
+    if (upload->error != 0) {
+        return;
+    }
+
+    if (drum_upload_write(upload->drum, &upload->up, pkt->data,
+            pkt->length) < 0) {
+        upload->error = (errno < 0) ? -errno : errno;
+    }
+}
+
+/*
+ * Make a value stored in chunks visible and ship it to
+ * any followers
+ */
+static void
+aci_handle_store_commit(struct aci_conn *conn)
+{
+    struct aci_repl_frame frame;
+    struct aci_status status;
+    struct aci_upload *upload;
+    struct drum_index_ent *ent;
+    char *buf;
+
+    status.error = 0;
+    if ((upload = conn->upload) == NULL) {
+        status.error = EINVAL;
+        aci_conn_send(conn, &status, sizeof(status), 0);
+        return;
+    }
+
+    conn->upload = NULL;
+    if ((status.error = upload->error) != 0) {
+        drum_upload_abort(upload->drum, &upload->up);
+    } else if (drum_upload_commit(upload->drum, &upload->up) < 0) {
+        status.error = (errno < 0) ? -errno : errno;
+    }
+
+    ent = drum_index_lookup(upload->drum->index, upload->up.key);
+    if (status.error == 0 && ent != NULL) {
+        watch_note(ACI_EVENT_STORE, ent->seq, upload->drum, upload->up.key);
+    }
+
+    if (status.error == 0 && repl_path != NULL && ent != NULL) {
+        repl_frame_init(&frame, ACI_REPL_STORE, upload->drum);
+        frame.type = ent->type;
+        frame.seq = ent->seq;
+        frame.expire = ent->expire;
+        frame.keylen = strlen(upload->up.key);
+        frame.length = ent->len;
+        buf = aci_arena_alloc(&conn->arena, ent->len);
+        if (buf != NULL && drum_read(upload->drum, ent, buf) == ent->len) {
+            repl_ship(&frame, upload->up.key, buf);
+        } else {
+            /* They catch up once they reconnect */
+            for (int i = 0; i < REPL_FOLLOWERS; ++i) {
+                if (followers[i].fd >= 0 && followers[i].live)
+                    repl_follower_drop(&followers[i]);
+            }
+        }
+    }
+
+    free(upload);
+    aci_conn_send(conn, &status, sizeof(status), 0);
+}
+
+static void
+aci_handle_get(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    struct drum_index_ent *ent;
+    struct aci_get *get;
+    struct drum *drum;
+    char key[DRUM_KEYLEN_MAX + 1];
+
+    get = (struct aci_get *)pkt->data;
+    if (pkt->length < sizeof(*get) ||
+        aci_key_get(get->key, get->keylen, pkt->length - sizeof(*get),
+        key) < 0) {
+        aci_send_end(conn, NULL, ACI_ROW_NONE);
+        return;
+    }
+
+    if (!conn_snap_held(conn, get->snap)) {
+        aci_send_end(conn, NULL, ACI_ROW_NONE);
+        return;
+    }
+
+    if ((drum = drum_lookup(get->drum)) == NULL) {
+        aci_send_end(conn, NULL, ACI_ROW_NONE);
+        return;
+    }
+
+    /* Expired but not reclaimed yet, do it now */
+    ent = aci_live(drum, key);
+    if (ent == NULL ||
+        aci_send_ent(conn, drum, ent, get->snap, ACI_ROW_END) < 0) {
+        aci_send_end(conn, key, ACI_ROW_NONE);
+    }
+}
+
+/*
+ * Stream the keys of a drum in key order, either those
+ * matching a prefix [ACI_CMD_SCAN] or those within a range
+ * [ACI_CMD_RANGE]. At most READ_BATCH rows are held in
+ * memory at a time.
+ */
+static void
+aci_handle_scan(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    struct read_batch batch;
+    struct aci_scan *scan;
+    struct drum_index_ent *ent, *last = NULL;
+    struct drum *drum;
+    char start[DRUM_KEYLEN_MAX + 1], end[DRUM_KEYLEN_MAX + 1];
+    char seek[DRUM_KEYLEN_MAX + 1], key[DRUM_KEYLEN_MAX + 1];
+    size_t prefix_len = 0;
+    uint32_t nrows = 0;
+    uint64_t now;
+    uint8_t more = 0;
+
+    if (pkt->length < sizeof(*scan)) {
+        aci_send_end(conn, NULL, ACI_ROW_NONE);
+        return;
+    }
+
+    scan = (struct aci_scan *)pkt->data;
+    if (!conn_snap_held(conn, scan->snap)) {
+        aci_send_end(conn, NULL, ACI_ROW_NONE);
+        return;
+    }
+
+    if ((drum = drum_lookup(scan->drum)) == NULL) {
+        aci_send_end(conn, NULL, ACI_ROW_NONE);
+        return;
+    }
+
+    /* Fields are zero padded, a full one has no NUL */
+    memcpy(start, scan->start, DRUM_KEYLEN_MAX);
+    memcpy(end, scan->end, DRUM_KEYLEN_MAX);
+    memcpy(seek, scan->after, DRUM_KEYLEN_MAX);
+    start[DRUM_KEYLEN_MAX] = '\0';
+    end[DRUM_KEYLEN_MAX] = '\0';
+    seek[DRUM_KEYLEN_MAX] = '\0';
+    if (pkt->op == ACI_CMD_SCAN) {
+        prefix_len = strlen(start);
+    }
+
+    batch.count = 0;
+    now = drum_clock();
+    if (scan->flags & ACI_SCAN_AFTER) {
+        ent = drum_index_seek(drum->index, seek);
+        if (ent != NULL && drum_index_keycmp(ent, seek) == 0)
+            ent = drum_index_next(ent);
+    } else {
+        ent = drum_index_seek(drum->index, start);
+    }
+
+    for (; ent != NULL; ent = drum_index_next(ent)) {
+        if (prefix_len > 0 && (drum_index_key(ent, key) < prefix_len ||
+            memcmp(key, start, prefix_len) != 0)) {
+            break;
+        }
+
+        if (pkt->op == ACI_CMD_RANGE && end[0] != '\0') {
+            if (drum_index_keycmp(ent, end) >= 0)
+                break;
+        }
+
+        if (drum_index_expired(ent, now)) {
+            continue;
+        }
+
+        /* Written after the snapshot */
+        if (drum_version_of(ent, scan->snap, &batch.vers[batch.count]) < 0) {
+            continue;
+        }
+
+        /* More rows remain, hand out the last key as the token */
+        if (scan->limit != 0 && nrows == scan->limit) {
+            more = ACI_ROW_MORE;
+            break;
+        }
+
+        batch.ents[batch.count++] = ent;
+        last = ent;
+        ++nrows;
+        if (batch.count < READ_BATCH) {
+            continue;
+        }
+
+        if (read_batch_send(conn, drum, &batch) < 0) {
+            break;
+        }
+
+        /*
+         * The client is not taking rows as fast as they are
+         * read, end the page here rather than queue it all.
+         */
+        if (conn->backlog > ACI_CONN_HIWAT) {
+            more = ACI_ROW_MORE;
+            break;
+        }
+    }
+
+    if (batch.count > 0 && read_batch_send(conn, drum, &batch) < 0) {
+        more = 0;
+    }
+
+    if (more) {
+        drum_index_key(last, seek);
+    }
+
+    aci_send_end(conn, more ? seek : NULL, more);
+}
+
+/*
+ * Test the value of an entry against a query and send
+ * it if it matches, unless 'send' is clear. Values held
+ * in a column are tested without touching the segment,
+ * and the segment is not read at all for key-only
+ * queries without a comparison. Columns only hold the
+ * latest version, older versions seen through a
+ * snapshot are always read.
+ *
+ * Returns 1 if the entry matched, 0 if it did not and
+ * -1 on error.
+ */
+static int
+aci_query_send(struct aci_conn *conn, const struct aci_query *q, struct drum *drum,
+    struct drum_index_ent *ent, const struct drum_version *v, int send)
+{
+    struct drum_column *col = NULL;
+    struct aci_arena_mark mark;
+    char small[sizeof(int64_t)];
+    const char *data = NULL;
+    char *buf;
+    size_t len;
+    int match;
+
+    len = v->len;
+    if (v->seq == ent->seq) {
+        col = drum_column_of(drum, v->type);
+    }
+
+    /* Every entry is tested, hand its value straight back */
+    mark = aci_arena_mark(&conn->arena);
+    if (col != NULL && drum_column_get(col, ent, small) == 0) {
+        data = small;
+    } else if (q->cmp != ACI_CMP_NONE || !(q->flags & ACI_PRED_KEYS)) {
+        if ((buf = aci_arena_alloc(&conn->arena, len)) == NULL) {
+            return -1;
+        }
+
+        if (drum_read_version(drum, v, buf) != len) {
+            aci_arena_release(&conn->arena, mark);
+            return -1;
+        }
+        data = buf;
+    }
+
+    if ((match = aci_query_value(q, v->type, data, len)) && send) {
+        if (q->flags & ACI_PRED_KEYS)
+            len = 0;
+        aci_send_ent_row(conn, ent, data, len, 0, v->type);
+    }
+
+    aci_arena_release(&conn->arena, mark);
+    return match != 0;
+}
+
+/*
+ * Evaluate a query predicate against every drum and
+ * stream back what matches. A packet with no predicate
+ * gets the plain list of drum names.
+ */
+static void
+aci_handle_query(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    struct drum_index_ent *ent;
+    struct drum_version v;
+    struct aci_query q;
+    struct drum *drum;
+    char key[DRUM_KEYLEN_MAX + 1];
+    const char *start;
+    uint32_t nrows = 0;
+    uint64_t now;
+    int match, diff;
+
+    if (pkt->length == 0) {
+        aci_send_drums(conn);
+        return;
+    }
+
+    if (aci_query_init(pkt, &q) < 0 || !conn_snap_held(conn, q.snap)) {
+        aci_send_end(conn, NULL, ACI_ROW_NONE);
+        return;
+    }
+
+    now = drum_clock();
+    TAILQ_FOREACH(drum, &state.drum_list, link) {
+        if (!aci_query_drum(&q, drum->name)) {
+            continue;
+        }
+
+        /* Drums go in name order, earlier pages covered these */
+        start = q.start;
+        if (q.flags & ACI_PRED_RESUME) {
+            diff = strncmp(drum->name, q.resume_drum, DRUM_NAMELEN);
+            if (diff < 0)
+                continue;
+            if (diff == 0 && strcmp(q.resume, start) > 0)
+                start = q.resume;
+        }
+
+        aci_send_row(conn, drum->name, strnlen(drum->name, DRUM_NAMELEN),
+            NULL, 0, ACI_ROW_DRUM, ACI_TYPE_DRUM);
+        if (!(q.flags & ACI_PRED_ROWS)) {
+            continue;
+        }
+
+        ent = drum_index_seek(drum->index, start);
+        for (; ent != NULL; ent = drum_index_next(ent)) {
+            drum_index_key(ent, key);
+            if ((match = aci_query_key(&q, key)) < 0) {
+                break;
+            }
+
+            if (!match || drum_index_expired(ent, now)) {
+                continue;
+            }
+
+            if (drum_version_of(ent, q.snap, &v) < 0) {
+                continue;
+            }
+
+            /* The index knows the type, skip without any I/O */
+            if (q.cmp != ACI_CMP_NONE && v.type != q.vtype) {
+                continue;
+            }
+
+            match = aci_query_send(conn, &q, drum, ent, &v,
+                q.limit == 0 || nrows < q.limit);
+            if (match < 0) {
+                break;
+            }
+
+            /* The next page starts at the first match left out */
+            if (match && q.limit != 0 && nrows == q.limit) {
+                aci_send_row(conn, key, strlen(key), drum->name,
+                    strnlen(drum->name, DRUM_NAMELEN),
+                    ACI_ROW_END | ACI_ROW_MORE, ACI_TYPE_DRUM);
+                return;
+            }
+            nrows += match;
+        }
+    }
+
+    aci_send_end(conn, NULL, 0);
+}
+
+/*
+ * Run an aggregate over one of the typed columns
+ * of a drum. Drums without DRUM_F_COLUMNAR keep no
+ * columns and get EOPNOTSUPP.
+ */
+static void
+aci_handle_aggregate(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    struct aci_agg_reply reply;
+    struct drum_column *col;
+    struct drum_agg res;
+    struct aci_agg *agg;
+    struct drum *drum;
+
+    memset(&reply, 0, sizeof(reply));
+    if (pkt->length < sizeof(*agg)) {
+        reply.error = EINVAL;
+        goto done;
+    }
+
+    agg = (struct aci_agg *)pkt->data;
+    if ((drum = drum_lookup(agg->drum)) == NULL) {
+        reply.error = ENOENT;
+        goto done;
+    }
+
+    if ((col = drum_column_of(drum, pkt->type)) == NULL) {
+        reply.error = EOPNOTSUPP;
+        goto done;
+    }
+
+    /* Expired values must not count */
+    drum_expire(drum, drum_clock(), SIZE_MAX);
+
+    switch (agg->func) {
+    case ACI_AGG_COUNT:
+        res.count = col->count;
+        res.value = col->count;
+        break;
+    case ACI_AGG_SUM:
+        drum_column_sum(col, &res);
+        break;
+    case ACI_AGG_MIN:
+        drum_column_min(col, &res);
+        break;
+    case ACI_AGG_MAX:
+        drum_column_max(col, &res);
+        break;
+    default:
+        reply.error = EINVAL;
+        goto done;
+    }
+
+    reply.count = res.count;
+    reply.value = res.value;
+done:
+    aci_conn_send(conn, &reply, sizeof(reply), 0);
+}
+
+/*
+ * Take a snapshot for a connection or release one
+ * it holds
+ */
+static void
+aci_handle_snapshot(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    struct aci_snap_reply reply;
+    struct aci_snap *snap;
+    uint8_t i;
+
+    memset(&reply, 0, sizeof(reply));
+    if (pkt->length < sizeof(*snap)) {
+        reply.error = EINVAL;
+        goto done;
+    }
+
+    snap = (struct aci_snap *)pkt->data;
+    if (!(snap->flags & ACI_SNAP_RELEASE)) {
+        if (conn->nsnaps == ACI_CONN_SNAPS) {
+            reply.error = ENOSPC;
+            goto done;
+        }
+
+        if ((reply.snap = drum_snap_take()) == 0) {
+            reply.error = ENOMEM;
+            goto done;
+        }
+
+        conn->snaps[conn->nsnaps++] = reply.snap;
+        goto done;
+    }
+
+    for (i = 0; i < conn->nsnaps; ++i) {
+        if (conn->snaps[i] == snap->snap)
+            break;
+    }
+
+    if (snap->snap == 0 || i == conn->nsnaps) {
+        reply.error = ENOENT;
+        goto done;
+    }
+
+    conn->snaps[i] = conn->snaps[--conn->nsnaps];
+    drum_snap_release(snap->snap);
+    aci_gc();
+    reply.snap = snap->snap;
+done:
+    aci_conn_send(conn, &reply, sizeof(reply), 0);
+}
+
+/*
+ * Report the replication state of the daemon
+ */
+static void
+aci_handle_stats(struct aci_conn *conn)
+{
+    struct aci_stats stats;
+
+    memset(&stats, 0, sizeof(stats));
+    stats.role = ACI_ROLE_LEADER;
+    stats.seq = drum_seq_last();
+    for (int i = 0; i < REPL_FOLLOWERS; ++i) {
+        if (followers[i].fd >= 0 && followers[i].live)
+            ++stats.followers;
+    }
+
+    /* Data is as fresh as the last leader frame applied */
+    if (leader_path != NULL) {
+        stats.role = ACI_ROLE_FOLLOWER;
+        stats.seq = repl_applied;
+        stats.leader_seq = leader_seq;
+        stats.lag = UINT64_MAX;
+        if (leader_stamp != 0)
+            stats.lag = drum_clock() - leader_stamp;
+        if (leader_fd >= 0 && leader_synced)
+            stats.flags |= ACI_STATS_LINKED;
+    }
+
+    stats.arena_peak = conn->arena.peak;
+    aci_conn_send(conn, &stats, sizeof(stats), 0);
+}
+
+/*
+ * Take over the segments odb-load staged for a drum. Live
+ * followers are dropped so they pick up the adopted keys
+ * when they catch up again.
+ */
+static void
+aci_handle_adopt(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    struct aci_status status;
+    struct aci_adopt *adopt;
+    struct drum *drum;
+    char name[DRUM_NAMELEN + 1];
+    char path[256];
+
+    status.error = 0;
+    if (leader_path != NULL) {
+        status.error = EROFS;
+        goto done;
+    }
+
+    if (pkt->length < sizeof(*adopt)) {
+        status.error = EINVAL;
+        goto done;
+    }
+
+    adopt = (struct aci_adopt *)pkt->data;
+    memset(name, 0, sizeof(name));
+    memcpy(name, adopt->drum, DRUM_NAMELEN);
+    snprintf(path, sizeof(path), DRUM_STAGE_FMT, drum_dir, name);
+    if (name[0] == '\0' || access(path, F_OK) < 0) {
+        status.error = ENOENT;
+        goto done;
+    }
+
+    if ((drum = drum_lookup(name)) == NULL) {
+        aci_create_drum(name, adopt->flags);
+        if ((drum = drum_lookup(name)) == NULL) {
+            status.error = EIO;
+            goto done;
+        }
+    }
+
+    if (drum_adopt(drum, path, drum_seq_next()) < 0) {
+        status.error = (errno < 0) ? -errno : errno;
+        goto done;
+    }
+
+    rmdir(path);
+    printf("adopted staged segments of \"%s\"\n", name);
+    for (int i = 0; i < REPL_FOLLOWERS; ++i) {
+        if (followers[i].fd >= 0 && followers[i].live)
+            repl_follower_drop(&followers[i]);
+    }
+done:
+    aci_conn_send(conn, &status, sizeof(status), 0);
+}
+
+static void
+backup_free(struct backup_job *job)
+{
+    if (job->dst >= 0) {
+        close(job->dst);
+    }
+
+    free(job->drums);
+    memset(job, 0, sizeof(*job));
+    job->dst = -1;
+}
+
+/*
+ * Tell the client how a copy went and let go of it
+ */
+static void
+backup_done(struct backup_job *job, struct aci_conn *conn, int error)
+{
+    struct aci_status status;
+    struct aci_part part;
+
+    if (job->op == ACI_CMD_EXPORT) {
+        memset(&part, 0, sizeof(part));
+        part.kind = ACI_PART_END;
+        part.error = error;
+        aci_conn_send(conn, &part, sizeof(part), 0);
+    } else {
+        status.error = error;
+        aci_conn_send(conn, &status, sizeof(status), 0);
+    }
+
+    printf("%s %s\n", (job->op == ACI_CMD_EXPORT) ? "export" : "backup",
+        (error == 0) ? "complete" : strerror(error));
+    backup_free(job);
+}
+
+/*
+ * Start copying the next part of a drum, its settings
+ * before each of its segments
+ *
+ * Returns zero on success, otherwise an errno value
+ */
+static int
+backup_part(struct backup_job *job, struct aci_conn *conn)
+{
+    struct backup_drum *bd;
+    struct drum_meta meta;
+    struct aci_part part;
+    struct stat st;
+    char path[BACKUP_PATHLEN + DRUM_NAMELEN + 16];
+    int dirlen;
+
+    bd = &job->drums[job->cur];
+    dirlen = snprintf(path, sizeof(path), "%s/%.*s", job->path,
+        DRUM_NAMELEN, bd->drum->name);
+
+    memset(&part, 0, sizeof(part));
+    memcpy(part.drum, bd->drum->name, DRUM_NAMELEN);
+    job->off = 0;
+    job->len = 0;
+    if (job->seg == BACKUP_META) {
+        meta.magic = DRUM_META_MAGIC;
+        meta.flags = bd->drum->flags;
+        if (job->op == ACI_CMD_EXPORT) {
+            part.kind = ACI_PART_META;
+            part.length = sizeof(meta);
+            aci_conn_send(conn, &part, sizeof(part), MSG_MORE);
+            aci_conn_send(conn, &meta, sizeof(meta), 0);
+            return 0;
+        }
+
+        if (mkdir(path, DRUM_MODE) < 0) {
+            return errno;
+        }
+
+        return (drum_init(path, meta.flags) < 0) ? EIO : 0;
+    }
+
+    /* The active segment is cut where it was when we began */
+    if (job->seg + 1 == bd->segs) {
+        job->len = bd->end;
+    } else if (fstat(bd->drum->segs[job->seg], &st) == 0) {
+        job->len = st.st_size;
+    } else {
+        return errno;
+    }
+
+    if (job->op == ACI_CMD_EXPORT) {
+        part.kind = ACI_PART_SEG;
+        part.seg = job->seg;
+        part.length = job->len;
+        aci_conn_send(conn, &part, sizeof(part), 0);
+        return 0;
+    }
+
+    snprintf(path + dirlen, sizeof(path) - dirlen, DRUM_SEG_FMT, "",
+        job->seg);
+    job->dst = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    return (job->dst < 0) ? errno : 0;
+}
+
+/*
+ * Move on to the next part once one is copied
+ */
+static void
+backup_next(struct backup_job *job)
+{
+    if (job->dst >= 0) {
+        close(job->dst);
+        job->dst = -1;
+    }
+
+    job->seg = (job->seg == BACKUP_META) ? 0 : job->seg + 1;
+    if (job->seg == job->drums[job->cur].segs) {
+        job->seg = BACKUP_META;
+        ++job->cur;
+    }
+
+    job->len = -1;
+}
+
+/*
+ * Copy between files within the kernel, falling back
+ * to sendfile() where copy_file_range() can't be used
+ * between the two
+ */
+static ssize_t
+backup_copy(int src, off_t *off, int dst, size_t len)
+{
+    ssize_t n;
+
+    n = copy_file_range(src, off, dst, NULL, len, 0);
+    if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+        errno == EOPNOTSUPP)) {
+        n = sendfile(dst, src, off, len);
+    }
+
+    return n;
+}
+
+/*
+ * Copy up to BACKUP_CHUNK bytes of a backup or export.
+ * An export goes no faster than its client takes it,
+ * it waits whenever the socket is full.
+ */
+static void
+backup_step(struct backup_job *job)
+{
+    struct aci_conn *conn;
+    struct backup_drum *bd;
+    size_t budget = BACKUP_CHUNK, len;
+    ssize_t n;
+    int error;
+
+    if ((conn = conn_lookup(job->conn)) == NULL) {
+        backup_free(job);
+        return;
+    }
+
+    while (budget > 0) {
+        if (job->op == ACI_CMD_EXPORT && (conn->backlog > 0 || conn->stalled))
+            break;
+
+        if (job->cur == job->ndrums) {
+            backup_done(job, conn, 0);
+            break;
+        }
+
+        if (job->len < 0 && (error = backup_part(job, conn)) != 0) {
+            backup_done(job, conn, error);
+            break;
+        }
+
+        if (job->off == job->len) {
+            backup_next(job);
+            continue;
+        }
+
+        bd = &job->drums[job->cur];
+        len = job->len - job->off;
+        len = (len > budget) ? budget : len;
+        if (job->op == ACI_CMD_EXPORT) {
+            n = sendfile(conn->fd, bd->drum->segs[job->seg], &job->off, len);
+        } else {
+            n = backup_copy(bd->drum->segs[job->seg], &job->off, job->dst,
+                len);
+        }
+
+        if (n < 0 && errno == EAGAIN) {
+            conn->stalled = 1;
+            break;
+        }
+
+        /* Part of a segment is on its way, the stream can't go on */
+        if (n <= 0 && job->op == ACI_CMD_EXPORT) {
+            conn->error = 1;
+            backup_free(job);
+            break;
+        }
+
+        if (n <= 0) {
+            backup_done(job, conn, (n < 0) ? errno : EIO);
+            break;
+        }
+
+        budget -= n;
+    }
+
+    conn_update(conn);
+}
+
+/*
+ * Advance every copy being made
+ *
+ * Returns the number of copies that can go on without
+ * waiting for their client
+ */
+static int
+backup_run(void)
+{
+    struct backup_job *job;
+    struct aci_conn *conn;
+    int ready = 0;
+
+    for (int i = 0; i < BACKUP_JOBS; ++i) {
+        job = &backups[i];
+        if (job->conn == 0) {
+            continue;
+        }
+
+        backup_step(job);
+        if (job->conn == 0 || (conn = conn_lookup(job->conn)) == NULL) {
+            continue;
+        }
+
+        if (job->op == ACI_CMD_BACKUP ||
+            (conn->backlog == 0 && !conn->stalled)) {
+            ++ready;
+        }
+    }
+
+    return ready;
+}
+
+/*
+ * Turn down a copy before it began
+ */
+static void
+backup_refuse(struct aci_conn *conn, aci_op_t op, int error)
+{
+    struct backup_job job;
+
+    memset(&job, 0, sizeof(job));
+    job.op = op;
+    job.dst = -1;
+    backup_done(&job, conn, error);
+}
+
+/*
+ * Begin a copy of one drum or all of them as they are
+ * now, it is made by backup_run() from here on
+ */
+static void
+aci_handle_backup(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    struct backup_job *job = NULL;
+    struct aci_backup *req;
+    struct drum *drum;
+    size_t path_len = 0, n = 0;
+
+    /* One copy at a time per connection */
+    for (int i = 0; i < BACKUP_JOBS; ++i) {
+        if (backups[i].conn == conn->id) {
+            backup_refuse(conn, pkt->op, EBUSY);
+            return;
+        }
+
+        if (backups[i].conn == 0 && job == NULL)
+            job = &backups[i];
+    }
+
+    if (job == NULL) {
+        backup_refuse(conn, pkt->op, EAGAIN);
+        return;
+    }
+
+    req = (struct aci_backup *)pkt->data;
+    if (pkt->length < sizeof(*req) ||
+        (pkt->op == ACI_CMD_EXPORT && conn->shm != NULL)) {
+        backup_refuse(conn, pkt->op, EINVAL);
+        return;
+    }
+
+    if (pkt->op == ACI_CMD_BACKUP) {
+        path_len = strnlen(req->path, pkt->length - sizeof(*req));
+        if (path_len == 0 || path_len >= BACKUP_PATHLEN ||
+            path_len == pkt->length - sizeof(*req)) {
+            backup_refuse(conn, pkt->op, EINVAL);
+            return;
+        }
+
+        if (mkdir(req->path, DRUM_MODE) < 0 && errno != EEXIST) {
+            backup_refuse(conn, pkt->op, errno);
+            return;
+        }
+    }
+
+    job->drums = calloc(state.drum_count + 1, sizeof(*job->drums));
+    if (job->drums == NULL) {
+        backup_refuse(conn, pkt->op, ENOMEM);
+        return;
+    }
+
+    TAILQ_FOREACH(drum, &state.drum_list, link) {
+        if (req->drum[0] != '\0' &&
+            strncmp(drum->name, req->drum, DRUM_NAMELEN) != 0)
+            continue;
+
+        job->drums[n].drum = drum;
+        job->drums[n].segs = drum->seg_count;
+        job->drums[n++].end = drum->seg_off;
+        if (n > state.drum_count)
+            break;
+    }
+
+    job->conn = conn->id;
+    job->op = pkt->op;
+    job->ndrums = n;
+    job->seg = BACKUP_META;
+    job->len = -1;
+    job->dst = -1;
+    memcpy(job->path, req->path, path_len);
+    if (req->drum[0] != '\0' && n == 0) {
+        backup_done(job, conn, ENOENT);
+    }
+}
+
+/*
+ * Start or stop watching a drum or key prefix, and
+ * answer with an ACI_EVENT_WATCH event
+ */
+static void
+aci_handle_watch(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    char buf[sizeof(struct aci_event) + DRUM_KEYLEN_MAX];
+    struct aci_watch *watch;
+    struct aci_event *ev;
+    char drum[DRUM_NAMELEN + 1];
+    int had, error = 0;
+
+    ev = (struct aci_event *)buf;
+    memset(ev, 0, sizeof(*ev));
+    memset(drum, 0, sizeof(drum));
+    watch = (struct aci_watch *)pkt->data;
+    if (pkt->length < sizeof(*watch) ||
+        watch->keylen > pkt->length - sizeof(*watch)) {
+        ev->op = ACI_EVENT_WATCH;
+        ev->error = EINVAL;
+        aci_conn_send(conn, ev, sizeof(*ev), 0);
+        return;
+    }
+
+    memcpy(drum, watch->drum, DRUM_NAMELEN);
+    had = (conn->watch != NULL);
+    if (conn->shm != NULL) {
+        /* A client behind on its ring would hold up the daemon */
+        error = EOPNOTSUPP;
+    } else if (watch->flags & ACI_WATCH_CANCEL) {
+        if (aci_watch_del(conn->watch, drum, watch->prefix,
+                watch->keylen) < 0)
+            error = (errno < 0) ? -errno : errno;
+    } else if (aci_watch_add(&conn->watch, drum, watch->prefix,
+            watch->keylen) < 0) {
+        error = (errno < 0) ? -errno : errno;
+    }
+
+    if (!had && conn->watch != NULL) {
+        ++watchers;
+    }
+
+    /* Changes from before the reply go out ahead of it */
+    if (aci_watch_pending(conn->watch)) {
+        aci_watch_flush(conn);
+    }
+
+    ev->op = ACI_EVENT_WATCH;
+    ev->error = error;
+    ev->seq = drum_seq_last();
+    ev->keylen = watch->keylen;
+    memcpy(ev->drum, watch->drum, DRUM_NAMELEN);
+    memcpy(buf + sizeof(*ev), watch->prefix, watch->keylen);
+    aci_conn_send(conn, buf, sizeof(*ev) + watch->keylen, 0);
+}
+
+/*
+ * Begin handing the daemon over to the new one asking
+ * for it. New clients wait in the listen backlog while
+ * the ones we have finish what they sent, then
+ * handoff_run() passes everything over.
+ */
+static void
+aci_handle_handoff(struct aci_conn *conn)
+{
+    struct aci_handoff_reply reply;
+
+    memset(&reply, 0, sizeof(reply));
+    if (handoff_conn != 0) {
+        reply.error = EBUSY;
+    } else if (conn->shm != NULL) {
+        reply.error = EINVAL;
+    }
+
+    if (reply.error != 0) {
+        aci_conn_send(conn, &reply, sizeof(reply), 0);
+        return;
+    }
+
+    printf("handing off to a new daemon\n");
+    handoff_conn = conn->id;
+    handoff_deadline = drum_clock() + ACI_HANDOFF_DRAIN;
+    if (use_uring) {
+        uring_cancel(URING_ACCEPT);
+    } else {
+        fds[0].events = 0;
+    }
+}
+
+static void
+aci_dispatch(struct aci_conn *conn, struct aci_pkt *pkt)
+{
+    /* Replies would be mistaken for events */
+    if (conn->watch != NULL && conn->watch->nfilters > 0 &&
+        pkt->op != ACI_CMD_WATCH) {
+        printf("got command on a watching connection\n");
+        return;
+    }
+
+    switch (pkt->op) {
+    case ACI_CMD_NOP:
+        break;
+    case ACI_CMD_QUERY:
+        aci_handle_query(conn, pkt);
+        break;
+    case ACI_CMD_CREATE:
+        aci_handle_create(pkt);
+        break;
+    case ACI_CMD_STORE:
+    case ACI_CMD_STORE_TTL:
+        aci_handle_store(conn, pkt);
+        break;
+    case ACI_CMD_STORE_BEGIN:
+        aci_handle_store_begin(conn, pkt);
+        break;
+    case ACI_CMD_STORE_CHUNK:
+        aci_handle_store_chunk(conn, pkt);
+        break;
+    case ACI_CMD_STORE_COMMIT:
+        aci_handle_store_commit(conn);
+        break;
+    case ACI_CMD_BATCH:
+        aci_handle_batch(conn, pkt);
+        break;
+    case ACI_CMD_INCR:
+    case ACI_CMD_APPEND:
+    case ACI_CMD_CAS:
+        aci_handle_update(conn, pkt);
+        break;
+    case ACI_CMD_WATCH:
+        aci_handle_watch(conn, pkt);
+        break;
+    case ACI_CMD_HANDOFF:
+        aci_handle_handoff(conn);
+        break;
+    case ACI_CMD_GET:
+        aci_handle_get(conn, pkt);
+        break;
+    case ACI_CMD_SCAN:
+    case ACI_CMD_RANGE:
+        aci_handle_scan(conn, pkt);
+        break;
+    case ACI_CMD_AGGREGATE:
+        aci_handle_aggregate(conn, pkt);
+        break;
+    case ACI_CMD_SNAPSHOT:
+        aci_handle_snapshot(conn, pkt);
+        break;
+    case ACI_CMD_STATS:
+        aci_handle_stats(conn);
+        break;
+    case ACI_CMD_ADOPT:
+        aci_handle_adopt(conn, pkt);
+        break;
+    case ACI_CMD_BACKUP:
+    case ACI_CMD_EXPORT:
+        aci_handle_backup(conn, pkt);
+        break;
+    default:
+        printf("got unknown operation\n");
+    }
+
+    aci_arena_reset(&conn->arena);
+}
+
+/*
+ * Run every packet waiting in the transmit ring of a
+ * shared-memory connection, then announce that we are
+ * going back to sleep on its eventfd. Queued replies
+ * go out first; while too many are queued the ring is
+ * left alone until the client drains its receive ring,
+ * which kicks the same eventfd [see aci_ring_drained()].
+ */
+static void
+shm_read(struct aci_conn *conn)
+{
+    /* Clients put whole packets, so none is larger than the ring */
+    static char buf[ACI_RING_SIZE];
+    struct aci_ring *ring;
+    struct aci_pkt *pkt;
+    uint64_t val;
+    size_t size;
+
+    ring = &conn->shm->region->tx;
+    read(conn->shm->tx_efd, &val, sizeof(val));
+
+    /* The client may have made room for queued replies */
+    if (conn->backlog > 0) {
+        aci_conn_flush(conn);
+    }
+
+    if (conn_update(conn) < 0 || conn->throttled) {
+        return;
+    }
+
+    pkt = (struct aci_pkt *)buf;
+    do {
+        if (aci_ring_broken(ring)) {
+            printf("got corrupt ring\n");
+            conn_close(conn);
+            return;
+        }
+
+        while (aci_ring_peek(ring, pkt, sizeof(*pkt)) == sizeof(*pkt)) {
+            if (pkt->length > sizeof(buf) - sizeof(*pkt)) {
+                printf("got oversized packet\n");
+                conn_close(conn);
+                return;
+            }
+
+            /* Packets are put whole, a short one is a broken peer */
+            size = sizeof(*pkt) + pkt->length;
+            if (aci_ring_get(ring, buf, size) != size) {
+                printf("got truncated packet\n");
+                conn_close(conn);
+                return;
+            }
+
+            aci_dispatch(conn, pkt);
+
+            /* The rest waits in the ring until the client catches up */
+            if (conn->error || conn->backlog > ACI_CONN_HIWAT) {
+                conn_update(conn);
+                return;
+            }
+        }
+    } while (!aci_ring_idle(ring));
+}
+
+/*
+ * Move a connection to the shared-memory channel whose
+ * descriptors came along with an ACI_CMD_SHM packet.
+ */
+static void
+aci_handle_shm(struct aci_conn *conn, int *fdv, int fdc)
+{
+    struct aci_status status;
+    struct pollfd *fd;
+    struct aci_shm *shm;
+
+    status.error = 0;
+    if (conn->shm != NULL || fdc != 3) {
+        status.error = EINVAL;
+        goto fail;
+    }
+
+    if (aci_shm_attach(fdv[0], fdv[1], fdv[2], &shm) < 0) {
+        status.error = (errno < 0) ? -errno : errno;
+        goto fail;
+    }
+
+    if ((fd = poll_fd_alloc(shm->tx_efd, conn)) == NULL) {
+        aci_shm_free(shm);
+        status.error = EBUSY;
+        aci_conn_send(conn, &status, sizeof(status), 0);
+        return;
+    }
+
+    fd->events = POLLIN;
+    aci_conn_send(conn, &status, sizeof(status), 0);
+
+    conn->shm = shm;
+    if (use_uring) {
+        uring_arm_event(conn);
+    }
+
+    shm_read(conn);
+    return;
+fail:
+    for (int i = 0; i < fdc; ++i) {
+        close(fdv[i]);
+    }
+
+    aci_conn_send(conn, &status, sizeof(status), 0);
+}
+
+/*
+ * Pick up any descriptors passed by the client
+ *
+ * Returns the number of descriptors written to 'fdv'
+ */
+static int
+ipc_fds(struct msghdr *msg, int *fdv)
+{
+    struct cmsghdr *cmsg;
+    int fdc = 0;
+
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+
+        fdc = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fdv, CMSG_DATA(cmsg), fdc * sizeof(int));
+    }
+
+    return fdc;
+}
+
+/*
+ * Handle every whole packet at the start of 'buf'. The
+ * descriptors go to the first ACI_CMD_SHM packet.
+ *
+ * Returns the number of bytes handled, -1 if the
+ * connection was closed
+ */
+static ssize_t
+ipc_packets(struct aci_conn *conn, char *buf, size_t len, int *fdv, int *fdc)
+{
+    struct aci_pkt *pkt;
+    uint32_t id = conn->id;
+    size_t off = 0, size;
+
+    while (len - off >= sizeof(*pkt)) {
+        pkt = (struct aci_pkt *)(buf + off);
+        if (pkt->length > ACI_PKT_MAX) {
+            printf("got oversized packet\n");
+            conn_close(conn);
+            return -1;
+        }
+
+        size = sizeof(*pkt) + pkt->length;
+        if (len - off < size) {
+            break;
+        }
+
+        if (pkt->op == ACI_CMD_SHM) {
+            aci_handle_shm(conn, fdv, *fdc);
+            *fdc = 0;
+        } else {
+            aci_dispatch(conn, pkt);
+        }
+
+        off += size;
+        if (conn_lookup(id) == NULL) {
+            return -1;
+        }
+    }
+
+    return off;
+}
+
+/*
+ * Handle bytes received from a client socket along
+ * with any descriptors that came with them. A read may
+ * end partway into a packet, or hold several; what is
+ * left of a packet waits in the input buffer of the
+ * connection for the rest.
+ */
+static void
+ipc_input(struct aci_conn *conn, char *buf, size_t len, int *fdv, int fdc)
+{
+    ssize_t used;
+
+    if (conn->inlen > 0) {
+        if (aci_conn_stash(conn, buf, len) < 0)
+            goto fail;
+        buf = conn->inbuf;
+        len = conn->inlen;
+    }
+
+    used = ipc_packets(conn, buf, len, fdv, &fdc);
+    for (int i = 0; i < fdc; ++i) {
+        close(fdv[i]);
+    }
+
+    if (used < 0) {
+        return;
+    }
+
+    if (buf == conn->inbuf) {
+        aci_conn_consume(conn, used);
+        return;
+    }
+
+    if (used == len || aci_conn_stash(conn, buf + used, len - used) == 0) {
+        return;
+    }
+
+    fdc = 0;
+fail:
+    for (int i = 0; i < fdc; ++i) {
+        close(fdv[i]);
+    }
+
+    printf("dropped partial packet\n");
+    conn_close(conn);
+}
+
+static void
+ipc_read(struct aci_conn *conn)
+{
+    char cbuf[URING_CMSG_LEN];
+    int fdv[IPC_MAX_FDS], fdc;
+    struct msghdr msg;
+    struct iovec iov;
+    char buf[IPC_BUFSIZE];
+    uint32_t id = conn->id;
+    ssize_t len;
+
+    iov.iov_base = buf;
+    iov.iov_len = sizeof(buf);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    len = recvmsg(conn->fd, &msg, 0);
+    if (len < 0 && errno == EAGAIN) {
+        return;
+    }
+
+    if (len <= 0) {
+        printf("client closed connection\n");
+        conn_close(conn);
+        return;
+    }
+
+    fdc = ipc_fds(&msg, fdv);
+    ipc_input(conn, buf, len, fdv, fdc);
+    if ((conn = conn_lookup(id)) != NULL) {
+        conn_update(conn);
+    }
+}
+
+/*
+ * Reclaim expired keys across every drum, a bounded
+ * number per drum at a time.
+ *
+ * Returns the number of milliseconds until there is
+ * more to reclaim, -1 if nothing is set to expire
+ */
+static int
+aci_expire(void)
+{
+    struct drum *drum;
+    uint64_t now, next, wake = UINT64_MAX;
+
+    now = drum_clock();
+    TAILQ_FOREACH(drum, &state.drum_list, link) {
+        drum_expire(drum, now, EXPIRE_BUDGET);
+        if ((next = drum_expire_next(drum)) < wake)
+            wake = next;
+    }
+
+    if (wake == UINT64_MAX) {
+        return -1;
+    }
+
+    if (wake <= now) {
+        return 0;
+    }
+
+    return (wake - now > INT_MAX) ? INT_MAX : (int)(wake - now);
+}
+
+/*
+ * Compact the DRUM_F_COMPACT drums a chunk at a time.
+ * Nothing is compacted while a copy is being made, since
+ * copies read the segments compaction empties.
+ *
+ * Returns the number of drums with more to compact
+ */
+static int
+aci_compact(void)
+{
+    struct drum *drum;
+    uint32_t tail;
+    ssize_t n;
+    int busy = 0;
+
+    /* The new daemon picks up where we leave off */
+    if (handoff_conn != 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < BACKUP_JOBS; ++i) {
+        if (backups[i].conn != 0)
+            return 0;
+    }
+
+    TAILQ_FOREACH(drum, &state.drum_list, link) {
+        if ((drum->flags & DRUM_F_COMPACT) == 0) {
+            continue;
+        }
+
+        tail = drum->seg_tail;
+        if ((n = drum_compact(drum, COMPACT_CHUNK)) < 0) {
+            printf("failed to compact \"%.*s\"\n", DRUM_NAMELEN, drum->name);
+            continue;
+        }
+
+        if (drum->seg_tail != tail) {
+            printf("compacted segment %u of \"%.*s\"\n", tail, DRUM_NAMELEN,
+                drum->name);
+        }
+
+        busy += (n > 0);
+    }
+
+    return busy;
+}
+
+/*
+ * Returns true if a replication socket has input or
+ * has been hung up on, so that reading will not block
+ */
+static int
+repl_readable(int fd)
+{
+    char c;
+
+    if (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) >= 0) {
+        return 1;
+    }
+
+    return errno != EAGAIN && errno != EWOULDBLOCK;
+}
+
+/*
+ * Send a follower every record stored after 'since'
+ * followed by ACI_REPL_SYNC, then start shipping it
+ * records as they are stored. Only the newest version
+ * of each key is sent, which is all a follower needs.
+ */
+static void
+repl_catchup(struct repl_follower *f, uint64_t since)
+{
+    struct aci_repl_frame frame;
+    struct drum_index_ent *ent;
+    struct drum *drum;
+    char key[DRUM_KEYLEN_MAX + 1];
+    uint64_t now;
+    char *buf;
+    int error = 0;
+
+    now = drum_clock();
+    TAILQ_FOREACH(drum, &state.drum_list, link) {
+        repl_frame_init(&frame, ACI_REPL_CREATE, drum);
+        if ((error = aci_repl_send(f->fd, &frame, NULL, NULL)) < 0) {
+            break;
+        }
+
+        ent = drum_index_seek(drum->index, "");
+        for (; ent != NULL && error == 0; ent = drum_index_next(ent)) {
+            if (ent->seq <= since || drum_index_expired(ent, now)) {
+                continue;
+            }
+
+            if ((buf = malloc(ent->len)) == NULL) {
+                error = -1;
+                break;
+            }
+
+            repl_frame_init(&frame, ACI_REPL_STORE, drum);
+            frame.type = ent->type;
+            frame.seq = ent->seq;
+            frame.expire = ent->expire;
+            frame.keylen = drum_index_key(ent, key);
+            frame.length = ent->len;
+            if (drum_read(drum, ent, buf) != ent->len ||
+                aci_repl_send(f->fd, &frame, key, buf) < 0) {
+                error = -1;
+            }
+
+            free(buf);
+        }
+
+        if (error < 0) {
+            break;
+        }
+    }
+
+    repl_frame_init(&frame, ACI_REPL_SYNC, NULL);
+    frame.seq = drum_seq_last();
+    if (error < 0 || aci_repl_send(f->fd, &frame, NULL, NULL) < 0) {
+        repl_follower_drop(f);
+        return;
+    }
+
+    printf("follower caught up from %llu\n", (unsigned long long)since);
+    f->live = 1;
+}
+
+/*
+ * Accept a follower on the replication socket
+ */
+static void
+repl_accept(void)
+{
+    struct timeval tv;
+    int fd, i;
+
+    if ((fd = accept(repl_sock, NULL, NULL)) < 0) {
+        return;
+    }
+
+    for (i = 0; i < REPL_FOLLOWERS; ++i) {
+        if (followers[i].fd < 0)
+            break;
+    }
+
+    if (i == REPL_FOLLOWERS || repl_watch(fd) < 0) {
+        printf("refusing follower, no free slots\n");
+        close(fd);
+        return;
+    }
+
+    /* A stuck follower gets dropped rather than stall writes */
+    tv.tv_sec = REPL_SNDTIMEO;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    followers[i].fd = fd;
+    followers[i].live = 0;
+    printf("follower connected\n");
+}
+
+/*
+ * Handle a frame from a follower, which only ever
+ * says hello
+ */
+static void
+repl_follower_input(struct repl_follower *f)
+{
+    struct aci_repl_frame frame;
+    char key[DRUM_KEYLEN_MAX + 1];
+    void *data;
+
+    if (aci_repl_recv(f->fd, &frame, key, &data) < 0) {
+        repl_follower_drop(f);
+        return;
+    }
+
+    free(data);
+    if (frame.op == ACI_REPL_HELLO && !f->live) {
+        repl_catchup(f, frame.seq);
+    }
+}
+
+/*
+ * Apply a frame from the leader
+ */
+static void
+repl_apply(struct aci_repl_frame *frame, const char *key, const void *data)
+{
+    struct drum_index_ent *ent;
+    struct drum *drum;
+    char name[DRUM_NAMELEN + 1];
+
+    memset(name, 0, sizeof(name));
+    memcpy(name, frame->drum, DRUM_NAMELEN);
+    switch (frame->op) {
+    case ACI_REPL_CREATE:
+        if (drum_lookup(name) == NULL)
+            aci_create_drum(name, frame->flags);
+        return;
+    case ACI_REPL_STORE:
+        if ((drum = drum_lookup(name)) == NULL)
+            return;
+
+        /* Catch-up resends what an earlier one already applied */
+        ent = drum_index_lookup(drum->index, key);
+        if (ent == NULL || ent->seq < frame->seq) {
+            if (drum_apply(drum, key, frame->type, data, frame->length,
+                    frame->expire, frame->seq) < 0) {
+                printf("error: failed to apply record %llu\n",
+                    (unsigned long long)frame->seq);
+                return;
+            }
+
+            watch_note(ACI_EVENT_STORE, frame->seq, drum, key);
+        }
+
+        /* Pass it on to followers of our own */
+        repl_ship(frame, key, data);
+        if (!leader_synced)
+            return;
+        break;
+    case ACI_REPL_SYNC:
+        leader_synced = 1;
+        printf("caught up with leader at %llu\n",
+            (unsigned long long)frame->seq);
+        break;
+    case ACI_REPL_BEAT:
+        if (!leader_synced)
+            return;
+        break;
+    default:
+        return;
+    }
+
+    if (frame->seq > leader_seq) {
+        leader_seq = frame->seq;
+    }
+
+    if (frame->op != ACI_REPL_BEAT) {
+        repl_applied = frame->seq;
+    }
+
+    leader_stamp = frame->stamp;
+}
+
+/*
+ * Apply every frame the leader has sent so far
+ */
+static void
+repl_leader_input(void)
+{
+    struct aci_repl_frame frame;
+    char key[DRUM_KEYLEN_MAX + 1];
+    void *data;
+
+    do {
+        if (aci_repl_recv(leader_fd, &frame, key, &data) < 0) {
+            printf("lost connection to leader\n");
+            repl_unwatch(leader_fd);
+            leader_fd = -1;
+            leader_synced = 0;
+            leader_retry = drum_clock() + REPL_RETRY;
+            return;
+        }
+
+        repl_apply(&frame, key, data);
+        free(data);
+    } while (repl_readable(leader_fd));
+}
+
+/*
+ * Connect to the leader and ask for every record
+ * not applied yet
+ */
+static void
+repl_connect(void)
+{
+    struct aci_repl_frame frame;
+    struct sockaddr_un un;
+    int fd;
+
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strncpy(un.sun_path, leader_path, sizeof(un.sun_path) - 1);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        return;
+    }
+
+    if (connect(fd, (struct sockaddr *)&un, sizeof(un)) < 0) {
+        close(fd);
+        return;
+    }
+
+    repl_frame_init(&frame, ACI_REPL_HELLO, NULL);
+    frame.seq = repl_applied;
+    if (aci_repl_send(fd, &frame, NULL, NULL) < 0 || repl_watch(fd) < 0) {
+        close(fd);
+        return;
+    }
+
+    printf("following %s from %llu\n", leader_path,
+        (unsigned long long)repl_applied);
+    leader_fd = fd;
+}
+
+/*
+ * Handle input on a replication socket
+ */
+static void
+repl_input(int fd)
+{
+    if (!repl_readable(fd)) {
+        return;
+    }
+
+    if (fd == repl_sock) {
+        repl_accept();
+        return;
+    }
+
+    if (fd == leader_fd) {
+        repl_leader_input();
+        return;
+    }
+
+    for (int i = 0; i < REPL_FOLLOWERS; ++i) {
+        if (followers[i].fd == fd) {
+            repl_follower_input(&followers[i]);
+            return;
+        }
+    }
+}
+
+/*
+ * Send heartbeats to followers and reconnect to the
+ * leader when it is time to
+ *
+ * Returns the number of milliseconds until there is
+ * more to do, -1 if nothing is scheduled
+ */
+static int
+repl_tick(void)
+{
+    struct aci_repl_frame frame;
+    uint64_t now, next = UINT64_MAX;
+    int live = 0;
+
+    now = drum_clock();
+    if (leader_path != NULL && leader_fd < 0) {
+        if (now >= leader_retry) {
+            repl_connect();
+            leader_retry = now + REPL_RETRY;
+        }
+        if (leader_fd < 0)
+            next = leader_retry;
+    }
+
+    for (int i = 0; i < REPL_FOLLOWERS; ++i) {
+        live += (followers[i].fd >= 0 && followers[i].live);
+    }
+
+    /* Heartbeats keep the lag of idle followers honest */
+    if (live > 0) {
+        if (now - repl_beat >= ACI_REPL_INTERVAL) {
+            repl_frame_init(&frame, ACI_REPL_BEAT, NULL);
+            frame.seq = drum_seq_last();
+            repl_ship(&frame, NULL, NULL);
+            repl_beat = now;
+        }
+        if (repl_beat + ACI_REPL_INTERVAL < next)
+            next = repl_beat + ACI_REPL_INTERVAL;
+    }
+
+    if (next == UINT64_MAX) {
+        return -1;
+    }
+
+    return (next <= now) ? 0 : (int)(next - now);
+}
+
+/*
+ * Go back to serving on our own once the new daemon
+ * went away before it was handed anything
+ */
+static void
+handoff_abort(void)
+{
+    struct aci_conn *conn;
+
+    printf("handoff given up on\n");
+    handoff_conn = 0;
+    if (use_uring) {
+        uring_arm_accept(listen_fd);
+    } else {
+        fds[0].events = POLLIN;
+    }
+
+    for (int i = 0; i < POLL_FD_COUNT; ++i) {
+        conn = conns[i];
+        if (conn != NULL && fds[i].fd == conn->fd)
+            conn_update(conn);
+    }
+}
+
+/*
+ * Pass the listening socket, an image of every drum
+ * and the idle clients along with what they watch to
+ * the new daemon, then exit. Clients that are still
+ * busy, on shared memory or holding snapshots are
+ * given up on.
+ */
+static void
+handoff_finish(struct aci_conn *succ)
+{
+    struct aci_handoff_reply reply;
+    int fdv[ACI_HANDOFF_FDS], fdc = 0;
+    struct aci_conn *conn;
+    struct drum *drum;
+    int image, watch = -1;
+
+    for (int i = 0; i < POLL_FD_COUNT; ++i) {
+        conn = conns[i];
+        if (conn == NULL || fds[i].fd != conn->fd || conn == succ)
+            continue;
+        if (!conn_idle(conn)) {
+            printf("dropped busy client in handoff\n");
+            conn_close(conn);
+        }
+    }
+
+    if ((image = memfd_create("odb-image", MFD_CLOEXEC)) < 0) {
+        perror("memfd_create");
+        handoff_abort();
+        return;
+    }
+
+    TAILQ_FOREACH(drum, &state.drum_list, link) {
+        if (drum_image_write(drum, image) < 0) {
+            printf("failed to write image of \"%.*s\"\n", DRUM_NAMELEN,
+                drum->name);
+            close(image);
+            handoff_abort();
+            return;
+        }
+    }
+
+    memset(&reply, 0, sizeof(reply));
+    fdv[fdc++] = listen_fd;
+    fdv[fdc++] = image;
+    if (repl_sock >= 0) {
+        reply.flags |= ACI_HANDOFF_REPL;
+        fdv[fdc++] = repl_sock;
+    }
+
+    /* Watch filters go in the order of the client sockets */
+    if (watchers > 0) {
+        if ((watch = memfd_create("odb-watch", MFD_CLOEXEC)) < 0) {
+            perror("memfd_create");
+            close(image);
+            handoff_abort();
+            return;
+        }
+
+        reply.flags |= ACI_HANDOFF_WATCH;
+        fdv[fdc++] = watch;
+    }
+
+    for (int i = 0; i < POLL_FD_COUNT && fdc < ACI_HANDOFF_FDS; ++i) {
+        conn = conns[i];
+        if (conn == NULL || fds[i].fd != conn->fd || conn == succ)
+            continue;
+        if (watch >= 0 && aci_watch_save(conn->watch, watch) < 0)
+            goto fail;
+        fdv[fdc++] = conn->fd;
+        ++reply.nconns;
+    }
+
+    if (aci_handoff_send(succ->fd, &reply, fdv, fdc) < 0) {
+        goto fail;
+    }
+
+    printf("handed off %u clients to a new daemon\n", reply.nconns);
+    exit(0);
+fail:
+    close(image);
+    if (watch >= 0) {
+        close(watch);
+    }
+
+    handoff_abort();
+}
+
+/*
+ * Move a handoff along. Idle clients are no longer read
+ * from; once every one of them is, or the deadline for
+ * the rest passed, handoff_finish() takes over.
+ *
+ * Returns how long the event loop may sleep for in
+ * milliseconds, -1 if no handoff is in progress
+ */
+static int
+handoff_run(void)
+{
+    struct aci_conn *conn, *succ;
+    uint64_t now;
+    int busy = 0;
+
+    if (handoff_conn == 0) {
+        return -1;
+    }
+
+    if ((succ = conn_lookup(handoff_conn)) == NULL) {
+        handoff_abort();
+        return -1;
+    }
+
+    for (int i = 0; i < POLL_FD_COUNT; ++i) {
+        conn = conns[i];
+        if (conn == NULL || fds[i].fd != conn->fd)
+            continue;
+        if (conn_update(conn) == 0 && !conn_idle(conn))
+            ++busy;
+    }
+
+    now = drum_clock();
+    if (busy > 0 && now < handoff_deadline) {
+        return handoff_deadline - now;
+    }
+
+    /* Receives being cancelled may still bring in bytes */
+    if (use_uring && uring_cancels > 0) {
+        return 0;
+    }
+
+    handoff_finish(succ);
+    return -1;
+}
+
+/*
+ * Returns how long the event loop may sleep for in
+ * milliseconds, -1 for as long as it takes
+ */
+static int
+aci_timeout(void)
+{
+    int expire, repl, handoff;
+
+    watch_run();
+    handoff = handoff_run();
+
+    /* Copies and compaction go on without waiting for an event */
+    if (backup_run() > 0 || aci_compact() > 0) {
+        return 0;
+    }
+
+    expire = aci_expire();
+    repl = repl_tick();
+    if (expire < 0 || (repl >= 0 && repl < expire)) {
+        expire = repl;
+    }
+
+    if (expire < 0 || (handoff >= 0 && handoff < expire)) {
+        expire = handoff;
+    }
+
+    return expire;
+}
+
+/*
+ * Open the replication socket followers connect to
+ *
+ * Returns zero on success
+ */
+static int
+repl_listen(void)
+{
+    struct sockaddr_un un;
+    struct pollfd *pfd;
+
+    /* Handed over already bound */
+    if (hot_repl >= 0) {
+        repl_sock = hot_repl;
+        goto listening;
+    }
+
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strncpy(un.sun_path, repl_path, sizeof(un.sun_path) - 1);
+    if ((repl_sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        perror("repl_sock");
+        return -1;
+    }
+
+    if (bind(repl_sock, (struct sockaddr *)&un, sizeof(un)) < 0) {
+        perror("bind");
+        return -1;
+    }
+
+    if (listen(repl_sock, REPL_FOLLOWERS) < 0) {
+        perror("listen");
+        return -1;
+    }
+
+listening:
+    if ((pfd = poll_fd_alloc(repl_sock, NULL)) == NULL) {
+        return -1;
+    }
+
+    pfd->events = POLLIN;
+    return 0;
+}
+
+static void
+uring_accept(int ssockfd, const struct io_uring_cqe *cqe)
+{
+    struct aci_conn *conn;
+
+    if (cqe->res >= 0) {
+        if ((conn = ipc_conn_new(cqe->res)) != NULL)
+            uring_arm_recv(conn);
+    } else if (cqe->res == -EINVAL && !accept_oneshot) {
+        accept_oneshot = 1;
+    } else if (cqe->res != -ECANCELED) {
+        printf("accept: %s\n", strerror(-cqe->res));
+    }
+
+    /* Stopped by a handoff, new clients wait for the next daemon */
+    if (!(cqe->flags & IORING_CQE_F_MORE) && handoff_conn == 0) {
+        uring_arm_accept(ssockfd);
+    }
+}
+
+static void
+uring_recv(uint32_t id, const struct io_uring_cqe *cqe)
+{
+    struct io_uring_recvmsg_out *out;
+    struct aci_conn *conn;
+    struct msghdr msg;
+    int fdv[IPC_MAX_FDS], fdc;
+    char *buf;
+
+    buf = aci_uring_pbuf(&ev_ring, cqe);
+    if ((conn = conn_lookup(id)) == NULL) {
+        aci_uring_pbuf_put(&ev_ring, cqe);
+        return;
+    }
+
+    /* Ran out of provided buffers, try again */
+    if (cqe->res == -ENOBUFS) {
+        if (!(cqe->flags & IORING_CQE_F_MORE) && !conn->throttled)
+            uring_arm_recv(conn);
+        return;
+    }
+
+    /* Stopped by conn_update(), rearmed once the queue drains */
+    if (cqe->res == -ECANCELED) {
+        return;
+    }
+
+    out = (struct io_uring_recvmsg_out *)buf;
+    if (cqe->res <= 0 || buf == NULL || out->payloadlen == 0) {
+        aci_uring_pbuf_put(&ev_ring, cqe);
+        printf("client closed connection\n");
+        conn_close(conn);
+        return;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = buf + sizeof(*out) + recv_msg.msg_namelen;
+    msg.msg_controllen = out->controllen;
+    fdc = ipc_fds(&msg, fdv);
+    ipc_input(conn, (char *)msg.msg_control + recv_msg.msg_controllen,
+        out->payloadlen, fdv, fdc);
+
+    aci_uring_pbuf_put(&ev_ring, cqe);
+    if ((conn = conn_lookup(id)) == NULL || conn_update(conn) < 0) {
+        return;
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE) && !conn->throttled) {
+        uring_arm_recv(conn);
+    }
+}
+
+static void
+uring_write(uint32_t id, const struct io_uring_cqe *cqe)
+{
+    struct aci_conn *conn;
+
+    if ((conn = conn_lookup(id)) == NULL) {
+        return;
+    }
+
+    conn->writing = 0;
+    if (cqe->res >= 0) {
+        aci_conn_flush(conn);
+    }
+
+    conn_update(conn);
+}
+
+static void
+uring_repl(int fd, const struct io_uring_cqe *cqe)
+{
+    if (cqe->res < 0 || !repl_watched(fd)) {
+        return;
+    }
+
+    repl_input(fd);
+    if (repl_watched(fd)) {
+        uring_arm_repl(fd);
+    }
+}
+
+static void
+uring_event(uint32_t id, const struct io_uring_cqe *cqe)
+{
+    struct aci_conn *conn;
+
+    if ((conn = conn_lookup(id)) == NULL || cqe->res < 0) {
+        return;
+    }
+
+    shm_read(conn);
+    if (cqe->flags & IORING_CQE_F_MORE) {
+        return;
+    }
+
+    if ((conn = conn_lookup(id)) != NULL) {
+        uring_arm_event(conn);
+    }
+}
+
+/*
+ * Event loop on io_uring. Accepts and receives are
+ * multishot, so each stays armed for the life of the
+ * socket, and every SQE queued while handling one
+ * round of completions goes out with the wait for
+ * the next in a single system call.
+ *
+ * Returns -1 if the engine could not be set up
+ */
+static int
+run_uring(int ssockfd)
+{
+    struct io_uring_cqe *cqe, ev;
+    uint32_t id;
+
+    if (aci_uring_init(&ev_ring, URING_ENTRIES) < 0) {
+        return -1;
+    }
+
+    if (!(ev_ring.features & IORING_FEAT_EXT_ARG)) {
+        aci_uring_free(&ev_ring);
+        return -1;
+    }
+
+    if (aci_uring_pbuf_init(&ev_ring, URING_PBUFS, URING_RECV_LEN) < 0) {
+        aci_uring_free(&ev_ring);
+        return -1;
+    }
+
+    /* Layout of every buffer a receive lands in */
+    memset(&recv_msg, 0, sizeof(recv_msg));
+    recv_msg.msg_controllen = URING_CMSG_LEN;
+
+    read_init();
+    uring_arm_accept(ssockfd);
+    for (int i = 1; i < POLL_FD_COUNT; ++i) {
+        if (fds[i].fd >= 0 && conns[i] == NULL)
+            uring_arm_repl(fds[i].fd);
+        else if (conns[i] != NULL && fds[i].fd == conns[i]->fd)
+            uring_arm_recv(conns[i]);
+    }
+
+    printf("using io_uring event loop\n");
+    for (;;) {
+        if (aci_uring_wait(&ev_ring, aci_timeout()) < 0) {
+            perror("io_uring_enter");
+            continue;
+        }
+
+        while ((cqe = aci_uring_cqe(&ev_ring)) != NULL) {
+            ev = *cqe;
+            aci_uring_seen(&ev_ring);
+
+            id = ev.user_data >> 8;
+            switch (ev.user_data & 0xFF) {
+            case URING_ACCEPT:
+                uring_accept(ssockfd, &ev);
+                break;
+            case URING_RECV:
+                uring_recv(id, &ev);
+                break;
+            case URING_EVENT:
+                uring_event(id, &ev);
+                break;
+            case URING_REPL:
+                uring_repl(id, &ev);
+                break;
+            case URING_WRITE:
+                uring_write(id, &ev);
+                break;
+            case URING_CANCEL:
+                --uring_cancels;
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Event loop on poll()
+ */
+static void
+run_poll(int ssockfd)
+{
+    struct aci_conn *conn;
+    int pollret;
+
+    /* Read through events */
+    for (;;) {
+        pollret = poll(fds, POLL_FD_COUNT, aci_timeout());
+        if (pollret < 0) {
+            perror("poll");
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            ipc_accept(ssockfd);
+        }
+
+        for (int i = 1; i < POLL_FD_COUNT; ++i) {
+            if (fds[i].fd < 0 || fds[i].revents == 0) {
+                continue;
+            }
+
+            /* Replication sockets have no connection */
+            if ((conn = conns[i]) == NULL) {
+                repl_input(fds[i].fd);
+                continue;
+            }
+
+            if (conn->shm != NULL && fds[i].fd == conn->shm->tx_efd) {
+                shm_read(conn);
+                continue;
+            }
+
+            if (fds[i].revents & POLLOUT) {
+                aci_conn_flush(conn);
+                if (conn_update(conn) < 0)
+                    continue;
+            }
+
+            if (fds[i].revents & ~POLLOUT) {
+                ipc_read(conn);
+            }
+        }
+    }
+}
+
+/*
+ * Give a connection taken over from an old daemon back
+ * the filters it watched there
+ *
+ * @conn: Connection taken over [NULL if it could not be]
+ * @p: Cursor into the saved filters, moved past them
+ * @end: End of the saved filters
+ */
+static void
+hot_watch_load(struct aci_conn *conn, const char **p, const char *end)
+{
+    struct aci_watcher *w = NULL;
+
+    if (*p >= end) {
+        return;
+    }
+
+    /* The records after a bad one can't be found */
+    if (aci_watch_load(&w, p, end) < 0) {
+        printf("warning: dropped watch filters in handoff\n");
+        *p = end;
+        free(w);
+        return;
+    }
+
+    if (conn == NULL || w == NULL) {
+        free(w);
+        return;
+    }
+
+    conn->watch = w;
+    ++watchers;
+}
+
+static void
+run(void)
+{
+    const char *watch, *watch_end;
+    struct sockaddr_un un;
+    struct aci_conn *conn;
+    int ssockfd, error;
+
+    /* Handed over already listening */
+    if (hot_listen >= 0) {
+        ssockfd = hot_listen;
+        goto listening;
+    }
+
+    memset(&un, 0, sizeof(un));
+    strncpy(un.sun_path, ipc_path, sizeof(un.sun_path) - 1);
+    un.sun_family = AF_UNIX;
+
+    /* Open a server side socket */
+    ssockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (ssockfd < 0) {
+        perror("ssockfd");
+        return;
+    }
+
+    error = bind(
+        ssockfd,
+        (struct sockaddr *)&un,
+        sizeof(un)
+    );
+
+    if (error < 0) {
+        perror("bind");
+        return;
+    }
+
+    error = listen(ssockfd, IPC_BACKLOG);
+    if (error < 0) {
+        perror("listen");
+        return;
+    }
+
+listening:
+    listen_fd = ssockfd;
+    fds[0].fd = ssockfd;
+    fds[0].events = POLLIN;
+    if (repl_path != NULL && repl_listen() < 0) {
+        return;
+    }
+
+    if (repl_path == NULL && hot_repl >= 0) {
+        close(hot_repl);
+    }
+
+    /* Clients handed over pick up where they left off */
+    watch = hot_watch;
+    watch_end = watch + hot_watch_len;
+    for (int i = 0; i < hot_nconns; ++i) {
+        conn = ipc_conn_new(hot_conns[i]);
+        if (hot_watch != NULL)
+            hot_watch_load(conn, &watch, watch_end);
+    }
+
+    if (hot_watch != NULL) {
+        munmap(hot_watch, hot_watch_len);
+        hot_watch = NULL;
+    }
+
+    if (use_uring && run_uring(ssockfd) < 0) {
+        printf("warning: io_uring unavailable, falling back to poll\n");
+        use_uring = 0;
+    }
+
+    run_poll(ssockfd);
+}
+
+/*
+ * Take over from the daemon running on 'ipc_path'
+ * [odb.d -H], see handoff_finish()
+ *
+ * Returns zero on success
+ */
+static int
+handoff_take(void)
+{
+    struct aci_handoff_reply reply;
+    int fdv[ACI_HANDOFF_FDS], fdc, next = 2;
+    struct stat st;
+
+    fdc = aci_handoff_take(ipc_path, &reply, fdv, ACI_HANDOFF_FDS);
+    if (fdc < 0) {
+        printf("fatal: no daemon to take over from at \"%s\"\n", ipc_path);
+        return -1;
+    }
+
+    if (reply.error != 0 || fdc < 2 + !!(reply.flags & ACI_HANDOFF_REPL) +
+        !!(reply.flags & ACI_HANDOFF_WATCH) + (int)reply.nconns) {
+        printf("fatal: handoff refused: %s\n",
+            strerror(reply.error != 0 ? reply.error : EPROTO));
+        for (int i = 0; i < fdc; ++i)
+            close(fdv[i]);
+        return -1;
+    }
+
+    /* Without an image the drums are replayed as usual */
+    hot_listen = fdv[0];
+    if (fstat(fdv[1], &st) == 0 && st.st_size > 0) {
+        hot_image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fdv[1], 0);
+        if (hot_image != MAP_FAILED)
+            hot_image_len = st.st_size;
+        else
+            hot_image = NULL;
+    }
+
+    close(fdv[1]);
+    if (reply.flags & ACI_HANDOFF_REPL) {
+        hot_repl = fdv[next++];
+    }
+
+    /* Without the filters the clients stop hearing of changes */
+    if (reply.flags & ACI_HANDOFF_WATCH) {
+        if (fstat(fdv[next], &st) == 0 && st.st_size > 0) {
+            hot_watch = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                fdv[next], 0);
+            if (hot_watch != MAP_FAILED)
+                hot_watch_len = st.st_size;
+            else
+                hot_watch = NULL;
+        }
+
+        close(fdv[next++]);
+    }
+
+    while (next < fdc) {
+        hot_conns[hot_nconns++] = fdv[next++];
+    }
+
+    printf("took over with %d clients\n", hot_nconns);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    pid_t child;
+    int opt, hot = 0;
+
+    while ((opt = getopt(argc, argv, "up:r:f:H")) != -1) {
+        switch (opt) {
+        case 'u':
+            use_uring = 1;
+            break;
+        case 'H':
+            hot = 1;
+            break;
+        case 'p':
+            ipc_path = optarg;
+            break;
+        case 'r':
+            repl_path = optarg;
+            break;
+        case 'f':
+            leader_path = optarg;
+            break;
+        default:
+            printf("usage: odb.d [-u] [-H] [-p sock] [-r repl-sock] "
+                "[-f leader-repl-sock] <drum dir>\n");
+            return -1;
+        }
+    }
+
+    if (optind >= argc) {
+        printf("fatal: expected drum directory as argument\n");
+        return -1;
+    }
+
+    drum_dir = argv[optind];
+    if (access(drum_dir, F_OK) != 0) {
+        printf("fatal: could not access \"%s\"\n", drum_dir);
+        return -1;
+    }
+
+    /* Streams are sent with sendfile(), which has no MSG_NOSIGNAL */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (hot && handoff_take() < 0) {
+        return -1;
+    }
+
+    TAILQ_INIT(&state.drum_list);
+    drum_enumerate();
+    if (hot_image != NULL) {
+        munmap(hot_image, hot_image_len);
+        hot_image = NULL;
+    }
+
+    memset(fds, -1, sizeof(fds));
+    for (int i = 0; i < REPL_FOLLOWERS; ++i) {
+        followers[i].fd = -1;
+    }
 
-    memset(fds, -1, sizeof(fds));
     child = fork();
     if (child == 0) {
         run();
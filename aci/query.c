@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <string.h>
+#include "aci/datatype.h"
+#include "aci/query.h"
+
+int
+aci_query_init(const struct aci_pkt *pkt, struct aci_query *res)
+{
+    const struct aci_pred *pred;
+
+    if (pkt == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (pkt->length < sizeof(*pred)) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    pred = (const struct aci_pred *)pkt->data;
+    if (pred->cmp > ACI_CMP_GE) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(res, 0, sizeof(*res));
+    memcpy(res->drum, pred->drum, DRUM_NAMELEN);
+    memcpy(res->key, pred->key, DRUM_KEYLEN_MAX);
+    memcpy(res->start, pred->start, DRUM_KEYLEN_MAX);
+    memcpy(res->end, pred->end, DRUM_KEYLEN_MAX);
+    memcpy(res->resume, pred->resume, DRUM_KEYLEN_MAX);
+    memcpy(res->resume_drum, pred->resume_drum, DRUM_NAMELEN);
+    res->limit = pred->limit;
+    res->flags = pred->flags;
+    res->cmp = pred->cmp;
+    res->vtype = pred->vtype;
+    res->snap = pred->snap;
+    res->operand = pred->operand;
+    res->operand_len = pkt->length - sizeof(*pred);
+
+    /* Operand must be able to hold a value of its type */
+    switch (res->vtype) {
+    case ACI_TYPE_INTEGER:
+        if (res->cmp != ACI_CMP_NONE && res->operand_len != sizeof(int64_t)) {
+            errno = -EINVAL;
+            return -1;
+        }
+        break;
+    case ACI_TYPE_BOOL:
+        if (res->cmp != ACI_CMP_NONE && res->operand_len != 1) {
+            errno = -EINVAL;
+            return -1;
+        }
+        break;
+    }
+
+    return 0;
+}
+
+int
+aci_query_drum(const struct aci_query *q, const char *name)
+{
+    char buf[DRUM_NAMELEN + 1];
+
+    if (q->drum[0] == '\0') {
+        return 1;
+    }
+
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, name, DRUM_NAMELEN);
+    return fnmatch(q->drum, buf, 0) == 0;
+}
+
+int
+aci_query_key(const struct aci_query *q, const char *key)
+{
+    if (q->end[0] != '\0' && strcmp(key, q->end) >= 0) {
+        return -1;
+    }
+
+    if (q->key[0] == '\0') {
+        return 1;
+    }
+
+    return fnmatch(q->key, key, 0) == 0;
+}
+
+/*
+ * Three-way compare of two byte strings, shorter
+ * strings sort first on a common prefix.
+ */
+static int
+query_bytecmp(const void *a, size_t a_len, const void *b, size_t b_len)
+{
+    size_t len;
+    int diff;
+
+    len = (a_len < b_len) ? a_len : b_len;
+    if ((diff = memcmp(a, b, len)) != 0) {
+        return diff;
+    }
+
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+int
+aci_query_value(const struct aci_query *q, uint8_t type, const void *data,
+    size_t len)
+{
+    int64_t a, b;
+    int diff;
+
+    if (q->cmp == ACI_CMP_NONE) {
+        return 1;
+    }
+
+    if (type != q->vtype) {
+        return 0;
+    }
+
+    switch (type) {
+    case ACI_TYPE_INTEGER:
+        if (len != sizeof(a)) {
+            return 0;
+        }
+
+        memcpy(&a, data, sizeof(a));
+        memcpy(&b, q->operand, sizeof(b));
+        diff = (a > b) - (a < b);
+        break;
+    case ACI_TYPE_BOOL:
+        if (len != 1) {
+            return 0;
+        }
+
+        a = (*(const uint8_t *)data != 0);
+        b = (*(const uint8_t *)q->operand != 0);
+        diff = (a > b) - (a < b);
+        break;
+    default:
+        diff = query_bytecmp(data, len, q->operand, q->operand_len);
+        break;
+    }
+
+    switch (q->cmp) {
+    case ACI_CMP_EQ:
+        return diff == 0;
+    case ACI_CMP_NE:
+        return diff != 0;
+    case ACI_CMP_LT:
+        return diff < 0;
+    case ACI_CMP_LE:
+        return diff <= 0;
+    case ACI_CMP_GT:
+        return diff > 0;
+    case ACI_CMP_GE:
+        return diff >= 0;
+    default:
+        return 0;
+    }
+}
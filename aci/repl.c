@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aci/repl.h"
+
+/*
+ * Read exactly 'len' bytes from a socket
+ */
+static int
+repl_read_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        n = recv(fd, p, len, MSG_WAITALL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n <= 0) {
+            errno = (n == 0) ? -EPIPE : -errno;
+            return -1;
+        }
+
+        p += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+int
+aci_repl_send(int fd, const struct aci_repl_frame *frame, const char *key,
+    const void *data)
+{
+    struct iovec iov[3];
+    struct msghdr msg;
+    size_t left;
+    ssize_t n;
+
+    if (frame == NULL || (frame->length > 0 && data == NULL) ||
+        (frame->keylen > 0 && key == NULL)) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    iov[0].iov_base = (void *)frame;
+    iov[0].iov_len = sizeof(*frame);
+    iov[1].iov_base = (void *)key;
+    iov[1].iov_len = frame->keylen;
+    iov[2].iov_base = (void *)data;
+    iov[2].iov_len = frame->length;
+    left = sizeof(*frame) + frame->keylen + frame->length;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (frame->length > 0) ? 3 : 2;
+
+    /* The peer may hang up at any point, never take SIGPIPE */
+    while (left > 0) {
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (n < 0) {
+            errno = -errno;
+            return -1;
+        }
+
+        left -= n;
+        while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len) {
+            n -= msg.msg_iov->iov_len;
+            ++msg.msg_iov;
+            --msg.msg_iovlen;
+        }
+
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + n;
+            msg.msg_iov->iov_len -= n;
+        }
+    }
+
+    return 0;
+}
+
+int
+aci_repl_recv(int fd, struct aci_repl_frame *frame, char *key, void **data)
+{
+    void *buf = NULL;
+
+    if (frame == NULL || key == NULL || data == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (repl_read_all(fd, frame, sizeof(*frame)) < 0) {
+        return -1;
+    }
+
+    if (repl_read_all(fd, key, frame->keylen) < 0) {
+        return -1;
+    }
+
+    key[frame->keylen] = '\0';
+
+    if (frame->length > ACI_REPL_DATA_MAX) {
+        errno = -EMSGSIZE;
+        return -1;
+    }
+
+    if (frame->length > 0) {
+        if ((buf = malloc(frame->length)) == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        if (repl_read_all(fd, buf, frame->length) < 0) {
+            free(buf);
+            return -1;
+        }
+    }
+
+    *data = buf;
+    return 0;
+}
@@ -0,0 +1,377 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "aci/uring.h"
+
+#define load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static inline int
+uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int
+uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+    const void *arg, size_t argsz)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+        arg, argsz);
+}
+
+static inline int
+uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+int
+aci_uring_init(struct aci_uring *ring, unsigned entries)
+{
+    struct io_uring_params p;
+    size_t sq_len, cq_len;
+    char *map;
+
+    if (ring == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&p, 0, sizeof(p));
+    if ((ring->fd = uring_setup(entries, &p)) < 0) {
+        return -1;
+    }
+
+    ring->features = p.features;
+    /* Both rings share one mapping on anything recent enough */
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(ring->fd);
+        errno = -ENOSYS;
+        return -1;
+    }
+
+    sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->map_len = (sq_len > cq_len) ? sq_len : cq_len;
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (map == MAP_FAILED) {
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        munmap(map, ring->map_len);
+        close(ring->fd);
+        return -1;
+    }
+
+    ring->map = map;
+    ring->sq_head = (unsigned *)(map + p.sq_off.head);
+    ring->sq_tail = (unsigned *)(map + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)(map + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(map + p.sq_off.array);
+    ring->sq_local = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(map + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(map + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)(map + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(map + p.cq_off.cqes);
+    return 0;
+}
+
+struct io_uring_sqe *
+aci_uring_sqe(struct aci_uring *ring)
+{
+    struct io_uring_sqe *sqe;
+    unsigned idx;
+
+    if (ring->sq_local - load_acquire(ring->sq_head) > *ring->sq_mask) {
+        if (aci_uring_submit(ring, 0) < 0) {
+            return NULL;
+        }
+    }
+
+    idx = ring->sq_local & *ring->sq_mask;
+    sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    ++ring->sq_local;
+    return sqe;
+}
+
+int
+aci_uring_submit(struct aci_uring *ring, unsigned wait_nr)
+{
+    unsigned to_submit, flags = 0;
+    int ret;
+
+    to_submit = ring->sq_local - *ring->sq_tail;
+    store_release(ring->sq_tail, ring->sq_local);
+    if (wait_nr > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+
+    do {
+        ret = uring_enter(ring->fd, to_submit, wait_nr, flags, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret;
+}
+
+int
+aci_uring_wait(struct aci_uring *ring, int timeout)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned to_submit;
+    int ret;
+
+    if (timeout < 0) {
+        return (aci_uring_submit(ring, 1) < 0) ? -1 : 0;
+    }
+
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000L;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (uintptr_t)&ts;
+
+    to_submit = ring->sq_local - *ring->sq_tail;
+    store_release(ring->sq_tail, ring->sq_local);
+    ret = uring_enter(ring->fd, to_submit, 1,
+        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (ret < 0 && (errno == ETIME || errno == EINTR)) {
+        return 0;
+    }
+
+    return (ret < 0) ? -1 : 0;
+}
+
+struct io_uring_cqe *
+aci_uring_cqe(struct aci_uring *ring)
+{
+    unsigned head;
+
+    head = *ring->cq_head;
+    if (head == load_acquire(ring->cq_tail)) {
+        return NULL;
+    }
+
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+void
+aci_uring_seen(struct aci_uring *ring)
+{
+    store_release(ring->cq_head, *ring->cq_head + 1);
+}
+
+int
+aci_uring_buffers(struct aci_uring *ring, const struct iovec *iov,
+    unsigned count)
+{
+    return uring_register(ring->fd, IORING_REGISTER_BUFFERS, iov, count);
+}
+
+int
+aci_uring_file(struct aci_uring *ring, int fd)
+{
+    struct io_uring_files_update up;
+
+    if (fd < 0 || fd >= ACI_URING_FILES) {
+        return -1;
+    }
+
+    /* Register an empty table the first time around */
+    if (ring->files == NULL) {
+        if ((ring->files = malloc(sizeof(int) * ACI_URING_FILES)) == NULL) {
+            return -1;
+        }
+
+        memset(ring->files, -1, sizeof(int) * ACI_URING_FILES);
+        if (uring_register(ring->fd, IORING_REGISTER_FILES, ring->files,
+                ACI_URING_FILES) < 0) {
+            free(ring->files);
+            ring->files = NULL;
+            return -1;
+        }
+    }
+
+    if (ring->files[fd] == fd) {
+        return fd;
+    }
+
+    memset(&up, 0, sizeof(up));
+    up.offset = fd;
+    up.fds = (uintptr_t)&fd;
+    if (uring_register(ring->fd, IORING_REGISTER_FILES_UPDATE, &up, 1) < 0) {
+        return -1;
+    }
+
+    ring->files[fd] = fd;
+    return fd;
+}
+
+void
+aci_uring_forget(struct aci_uring *ring, int fd)
+{
+    struct io_uring_files_update up;
+    int none = -1;
+
+    if (ring->files == NULL || fd < 0 || fd >= ACI_URING_FILES) {
+        return;
+    }
+
+    if (ring->files[fd] != fd) {
+        return;
+    }
+
+    memset(&up, 0, sizeof(up));
+    up.offset = fd;
+    up.fds = (uintptr_t)&none;
+    uring_register(ring->fd, IORING_REGISTER_FILES_UPDATE, &up, 1);
+    ring->files[fd] = -1;
+}
+
+/*
+ * Publish a provided buffer at the tail of the
+ * buffer ring
+ */
+static void
+uring_pbuf_add(struct aci_uring *ring, uint16_t bid)
+{
+    struct io_uring_buf *buf;
+    uint16_t tail;
+
+    tail = ring->br->tail;
+    buf = &ring->br->bufs[tail & (ring->pbuf_count - 1)];
+    buf->addr = (uintptr_t)(ring->pbufs + (size_t)bid * ring->pbuf_len);
+    buf->len = ring->pbuf_len;
+    buf->bid = bid;
+    store_release(&ring->br->tail, tail + 1);
+}
+
+int
+aci_uring_pbuf_init(struct aci_uring *ring, uint16_t count, uint32_t len)
+{
+    struct io_uring_buf_reg reg;
+    size_t ring_len;
+    void *br;
+
+    if (count == 0 || (count & (count - 1)) != 0) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    ring_len = count * sizeof(struct io_uring_buf);
+    br = mmap(NULL, ring_len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (br == MAP_FAILED) {
+        return -1;
+    }
+
+    if ((ring->pbufs = malloc((size_t)count * len)) == NULL) {
+        munmap(br, ring_len);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)br;
+    reg.ring_entries = count;
+    reg.bgid = 0;
+    if (uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(br, ring_len);
+        free(ring->pbufs);
+        ring->pbufs = NULL;
+        return -1;
+    }
+
+    ring->br = br;
+    ring->pbuf_count = count;
+    ring->pbuf_len = len;
+    for (uint16_t i = 0; i < count; ++i) {
+        uring_pbuf_add(ring, i);
+    }
+
+    return 0;
+}
+
+char *
+aci_uring_pbuf(struct aci_uring *ring, const struct io_uring_cqe *cqe)
+{
+    uint16_t bid;
+
+    if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+        return NULL;
+    }
+
+    bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    return ring->pbufs + (size_t)bid * ring->pbuf_len;
+}
+
+void
+aci_uring_pbuf_put(struct aci_uring *ring, const struct io_uring_cqe *cqe)
+{
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        uring_pbuf_add(ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+}
+
+void
+aci_uring_free(struct aci_uring *ring)
+{
+    if (ring == NULL || ring->map == NULL) {
+        return;
+    }
+
+    if (ring->br != NULL) {
+        munmap(ring->br, ring->pbuf_count * sizeof(struct io_uring_buf));
+        free(ring->pbufs);
+    }
+
+    munmap(ring->sqes, ring->sqes_len);
+    munmap(ring->map, ring->map_len);
+    close(ring->fd);
+    free(ring->files);
+    memset(ring, 0, sizeof(*ring));
+}
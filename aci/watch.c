@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "aci/proto.h"
+#include "aci/conn.h"
+#include "aci/watch.h"
+
+#define WATCH_SLOTS (ACI_WATCH_QUEUE * 2)
+
+/*
+ * FNV-1a hash of a drum name and key
+ */
+static size_t
+watch_hash(const char *drum, const char *key, size_t len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < DRUM_NAMELEN && drum[i] != '\0'; ++i) {
+        hash = (hash ^ (uint8_t)drum[i]) * 0x100000001b3ULL;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ (uint8_t)key[i]) * 0x100000001b3ULL;
+    }
+
+    return hash & (WATCH_SLOTS - 1);
+}
+
+/*
+ * Returns true if a change is of interest to one of
+ * the filters of a watcher. Drums being created are of
+ * interest to every filter on them.
+ */
+static int
+watch_match(const struct aci_watcher *w, uint8_t op, const char *drum,
+    const char *key, size_t len)
+{
+    const struct aci_watch_filter *f;
+
+    for (uint8_t i = 0; i < w->nfilters; ++i) {
+        f = &w->filters[i];
+        if (f->drum[0] != '\0' && strncmp(f->drum, drum, DRUM_NAMELEN) != 0)
+            continue;
+        if (op == ACI_EVENT_CREATE)
+            return 1;
+        if (f->keylen <= len && memcmp(f->prefix, key, f->keylen) == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Look up the filter made from the same arguments
+ *
+ * Returns -1 if there is none
+ */
+static int
+watch_find(const struct aci_watcher *w, const char *drum, const char *prefix,
+    size_t len)
+{
+    const struct aci_watch_filter *f;
+
+    for (uint8_t i = 0; i < w->nfilters; ++i) {
+        f = &w->filters[i];
+        if (strncmp(f->drum, drum, DRUM_NAMELEN) == 0 && f->keylen == len &&
+            memcmp(f->prefix, prefix, len) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/*
+ * Throw away every queued change
+ */
+static void
+watch_reset(struct aci_watcher *w)
+{
+    w->count = 0;
+    memset(w->slots, 0, sizeof(w->slots));
+}
+
+/*
+ * Write an event frame to a buffer
+ *
+ * @drum: Drum name [NULL for none]
+ */
+static size_t
+watch_frame(char *buf, uint8_t op, uint64_t seq, const char *drum,
+    const char *key, size_t len)
+{
+    struct aci_event *ev;
+
+    ev = (struct aci_event *)buf;
+    memset(ev, 0, sizeof(*ev));
+    ev->op = op;
+    ev->seq = seq;
+    ev->keylen = len;
+    if (drum != NULL) {
+        memcpy(ev->drum, drum, DRUM_NAMELEN);
+    }
+
+    if (len > 0) {
+        memcpy(buf + sizeof(*ev), key, len);
+    }
+
+    return sizeof(*ev) + len;
+}
+
+int
+aci_watch_add(struct aci_watcher **wp, const char *drum, const char *prefix,
+    size_t len)
+{
+    struct aci_watch_filter *f;
+    struct aci_watcher *w;
+
+    if (wp == NULL || drum == NULL || len > DRUM_KEYLEN_MAX) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((w = *wp) == NULL) {
+        if ((w = calloc(1, sizeof(*w))) == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        *wp = w;
+    }
+
+    if (watch_find(w, drum, prefix, len) >= 0) {
+        return 0;
+    }
+
+    if (w->nfilters == ACI_WATCH_MAX) {
+        errno = -ENOSPC;
+        return -1;
+    }
+
+    f = &w->filters[w->nfilters++];
+    memset(f, 0, sizeof(*f));
+    strncpy(f->drum, drum, DRUM_NAMELEN);
+    f->keylen = len;
+    memcpy(f->prefix, prefix, len);
+    return 0;
+}
+
+int
+aci_watch_del(struct aci_watcher *w, const char *drum, const char *prefix,
+    size_t len)
+{
+    int i;
+
+    if (w == NULL || drum == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((i = watch_find(w, drum, prefix, len)) < 0) {
+        errno = -ENOENT;
+        return -1;
+    }
+
+    w->filters[i] = w->filters[--w->nfilters];
+    return 0;
+}
+
+void
+aci_watch_note(struct aci_watcher *w, uint8_t op, uint64_t seq,
+    const char *drum, const char *key, size_t len)
+{
+    struct aci_watch_ev *ev;
+    size_t i;
+    uint16_t slot;
+
+    if (w == NULL || !watch_match(w, op, drum, key, len)) {
+        return;
+    }
+
+    /* Already queued, it only needs the newer sequence number */
+    i = watch_hash(drum, key, len);
+    while ((slot = w->slots[i]) != 0) {
+        ev = &w->queue[slot - 1];
+        if (ev->op == op && ev->keylen == len &&
+            strncmp(ev->drum, drum, DRUM_NAMELEN) == 0 &&
+            memcmp(ev->key, key, len) == 0) {
+            ev->seq = seq;
+            return;
+        }
+
+        i = (i + 1) & (WATCH_SLOTS - 1);
+    }
+
+    if (w->count == ACI_WATCH_QUEUE) {
+        watch_reset(w);
+        w->lost_seq = seq;
+        return;
+    }
+
+    ev = &w->queue[w->count++];
+    ev->op = op;
+    ev->keylen = len;
+    ev->seq = seq;
+    strncpy(ev->drum, drum, DRUM_NAMELEN);
+    memcpy(ev->key, key, len);
+    w->slots[i] = w->count;
+}
+
+int
+aci_watch_flush(struct aci_conn *conn)
+{
+    char buf[ACI_OUTBUF_LEN];
+    struct aci_watch_ev *ev;
+    struct aci_watcher *w;
+    size_t len = 0;
+
+    if (conn == NULL || (w = conn->watch) == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* Whatever is still queued came in after what was lost */
+    if (w->lost_seq != 0) {
+        len = watch_frame(buf, ACI_EVENT_LOST, w->lost_seq, NULL, NULL, 0);
+        w->lost_seq = 0;
+    }
+
+    for (size_t i = 0; i < w->count; ++i) {
+        ev = &w->queue[i];
+        if (len + sizeof(struct aci_event) + ev->keylen > sizeof(buf)) {
+            if (aci_conn_send(conn, buf, len, MSG_MORE) < 0)
+                break;
+            len = 0;
+        }
+
+        len += watch_frame(buf + len, ev->op, ev->seq, ev->drum, ev->key,
+            ev->keylen);
+    }
+
+    watch_reset(w);
+    if (len > 0 && aci_conn_send(conn, buf, len, 0) < 0) {
+        return -1;
+    }
+
+    return conn->error ? -1 : 0;
+}
+
+int
+aci_watch_pending(const struct aci_watcher *w)
+{
+    return w != NULL && (w->count > 0 || w->lost_seq != 0);
+}
+
+int
+aci_watch_save(const struct aci_watcher *w, int fd)
+{
+    uint8_t count;
+    size_t len;
+
+    count = (w != NULL) ? w->nfilters : 0;
+    if (write(fd, &count, sizeof(count)) != sizeof(count)) {
+        return -1;
+    }
+
+    len = count * sizeof(w->filters[0]);
+    if (len > 0 && write(fd, w->filters, len) != (ssize_t)len) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+aci_watch_load(struct aci_watcher **wp, const char **p, const char *end)
+{
+    const struct aci_watch_filter *f;
+    uint8_t count;
+
+    if (wp == NULL || p == NULL || *p >= end) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    count = *(const uint8_t *)(*p)++;
+    if (count > ACI_WATCH_MAX ||
+        (size_t)(end - *p) < count * sizeof(*f)) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    f = (const struct aci_watch_filter *)*p;
+    *p += count * sizeof(*f);
+    for (uint8_t i = 0; i < count; ++i, ++f) {
+        if (f->keylen > DRUM_KEYLEN_MAX)
+            continue;
+        if (aci_watch_add(wp, f->drum, f->prefix, f->keylen) < 0)
+            return -1;
+    }
+
+    return 0;
+}
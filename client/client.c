@@ -28,14 +28,22 @@
  */
 
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
+#include <ctype.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include "aci/datatype.h"
 #include "aci/proto.h"
+#include "aci/link.h"
+#include "aci/shard.h"
 #include "drum/drum.h"
 
 /* Various prefixes used for operations */
@@ -50,13 +58,51 @@
 #define CMD_NOP     "NOP"
 #define CMD_QUERY   "QUERY"
 #define CMD_CREATE  "CREATE"
+#define CMD_STORE   "STORE"
+#define CMD_GET     "GET"
+#define CMD_SCAN    "SCAN"
+#define CMD_RANGE   "RANGE"
+#define CMD_NEXT    "NEXT"
+#define CMD_AGG     "AGG"
+#define CMD_SNAP    "SNAP"
+#define CMD_STATS   "STATS"
+#define CMD_BACKUP  "BACKUP"
+#define CMD_EXPORT  "EXPORT"
+#define CMD_UPLOAD  "UPLOAD"
+#define CMD_INCR    "INCR"
+#define CMD_DECR    "DECR"
+#define CMD_APPEND  "APPEND"
+#define CMD_CAS     "CAS"
+#define CMD_WATCH   "WATCH"
 
 /* Object types */
 #define OBJECT_DRUM "DRUM"
 
+/* Object options */
+#define OPT_COLUMNAR "COLUMNAR"
+#define OPT_COMPACT "COMPACT"
+#define OPT_DIRECT "DIRECT"
+
+/* Store options */
+#define OPT_TTL "TTL"
+
+/* Snapshot options */
+#define OPT_RELEASE "RELEASE"
+
 /* Environment defines */
 #define IPC_PATH "/tmp/odb.d"
 #define CLIENT_VERSION "v0.0.1"
+#define VALUE_MAX 128
+#define EXPORT_BUFLEN (64 * 1024)
+
+/* Room for a command with two keys of DRUM_KEYLEN_MAX */
+#define INPUT_MAX 1024
+
+/* Commands a script keeps in flight by default */
+#define SCRIPT_WINDOW 64
+
+/* Request bytes a script keeps in flight, well within a ring */
+#define SCRIPT_INFLIGHT (32 * 1024)
 
 static const char *typetab[] = {
     [ACI_TYPE_NONE] = "NONE",
@@ -66,73 +112,1391 @@ static const char *typetab[] = {
     [ACI_TYPE_DRUM] = "DRUM"
 };
 
-static int ssockfd = -1;
+static const char *aggtab[] = {
+    [ACI_AGG_COUNT] = "COUNT",
+    [ACI_AGG_SUM] = "SUM",
+    [ACI_AGG_MIN] = "MIN",
+    [ACI_AGG_MAX] = "MAX"
+};
+
+static const char *cmptab[] = {
+    [ACI_CMP_NONE] = "",
+    [ACI_CMP_EQ] = "==",
+    [ACI_CMP_NE] = "!=",
+    [ACI_CMP_LT] = "<",
+    [ACI_CMP_LE] = "<=",
+    [ACI_CMP_GT] = ">",
+    [ACI_CMP_GE] = ">="
+};
+
+static struct aci_shards *shards = NULL;
+
+/* Last scan request, kept around for c.NEXT */
+static struct aci_scan last_scan;
+static aci_op_t last_scan_op;
+static int scan_pending = 0;
+
+/* Last query with a predicate [last_scan_op is ACI_CMD_QUERY] */
+static char last_query[sizeof(struct aci_pred) + VALUE_MAX];
+static size_t last_query_len;
+
+/* Snapshot reads go through on each shard [zero for the latest] */
+static uint64_t cur_snap[ACI_SHARDS_MAX];
+
+/*
+ * A command of a script whose reply has not been
+ * taken yet
+ *
+ * @link: Link the reply comes back on
+ * @op: Operation that was sent
+ * @line: Line of the script it came from
+ * @len: Length of the request
+ */
+struct script_op {
+    struct aci_link *link;
+    aci_op_t op;
+    size_t line;
+    size_t len;
+};
+
+/* Commands of a script in flight, oldest first */
+static struct script_op *script_ops = NULL;
+static size_t script_window = SCRIPT_WINDOW;
+static size_t script_head = 0;
+static size_t script_count = 0;
+static size_t script_bytes = 0;
+static size_t script_line = 0;
+static size_t script_failed = 0;
+
+/* Set by whatever fails the command being run */
+static int cmd_error = 0;
+
+static void
+exit_hook(void)
+{
+    if (shards != NULL) {
+        aci_shards_close(shards);
+        shards = NULL;
+    }
+}
+
+static void
+sig_hook(int signo)
+{
+    printf("got signal %d\n", signo);
+    exit(0);
+}
+
+static void
+help(void)
+{
+    printf(
+        "-- OSMORA database daemon --\n"
+        "[h.]   Show this help menu\n"
+        "[c.]   Perform a command\n"
+        "[l.]   Get link path\n"
+        "[v.]   Get version\n"
+        "[q.]   Quit client\n"
+        "\n"
+        "-- Commands --\n"
+        "c.QUERY [drum-glob] [KEY <glob>] [FROM <key>] [TO <key>]\n"
+        "        [WHERE <op> <type> <value>] [ROWS] [KEYS] [LIMIT <n>]\n"
+        "c.CREATE DRUM <name> [COLUMNAR] [COMPACT] [DIRECT]\n"
+        "c.STORE <drum> <key> [TTL <ms>] [INTEGER|BOOL|STRING] <value>\n"
+        "c.UPLOAD <drum> <key> <file>  Store a file as a STRING value\n"
+        "c.GET <drum> <key>\n"
+        "c.INCR <drum> <key> [n]  Add to an INTEGER value\n"
+        "c.DECR <drum> <key> [n]  Subtract from an INTEGER value\n"
+        "c.APPEND <drum> <key> <value>  Add to a STRING value\n"
+        "c.CAS <drum> <key> <seq> [INTEGER|BOOL|STRING] <value>\n"
+        "       Store if the key is still at <seq> [0 if missing]\n"
+        "c.WATCH <drum|*> [prefix]  Print changes until interrupted\n"
+        "c.SCAN <drum> <prefix> [limit]\n"
+        "c.RANGE <drum> <start> <end|*> [limit]\n"
+        "c.NEXT   Continue the last SCAN/RANGE/QUERY\n"
+        "c.AGG <drum> <COUNT|SUM|MIN|MAX> [INTEGER|BOOL]\n"
+        "c.SNAP [RELEASE]  Read from a new snapshot, or the latest\n"
+        "c.STATS  Show the replication state of the daemon\n"
+        "c.BACKUP <drum|*> <dir>  Have the daemon copy drums to <dir>\n"
+        "c.EXPORT <drum|*> <dir>  Copy drums from the daemon to <dir>\n"
+    );
+}
+
+static void
+unknown_command(void)
+{
+    cmd_error = 1;
+    printf(
+        "* Unknown command\n"
+        "[?]: Use the 'h.' prefix for help\n"
+    );
+}
+
+static void
+aci_create(const char *name, aci_datatype_t type, uint32_t flags)
+{
+    int error;
+    size_t name_len;
+    struct aci_create create;
+    struct aci_pkt *pkt;
+
+    if (name == NULL) {
+        return;
+    }
+
+    name_len = strlen(name);
+    if (name_len >= DRUM_NAMELEN) {
+        printf("* \"%s\" is too long [max %d]\n", name, DRUM_NAMELEN - 1);
+        cmd_error = 1;
+        return;
+    }
+
+    memset(&create, 0, sizeof(create));
+    memcpy(create.name, name, name_len);
+    create.flags = flags;
+    error = aci_pkt_init(
+        ACI_CMD_CREATE,
+        type,
+        sizeof(create),
+        &create,
+        &pkt
+    );
+
+    if (error != 0) {
+        perror("aci_pkt_init");
+    }
+
+    /* Every shard holds every drum */
+    for (size_t i = 0; i < shards->count; ++i) {
+        aci_link_send(shards->links[i], pkt, sizeof(*pkt) + pkt->length);
+    }
+
+    aci_pkt_free(pkt);
+}
+
+/*
+ * Bundle data into a packet and send it to the
+ * ACI daemon
+ */
+static int
+aci_send(struct aci_link *link, aci_op_t op, aci_datatype_t type,
+    const void *data, size_t len)
+{
+    struct aci_pkt *pkt;
+    int error;
+
+    error = aci_pkt_init(op, type, len, data, &pkt);
+    if (error != 0) {
+        perror("aci_pkt_init");
+        return error;
+    }
+
+    aci_link_send(link, pkt, sizeof(*pkt) + pkt->length);
+    aci_pkt_free(pkt);
+    return 0;
+}
+
+/*
+ * Returns the link to the shard holding a key
+ */
+static inline struct aci_link *
+shard_link(const char *drum, const char *key)
+{
+    return shards->links[aci_shard_of(shards, drum, key)];
+}
+
+/*
+ * Copy a string into a zero padded fixed-size
+ * field
+ */
+static int
+pad_copy(char *dest, const char *src, size_t size)
+{
+    size_t len;
+
+    len = strlen(src);
+    if (len >= size) {
+        printf("* \"%s\" is too long [max %zu]\n", src, size - 1);
+        cmd_error = 1;
+        return -1;
+    }
+
+    memset(dest, 0, size);
+    memcpy(dest, src, len);
+    return 0;
+}
+
+/*
+ * Returns the length of a key, or -1 if a drum
+ * cannot hold it
+ */
+static ssize_t
+key_len(const char *key)
+{
+    size_t len;
+
+    len = strlen(key);
+    if (len == 0 || len > DRUM_KEYLEN_MAX) {
+        printf("* \"%s\" is not a valid key [max %d]\n", key,
+            DRUM_KEYLEN_MAX);
+        cmd_error = 1;
+        return -1;
+    }
+
+    return len;
+}
+
+/*
+ * Look up a datatype by name, returns ACI_TYPE_NONE
+ * if there is no such type.
+ */
+static aci_datatype_t
+type_lookup(const char *name)
+{
+    for (int i = 0; i < sizeof(typetab) / sizeof(typetab[0]); ++i) {
+        if (strcmp(typetab[i], name) == 0)
+            return i;
+    }
+
+    return ACI_TYPE_NONE;
+}
+
+/*
+ * Split an optional datatype off the front of a
+ * value, which is a string if no type is given
+ */
+static aci_datatype_t
+value_type(char **value)
+{
+    aci_datatype_t type;
+    char *p;
+
+    if ((p = strchr(*value, ' ')) == NULL) {
+        return ACI_TYPE_STRING;
+    }
+
+    *p = '\0';
+    if ((type = type_lookup(*value)) != ACI_TYPE_NONE) {
+        *value = p + 1;
+        return type;
+    }
+
+    *p = ' ';
+    return ACI_TYPE_STRING;
+}
+
+/*
+ * Encode a value of the given type, returns the
+ * length of the encoded value or -1 on error.
+ */
+static ssize_t
+encode_value(aci_datatype_t type, const char *value, char *buf,
+    size_t size)
+{
+    int64_t ival;
+    char *end;
+    size_t len;
+
+    switch (type) {
+    case ACI_TYPE_INTEGER:
+        ival = strtoll(value, &end, 0);
+        if (*value == '\0' || *end != '\0') {
+            printf("* \"%s\" is not an integer\n", value);
+            cmd_error = 1;
+            return -1;
+        }
+
+        memcpy(buf, &ival, sizeof(ival));
+        return sizeof(ival);
+    case ACI_TYPE_BOOL:
+        if (strcmp(value, "true") == 0 || strcmp(value, "1") == 0) {
+            buf[0] = 1;
+        } else if (strcmp(value, "false") == 0 || strcmp(value, "0") == 0) {
+            buf[0] = 0;
+        } else {
+            printf("* \"%s\" is not a bool\n", value);
+            cmd_error = 1;
+            return -1;
+        }
+        return 1;
+    default:
+        len = strlen(value);
+        if (len > size) {
+            printf("* Value is too long [max %zu]\n", size);
+            cmd_error = 1;
+            return -1;
+        }
+
+        memcpy(buf, value, len);
+        return len;
+    }
+}
+
+/*
+ * Print a value according to its type
+ */
+static void
+print_value(uint8_t type, const char *data, uint32_t len)
+{
+    int64_t ival;
+
+    if (type == ACI_TYPE_INTEGER && len == sizeof(ival)) {
+        memcpy(&ival, data, sizeof(ival));
+        printf("%lld\n", (long long)ival);
+    } else if (type == ACI_TYPE_BOOL && len == 1) {
+        printf("%s\n", data[0] ? "true" : "false");
+    } else {
+        printf("%.*s\n", (int)len, (data != NULL) ? data : "");
+    }
+}
+
+/*
+ * Receive a reply made up of rows, printing each
+ * of them. With no link given, the replies of every
+ * shard are merged, keeping at most 'limit' rows.
+ * Returns the flags of the final row, whose key
+ * [e.g., a resume token] is written to 'token' and
+ * the drum of that key, if any, to 'drum'.
+ */
+static uint8_t
+recv_rows(struct aci_link *link, uint32_t limit, char *token, char *drum)
+{
+    struct aci_rowset set;
+    struct aci_row *row;
+    const char *key;
+    uint32_t row_id = 0;
+    int error;
+
+    if (link != NULL) {
+        memset(&set, 0, sizeof(set));
+        if ((error = aci_link_rows(link, &set)) < 0)
+            aci_rowset_free(&set);
+    } else {
+        error = aci_shards_rows(shards, limit, &set);
+    }
+
+    if (error < 0) {
+        memset(&set, 0, sizeof(set));
+        set.flags = ACI_ROW_END;
+    }
+
+    printf("-----------------------------------------\n");
+    for (size_t i = 0; i < set.count; ++i) {
+        row = &set.rows[i].row;
+        key = set.rows[i].key;
+        if (row->flags & ACI_ROW_DRUM) {
+            printf("[%s]\n", key);
+        } else if (row->length > 0) {
+            printf("%d ~ %s = ", row_id++, key);
+            print_value(row->type, set.rows[i].data, row->length);
+        } else {
+            printf("%d ~ %s\n", row_id++, key);
+        }
+    }
+
+    if (row_id == 0) {
+        printf("** NO ENTRIES **\n");
+    }
+    printf("-----------------------------------------\n");
+
+    if (token != NULL) {
+        strcpy(token, set.token);
+    }
+
+    if (drum != NULL) {
+        memcpy(drum, set.token_drum, DRUM_NAMELEN);
+    }
+
+    aci_rowset_free(&set);
+    return set.flags;
+}
+
+/*
+ * Take the reply to a store
+ *
+ * Returns zero if the store was made
+ */
+static int
+store_status(struct aci_link *link)
+{
+    struct aci_status status;
+
+    if (aci_link_recv(link, &status, sizeof(status)) != sizeof(status)) {
+        printf("* No reply from daemon\n");
+        return -1;
+    }
+
+    if (status.error != 0) {
+        printf("* Store failed: %s\n", strerror(status.error));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Take the reply to an update and print the version
+ * the key is at, along with any value sent back
+ *
+ * Returns zero if the update was made
+ */
+static int
+update_status(struct aci_link *link)
+{
+    struct aci_update_reply reply;
+    char *data = NULL;
+    int retval = 0;
+
+    if (aci_link_recv(link, &reply, sizeof(reply)) != sizeof(reply)) {
+        printf("* No reply from daemon\n");
+        return -1;
+    }
+
+    if (reply.length > 0) {
+        if ((data = malloc(reply.length)) == NULL ||
+            aci_link_recv(link, data, reply.length) != reply.length) {
+            printf("* No reply from daemon\n");
+            free(data);
+            return -1;
+        }
+    }
+
+    if (reply.error == ESTALE) {
+        printf("* Key changed, it is at [seq %ju]", (uintmax_t)reply.seq);
+        retval = -1;
+    } else if (reply.error != 0) {
+        printf("* Update failed: %s", strerror(reply.error));
+        retval = -1;
+    } else {
+        printf("[seq %ju]", (uintmax_t)reply.seq);
+    }
+
+    if (data != NULL) {
+        printf(" = ");
+        print_value(reply.type, data, reply.length);
+    } else {
+        printf("%s\n", (retval == 0) ? " ok" : "");
+    }
+
+    free(data);
+    return retval;
+}
+
+/*
+ * Take the reply to the oldest command of a script
+ * in flight and print its result
+ */
+static void
+script_pop(void)
+{
+    struct script_op *op;
+
+    op = &script_ops[script_head];
+    script_head = (script_head + 1) % script_window;
+    --script_count;
+    script_bytes -= op->len;
+
+    switch (op->op) {
+    case ACI_CMD_STORE:
+    case ACI_CMD_STORE_TTL:
+        printf("[%zu] ", op->line);
+        if (store_status(op->link) == 0) {
+            printf("ok\n");
+        } else {
+            ++script_failed;
+        }
+        break;
+    case ACI_CMD_GET:
+        printf("[%zu]\n", op->line);
+        recv_rows(op->link, 0, NULL, NULL);
+        break;
+    case ACI_CMD_INCR:
+    case ACI_CMD_APPEND:
+    case ACI_CMD_CAS:
+        printf("[%zu] ", op->line);
+        if (update_status(op->link) < 0) {
+            ++script_failed;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Note a command of a script that was sent without
+ * waiting for its reply. Replies come back in order on
+ * each link, so the oldest one is always next on its
+ * link. Requests are bounded too, so that a client
+ * waiting for room on a shared-memory ring never holds
+ * up a daemon waiting for room to reply.
+ */
+static void
+script_push(struct aci_link *link, aci_op_t op, size_t len)
+{
+    struct script_op *p;
+
+    p = &script_ops[(script_head + script_count) % script_window];
+    p->link = link;
+    p->op = op;
+    p->line = script_line;
+    p->len = len;
+    ++script_count;
+    script_bytes += len;
+
+    while (script_count == script_window || script_bytes > SCRIPT_INFLIGHT) {
+        script_pop();
+    }
+}
+
+/*
+ * Take the reply of every command of a script still
+ * in flight
+ */
+static void
+script_drain(void)
+{
+    while (script_count > 0) {
+        script_pop();
+    }
+}
+
+static void
+db_store(const char *drum, const char *key, aci_datatype_t type,
+    const char *value, uint64_t ttl)
+{
+    struct aci_store *store;
+    struct aci_link *link;
+    struct aci_store_ttl *ttl_store;
+    char buf[VALUE_MAX], *p;
+    ssize_t value_len, klen;
+    size_t hdr_len, len;
+    aci_op_t op;
+
+    value_len = encode_value(type, value, buf, sizeof(buf));
+    if (value_len < 0 || (klen = key_len(key)) < 0) {
+        return;
+    }
+
+    /* Both payloads start with the drum, the key follows the header */
+    op = (ttl != 0) ? ACI_CMD_STORE_TTL : ACI_CMD_STORE;
+    hdr_len = (ttl != 0) ? sizeof(*ttl_store) : sizeof(*store);
+    if ((store = malloc(hdr_len + klen + value_len)) == NULL) {
+        return;
+    }
+
+    if (pad_copy(store->drum, drum, DRUM_NAMELEN) < 0) {
+        free(store);
+        return;
+    }
+
+    if (ttl != 0) {
+        ttl_store = (struct aci_store_ttl *)store;
+        ttl_store->ttl = ttl;
+        ttl_store->keylen = klen;
+    } else {
+        store->keylen = klen;
+    }
+
+    p = (char *)store + hdr_len;
+    memcpy(p, key, klen);
+    memcpy(p + klen, buf, value_len);
+    len = hdr_len + klen + value_len;
+    link = shard_link(store->drum, key);
+    aci_send(link, op, type, store, len);
+    free(store);
+
+    /* A script takes the reply later */
+    if (script_ops != NULL) {
+        script_push(link, op, sizeof(struct aci_pkt) + len);
+        return;
+    }
+
+    if (store_status(link) < 0) {
+        cmd_error = 1;
+    }
+}
+
+/*
+ * Send an update to the shard holding a key and take
+ * its reply, or leave it for a script to take. The
+ * payload starts with the drum.
+ */
+static void
+update_send(aci_op_t op, aci_datatype_t type, const char *key, void *buf,
+    size_t len)
+{
+    struct aci_link *link;
+
+    link = shard_link(buf, key);
+    aci_send(link, op, type, buf, len);
+    if (script_ops != NULL) {
+        script_push(link, op, sizeof(struct aci_pkt) + len);
+        return;
+    }
+
+    if (update_status(link) < 0) {
+        cmd_error = 1;
+    }
+}
+
+static void
+db_incr(const char *drum, const char *key, const char *delta, int negate)
+{
+    char buf[sizeof(struct aci_incr) + DRUM_KEYLEN_MAX];
+    struct aci_incr *incr;
+    ssize_t klen;
+
+    incr = (struct aci_incr *)buf;
+    if (pad_copy(incr->drum, drum, DRUM_NAMELEN) < 0 ||
+        (klen = key_len(key)) < 0) {
+        return;
+    }
+
+    incr->delta = 1;
+    if (delta != NULL &&
+        encode_value(ACI_TYPE_INTEGER, delta, (char *)&incr->delta,
+        sizeof(incr->delta)) < 0) {
+        return;
+    }
+
+    if (negate) {
+        incr->delta = -incr->delta;
+    }
+
+    incr->keylen = klen;
+    memcpy(incr->key, key, klen);
+    update_send(ACI_CMD_INCR, ACI_TYPE_INTEGER, key, incr,
+        sizeof(*incr) + klen);
+}
+
+static void
+db_append(const char *drum, const char *key, const char *value)
+{
+    char buf[sizeof(struct aci_store) + DRUM_KEYLEN_MAX + VALUE_MAX];
+    struct aci_store *store;
+    ssize_t value_len, klen;
+
+    store = (struct aci_store *)buf;
+    if (pad_copy(store->drum, drum, DRUM_NAMELEN) < 0 ||
+        (klen = key_len(key)) < 0) {
+        return;
+    }
+
+    value_len = encode_value(ACI_TYPE_STRING, value, store->data + klen,
+        VALUE_MAX);
+    if (value_len < 0) {
+        return;
+    }
+
+    store->keylen = klen;
+    memcpy(store->data, key, klen);
+    update_send(ACI_CMD_APPEND, ACI_TYPE_STRING, key, store,
+        sizeof(*store) + klen + value_len);
+}
+
+static void
+db_cas(const char *drum, const char *key, uint64_t seq,
+    aci_datatype_t type, const char *value)
+{
+    char buf[sizeof(struct aci_cas) + DRUM_KEYLEN_MAX + VALUE_MAX];
+    struct aci_cas *cas;
+    ssize_t value_len, klen;
+
+    cas = (struct aci_cas *)buf;
+    if (pad_copy(cas->drum, drum, DRUM_NAMELEN) < 0 ||
+        (klen = key_len(key)) < 0) {
+        return;
+    }
+
+    value_len = encode_value(type, value, cas->data + klen, VALUE_MAX);
+    if (value_len < 0) {
+        return;
+    }
+
+    cas->seq = seq;
+    cas->keylen = klen;
+    memcpy(cas->data, key, klen);
+    update_send(ACI_CMD_CAS, type, key, cas,
+        sizeof(*cas) + klen + value_len);
+}
+
+/*
+ * Take one event off a watching link and print it
+ *
+ * Returns -1 if the link failed or the watch was refused
+ */
+static int
+watch_event(struct aci_link *link)
+{
+    char key[DRUM_KEYLEN_MAX + 1], drum[DRUM_NAMELEN + 1];
+    struct aci_event ev;
+
+    if (aci_link_recv(link, &ev, sizeof(ev)) != sizeof(ev) ||
+        (ev.keylen > 0 && aci_link_recv(link, key, ev.keylen) != ev.keylen)) {
+        printf("* No reply from daemon\n");
+        return -1;
+    }
+
+    key[ev.keylen] = '\0';
+    memset(drum, 0, sizeof(drum));
+    memcpy(drum, ev.drum, DRUM_NAMELEN);
+    switch (ev.op) {
+    case ACI_EVENT_WATCH:
+        if (ev.error != 0) {
+            printf("* Watch failed: %s\n", strerror(ev.error));
+            return -1;
+        }
+
+        printf("[*] watching from [seq %ju]\n", (uintmax_t)ev.seq);
+        break;
+    case ACI_EVENT_STORE:
+        printf("[seq %ju] STORE %s %s\n", (uintmax_t)ev.seq, drum, key);
+        break;
+    case ACI_EVENT_CREATE:
+        printf("[seq %ju] CREATE %s\n", (uintmax_t)ev.seq, drum);
+        break;
+    case ACI_EVENT_LOST:
+        printf("* Changes up to [seq %ju] were lost\n", (uintmax_t)ev.seq);
+        break;
+    }
+
+    fflush(stdout);
+    return 0;
+}
+
+/*
+ * Watch a drum or key prefix on every shard and print
+ * its changes as they come in. The links take nothing
+ * else from then on, so this only returns on failure.
+ */
+static void
+db_watch(const char *drum, const char *prefix)
+{
+    char buf[sizeof(struct aci_watch) + DRUM_KEYLEN_MAX];
+    struct pollfd pfd[ACI_SHARDS_MAX];
+    struct aci_watch *watch;
+    ssize_t len = 0;
+
+    watch = (struct aci_watch *)buf;
+    memset(watch, 0, sizeof(*watch));
+    if (strcmp(drum, "*") != 0 &&
+        pad_copy(watch->drum, drum, DRUM_NAMELEN) < 0) {
+        return;
+    }
+
+    if (prefix != NULL && (len = key_len(prefix)) < 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < shards->count; ++i) {
+        if (shards->links[i]->shm != NULL) {
+            printf("* Watching needs a socket link [run without -s]\n");
+            cmd_error = 1;
+            return;
+        }
+    }
+
+    watch->keylen = len;
+    if (len > 0) {
+        memcpy(watch->prefix, prefix, len);
+    }
+
+    for (size_t i = 0; i < shards->count; ++i) {
+        aci_send(shards->links[i], ACI_CMD_WATCH, ACI_TYPE_NONE, watch,
+            sizeof(*watch) + len);
+        pfd[i].fd = shards->links[i]->sockfd;
+        pfd[i].events = POLLIN;
+    }
+
+    for (;;) {
+        if (poll(pfd, shards->count, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            break;
+        }
+
+        for (size_t i = 0; i < shards->count; ++i) {
+            if (pfd[i].revents == 0)
+                continue;
+            if (watch_event(shards->links[i]) < 0) {
+                cmd_error = 1;
+                return;
+            }
+        }
+    }
+}
+
+/*
+ * Store the contents of a file in chunks, so that it
+ * may be of any size
+ */
+static void
+db_upload(const char *drum, const char *key, const char *file)
+{
+    char hdr[sizeof(struct aci_store_begin) + DRUM_KEYLEN_MAX];
+    struct aci_store_begin *begin;
+    struct aci_status status;
+    struct aci_link *link;
+    struct stat st;
+    char *buf;
+    ssize_t n, klen;
+    int fd, dmmy = 0;
+
+    begin = (struct aci_store_begin *)hdr;
+    if (pad_copy(begin->drum, drum, DRUM_NAMELEN) < 0 ||
+        (klen = key_len(key)) < 0) {
+        return;
+    }
+
+    if ((fd = open(file, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        perror(file);
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    if ((buf = malloc(ACI_CHUNK_LEN)) == NULL) {
+        close(fd);
+        return;
+    }
+
+    begin->length = st.st_size;
+    begin->ttl = 0;
+    begin->keylen = klen;
+    memcpy(begin->key, key, klen);
+    link = shard_link(begin->drum, key);
+    aci_send(link, ACI_CMD_STORE_BEGIN, ACI_TYPE_STRING, begin,
+        sizeof(*begin) + klen);
+    if (aci_link_recv(link, &status, sizeof(status)) != sizeof(status)) {
+        printf("* No reply from daemon\n");
+        goto done;
+    }
+
+    if (status.error != 0) {
+        printf("* Store failed: %s\n", strerror(status.error));
+        goto done;
+    }
+
+    /* A short file fails the commit, the daemon counts the bytes */
+    while ((n = read(fd, buf, ACI_CHUNK_LEN)) > 0) {
+        aci_send(link, ACI_CMD_STORE_CHUNK, ACI_TYPE_NONE, buf, n);
+    }
+
+    aci_send(link, ACI_CMD_STORE_COMMIT, ACI_TYPE_NONE, &dmmy, 0);
+    if (aci_link_recv(link, &status, sizeof(status)) != sizeof(status)) {
+        printf("* No reply from daemon\n");
+        goto done;
+    }
+
+    if (status.error != 0) {
+        printf("* Store failed: %s\n", strerror(status.error));
+        goto done;
+    }
+
+    printf("[*] stored %jd bytes\n", (intmax_t)st.st_size);
+done:
+    free(buf);
+    close(fd);
+}
+
+static void
+db_get(const char *drum, const char *key)
+{
+    char buf[sizeof(struct aci_get) + DRUM_KEYLEN_MAX];
+    struct aci_link *link;
+    struct aci_get *get;
+    ssize_t klen;
+    size_t shard;
+
+    get = (struct aci_get *)buf;
+    if (pad_copy(get->drum, drum, DRUM_NAMELEN) < 0 ||
+        (klen = key_len(key)) < 0) {
+        return;
+    }
+
+    shard = aci_shard_of(shards, get->drum, key);
+    link = shards->links[shard];
+    get->snap = cur_snap[shard];
+    get->keylen = klen;
+    memcpy(get->key, key, klen);
+    aci_send(link, ACI_CMD_GET, ACI_TYPE_NONE, get, sizeof(*get) + klen);
+    if (script_ops != NULL) {
+        script_push(link, ACI_CMD_GET, sizeof(struct aci_pkt) +
+            sizeof(*get) + klen);
+        return;
+    }
+
+    recv_rows(link, 0, NULL, NULL);
+}
+
+/*
+ * Send the last scan request and keep its resume
+ * token around if more rows remain
+ */
+static void
+db_next_page(void)
+{
+    char token[DRUM_KEYLEN_MAX + 1];
+    uint8_t flags;
+
+    /* Keys are spread over every shard */
+    for (size_t i = 0; i < shards->count; ++i) {
+        last_scan.snap = cur_snap[i];
+        aci_send(shards->links[i], last_scan_op, ACI_TYPE_NONE, &last_scan,
+            sizeof(last_scan));
+    }
+
+    flags = recv_rows(NULL, last_scan.limit, token, NULL);
+
+    scan_pending = 0;
+    if (flags & ACI_ROW_MORE) {
+        strncpy(last_scan.after, token, DRUM_KEYLEN_MAX);
+        last_scan.flags |= ACI_SCAN_AFTER;
+        scan_pending = 1;
+        printf("[*] more rows available, use c.%s\n", CMD_NEXT);
+    }
+}
+
+/*
+ * Send the last query and keep its resume token
+ * around if more rows remain
+ */
+static void
+db_query_page(void)
+{
+    struct aci_pred *pred = (struct aci_pred *)last_query;
+    char token[DRUM_KEYLEN_MAX + 1], drum[DRUM_NAMELEN];
+
+    for (size_t i = 0; i < shards->count; ++i) {
+        pred->snap = cur_snap[i];
+        aci_send(shards->links[i], ACI_CMD_QUERY, ACI_TYPE_NONE, pred,
+            last_query_len);
+    }
+
+    scan_pending = 0;
+    if (recv_rows(NULL, pred->limit, token, drum) & ACI_ROW_MORE) {
+        strncpy(pred->resume, token, DRUM_KEYLEN_MAX);
+        memcpy(pred->resume_drum, drum, DRUM_NAMELEN);
+        pred->flags |= ACI_PRED_RESUME;
+        scan_pending = 1;
+        printf("[*] more rows available, use c.%s\n", CMD_NEXT);
+    }
+}
+
+static void
+db_scan(aci_op_t op, const char *drum, const char *start,
+    const char *end, const char *limit)
+{
+    struct aci_scan *scan = &last_scan;
+
+    memset(scan, 0, sizeof(*scan));
+    if (pad_copy(scan->drum, drum, DRUM_NAMELEN) < 0 ||
+        (start[0] != '\0' && key_len(start) < 0)) {
+        return;
+    }
+
+    /* Bounds are zero padded, a full one has no NUL */
+    strncpy(scan->start, start, DRUM_KEYLEN_MAX);
+    if (end != NULL && strcmp(end, "*") != 0) {
+        if (key_len(end) < 0)
+            return;
+        strncpy(scan->end, end, DRUM_KEYLEN_MAX);
+    }
+
+    if (limit != NULL) {
+        scan->limit = strtoul(limit, NULL, 10);
+    }
+
+    last_scan_op = op;
+    db_next_page();
+}
+
+static void
+db_aggregate(const char *drum, const char *func, const char *type)
+{
+    struct aci_agg_reply reply, res;
+    struct aci_agg agg;
+    aci_datatype_t col = ACI_TYPE_INTEGER;
+    int i, error = 0;
+
+    if (pad_copy(agg.drum, drum, DRUM_NAMELEN) < 0) {
+        return;
+    }
+
+    for (i = 0; i < sizeof(aggtab) / sizeof(aggtab[0]); ++i) {
+        if (strcmp(aggtab[i], func) == 0)
+            break;
+    }
+
+    if (i == sizeof(aggtab) / sizeof(aggtab[0])) {
+        printf("* Unknown aggregate \"%s\"\n", func);
+        return;
+    }
+
+    if (type != NULL) {
+        col = type_lookup(type);
+    }
+
+    agg.func = i;
+    for (size_t j = 0; j < shards->count; ++j) {
+        aci_send(shards->links[j], ACI_CMD_AGGREGATE, col, &agg, sizeof(agg));
+    }
+
+    /* Combine the partial aggregate of each shard */
+    memset(&res, 0, sizeof(res));
+    for (size_t j = 0; j < shards->count; ++j) {
+        if (aci_link_recv(shards->links[j], &reply, sizeof(reply)) !=
+            sizeof(reply)) {
+            printf("* No reply from daemon\n");
+            return;
+        }
+
+        if (reply.error != 0 || error != 0) {
+            error = (error != 0) ? error : reply.error;
+            continue;
+        }
+
+        if (reply.count == 0) {
+            continue;
+        }
+
+        switch (agg.func) {
+        case ACI_AGG_MIN:
+            if (res.count == 0 || reply.value < res.value)
+                res.value = reply.value;
+            break;
+        case ACI_AGG_MAX:
+            if (res.count == 0 || reply.value > res.value)
+                res.value = reply.value;
+            break;
+        default:
+            res.value += reply.value;
+            break;
+        }
+
+        res.count += reply.count;
+    }
+
+    if (error != 0) {
+        printf("* Aggregate failed: %s\n", strerror(error));
+        return;
+    }
+
+    printf("%s = %lld [over %llu values]\n", aggtab[i],
+        (long long)res.value, (unsigned long long)res.count);
+}
+
+/*
+ * Send a snapshot request to a shard
+ *
+ * Returns zero on success
+ */
+static int
+db_snap_send(size_t shard, uint64_t snap, uint8_t flags, uint64_t *res)
+{
+    struct aci_snap_reply reply;
+    struct aci_snap req;
+    struct aci_link *link;
+
+    req.snap = snap;
+    req.flags = flags;
+    link = shards->links[shard];
+    aci_send(link, ACI_CMD_SNAPSHOT, ACI_TYPE_NONE, &req, sizeof(req));
+    if (aci_link_recv(link, &reply, sizeof(reply)) != sizeof(reply)) {
+        printf("* No reply from daemon\n");
+        return -1;
+    }
+
+    if (reply.error != 0) {
+        printf("* Snapshot failed: %s\n", strerror(reply.error));
+        return -1;
+    }
+
+    if (res != NULL) {
+        *res = reply.snap;
+    }
+
+    return 0;
+}
+
+/*
+ * Release the snapshots reads go through
+ */
+static void
+db_snap_release(uint64_t *snaps)
+{
+    for (size_t i = 0; i < shards->count; ++i) {
+        if (snaps[i] != 0)
+            db_snap_send(i, snaps[i], ACI_SNAP_RELEASE, NULL);
+        snaps[i] = 0;
+    }
+}
+
+/*
+ * Point reads at a new snapshot, or back at the
+ * latest data with RELEASE. The previous snapshot
+ * is released either way. Each shard takes its own
+ * snapshot, they are not a single point in time
+ * across shards.
+ */
+static void
+db_snapshot(const char *opt)
+{
+    uint64_t snaps[ACI_SHARDS_MAX];
+
+    if (opt != NULL && strcmp(opt, OPT_RELEASE) != 0) {
+        printf("* Unknown option \"%s\"\n", opt);
+        return;
+    }
+
+    memset(snaps, 0, sizeof(snaps));
+    for (size_t i = 0; opt == NULL && i < shards->count; ++i) {
+        if (db_snap_send(i, 0, 0, &snaps[i]) < 0) {
+            db_snap_release(snaps);
+            return;
+        }
+    }
+
+    db_snap_release(cur_snap);
+
+    /* A resumed scan must not jump between snapshots */
+    memcpy(cur_snap, snaps, sizeof(cur_snap));
+    scan_pending = 0;
+    if (snaps[0] != 0) {
+        printf("[*] reading from snapshot %llu\n",
+            (unsigned long long)snaps[0]);
+    } else {
+        printf("[*] reading latest data\n");
+    }
+}
 
+/*
+ * Print the replication state of a daemon
+ */
 static void
-exit_hook(void)
+print_stats(const struct aci_stats *stats)
 {
-    if (ssockfd > 0) {
-        close(ssockfd);
+    if (stats->role == ACI_ROLE_LEADER) {
+        printf("role: leader [%u followers]\n", stats->followers);
+        printf("seq: %llu\n", (unsigned long long)stats->seq);
+    } else {
+        printf("role: follower [%s]\n",
+            (stats->flags & ACI_STATS_LINKED) ? "linked" : "not linked");
+        printf("seq: %llu of %llu\n", (unsigned long long)stats->seq,
+            (unsigned long long)stats->leader_seq);
+        if (stats->lag == UINT64_MAX) {
+            printf("lag: unknown\n");
+        } else {
+            printf("lag: %llu ms\n", (unsigned long long)stats->lag);
+        }
     }
 
-    exit(0);
+    printf("arena peak: %llu bytes\n",
+        (unsigned long long)stats->arena_peak);
 }
 
+/*
+ * Show the replication state of the daemon
+ */
 static void
-sig_hook(int signo)
+db_stats(void)
 {
-    printf("got signal %d\n", signo);
-    exit_hook();
+    struct aci_stats stats;
+    char dmmy = 0;
+
+    for (size_t i = 0; i < shards->count; ++i) {
+        aci_send(shards->links[i], ACI_CMD_STATS, ACI_TYPE_NONE, &dmmy, 0);
+        if (aci_link_recv(shards->links[i], &stats, sizeof(stats)) !=
+            sizeof(stats)) {
+            printf("* No reply from daemon\n");
+            return;
+        }
+
+        if (shards->count > 1) {
+            printf("[%s]\n", shards->paths[i]);
+        }
+
+        print_stats(&stats);
+    }
 }
 
+/*
+ * Where the copy of a shard goes, each shard of a
+ * sharded setup gets a directory of its own
+ */
 static void
-help(void)
+backup_dir(size_t shard, const char *dir, char *buf, size_t len)
 {
-    printf(
-        "-- OSMORA database daemon --\n"
-        "[h.]   Show this help menu\n"
-        "[c.]   Perform a command\n"
-        "[l.]   Get link path\n"
-        "[v.]   Get version\n"
-        "[q.]   Quit client\n"
-    );
+    if (shards->count == 1) {
+        snprintf(buf, len, "%s", dir);
+        return;
+    }
+
+    snprintf(buf, len, "%s/%zu", dir, shard);
 }
 
-static void
-unknown_command(void)
+/*
+ * Read the parts of an export stream into drum
+ * directories under 'dir'
+ *
+ * Returns the number of bytes written, -1 on error
+ */
+static ssize_t
+export_recv(struct aci_link *link, const char *dir)
 {
-    printf(
-        "* Unknown command\n"
-        "[?]: Use the 'h.' prefix for help\n"
-    );
+    struct aci_part part;
+    char drum[256], path[512], *buf;
+    uint64_t left, total = 0;
+    size_t len;
+    ssize_t n;
+    int fd;
+
+    if ((buf = malloc(EXPORT_BUFLEN)) == NULL) {
+        return -1;
+    }
+
+    for (;;) {
+        if (aci_link_recv(link, &part, sizeof(part)) != sizeof(part)) {
+            printf("* Export cut short\n");
+            break;
+        }
+
+        if (part.kind == ACI_PART_END) {
+            free(buf);
+            if (part.error != 0) {
+                printf("* Export failed: %s\n", strerror(part.error));
+                return -1;
+            }
+
+            return total;
+        }
+
+        snprintf(drum, sizeof(drum), "%s/%.*s", dir, DRUM_NAMELEN,
+            part.drum);
+        if (part.kind == ACI_PART_META) {
+            mkdir(drum, 0700);
+            snprintf(path, sizeof(path), DRUM_META_FMT, drum);
+        } else {
+            snprintf(path, sizeof(path), DRUM_SEG_FMT, drum, part.seg);
+        }
+
+        if ((fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600)) < 0) {
+            perror(path);
+            break;
+        }
+
+        for (left = part.length; left > 0; left -= n) {
+            len = (left > EXPORT_BUFLEN) ? EXPORT_BUFLEN : left;
+            n = recv(link->sockfd, buf, len, 0);
+            if (n <= 0 || write(fd, buf, n) != n) {
+                break;
+            }
+        }
+
+        close(fd);
+        if (left > 0) {
+            printf("* Export cut short\n");
+            break;
+        }
+
+        total += part.length;
+    }
+
+    free(buf);
+    return -1;
 }
 
+/*
+ * Copy a drum [or all of them, with '*'] as it is now.
+ * A backup is written by the daemon to 'dir' on its own
+ * host. An export is streamed here over a link of its
+ * own and written to 'dir' locally.
+ */
 static void
-aci_create(const char *name, aci_datatype_t type)
+db_backup(aci_op_t op, const char *drum, const char *dir)
 {
-    int error;
-    size_t name_len;
-    struct aci_pkt *pkt;
+    struct aci_backup *req;
+    struct aci_status status;
+    struct aci_link *link;
+    char path[256];
+    size_t len;
+    ssize_t total;
 
-    if (name == NULL) {
+    if (strcmp(drum, "*") == 0) {
+        drum = "";
+    }
+
+    if (op == ACI_CMD_EXPORT && mkdir(dir, 0700) < 0 && errno != EEXIST) {
+        perror(dir);
         return;
     }
 
-    name_len = strlen(name);
-    error = aci_pkt_init(
-        ACI_CMD_CREATE,
-        type,
-        name_len,
-        name,
-        &pkt
-    );
+    for (size_t i = 0; i < shards->count; ++i) {
+        backup_dir(i, dir, path, sizeof(path));
+        len = sizeof(*req) + strlen(path) + 1;
+        if ((req = calloc(1, len)) == NULL) {
+            return;
+        }
 
-    if (error != 0) {
-        perror("aci_pkt_init");
+        pad_copy(req->drum, drum, DRUM_NAMELEN);
+        if (op == ACI_CMD_BACKUP) {
+            memcpy(req->path, path, strlen(path));
+            aci_send(shards->links[i], op, ACI_TYPE_NONE, req, len);
+            free(req);
+            if (aci_link_recv(shards->links[i], &status, sizeof(status)) !=
+                sizeof(status)) {
+                printf("* No reply from daemon\n");
+                return;
+            }
+
+            if (status.error != 0) {
+                printf("* Backup failed: %s\n", strerror(status.error));
+                return;
+            }
+
+            printf("[*] backed up to %s\n", path);
+            continue;
+        }
+
+        /* Streams never go through shared memory */
+        if (aci_link_open(shards->paths[i], 0, &link) < 0) {
+            printf("* Could not reach %s\n", shards->paths[i]);
+            free(req);
+            return;
+        }
+
+        mkdir(path, 0700);
+        aci_send(link, op, ACI_TYPE_NONE, req, sizeof(*req));
+        free(req);
+        total = export_recv(link, path);
+        aci_link_close(link);
+        if (total < 0) {
+            return;
+        }
+
+        printf("[*] exported %zd bytes to %s\n", total, path);
     }
+}
 
-    send(ssockfd, pkt, sizeof(*pkt) + pkt->length, 0);
-    aci_pkt_free(pkt);
+/*
+ * Continue the last scan or query from its resume token
+ */
+static void
+db_next(void)
+{
+    if (!scan_pending) {
+        printf("* No scan to continue\n");
+        return;
+    }
+
+    if (last_scan_op == ACI_CMD_QUERY) {
+        db_query_page();
+        return;
+    }
+
+    db_next_page();
 }
 
 /*
@@ -159,7 +1523,10 @@ db_nop(void)
         perror("aci_pkt_init");
     }
 
-    send(ssockfd, pkt, sizeof(*pkt) + pkt->length, 0);
+    for (size_t i = 0; i < shards->count; ++i) {
+        aci_link_send(shards->links[i], pkt, sizeof(*pkt) + pkt->length);
+    }
+
     aci_pkt_free(pkt);
 }
 
@@ -184,12 +1551,13 @@ db_query(void)
         perror("aci_pkt_init");
     }
 
-    send(ssockfd, pkt, sizeof(*pkt) + pkt->length, 0);
+    /* Every shard holds every drum, the first one will do */
+    aci_link_send(shards->links[0], pkt, sizeof(*pkt) + pkt->length);
     aci_pkt_free(pkt);
 
     printf("-----------------------------------------\n");
     /* Recieve the list of paths */
-    while (recv(ssockfd, name, DRUM_NAMELEN, 0) > 0) {
+    while (aci_link_recv(shards->links[0], name, DRUM_NAMELEN) > 0) {
         if (name[0] == EOF) {
             break;
         }
@@ -205,13 +1573,100 @@ db_query(void)
     printf("received %d entries\n", row_id);
 }
 
+/*
+ * Query with a predicate that is evaluated by the
+ * daemon, the arguments are pulled from the current
+ * strtok() state.
+ */
+static void
+db_query_pred(char *tok)
+{
+    struct aci_pred *pred = (struct aci_pred *)last_query;
+    ssize_t operand_len = 0;
+    char *arg[3];
+    int i;
+
+    /* The last query is overwritten, whatever was pending */
+    scan_pending = 0;
+    memset(last_query, 0, sizeof(last_query));
+    if (strchr("KFTWRL", tok[0]) == NULL || islower(tok[1])) {
+        if (pad_copy(pred->drum, tok, DRUM_NAMELEN) < 0)
+            return;
+        tok = strtok(NULL, " ");
+    }
+
+    for (; tok != NULL; tok = strtok(NULL, " ")) {
+        if (strcmp(tok, "ROWS") == 0) {
+            pred->flags |= ACI_PRED_ROWS;
+            continue;
+        }
+        if (strcmp(tok, "KEYS") == 0) {
+            pred->flags |= ACI_PRED_ROWS | ACI_PRED_KEYS;
+            continue;
+        }
+
+        if ((arg[0] = strtok(NULL, " ")) == NULL) {
+            unknown_command();
+            return;
+        }
+
+        if (strcmp(tok, "KEY") == 0) {
+            if (pad_copy(pred->key, arg[0], DRUM_KEYLEN_MAX) < 0)
+                return;
+        } else if (strcmp(tok, "FROM") == 0) {
+            if (pad_copy(pred->start, arg[0], DRUM_KEYLEN_MAX) < 0)
+                return;
+        } else if (strcmp(tok, "TO") == 0) {
+            if (pad_copy(pred->end, arg[0], DRUM_KEYLEN_MAX) < 0)
+                return;
+        } else if (strcmp(tok, "LIMIT") == 0) {
+            pred->limit = strtoul(arg[0], NULL, 10);
+        } else if (strcmp(tok, "WHERE") == 0) {
+            arg[1] = strtok(NULL, " ");
+            arg[2] = strtok(NULL, " ");
+            if (arg[1] == NULL || arg[2] == NULL) {
+                unknown_command();
+                return;
+            }
+
+            for (i = 1; i < sizeof(cmptab) / sizeof(cmptab[0]); ++i) {
+                if (strcmp(cmptab[i], arg[0]) == 0)
+                    break;
+            }
+
+            if (i == sizeof(cmptab) / sizeof(cmptab[0])) {
+                printf("* Unknown comparison \"%s\"\n", arg[0]);
+                return;
+            }
+
+            pred->cmp = i;
+            pred->vtype = type_lookup(arg[1]);
+            operand_len = encode_value(pred->vtype, arg[2], pred->operand,
+                VALUE_MAX);
+            if (operand_len < 0) {
+                return;
+            }
+        } else {
+            unknown_command();
+            return;
+        }
+
+        pred->flags |= ACI_PRED_ROWS;
+    }
+
+    last_query_len = sizeof(*pred) + operand_len;
+    last_scan_op = ACI_CMD_QUERY;
+    db_query_page();
+}
+
 /*
  * Create a database object
  */
 static int
-db_create(char *object, char *name)
+db_create(char *object, char *name, const char *opt)
 {
     aci_datatype_t type = ACI_TYPE_NONE;
+    uint32_t flags = 0;
 
     if (object == NULL || name == NULL) {
         return -1;
@@ -227,8 +1682,21 @@ db_create(char *object, char *name)
         return -1;
     }
 
+    for (; opt != NULL; opt = strtok(NULL, " ")) {
+        if (strcmp(opt, OPT_COLUMNAR) == 0) {
+            flags |= DRUM_F_COLUMNAR;
+        } else if (strcmp(opt, OPT_COMPACT) == 0) {
+            flags |= DRUM_F_COMPACT;
+        } else if (strcmp(opt, OPT_DIRECT) == 0) {
+            flags |= DRUM_F_DIRECT;
+        } else {
+            printf("* Unknown option \"%s\"\n", opt);
+            return -1;
+        }
+    }
+
     printf("* Creating %s [%s]\n", name, typetab[type]);
-    aci_create(name, type);
+    aci_create(name, type, flags);
     return 0;
 }
 
@@ -237,6 +1705,9 @@ db_command(const char *input)
 {
     char *p, *p1;
     char *object, *name;
+    char *arg[4], *end;
+    aci_datatype_t type;
+    uint64_t ttl, seq;
 
     if (input == NULL) {
         return;
@@ -257,9 +1728,18 @@ db_command(const char *input)
             db_nop();
             break;
         }
+        if (strncmp(p1, CMD_NEXT, sizeof(CMD_NEXT)) == 0) {
+            db_next();
+            break;
+        }
     case 'Q':
         if (strncmp(p1, CMD_QUERY, sizeof(CMD_QUERY)) == 0) {
             printf("[*] sending query\n");
+            if ((arg[0] = strtok(NULL, " ")) != NULL) {
+                db_query_pred(arg[0]);
+                break;
+            }
+
             db_query();
             break;
         }
@@ -277,7 +1757,190 @@ db_command(const char *input)
             if ((name = strdup(name)) == NULL)
                 break;
 
-            db_create(object, name);
+            if (db_create(object, name, strtok(NULL, " ")) < 0)
+                cmd_error = 1;
+            break;
+        }
+        if (strncmp(p1, CMD_CAS, sizeof(CMD_CAS)) == 0) {
+            arg[0] = strtok(NULL, " ");
+            arg[1] = strtok(NULL, " ");
+            arg[2] = strtok(NULL, " ");
+            arg[3] = strtok(NULL, "");
+            if (arg[0] == NULL || arg[1] == NULL || arg[2] == NULL ||
+                arg[3] == NULL) {
+                unknown_command();
+                break;
+            }
+
+            seq = strtoull(arg[2], &end, 10);
+            if (*end != '\0') {
+                unknown_command();
+                break;
+            }
+
+            type = value_type(&arg[3]);
+            db_cas(arg[0], arg[1], seq, type, arg[3]);
+            break;
+        }
+    case 'S':
+        if (strncmp(p1, CMD_STORE, sizeof(CMD_STORE)) == 0) {
+            arg[0] = strtok(NULL, " ");
+            arg[1] = strtok(NULL, " ");
+            arg[2] = strtok(NULL, "");
+            if (arg[0] == NULL || arg[1] == NULL || arg[2] == NULL) {
+                unknown_command();
+                break;
+            }
+
+            /* Optional TTL before the value */
+            ttl = 0;
+            if (strncmp(arg[2], OPT_TTL " ", sizeof(OPT_TTL)) == 0) {
+                ttl = strtoull(arg[2] + sizeof(OPT_TTL), &end, 10);
+                if (ttl == 0 || *end != ' ') {
+                    unknown_command();
+                    break;
+                }
+                arg[2] = end + 1;
+            }
+
+            /* Optional type before the value */
+            type = value_type(&arg[2]);
+            db_store(arg[0], arg[1], type, arg[2], ttl);
+            break;
+        }
+        if (strncmp(p1, CMD_SCAN, sizeof(CMD_SCAN)) == 0) {
+            arg[0] = strtok(NULL, " ");
+            arg[1] = strtok(NULL, " ");
+            arg[2] = strtok(NULL, " ");
+            if (arg[0] == NULL) {
+                unknown_command();
+                break;
+            }
+
+            db_scan(ACI_CMD_SCAN, arg[0], (arg[1] != NULL) ? arg[1] : "",
+                NULL, arg[2]);
+            break;
+        }
+        if (strncmp(p1, CMD_SNAP, sizeof(CMD_SNAP)) == 0) {
+            db_snapshot(strtok(NULL, " "));
+            break;
+        }
+        if (strncmp(p1, CMD_STATS, sizeof(CMD_STATS)) == 0) {
+            db_stats();
+            break;
+        }
+    case 'B':
+        if (strncmp(p1, CMD_BACKUP, sizeof(CMD_BACKUP)) == 0) {
+            arg[0] = strtok(NULL, " ");
+            arg[1] = strtok(NULL, " ");
+            if (arg[0] == NULL || arg[1] == NULL) {
+                unknown_command();
+                break;
+            }
+
+            db_backup(ACI_CMD_BACKUP, arg[0], arg[1]);
+            break;
+        }
+    case 'E':
+        if (strncmp(p1, CMD_EXPORT, sizeof(CMD_EXPORT)) == 0) {
+            arg[0] = strtok(NULL, " ");
+            arg[1] = strtok(NULL, " ");
+            if (arg[0] == NULL || arg[1] == NULL) {
+                unknown_command();
+                break;
+            }
+
+            db_backup(ACI_CMD_EXPORT, arg[0], arg[1]);
+            break;
+        }
+    case 'G':
+        if (strncmp(p1, CMD_GET, sizeof(CMD_GET)) == 0) {
+            arg[0] = strtok(NULL, " ");
+            arg[1] = strtok(NULL, " ");
+            if (arg[0] == NULL || arg[1] == NULL) {
+                unknown_command();
+                break;
+            }
+
+            db_get(arg[0], arg[1]);
+            break;
+        }
+    case 'R':
+        if (strncmp(p1, CMD_RANGE, sizeof(CMD_RANGE)) == 0) {
+            for (int i = 0; i < 4; ++i) {
+                arg[i] = strtok(NULL, " ");
+            }
+            if (arg[0] == NULL || arg[1] == NULL || arg[2] == NULL) {
+                unknown_command();
+                break;
+            }
+
+            db_scan(ACI_CMD_RANGE, arg[0], arg[1], arg[2], arg[3]);
+            break;
+        }
+    case 'U':
+        if (strncmp(p1, CMD_UPLOAD, sizeof(CMD_UPLOAD)) == 0) {
+            arg[0] = strtok(NULL, " ");
+            arg[1] = strtok(NULL, " ");
+            arg[2] = strtok(NULL, " ");
+            if (arg[0] == NULL || arg[1] == NULL || arg[2] == NULL) {
+                unknown_command();
+                break;
+            }
+
+            db_upload(arg[0], arg[1], arg[2]);
+            break;
+        }
+    case 'A':
+        if (strncmp(p1, CMD_AGG, sizeof(CMD_AGG)) == 0) {
+            arg[0] = strtok(NULL, " ");
+            arg[1] = strtok(NULL, " ");
+            arg[2] = strtok(NULL, " ");
+            if (arg[0] == NULL || arg[1] == NULL) {
+                unknown_command();
+                break;
+            }
+
+            db_aggregate(arg[0], arg[1], arg[2]);
+            break;
+        }
+        if (strncmp(p1, CMD_APPEND, sizeof(CMD_APPEND)) == 0) {
+            arg[0] = strtok(NULL, " ");
+            arg[1] = strtok(NULL, " ");
+            arg[2] = strtok(NULL, "");
+            if (arg[0] == NULL || arg[1] == NULL || arg[2] == NULL) {
+                unknown_command();
+                break;
+            }
+
+            db_append(arg[0], arg[1], arg[2]);
+            break;
+        }
+    case 'W':
+        if (strncmp(p1, CMD_WATCH, sizeof(CMD_WATCH)) == 0) {
+            arg[0] = strtok(NULL, " ");
+            arg[1] = strtok(NULL, " ");
+            if (arg[0] == NULL) {
+                unknown_command();
+                break;
+            }
+
+            db_watch(arg[0], arg[1]);
+            break;
+        }
+    case 'I':
+    case 'D':
+        if (strncmp(p1, CMD_INCR, sizeof(CMD_INCR)) == 0 ||
+            strncmp(p1, CMD_DECR, sizeof(CMD_DECR)) == 0) {
+            arg[0] = strtok(NULL, " ");
+            arg[1] = strtok(NULL, " ");
+            arg[2] = strtok(NULL, " ");
+            if (arg[0] == NULL || arg[1] == NULL) {
+                unknown_command();
+                break;
+            }
+
+            db_incr(arg[0], arg[1], arg[2], *p1 == 'D');
             break;
         }
     default:
@@ -321,7 +1984,10 @@ parse_input(const char *buffer)
         printf("%s\n", CLIENT_VERSION);
         break;
     case LINK_PREFIX:
-        printf("ipc link @ %s\n", IPC_PATH);
+        for (size_t i = 0; i < shards->count; ++i) {
+            printf("ipc link @ %s [%s]\n", shards->paths[i],
+                (shards->links[i]->shm != NULL) ? "shm" : "socket");
+        }
         break;
     case QUIT_PREFIX:
         exit(0);
@@ -337,43 +2003,168 @@ parse_input(const char *buffer)
     }
 }
 
+/*
+ * Returns true if a line of a script is a command
+ * whose reply can be taken later
+ */
+static int
+script_async(const char *input)
+{
+    static const char *cmds[] = {
+        CMD_STORE, CMD_GET, CMD_CREATE, CMD_NOP,
+        CMD_INCR, CMD_DECR, CMD_APPEND, CMD_CAS
+    };
+    size_t len;
+
+    if (input[0] != COMMAND_PREFIX || input[1] != '.') {
+        return 0;
+    }
+
+    input += PREFIX_LEN;
+    for (size_t i = 0; i < sizeof(cmds) / sizeof(cmds[0]); ++i) {
+        len = strlen(cmds[i]);
+        if (strncmp(input, cmds[i], len) == 0 &&
+            (input[len] == ' ' || input[len] == '\0'))
+            return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Wait until every shard has handled everything sent
+ * to it, including commands that get no reply
+ */
+static void
+script_sync(void)
+{
+    struct aci_stats stats;
+    int dmmy = 0;
+
+    for (size_t i = 0; i < shards->count; ++i) {
+        aci_send(shards->links[i], ACI_CMD_STATS, ACI_TYPE_NONE, &dmmy, 0);
+    }
+
+    for (size_t i = 0; i < shards->count; ++i) {
+        aci_link_recv(shards->links[i], &stats, sizeof(stats));
+    }
+}
+
+/*
+ * Run the commands of a script. Stores, gets and
+ * creates go out without waiting for the commands
+ * before them, up to the in-flight window; anything
+ * else waits for them first. Results are printed with
+ * the line they came from.
+ *
+ * Returns the number of commands that failed
+ */
+static size_t
+script_run(FILE *fp)
+{
+    struct timespec start, end;
+    char buf[INPUT_MAX];
+    size_t count = 0;
+    double secs;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+        ++script_line;
+        buf[strcspn(buf, "\n")] = '\0';
+        if (buf[0] == '\0' || buf[0] == '#') {
+            continue;
+        }
+
+        if (strcmp(buf, "q.") == 0) {
+            break;
+        }
+
+        if (!script_async(buf)) {
+            script_drain();
+            printf("[%zu]\n", script_line);
+        }
+
+        cmd_error = 0;
+        parse_input(buf);
+        if (cmd_error) {
+            printf("[%zu] failed\n", script_line);
+            ++script_failed;
+        }
+
+        ++count;
+    }
+
+    script_drain();
+    script_sync();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    secs = (end.tv_sec - start.tv_sec) +
+        (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("[*] %zu commands, %zu failed in %.3f s [%.0f ops/sec]\n",
+        count, script_failed, secs, (secs > 0) ? count / secs : 0.0);
+    return script_failed;
+}
+
 int
-main(void)
+main(int argc, char **argv)
 {
-    struct sockaddr_un un;
-    char buf[256];
-    int error;
+    const char *path = IPC_PATH, *script = NULL;
+    uint32_t link_flags = 0;
+    char buf[INPUT_MAX];
+    FILE *fp;
+    int opt;
 
-    if (access(IPC_PATH, F_OK) != 0) {
-        printf("fatal: did not find IPC channel\n");
-        printf("[?]: Is the daemon running?\n");
-        return -1;
+    while ((opt = getopt(argc, argv, "sp:f:w:")) != -1) {
+        switch (opt) {
+        case 's':
+            link_flags |= ACI_LINK_SHM;
+            break;
+        case 'p':
+            path = optarg;
+            break;
+        case 'f':
+            script = optarg;
+            break;
+        case 'w':
+            script_window = strtoul(optarg, NULL, 10);
+            if (script_window > 0)
+                break;
+            /* Fallthrough */
+        default:
+            printf("usage: %s [-s] [-p sock[%ssock...]] [-f script|-] "
+                "[-w window]\n", argv[0], ACI_SHARD_SEP);
+            return -1;
+        }
     }
 
     atexit(exit_hook);
     signal(SIGINT, sig_hook);
 
-    memset(&un, 0, sizeof(un));
-    un.sun_family = AF_UNIX;
-    memcpy(un.sun_path, IPC_PATH, sizeof(IPC_PATH));
-
-    /* Create the server-side socket */
-    ssockfd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (ssockfd < 0) {
-        perror("sockfd");
+    /* Drums are sharded over every daemon listed */
+    if (aci_shards_open(path, link_flags, &shards) < 0) {
+        printf("fatal: could not reach every IPC channel\n");
+        printf("[?]: Is the daemon running?\n");
         return -1;
     }
 
-    /* Connect to the IPC channel */
-    error = connect(
-        ssockfd,
-        (struct sockaddr *)&un,
-        sizeof(un)
-    );
+    if ((link_flags & ACI_LINK_SHM) && shards->links[0]->shm == NULL) {
+        printf("[?]: daemon refused shared memory, using socket\n");
+    }
 
-    if (error < 0) {
-        perror("connect");
-        return -1;
+    /* Run a script instead of prompting */
+    if (script != NULL) {
+        fp = (strcmp(script, "-") == 0) ? stdin : fopen(script, "r");
+        if (fp == NULL) {
+            perror(script);
+            return -1;
+        }
+
+        script_ops = calloc(script_window, sizeof(*script_ops));
+        if (script_ops == NULL) {
+            return -1;
+        }
+
+        return (script_run(fp) > 0) ? 1 : 0;
     }
 
     printf("-- odb client %s --\n", CLIENT_VERSION);
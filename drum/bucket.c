@@ -50,19 +50,24 @@ drum_bucket_init(const char *name, const void *data, size_t len,
     }
 
     name_len = strlen(name);
-    if (name_len >= DRUM_KEYLEN_MAX - 1) {
+    if (name_len > DRUM_KEYLEN_MAX) {
         errno = -ENAMETOOLONG;
         return -1;
     }
 
-    bucket = malloc(sizeof(*bucket) + len);
+    bucket = malloc(sizeof(*bucket) + name_len + len);
     if (bucket == NULL) {
         errno = -ENOMEM;
         return -1;
     }
 
-    memcpy(bucket->name, name, name_len);
     bucket->record_len = len;
-    memcpy(bucket->data,  data, len);
+    bucket->type = 0;
+    bucket->expire = 0;
+    bucket->seq = 0;
+    bucket->key_len = name_len;
+    memcpy(bucket->data, name, name_len);
+    memcpy(bucket->data + name_len, data, len);
+    *res = bucket;
     return 0;
 }
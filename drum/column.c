@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include "aci/datatype.h"
+#include "drum/column.h"
+#include "drum/index.h"
+
+#define COLUMN_MIN_CAP 64
+
+/*
+ * Vector of four integers, lowered by the compiler to
+ * whatever SIMD registers the target has.
+ */
+typedef int64_t vec_i64 __attribute__((vector_size(4 * sizeof(int64_t))));
+#define VEC_LANES (sizeof(vec_i64) / sizeof(int64_t))
+
+/* Unaligned load of VEC_LANES values */
+#define vec_load(v, p) memcpy(&(v), (p), sizeof(vec_i64))
+
+static inline int
+bit_test(const uint64_t *bits, size_t i)
+{
+    return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+static inline void
+bit_assign(uint64_t *bits, size_t i, int val)
+{
+    if (val) {
+        bits[i / 64] |= 1ULL << (i % 64);
+    } else {
+        bits[i / 64] &= ~(1ULL << (i % 64));
+    }
+}
+
+/*
+ * Make room for one more value
+ */
+static int
+column_grow(struct drum_column *col)
+{
+    struct drum_index_ent **owners;
+    size_t cap, words;
+    void *p;
+
+    if (col->count < col->cap) {
+        return 0;
+    }
+
+    cap = (col->cap == 0) ? COLUMN_MIN_CAP : col->cap * 2;
+    owners = realloc(col->owners, cap * sizeof(*owners));
+    if (owners == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+    col->owners = owners;
+
+    if (col->type == ACI_TYPE_BOOL) {
+        words = cap / 64;
+        if ((p = realloc(col->bits, words * sizeof(uint64_t))) == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        col->bits = p;
+        memset(&col->bits[col->cap / 64], 0,
+            (words - col->cap / 64) * sizeof(uint64_t));
+    } else {
+        if ((p = realloc(col->ints, cap * sizeof(int64_t))) == NULL) {
+            errno = -ENOMEM;
+            return -1;
+        }
+        col->ints = p;
+    }
+
+    col->cap = cap;
+    return 0;
+}
+
+int
+drum_column_set(struct drum_column *col, struct drum_index_ent *ent,
+    const void *value)
+{
+    uint32_t slot;
+    int64_t ival;
+
+    if (col == NULL || ent == NULL || value == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    slot = ent->slot;
+    if (slot == DRUM_SLOT_NONE) {
+        if (column_grow(col) < 0) {
+            return -1;
+        }
+
+        slot = col->count++;
+        col->owners[slot] = ent;
+        ent->slot = slot;
+    }
+
+    if (col->type == ACI_TYPE_BOOL) {
+        bit_assign(col->bits, slot, *(const uint8_t *)value != 0);
+    } else {
+        memcpy(&ival, value, sizeof(ival));
+        col->ints[slot] = ival;
+    }
+
+    return 0;
+}
+
+int
+drum_column_get(const struct drum_column *col,
+    const struct drum_index_ent *ent, void *value)
+{
+    uint8_t bval;
+
+    if (col == NULL || ent == NULL || value == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (ent->slot == DRUM_SLOT_NONE || ent->slot >= col->count) {
+        errno = -ENOENT;
+        return -1;
+    }
+
+    if (col->type == ACI_TYPE_BOOL) {
+        bval = bit_test(col->bits, ent->slot);
+        memcpy(value, &bval, sizeof(bval));
+    } else {
+        memcpy(value, &col->ints[ent->slot], sizeof(int64_t));
+    }
+
+    return 0;
+}
+
+void
+drum_column_remove(struct drum_column *col, struct drum_index_ent *ent)
+{
+    struct drum_index_ent *moved;
+    uint32_t slot, last;
+
+    if (col == NULL || ent == NULL || ent->slot == DRUM_SLOT_NONE) {
+        return;
+    }
+
+    slot = ent->slot;
+    last = col->count - 1;
+    if (slot != last) {
+        moved = col->owners[last];
+        if (col->type == ACI_TYPE_BOOL) {
+            bit_assign(col->bits, slot, bit_test(col->bits, last));
+        } else {
+            col->ints[slot] = col->ints[last];
+        }
+
+        col->owners[slot] = moved;
+        moved->slot = slot;
+    }
+
+    if (col->type == ACI_TYPE_BOOL) {
+        bit_assign(col->bits, last, 0);
+    }
+
+    ent->slot = DRUM_SLOT_NONE;
+    --col->count;
+}
+
+/*
+ * Count the set bits of a bool column; bits past
+ * the end of the column are always clear.
+ */
+static uint64_t
+column_popcount(const struct drum_column *col)
+{
+    uint64_t total = 0;
+    size_t words;
+
+    words = (col->count + 63) / 64;
+    for (size_t i = 0; i < words; ++i) {
+        total += __builtin_popcountll(col->bits[i]);
+    }
+
+    return total;
+}
+
+void
+drum_column_sum(const struct drum_column *col, struct drum_agg *res)
+{
+    vec_i64 acc0 = {0}, acc1 = {0}, v0, v1;
+    const int64_t *p = col->ints;
+    size_t i = 0, n = col->count;
+    int64_t sum = 0;
+
+    res->count = n;
+    if (col->type == ACI_TYPE_BOOL) {
+        res->value = column_popcount(col);
+        return;
+    }
+
+    /* Two accumulators to hide the add latency */
+    for (; i + 2 * VEC_LANES <= n; i += 2 * VEC_LANES) {
+        vec_load(v0, &p[i]);
+        vec_load(v1, &p[i + VEC_LANES]);
+        acc0 += v0;
+        acc1 += v1;
+    }
+
+    acc0 += acc1;
+    for (size_t j = 0; j < VEC_LANES; ++j) {
+        sum += acc0[j];
+    }
+
+    for (; i < n; ++i) {
+        sum += p[i];
+    }
+
+    res->value = sum;
+}
+
+void
+drum_column_min(const struct drum_column *col, struct drum_agg *res)
+{
+    const int64_t *p = col->ints;
+    size_t i = 0, n = col->count;
+    vec_i64 m, v, mask;
+    int64_t min;
+
+    res->count = n;
+    res->value = 0;
+    if (n == 0) {
+        return;
+    }
+
+    if (col->type == ACI_TYPE_BOOL) {
+        res->value = (column_popcount(col) == n);
+        return;
+    }
+
+    min = p[0];
+    if (n >= VEC_LANES) {
+        vec_load(m, p);
+        for (i = VEC_LANES; i + VEC_LANES <= n; i += VEC_LANES) {
+            vec_load(v, &p[i]);
+            mask = v < m;
+            m = (v & mask) | (m & ~mask);
+        }
+
+        for (size_t j = 0; j < VEC_LANES; ++j) {
+            min = (m[j] < min) ? m[j] : min;
+        }
+    }
+
+    for (; i < n; ++i) {
+        min = (p[i] < min) ? p[i] : min;
+    }
+
+    res->value = min;
+}
+
+void
+drum_column_max(const struct drum_column *col, struct drum_agg *res)
+{
+    const int64_t *p = col->ints;
+    size_t i = 0, n = col->count;
+    vec_i64 m, v, mask;
+    int64_t max;
+
+    res->count = n;
+    res->value = 0;
+    if (n == 0) {
+        return;
+    }
+
+    if (col->type == ACI_TYPE_BOOL) {
+        res->value = (column_popcount(col) > 0);
+        return;
+    }
+
+    max = p[0];
+    if (n >= VEC_LANES) {
+        vec_load(m, p);
+        for (i = VEC_LANES; i + VEC_LANES <= n; i += VEC_LANES) {
+            vec_load(v, &p[i]);
+            mask = v > m;
+            m = (v & mask) | (m & ~mask);
+        }
+
+        for (size_t j = 0; j < VEC_LANES; ++j) {
+            max = (m[j] > max) ? m[j] : max;
+        }
+    }
+
+    for (; i < n; ++i) {
+        max = (p[i] > max) ? p[i] : max;
+    }
+
+    res->value = max;
+}
+
+void
+drum_column_free(struct drum_column *col)
+{
+    if (col == NULL) {
+        return;
+    }
+
+    if (col->type == ACI_TYPE_BOOL) {
+        free(col->bits);
+    } else {
+        free(col->ints);
+    }
+
+    free(col->owners);
+    col->ints = NULL;
+    col->owners = NULL;
+    col->count = 0;
+    col->cap = 0;
+}
@@ -0,0 +1,1774 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <sys/stat.h>
+#include <time.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "aci/datatype.h"
+#include "drum/drum.h"
+#include "drum/bucket.h"
+#include "drum/epoch.h"
+#include "drum/index.h"
+#include "drum/pool.h"
+
+#define SEG_MODE 0600
+
+/* Round an offset to a DRUM_DIO_ALIGN block */
+#define DIO_DOWN(off) ((off) & ~(off_t)(DRUM_DIO_ALIGN - 1))
+#define DIO_UP(off) DIO_DOWN((off) + DRUM_DIO_ALIGN - 1)
+
+/*
+ * Returns a copy of a descriptor table with room for
+ * one more, or NULL if out of memory
+ */
+static int *
+drum_seg_grow(const int *old, uint32_t count, int fd)
+{
+    int *segs;
+
+    if ((segs = malloc(sizeof(int) * (count + 1))) == NULL) {
+        errno = -ENOMEM;
+        return NULL;
+    }
+
+    if (count > 0) {
+        memcpy(segs, old, sizeof(int) * count);
+    }
+
+    segs[count] = fd;
+    return segs;
+}
+
+/*
+ * Append a segment descriptor to the drum, and its
+ * O_DIRECT twin if it has one. The tables are copied
+ * rather than grown in place, since readers may be
+ * looking at the old ones.
+ */
+static int
+drum_seg_push(struct drum *drum, int fd, int dio)
+{
+    int *segs, *dios = NULL, *old, *old_dio;
+    uint32_t count;
+
+    count = drum->seg_count;
+    old = drum->segs;
+    old_dio = drum->dio;
+    if ((segs = drum_seg_grow(old, count, fd)) == NULL) {
+        return -1;
+    }
+
+    if ((drum->flags & DRUM_F_DIRECT) &&
+        (dios = drum_seg_grow(old_dio, count, dio)) == NULL) {
+        free(segs);
+        return -1;
+    }
+
+    atomic_store_explicit(&drum->segs, segs, memory_order_release);
+    if (dios != NULL) {
+        atomic_store_explicit(&drum->dio, dios, memory_order_release);
+        drum_epoch_retire(old_dio, free);
+    }
+
+    atomic_store_explicit(&drum->seg_count, count + 1, memory_order_release);
+    drum_epoch_retire(old, free);
+    return 0;
+}
+
+/*
+ * Open a segment file and add it to the drum, along
+ * with an O_DIRECT descriptor of it for a drum that
+ * has DRUM_F_DIRECT set
+ *
+ * @oflags: Flags to open with besides O_RDWR
+ */
+static int
+drum_seg_add(struct drum *drum, const char *path, int oflags)
+{
+    int fd, dio = -1;
+
+    if ((fd = open(path, O_RDWR | oflags, SEG_MODE)) < 0) {
+        return -1;
+    }
+
+    if (drum->flags & DRUM_F_DIRECT) {
+        dio = open(path, O_RDWR | O_DIRECT);
+
+        /* Filesystems without O_DIRECT leave the drum buffered */
+        if (dio < 0 && errno == EINVAL && drum->seg_count == 0) {
+            drum->flags &= ~DRUM_F_DIRECT;
+        } else if (dio < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    if (drum_seg_push(drum, fd, dio) < 0) {
+        close(fd);
+        if (dio >= 0)
+            close(dio);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Allocate the blocks the active segment is about to
+ * grow into up front, so that appends don't wait on
+ * the filesystem to find room. The size is left as is
+ * and replay still ends at the last bucket written.
+ */
+static void
+drum_seg_reserve(struct drum *drum)
+{
+    int fd;
+
+    fd = drum->segs[drum->seg_count - 1];
+    fallocate(fd, FALLOC_FL_KEEP_SIZE, drum->seg_off, DRUM_SEG_RESERVE);
+    drum->seg_resv = drum->seg_off + DRUM_SEG_RESERVE;
+}
+
+/*
+ * Pick up appending to the active segment once its
+ * write offset was set. A DRUM_F_DIRECT drum brings
+ * the partial block at the offset into 'tail'.
+ */
+static int
+drum_seg_resume(struct drum *drum)
+{
+    ssize_t want;
+    int fd;
+
+    drum->seg_resv = 0;
+    if ((drum->flags & DRUM_F_DIRECT) == 0) {
+        return 0;
+    }
+
+    if (drum->tail == NULL && (drum->tail = drum_pool_get()) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    drum->tail_off = DIO_DOWN(drum->seg_off);
+    want = drum->seg_off - drum->tail_off;
+    fd = drum->dio[drum->seg_count - 1];
+    if (want > 0 && pread(fd, drum->tail, DRUM_DIO_ALIGN,
+            drum->tail_off) < want) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Create a new active segment
+ */
+static int
+drum_seg_create(struct drum *drum)
+{
+    char path[256];
+
+    snprintf(path, sizeof(path), DRUM_SEG_FMT, drum->path, drum->seg_count);
+    if (drum_seg_add(drum, path, O_CREAT | O_EXCL) < 0) {
+        return -1;
+    }
+
+    drum->seg_off = 0;
+    return drum_seg_resume(drum);
+}
+
+/*
+ * Write to the active segment of a DRUM_F_DIRECT drum
+ * at its write offset. The data goes into 'tail' after
+ * the partial block held there and every block it
+ * touches is written out, the rest of the last one
+ * taken up by a DRUM_BUCKET_PEND bucket that replay
+ * skips and the next write covers.
+ */
+static int
+drum_dio_write(struct drum *drum, uint32_t seg, const void *buf, size_t len)
+{
+    const size_t cap = DRUM_POOL_BUFLEN - DRUM_DIO_ALIGN;
+    struct drum_bucket pad;
+    const char *p = buf;
+    size_t pos, n;
+    off_t end;
+    int fd;
+
+    fd = drum->dio[seg];
+    pos = drum->seg_off - drum->tail_off;
+    while (len > 0) {
+        n = (len < cap - pos) ? len : cap - pos;
+        memcpy(drum->tail + pos, p, n);
+        pos += n;
+        p += n;
+        len -= n;
+        if (pos < cap)
+            continue;
+        if (pwrite(fd, drum->tail, cap, drum->tail_off) != cap)
+            goto fail;
+        drum->tail_off += cap;
+        pos = 0;
+    }
+
+    /* The pad needs room for its header */
+    end = DIO_UP(pos);
+    if (end > pos && end - pos < sizeof(pad)) {
+        end += DRUM_DIO_ALIGN;
+    }
+
+    if (end > pos) {
+        memset(&pad, 0, sizeof(pad));
+        pad.type = DRUM_BUCKET_PEND;
+        pad.record_len = end - pos - sizeof(pad);
+        memcpy(drum->tail + pos, &pad, sizeof(pad));
+    }
+
+    if (end > 0 && pwrite(fd, drum->tail, end, drum->tail_off) != end) {
+        goto fail;
+    }
+
+    /* Only the partial block is kept */
+    n = DIO_DOWN(pos);
+    memmove(drum->tail, drum->tail + n, pos - n);
+    drum->tail_off += n;
+    return 0;
+fail:
+    /* What is before the write offset is still on disk */
+    drum_seg_resume(drum);
+    return -1;
+}
+
+/*
+ * Move the write offset of a DRUM_F_DIRECT drum to
+ * 'end', past a span written around 'tail', rounding
+ * it up to a block with a DRUM_BUCKET_PEND bucket in
+ * between so that appends stay block-aligned
+ */
+static int
+drum_dio_skip(struct drum *drum, uint32_t seg, off_t *end)
+{
+    struct drum_bucket pad;
+    off_t to;
+
+    to = DIO_UP(*end);
+    if (to > *end && to - *end < sizeof(pad)) {
+        to += DRUM_DIO_ALIGN;
+    }
+
+    if (to > *end) {
+        memset(&pad, 0, sizeof(pad));
+        pad.type = DRUM_BUCKET_PEND;
+        pad.record_len = to - *end - sizeof(pad);
+        if (pwrite(drum->segs[seg], &pad, sizeof(pad), *end) != sizeof(pad))
+            return -1;
+    }
+
+    drum->tail_off = to;
+    *end = to;
+    return 0;
+}
+
+/*
+ * Write to the active segment at its write offset
+ */
+static int
+drum_seg_write(struct drum *drum, uint32_t seg, const void *buf, size_t len)
+{
+    if (drum->flags & DRUM_F_DIRECT) {
+        return drum_dio_write(drum, seg, buf, len);
+    }
+
+    if (pwrite(drum->segs[seg], buf, len, drum->seg_off) != len) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Returns the size the bucket an entry points at
+ * takes up on disk
+ */
+static size_t
+drum_ent_size(const struct drum_index_ent *ent)
+{
+    return sizeof(struct drum_bucket) + ent->keylen + ent->len;
+}
+
+struct drum_column *
+drum_column_of(struct drum *drum, uint8_t type)
+{
+    if (drum == NULL || !(drum->flags & DRUM_F_COLUMNAR)) {
+        return NULL;
+    }
+
+    switch (type) {
+    case ACI_TYPE_INTEGER:
+        return &drum->ints;
+    case ACI_TYPE_BOOL:
+        return &drum->bools;
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns the size a value of 'type' must have to be
+ * kept in a column
+ */
+static size_t
+drum_column_size(uint8_t type)
+{
+    switch (type) {
+    case ACI_TYPE_INTEGER:
+        return sizeof(int64_t);
+    case ACI_TYPE_BOOL:
+        return sizeof(uint8_t);
+    }
+
+    return 0;
+}
+
+/*
+ * Keep the columns of a drum in sync with the value
+ * an index entry now refers to
+ */
+static int
+drum_column_track(struct drum *drum, struct drum_index_ent *ent, uint8_t type,
+    const void *data, size_t len)
+{
+    struct drum_column *col;
+
+    /* Drop the old value if it can't be updated in place */
+    col = drum_column_of(drum, ent->type);
+    if (col != NULL && (ent->type != type || len != drum_column_size(type))) {
+        drum_column_remove(col, ent);
+    }
+
+    ent->type = type;
+    col = drum_column_of(drum, type);
+    if (col == NULL || len != drum_column_size(type)) {
+        return 0;
+    }
+
+    return drum_column_set(col, ent, data);
+}
+
+/*
+ * Set the expiry time of an entry, rearming its timer
+ */
+static void
+drum_expire_set(struct drum *drum, struct drum_index_ent *ent, uint64_t expire)
+{
+    drum_wheel_del(&drum->wheel, &ent->timer);
+    ent->expire = expire;
+    if (expire != 0) {
+        drum_wheel_add(&drum->wheel, &ent->timer, expire);
+    }
+}
+
+/*
+ * Keep the version an entry is about to lose to a new
+ * store, for the snapshots that can still see it. Must
+ * be called within a write to the entry.
+ */
+static int
+drum_version_push(struct drum *drum, struct drum_index_ent *ent)
+{
+    struct drum_version *v;
+
+    if ((v = malloc(sizeof(*v))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    v->seq = ent->seq;
+    v->seg = ent->seg;
+    v->off = ent->off;
+    v->len = ent->len;
+    v->type = ent->type;
+    v->older = ent->older;
+    if (ent->older == NULL) {
+        LIST_INSERT_HEAD(&drum->versioned, ent, vlink);
+    }
+
+    ent->older = v;
+    return 0;
+}
+
+/*
+ * Retire the chain of older versions of an entry
+ */
+static void
+drum_version_drop(struct drum_index_ent *ent)
+{
+    struct drum_version *v, *older;
+
+    if ((v = ent->older) == NULL) {
+        return;
+    }
+
+    drum_index_write_begin(ent);
+    ent->older = NULL;
+    drum_index_write_end(ent);
+    for (; v != NULL; v = older) {
+        older = v->older;
+        drum_epoch_retire(v, free);
+    }
+
+    LIST_REMOVE(ent, vlink);
+}
+
+/*
+ * Read the settings of a drum, if it has any
+ */
+static void
+drum_meta_read(struct drum *drum)
+{
+    struct drum_meta meta;
+    char path[256];
+    int fd;
+
+    drum->flags = 0;
+    snprintf(path, sizeof(path), DRUM_META_FMT, drum->path);
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return;
+    }
+
+    if (read(fd, &meta, sizeof(meta)) == sizeof(meta)) {
+        if (meta.magic == DRUM_META_MAGIC)
+            drum->flags = meta.flags;
+    }
+
+    close(fd);
+}
+
+int
+drum_init(const char *path, uint32_t flags)
+{
+    struct drum_meta meta;
+    char meta_path[256];
+    int fd;
+
+    if (path == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    meta.magic = DRUM_META_MAGIC;
+    meta.flags = flags;
+    snprintf(meta_path, sizeof(meta_path), DRUM_META_FMT, path);
+    fd = open(meta_path, O_WRONLY | O_CREAT | O_TRUNC, SEG_MODE);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (write(fd, &meta, sizeof(meta)) != sizeof(meta)) {
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+    return 0;
+}
+
+/*
+ * Point the index at a bucket that was just written
+ * to 'seg' with its data at 'off'. 'data' is only
+ * looked at for values that belong in a column.
+ */
+static int
+drum_link(struct drum *drum, const struct drum_bucket *hdr, const char *key,
+    uint32_t seg, off_t off, const void *data)
+{
+    struct drum_index_ent *ent;
+    struct drum_version v;
+    int added, error = 0;
+
+    v.seq = hdr->seq;
+    v.seg = seg;
+    v.off = off;
+    v.len = hdr->record_len;
+    v.type = hdr->type;
+    ent = drum_index_insert(drum->index, key, &v, &added);
+    if (ent == NULL) {
+        return -1;
+    }
+
+    /* Readers see the old version or the new one, never a mix */
+    if (!added) {
+        drum_index_write_begin(ent);
+
+        /* A snapshot may still need the version being replaced */
+        if (drum_snap_count() > 0 && drum_snap_needs(ent->seq, v.seq)) {
+            error = drum_version_push(drum, ent);
+        }
+
+        if (error == 0) {
+            drum->live -= drum_ent_size(ent);
+            ent->seq = v.seq;
+            ent->seg = v.seg;
+            ent->off = v.off;
+            ent->len = v.len;
+        }
+    }
+
+    if (error == 0) {
+        error = drum_column_track(drum, ent, v.type, data, v.len);
+    }
+
+    if (!added) {
+        drum_index_write_end(ent);
+    }
+
+    if (error < 0) {
+        return -1;
+    }
+
+    drum->live += drum_ent_size(ent);
+    drum_expire_set(drum, ent, hdr->expire);
+    return 0;
+}
+
+/*
+ * Walk the buckets of a segment and add each of them
+ * to the index. Returns the offset at which the last
+ * complete bucket ends.
+ */
+static off_t
+drum_seg_replay(struct drum *drum, uint32_t seg)
+{
+    char buf[sizeof(struct drum_bucket) + DRUM_KEYLEN_MAX + sizeof(int64_t)];
+    char key[DRUM_KEYLEN_MAX + 1];
+    struct drum_index_ent *ent;
+    struct drum_bucket *hdr;
+    struct stat st;
+    uint64_t now, seq = 0;
+    off_t off = 0, size;
+    ssize_t n;
+    int fd;
+
+    now = drum_clock();
+    fd = drum->segs[seg];
+    if (fstat(fd, &st) < 0) {
+        return -1;
+    }
+
+    /* One read brings in the header, the key and any column value */
+    hdr = (struct drum_bucket *)buf;
+    for (;; off += size) {
+        n = pread(fd, buf, sizeof(buf), off);
+        if (n < (ssize_t)sizeof(*hdr)) {
+            break;
+        }
+
+        /* Torn tail from an interrupted write */
+        size = DRUM_BUCKET_SIZE(hdr);
+        if (off + size > st.st_size) {
+            break;
+        }
+
+        /* Numbers the buckets that follow it */
+        if (hdr->type == DRUM_BUCKET_SEQ) {
+            seq = hdr->seq;
+            drum_seq_observe(seq);
+            continue;
+        }
+
+        /* Upload that was never committed */
+        if (hdr->type == DRUM_BUCKET_PEND) {
+            continue;
+        }
+
+        if (hdr->seq == 0) {
+            hdr->seq = seq;
+        }
+
+        memcpy(key, hdr->data, hdr->key_len);
+        key[hdr->key_len] = '\0';
+
+        /* Upload committed after a later store was appended */
+        ent = drum_index_lookup(drum->index, key);
+        if (ent != NULL && ent->seq > hdr->seq) {
+            continue;
+        }
+
+        /* Expired while we were down, drop any older version */
+        if (hdr->expire != 0 && hdr->expire <= now) {
+            if (ent != NULL)
+                drum_remove(drum, ent);
+            continue;
+        }
+
+        drum_seq_observe(hdr->seq);
+        if (drum_link(drum, hdr, key, seg, off + size - hdr->record_len,
+                hdr->data + hdr->key_len) < 0) {
+            return -1;
+        }
+    }
+
+    return off;
+}
+
+/*
+ * Set up the in-memory state of a drum about to have
+ * its segments opened
+ */
+static int
+drum_open_init(struct drum *drum)
+{
+    if (drum_index_init(&drum->index) < 0) {
+        return -1;
+    }
+
+    drum_meta_read(drum);
+    memset(&drum->ints, 0, sizeof(drum->ints));
+    memset(&drum->bools, 0, sizeof(drum->bools));
+    drum->ints.type = ACI_TYPE_INTEGER;
+    drum->bools.type = ACI_TYPE_BOOL;
+    drum_wheel_init(&drum->wheel, drum_clock());
+    LIST_INIT(&drum->versioned);
+
+    drum->segs = NULL;
+    drum->seg_count = 0;
+    drum->dio = NULL;
+    drum->tail = NULL;
+    drum->tail_off = 0;
+    drum->seg_resv = 0;
+    drum->live = 0;
+    drum->disk = 0;
+    drum->uploads = 0;
+    drum->seg_tail = 0;
+    drum->compact_off = 0;
+    return 0;
+}
+
+/*
+ * Put segments that lie past a gap back in the stage
+ * of the drum. Only an adopt cut short leaves them,
+ * having renamed its last segments in before the first,
+ * so staged segment 'i' sits at the gap plus 'i'. Left
+ * in place they would stop the drum from rotating into
+ * their numbers. Segments that can't go back are
+ * removed, the stage is incomplete without them anyway.
+ */
+static void
+drum_seg_unstage(struct drum *drum)
+{
+    char stage[256], from[256], to[320];
+    const char *name;
+    struct dirent *dirent;
+    unsigned int n;
+    char *parent, end;
+    DIR *dir;
+
+    /* The stage sits next to the drum directory */
+    if ((name = strrchr(drum->path, '/')) == NULL) {
+        parent = strdup(".");
+        name = drum->path;
+    } else {
+        parent = strndup(drum->path, name++ - drum->path);
+    }
+
+    if (parent == NULL) {
+        return;
+    }
+
+    snprintf(stage, sizeof(stage), DRUM_STAGE_FMT, parent, name);
+    free(parent);
+    if ((dir = opendir(drum->path)) == NULL) {
+        return;
+    }
+
+    while ((dirent = readdir(dir)) != NULL) {
+        if (sscanf(dirent->d_name, "%u.se%c", &n, &end) != 2 ||
+            end != 'g' || n <= drum->seg_count) {
+            continue;
+        }
+
+        snprintf(from, sizeof(from), DRUM_SEG_FMT, drum->path, n);
+        snprintf(to, sizeof(to), DRUM_SEG_FMT, stage, n - drum->seg_count);
+        mkdir(stage, 0700);
+        if (rename(from, to) < 0) {
+            unlink(from);
+        }
+    }
+
+    closedir(dir);
+}
+
+int
+drum_open(struct drum *drum)
+{
+    char path[256];
+    off_t off = 0;
+    int fd;
+
+    if (drum == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (drum_open_init(drum) < 0) {
+        return -1;
+    }
+
+    for (;;) {
+        snprintf(path, sizeof(path), DRUM_SEG_FMT, drum->path, drum->seg_count);
+        if (access(path, F_OK) < 0) {
+            break;
+        }
+
+        if (drum_seg_add(drum, path, 0) < 0) {
+            return -1;
+        }
+
+        off = drum_seg_replay(drum, drum->seg_count - 1);
+        if (off < 0) {
+            return -1;
+        }
+
+        /* Replay is the only reader that goes through the cache */
+        fd = drum->segs[drum->seg_count - 1];
+        if (drum->flags & DRUM_F_DIRECT) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+
+        /* Skip over segments compaction emptied */
+        if (off == 0 && drum->seg_tail == drum->seg_count - 1) {
+            ++drum->seg_tail;
+        }
+
+        drum->disk += off;
+    }
+
+    drum_seg_unstage(drum);
+    if (drum->seg_count == 0) {
+        return drum_seg_create(drum);
+    }
+
+    if (drum->seg_tail >= drum->seg_count) {
+        drum->seg_tail = drum->seg_count - 1;
+    }
+
+    /* Drop any torn tail so new appends line up */
+    drum->seg_off = off;
+    ftruncate(drum->segs[drum->seg_count - 1], off);
+    return drum_seg_resume(drum);
+}
+
+/*
+ * Output of drum_image_write(), gathered into large
+ * writes
+ *
+ * @fd: File being written
+ * @len: Bytes waiting in 'data'
+ * @total: Bytes written or waiting
+ * @error: Set once a write failed
+ */
+struct drum_image_out {
+    int fd;
+    size_t len;
+    size_t total;
+    int error;
+    char data[64 * 1024];
+};
+
+static void
+drum_image_flush(struct drum_image_out *out)
+{
+    if (out->len > 0 && !out->error &&
+        write(out->fd, out->data, out->len) != out->len) {
+        out->error = 1;
+    }
+
+    out->len = 0;
+}
+
+static void
+drum_image_put(struct drum_image_out *out, const void *buf, size_t len)
+{
+    if (out->len + len > sizeof(out->data)) {
+        drum_image_flush(out);
+    }
+
+    memcpy(out->data + out->len, buf, len);
+    out->len += len;
+    out->total += len;
+}
+
+ssize_t
+drum_image_write(struct drum *drum, int fd)
+{
+    char value[sizeof(int64_t)];
+    struct drum_image_out *out;
+    struct drum_image_ent rec;
+    struct drum_index_ent *ent;
+    struct drum_image img;
+    struct drum_column *col;
+    struct stat st;
+    char key[DRUM_KEYLEN_MAX + 1];
+    uint64_t size;
+    off_t start;
+
+    if (drum == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((start = lseek(fd, 0, SEEK_CUR)) < 0) {
+        return -1;
+    }
+
+    if ((out = malloc(sizeof(*out))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    memset(&img, 0, sizeof(img));
+    img.magic = DRUM_IMAGE_MAGIC;
+    memcpy(img.name, drum->name, DRUM_NAMELEN);
+    img.seq = drum_seq_last();
+    img.seg_count = drum->seg_count;
+    img.seg_tail = drum->seg_tail;
+    img.nents = drum->index->count;
+
+    out->fd = fd;
+    out->len = 0;
+    out->total = 0;
+    out->error = 0;
+    drum_image_put(out, &img, sizeof(img));
+    for (uint32_t i = 0; i < drum->seg_count; ++i) {
+        if (fstat(drum->segs[i], &st) < 0) {
+            out->error = 1;
+            break;
+        }
+
+        size = st.st_size;
+        drum_image_put(out, &size, sizeof(size));
+    }
+
+    ent = drum_index_next(drum->index->head);
+    for (; ent != NULL && !out->error; ent = drum_index_next(ent)) {
+        rec.seq = ent->seq;
+        rec.expire = ent->expire;
+        rec.off = ent->off;
+        rec.len = ent->len;
+        rec.seg = ent->seg;
+        rec.type = ent->type;
+        rec.keylen = drum_index_key(ent, key);
+        drum_image_put(out, &rec, sizeof(rec));
+        drum_image_put(out, key, rec.keylen);
+
+        /* Columns are rebuilt without going back to the segments */
+        col = drum_column_of(drum, ent->type);
+        if (col != NULL && ent->len == drum_column_size(ent->type)) {
+            drum_column_get(col, ent, value);
+            drum_image_put(out, value, ent->len);
+        }
+    }
+
+    drum_image_flush(out);
+    img.size = out->total;
+    if (out->error || pwrite(fd, &img, sizeof(img), start) != sizeof(img)) {
+        free(out);
+        return -1;
+    }
+
+    free(out);
+    return img.size;
+}
+
+const struct drum_image *
+drum_image_find(const void *buf, size_t len, const char *name)
+{
+    const struct drum_image *img;
+    size_t off = 0;
+
+    if (buf == NULL || name == NULL) {
+        return NULL;
+    }
+
+    while (len - off >= sizeof(*img)) {
+        img = (const struct drum_image *)((const char *)buf + off);
+        if (img->magic != DRUM_IMAGE_MAGIC || img->size < sizeof(*img) ||
+            img->size > len - off) {
+            return NULL;
+        }
+
+        if (strncmp(img->name, name, DRUM_NAMELEN) == 0) {
+            return img;
+        }
+
+        off += img->size;
+    }
+
+    return NULL;
+}
+
+int
+drum_image_open(struct drum *drum, const struct drum_image *img)
+{
+    const struct drum_image_ent *rec;
+    const uint64_t *sizes;
+    struct drum_bucket hdr;
+    const char *p, *end;
+    char key[DRUM_KEYLEN_MAX + 1];
+    char path[256];
+    struct stat st;
+    int fd;
+
+    if (drum == NULL || img == NULL || img->seg_count == 0) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (drum_open_init(drum) < 0) {
+        return -1;
+    }
+
+    /* Anything stored since would be missing from the index */
+    sizes = (const uint64_t *)(img + 1);
+    p = (const char *)(sizes + img->seg_count);
+    end = (const char *)img + img->size;
+    for (uint32_t i = 0; i < img->seg_count; ++i) {
+        snprintf(path, sizeof(path), DRUM_SEG_FMT, drum->path, i);
+        if (drum_seg_add(drum, path, 0) < 0) {
+            goto fail;
+        }
+
+        fd = drum->segs[i];
+        if (fstat(fd, &st) < 0 || st.st_size != sizes[i]) {
+            errno = -ESTALE;
+            goto fail;
+        }
+
+        drum->disk += sizes[i];
+    }
+
+    snprintf(path, sizeof(path), DRUM_SEG_FMT, drum->path, img->seg_count);
+    if (access(path, F_OK) == 0) {
+        errno = -ESTALE;
+        goto fail;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    for (uint64_t i = 0; i < img->nents; ++i) {
+        rec = (const struct drum_image_ent *)p;
+        if (p + sizeof(*rec) > end || p + sizeof(*rec) + rec->keylen > end ||
+            rec->seg >= img->seg_count) {
+            errno = -EINVAL;
+            goto fail;
+        }
+
+        hdr.record_len = rec->len;
+        hdr.type = rec->type;
+        hdr.expire = rec->expire;
+        hdr.seq = rec->seq;
+        hdr.key_len = rec->keylen;
+        memcpy(key, rec->data, rec->keylen);
+        key[rec->keylen] = '\0';
+        p += sizeof(*rec) + rec->keylen;
+        if (drum_column_of(drum, rec->type) != NULL &&
+            rec->len == drum_column_size(rec->type)) {
+            p += rec->len;
+        }
+
+        if (p > end || drum_link(drum, &hdr, key, rec->seg, rec->off,
+                rec->data + rec->keylen) < 0) {
+            goto fail;
+        }
+    }
+
+    drum_seq_observe(img->seq);
+    drum->seg_tail = img->seg_tail;
+    drum->seg_off = sizes[img->seg_count - 1];
+    if (drum_seg_resume(drum) < 0) {
+        goto fail;
+    }
+
+    return 0;
+fail:
+    drum_close(drum);
+    return -1;
+}
+
+/*
+ * Stamp the leading DRUM_BUCKET_SEQ bucket of a staged
+ * segment with the sequence number of its buckets
+ *
+ * Returns zero on success
+ */
+static int
+drum_stage_stamp(const char *path, uint64_t seq)
+{
+    struct drum_bucket hdr;
+    int fd, error = 0;
+
+    if ((fd = open(path, O_RDWR)) < 0) {
+        return -1;
+    }
+
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        hdr.type != DRUM_BUCKET_SEQ) {
+        errno = -EINVAL;
+        close(fd);
+        return -1;
+    }
+
+    hdr.seq = seq;
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+        error = -1;
+    }
+
+    close(fd);
+    return error;
+}
+
+int
+drum_adopt(struct drum *drum, const char *dir, uint64_t seq)
+{
+    char from[256], to[256];
+    uint32_t count, base, i;
+    off_t off = 0;
+
+    if (drum == NULL || dir == NULL || drum->seg_count == 0) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    for (count = 0;; ++count) {
+        snprintf(from, sizeof(from), DRUM_SEG_FMT, dir, count);
+        if (access(from, F_OK) < 0) {
+            break;
+        }
+
+        if (drum_stage_stamp(from, seq) < 0) {
+            return -1;
+        }
+    }
+
+    if (count == 0) {
+        errno = -ENOENT;
+        return -1;
+    }
+
+    /* Segments past a gap are not opened, so the first lands last */
+    base = drum->seg_count;
+    for (i = count; i-- > 0;) {
+        snprintf(from, sizeof(from), DRUM_SEG_FMT, dir, i);
+        snprintf(to, sizeof(to), DRUM_SEG_FMT, drum->path, base + i);
+        if (rename(from, to) < 0) {
+            goto undo;
+        }
+    }
+
+    /*
+     * The segments are in for good now. Should loading
+     * them fail, the drum is opened afresh, which picks
+     * them all up or fails the same way it would on a
+     * restart.
+     */
+    for (i = 0; i < count; ++i) {
+        snprintf(to, sizeof(to), DRUM_SEG_FMT, drum->path, base + i);
+        if (drum_seg_add(drum, to, 0) < 0 ||
+            (off = drum_seg_replay(drum, drum->seg_count - 1)) < 0) {
+            drum_close(drum);
+            return drum_open(drum);
+        }
+
+        drum->disk += off;
+    }
+
+    drum->seg_off = off;
+    return drum_seg_resume(drum);
+undo:
+    while (++i < count) {
+        snprintf(from, sizeof(from), DRUM_SEG_FMT, dir, i);
+        snprintf(to, sizeof(to), DRUM_SEG_FMT, drum->path, base + i);
+        rename(to, from);
+    }
+
+    return -1;
+}
+
+/*
+ * Rotate the active segment once it has grown past
+ * DRUM_SEG_MAX
+ */
+static int
+drum_seg_room(struct drum *drum)
+{
+    if (drum == NULL || drum->seg_count == 0) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (drum->seg_off >= DRUM_SEG_MAX && drum_seg_create(drum) < 0) {
+        return -1;
+    }
+
+    if (drum->seg_off >= drum->seg_resv) {
+        drum_seg_reserve(drum);
+    }
+
+    return 0;
+}
+
+/*
+ * Append a bucket written by the store numbered 'seq'
+ */
+static int
+drum_append(struct drum *drum, const char *key, uint8_t type, const void *data,
+    size_t len, uint64_t expire, uint64_t seq)
+{
+    struct drum_bucket *bucket;
+    size_t size;
+    uint32_t seg;
+
+    if (drum_seg_room(drum) < 0) {
+        return -1;
+    }
+
+    if (drum_bucket_init(key, data, len, &bucket) < 0) {
+        return -1;
+    }
+
+    bucket->type = type;
+    bucket->expire = expire;
+    bucket->seq = seq;
+    seg = drum->seg_count - 1;
+    size = DRUM_BUCKET_SIZE(bucket);
+    if (drum_seg_write(drum, seg, bucket, size) < 0) {
+        free(bucket);
+        return -1;
+    }
+
+    if (drum_link(drum, bucket, key, seg, drum->seg_off + size - len,
+            data) < 0) {
+        free(bucket);
+        return -1;
+    }
+
+    drum->seg_off += size;
+    drum->disk += size;
+    free(bucket);
+    return 0;
+}
+
+int
+drum_upload_begin(struct drum *drum, struct drum_upload *up, const char *key,
+    uint8_t type, size_t len, uint64_t expire)
+{
+    char buf[sizeof(struct drum_bucket) + DRUM_KEYLEN_MAX];
+    struct drum_bucket *hdr;
+    size_t key_len, size;
+    off_t end;
+
+    if (up == NULL || key == NULL || type == DRUM_BUCKET_PEND ||
+        type == DRUM_BUCKET_SEQ) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((key_len = strlen(key)) > DRUM_KEYLEN_MAX) {
+        errno = -ENAMETOOLONG;
+        return -1;
+    }
+
+    if (drum_seg_room(drum) < 0) {
+        return -1;
+    }
+
+    hdr = (struct drum_bucket *)buf;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->record_len = len;
+    hdr->type = DRUM_BUCKET_PEND;
+    hdr->key_len = key_len;
+    memcpy(hdr->data, key, key_len);
+
+    up->seg = drum->seg_count - 1;
+    up->off = drum->seg_off;
+    size = sizeof(*hdr) + key_len;
+    if (drum_seg_write(drum, up->seg, buf, size) < 0) {
+        return -1;
+    }
+
+    /*
+     * Extend the segment so that later appends go past the
+     * value. The value itself is written through the page
+     * cache, so direct appends pick up at the next block.
+     */
+    end = up->off + size + len;
+    if (drum->flags & DRUM_F_DIRECT) {
+        if (drum_dio_skip(drum, up->seg, &end) < 0)
+            return -1;
+    } else if (ftruncate(drum->segs[up->seg], end) < 0) {
+        return -1;
+    }
+
+    memcpy(up->key, key, key_len + 1);
+    up->data = up->off + size;
+    up->len = len;
+    up->done = 0;
+    up->type = type;
+    up->expire = expire;
+    drum->disk += end - drum->seg_off;
+    drum->seg_off = end;
+    ++drum->uploads;
+    return 0;
+}
+
+int
+drum_upload_write(struct drum *drum, struct drum_upload *up, const void *buf,
+    size_t len)
+{
+    off_t off;
+
+    if (drum == NULL || up == NULL || (len > 0 && buf == NULL)) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (len > up->len - up->done) {
+        errno = -EFBIG;
+        return -1;
+    }
+
+    off = up->data + up->done;
+    if (pwrite(drum->segs[up->seg], buf, len, off) != len) {
+        return -1;
+    }
+
+    up->done += len;
+    return 0;
+}
+
+int
+drum_upload_commit(struct drum *drum, struct drum_upload *up)
+{
+    struct drum_bucket hdr;
+    char value[sizeof(int64_t)];
+    int fd;
+
+    if (drum == NULL || up == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* Over either way, the caller is done with it */
+    drum_upload_abort(drum, up);
+    if (up->done != up->len) {
+        errno = -EIO;
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.record_len = up->len;
+    hdr.type = up->type;
+    hdr.expire = up->expire;
+    hdr.seq = drum_seq_next();
+    hdr.key_len = strlen(up->key);
+
+    /* A single write turns the reserved bucket into a live one */
+    fd = drum->segs[up->seg];
+    if (pwrite(fd, &hdr, sizeof(hdr), up->off) != sizeof(hdr)) {
+        return -1;
+    }
+
+    /* Only pull in values that belong in a column */
+    if (drum_column_of(drum, up->type) != NULL &&
+        up->len == drum_column_size(up->type) &&
+        pread(fd, value, up->len, up->data) != up->len) {
+        return -1;
+    }
+
+    return drum_link(drum, &hdr, up->key, up->seg, up->data, value);
+}
+
+void
+drum_upload_abort(struct drum *drum, struct drum_upload *up)
+{
+    if (drum == NULL || up == NULL || drum->uploads == 0) {
+        return;
+    }
+
+    --drum->uploads;
+}
+
+int
+drum_store(struct drum *drum, const char *key, uint8_t type, const void *data,
+    size_t len, uint64_t expire)
+{
+    return drum_append(drum, key, type, data, len, expire, drum_seq_next());
+}
+
+int
+drum_apply(struct drum *drum, const char *key, uint8_t type, const void *data,
+    size_t len, uint64_t expire, uint64_t seq)
+{
+    drum_seq_observe(seq);
+    return drum_append(drum, key, type, data, len, expire, seq);
+}
+
+void
+drum_remove(struct drum *drum, struct drum_index_ent *ent)
+{
+    char key[DRUM_KEYLEN_MAX + 1];
+    struct drum_column *col;
+
+    if (drum == NULL || ent == NULL) {
+        return;
+    }
+
+    drum_wheel_del(&drum->wheel, &ent->timer);
+    drum_version_drop(ent);
+    if ((col = drum_column_of(drum, ent->type)) != NULL) {
+        drum_column_remove(col, ent);
+    }
+
+    drum->live -= drum_ent_size(ent);
+    drum_index_key(ent, key);
+    drum_index_remove(drum->index, key);
+}
+
+/*
+ * Returns true if a version kept for snapshots
+ * lives in 'seg'
+ */
+static int
+drum_seg_versioned(struct drum *drum, uint32_t seg)
+{
+    struct drum_index_ent *ent;
+    struct drum_version *v;
+
+    LIST_FOREACH(ent, &drum->versioned, vlink) {
+        for (v = ent->older; v != NULL; v = v->older) {
+            if (v->seg == seg)
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Empty a segment once no reader can still be reading
+ * from it. The path is truncated rather than the
+ * descriptor, which may be closed by then.
+ */
+static void
+drum_seg_empty(void *path)
+{
+    int fd;
+
+    if ((fd = open(path, O_WRONLY | O_TRUNC)) >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+
+    free(path);
+}
+
+/*
+ * Empty the oldest segment once compaction went
+ * through all of it
+ *
+ * Returns zero if it has to wait
+ */
+static int
+drum_compact_seal(struct drum *drum)
+{
+    char *path;
+    uint32_t seg;
+
+    seg = drum->seg_tail;
+    if (drum_seg_versioned(drum, seg)) {
+        return 0;
+    }
+
+    if ((path = malloc(256)) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    /* The copies must be on disk before the originals go */
+    for (uint32_t i = drum->compact_seg; i < drum->seg_count; ++i) {
+        if (fdatasync(drum->segs[i]) < 0) {
+            free(path);
+            return -1;
+        }
+    }
+
+    snprintf(path, 256, DRUM_SEG_FMT, drum->path, seg);
+    drum_epoch_retire(path, drum_seg_empty);
+    drum->disk -= drum->compact_off;
+    drum->compact_off = 0;
+    ++drum->seg_tail;
+    return 1;
+}
+
+/*
+ * Returns true if a drum has compaction to do
+ */
+static int
+drum_compact_due(struct drum *drum)
+{
+    uint64_t dead;
+
+    if ((drum->flags & DRUM_F_COMPACT) == 0) {
+        return 0;
+    }
+
+    /* Finish the segment once begun */
+    if (drum->compact_off > 0) {
+        return 1;
+    }
+
+    /* The active segment is still being written to */
+    if (drum->seg_tail + 1 >= drum->seg_count) {
+        return 0;
+    }
+
+    /* A reserved bucket could turn live behind our back */
+    if (drum->uploads > 0) {
+        return 0;
+    }
+
+    dead = drum->disk - drum->live;
+    return dead >= DRUM_COMPACT_MIN && dead >= drum->disk / 2;
+}
+
+ssize_t
+drum_compact(struct drum *drum, size_t budget)
+{
+    char buf[sizeof(struct drum_bucket) + DRUM_KEYLEN_MAX];
+    char key[DRUM_KEYLEN_MAX + 1];
+    struct drum_index_ent *ent;
+    struct drum_bucket *hdr;
+    size_t done = 0;
+    uint64_t now;
+    off_t off, size;
+    uint32_t seg;
+    ssize_t n;
+    void *data;
+    int fd;
+
+    if (drum == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (!drum_compact_due(drum)) {
+        return 0;
+    }
+
+    if (drum->compact_off == 0) {
+        drum->compact_seg = drum->seg_count - 1;
+    }
+
+    now = drum_clock();
+    seg = drum->seg_tail;
+    fd = drum->segs[seg];
+    hdr = (struct drum_bucket *)buf;
+    while (done < budget) {
+        off = drum->compact_off;
+        n = pread(fd, buf, sizeof(buf), off);
+        if (n < 0) {
+            return -1;
+        }
+
+        /* Went through all of it */
+        if (n < (ssize_t)sizeof(*hdr)) {
+            if ((n = drum_compact_seal(drum)) <= 0)
+                return n;
+            return (done > 0) ? done : 1;
+        }
+
+        size = DRUM_BUCKET_SIZE(hdr);
+        drum->compact_off += size;
+        done += size;
+        if (hdr->type == DRUM_BUCKET_SEQ || hdr->type == DRUM_BUCKET_PEND) {
+            continue;
+        }
+
+        /* Only the bucket the index points at is live */
+        memcpy(key, hdr->data, hdr->key_len);
+        key[hdr->key_len] = '\0';
+        ent = drum_index_lookup(drum->index, key);
+        if (ent == NULL || ent->seg != seg ||
+            ent->off != off + size - hdr->record_len) {
+            continue;
+        }
+
+        if (drum_index_expired(ent, now)) {
+            drum_remove(drum, ent);
+            continue;
+        }
+
+        if ((data = malloc(ent->len + 1)) == NULL) {
+            drum->compact_off = off;
+            errno = -ENOMEM;
+            return -1;
+        }
+
+        /* Try the bucket again next time */
+        if (drum_read(drum, ent, data) != ent->len ||
+            drum_append(drum, key, ent->type, data, ent->len, ent->expire,
+            ent->seq) < 0) {
+            drum->compact_off = off;
+            free(data);
+            return -1;
+        }
+
+        free(data);
+    }
+
+    return done;
+}
+
+size_t
+drum_expire(struct drum *drum, uint64_t now, size_t budget)
+{
+    struct drum_timer *t;
+    size_t count = 0;
+
+    if (drum == NULL) {
+        return 0;
+    }
+
+    drum_wheel_advance(&drum->wheel, now);
+    while (count < budget && (t = drum_wheel_pop(&drum->wheel)) != NULL) {
+        drum_remove(drum, drum_index_of_timer(t));
+        ++count;
+    }
+
+    return count;
+}
+
+uint64_t
+drum_expire_next(struct drum *drum)
+{
+    if (drum == NULL) {
+        return UINT64_MAX;
+    }
+
+    return drum_wheel_next(&drum->wheel);
+}
+
+uint64_t
+drum_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void
+drum_gc(struct drum *drum)
+{
+    struct drum_index_ent *ent, *next;
+    struct drum_version *v, **vp;
+    uint64_t upper;
+    int needed;
+
+    if (drum == NULL) {
+        return;
+    }
+
+    for (ent = LIST_FIRST(&drum->versioned); ent != NULL; ent = next) {
+        next = LIST_NEXT(ent, vlink);
+
+        /* Each version is seen by snapshots until the next one */
+        upper = ent->seq;
+        vp = &ent->older;
+        while ((v = *vp) != NULL) {
+            needed = drum_snap_needs(v->seq, upper);
+            upper = v->seq;
+            if (needed) {
+                vp = &v->older;
+                continue;
+            }
+
+            *vp = v->older;
+            drum_epoch_retire(v, free);
+        }
+
+        if (ent->older == NULL) {
+            LIST_REMOVE(ent, vlink);
+        }
+    }
+}
+
+int
+drum_locate(struct drum *drum, const struct drum_version *v, int *fd,
+    off_t *off)
+{
+    uint32_t count;
+
+    if (drum == NULL || v == NULL || fd == NULL || off == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* The table is published before the count that covers it */
+    count = atomic_load_explicit(&drum->seg_count, memory_order_acquire);
+    if (v->seg >= count) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    *fd = atomic_load_explicit(&drum->segs, memory_order_acquire)[v->seg];
+    *off = v->off;
+    return 0;
+}
+
+/*
+ * Read a version of a DRUM_F_DIRECT drum through its
+ * O_DIRECT descriptors, a span of whole blocks at a
+ * time into a buffer from the pool
+ */
+static ssize_t
+drum_dio_read(struct drum *drum, const struct drum_version *v, void *buf)
+{
+    size_t done = 0, skip, span, n;
+    char *bounce;
+    ssize_t got = 0;
+    off_t off;
+    int fd;
+
+    /* The table is published before the count that covers it */
+    if (v->seg >= atomic_load_explicit(&drum->seg_count,
+            memory_order_acquire)) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((bounce = drum_pool_get()) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    fd = atomic_load_explicit(&drum->dio, memory_order_acquire)[v->seg];
+    off = v->off;
+    while (done < v->len) {
+        skip = off - DIO_DOWN(off);
+        span = DIO_UP(skip + v->len - done);
+        if (span > DRUM_POOL_BUFLEN)
+            span = DRUM_POOL_BUFLEN;
+
+        got = pread(fd, bounce, span, off - skip);
+        if (got <= (ssize_t)skip)
+            break;
+
+        n = got - skip;
+        if (n > v->len - done)
+            n = v->len - done;
+        memcpy((char *)buf + done, bounce + skip, n);
+        done += n;
+        off += n;
+    }
+
+    drum_pool_put(bounce);
+    return (done == 0 && got < 0) ? -1 : (ssize_t)done;
+}
+
+ssize_t
+drum_read_version(struct drum *drum, const struct drum_version *v, void *buf)
+{
+    off_t off;
+    int fd;
+
+    if (buf == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (drum_locate(drum, v, &fd, &off) < 0) {
+        return -1;
+    }
+
+    if (drum->flags & DRUM_F_DIRECT) {
+        return drum_dio_read(drum, v, buf);
+    }
+
+    return pread(fd, buf, v->len, off);
+}
+
+ssize_t
+drum_read(struct drum *drum, const struct drum_index_ent *ent, void *buf)
+{
+    struct drum_version v;
+
+    if (drum_version_of(ent, 0, &v) < 0) {
+        return -1;
+    }
+
+    return drum_read_version(drum, &v, buf);
+}
+
+void
+drum_close(struct drum *drum)
+{
+    if (drum == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < drum->seg_count; ++i) {
+        close(drum->segs[i]);
+        if (drum->dio != NULL)
+            close(drum->dio[i]);
+    }
+
+    while (!LIST_EMPTY(&drum->versioned)) {
+        drum_version_drop(LIST_FIRST(&drum->versioned));
+    }
+
+    free(drum->segs);
+    free(drum->dio);
+    drum_pool_put(drum->tail);
+    drum_column_free(&drum->ints);
+    drum_column_free(&drum->bools);
+    drum_index_free(drum->index);
+    drum->segs = NULL;
+    drum->seg_count = 0;
+    drum->dio = NULL;
+    drum->tail = NULL;
+    drum->index = NULL;
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "drum/epoch.h"
+
+/*
+ * The epoch a reader slot is pinned to
+ *
+ * @epoch: Epoch seen on entry [zero while outside]
+ * @owned: Set while a thread holds the slot
+ */
+struct epoch_slot {
+    _Alignas(64) _Atomic uint64_t epoch;
+    _Atomic uint8_t owned;
+};
+
+/*
+ * An object waiting for its readers to leave
+ *
+ * @next: Next retired object
+ * @epoch: Epoch it was retired in
+ * @fn: Frees the object
+ * @p: The object
+ */
+struct epoch_retired {
+    struct epoch_retired *next;
+    uint64_t epoch;
+    void (*fn)(void *);
+    void *p;
+};
+
+static struct epoch_slot slots[DRUM_EPOCH_READERS];
+static _Atomic uint64_t epoch_now = 1;
+static _Atomic uint32_t epoch_readers = 0;
+
+/* Reader side, per thread */
+static _Thread_local struct epoch_slot *epoch_mine = NULL;
+static _Thread_local uint32_t epoch_depth = 0;
+
+/* Writer side */
+static struct epoch_retired *retired = NULL;
+static size_t retired_count = 0;
+
+/*
+ * Claim a reader slot for the calling thread
+ *
+ * Returns NULL if every slot is taken
+ */
+static struct epoch_slot *
+epoch_claim(void)
+{
+    uint8_t expect;
+
+    for (int i = 0; i < DRUM_EPOCH_READERS; ++i) {
+        expect = 0;
+        if (atomic_compare_exchange_strong(&slots[i].owned, &expect, 1)) {
+            atomic_fetch_add(&epoch_readers, 1);
+            return &slots[i];
+        }
+    }
+
+    return NULL;
+}
+
+int
+drum_epoch_enter(void)
+{
+    uint64_t now;
+
+    if (epoch_depth++ > 0) {
+        return 0;
+    }
+
+    if (epoch_mine == NULL && (epoch_mine = epoch_claim()) == NULL) {
+        epoch_depth = 0;
+        errno = -EAGAIN;
+        return -1;
+    }
+
+    /*
+     * Either the writer sees the pin when it next reclaims,
+     * or everything it unlinked before then is seen here.
+     */
+    now = atomic_load_explicit(&epoch_now, memory_order_acquire);
+    atomic_store_explicit(&epoch_mine->epoch, now, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    return 0;
+}
+
+void
+drum_epoch_exit(void)
+{
+    if (epoch_depth == 0 || --epoch_depth > 0) {
+        return;
+    }
+
+    atomic_store_explicit(&epoch_mine->epoch, 0, memory_order_release);
+}
+
+void
+drum_epoch_detach(void)
+{
+    if (epoch_mine == NULL || epoch_depth > 0) {
+        return;
+    }
+
+    atomic_store_explicit(&epoch_mine->owned, 0, memory_order_release);
+    atomic_fetch_sub(&epoch_readers, 1);
+    epoch_mine = NULL;
+}
+
+void
+drum_epoch_retire(void *p, void (*fn)(void *))
+{
+    struct epoch_retired *r;
+
+    if (p == NULL) {
+        return;
+    }
+
+    /* Nobody reads but the writer, nothing to wait for */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&epoch_readers, memory_order_relaxed) == 0) {
+        drum_epoch_reclaim();
+        fn(p);
+        return;
+    }
+
+    /* Better to leak it than to free it early */
+    if ((r = malloc(sizeof(*r))) == NULL) {
+        return;
+    }
+
+    r->epoch = atomic_load_explicit(&epoch_now, memory_order_relaxed);
+    r->fn = fn;
+    r->p = p;
+    r->next = retired;
+    retired = r;
+    if (++retired_count >= DRUM_EPOCH_BATCH) {
+        drum_epoch_reclaim();
+    }
+}
+
+size_t
+drum_epoch_reclaim(void)
+{
+    struct epoch_retired *r, **rp;
+    uint64_t oldest, pin;
+
+    if (retired == NULL) {
+        return 0;
+    }
+
+    /* Readers that come in from here on see nothing retired */
+    oldest = atomic_fetch_add(&epoch_now, 1) + 1;
+    atomic_thread_fence(memory_order_seq_cst);
+    for (int i = 0; i < DRUM_EPOCH_READERS; ++i) {
+        pin = atomic_load_explicit(&slots[i].epoch, memory_order_acquire);
+        if (pin != 0 && pin < oldest)
+            oldest = pin;
+    }
+
+    rp = &retired;
+    while ((r = *rp) != NULL) {
+        if (r->epoch >= oldest) {
+            rp = &r->next;
+            continue;
+        }
+
+        *rp = r->next;
+        r->fn(r->p);
+        free(r);
+        --retired_count;
+    }
+
+    return retired_count;
+}
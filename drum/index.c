@@ -0,0 +1,534 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include "drum/epoch.h"
+#include "drum/index.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+/*
+ * A key being looked for, split up the way entries
+ * keep theirs
+ *
+ * @head: First bytes of the key, zero padded
+ * @tail: Bytes past the inline part
+ * @len: Length of the key
+ */
+struct index_key {
+    char head[DRUM_KEY_INLINE];
+    const char *tail;
+    size_t len;
+};
+
+static void
+index_key_init(struct index_key *k, const char *key)
+{
+    k->len = strnlen(key, DRUM_KEYLEN_MAX);
+    memset(k->head, 0, sizeof(k->head));
+    memcpy(k->head, key, MIN(k->len, DRUM_KEY_INLINE));
+    k->tail = key + MIN(k->len, DRUM_KEY_INLINE);
+}
+
+/*
+ * Returns the bytes of a key an entry keeps for itself
+ */
+static inline char *
+index_suffix(const struct drum_index_ent *ent)
+{
+    return (char *)&ent->next[ent->nlevels];
+}
+
+/*
+ * Compare the bytes of an entry past its inline part,
+ * its prefix then its suffix, with 'len' bytes of 'tail'
+ */
+static int
+index_tailcmp(const struct drum_index_ent *ent, const char *tail, size_t len)
+{
+    size_t plen = 0, slen, n;
+    int diff;
+
+    if (ent->prefix != NULL) {
+        plen = ent->prefix->len;
+        n = MIN(plen, len);
+        if ((diff = memcmp(ent->prefix->data, tail, n)) != 0) {
+            return diff;
+        }
+
+        /* Key ends within the prefix */
+        if (len < plen) {
+            return 1;
+        }
+    }
+
+    slen = ent->keylen - DRUM_KEY_INLINE - plen;
+    len -= plen;
+    if ((diff = memcmp(index_suffix(ent), tail + plen, MIN(slen, len))) != 0) {
+        return diff;
+    }
+
+    return (slen > len) - (slen < len);
+}
+
+/*
+ * Compare the key of an entry with a key being looked
+ * for. Keys hold no NUL bytes, so equal inline parts
+ * mean both keys are at least DRUM_KEY_INLINE long or
+ * of the same length.
+ */
+static inline int
+index_keycmp(const struct drum_index_ent *ent, const struct index_key *k)
+{
+    int diff;
+
+    diff = memcmp(ent->key, k->head, DRUM_KEY_INLINE);
+    if (diff != 0 || (ent->keylen <= DRUM_KEY_INLINE &&
+        k->len <= DRUM_KEY_INLINE)) {
+        return diff;
+    }
+
+    if (ent->keylen <= DRUM_KEY_INLINE) {
+        return -1;
+    }
+
+    return index_tailcmp(ent, k->tail, k->len - DRUM_KEY_INLINE);
+}
+
+/*
+ * Drop a reference to a shared prefix. References are
+ * only taken by the writer, but readers may still be
+ * looking at the prefix through an entry that was just
+ * retired.
+ */
+static void
+index_prefix_put(struct drum_key_prefix *p)
+{
+    if (p != NULL && --p->refs == 0) {
+        drum_epoch_retire(p, free);
+    }
+}
+
+/*
+ * Pick the shared prefix of a new long key from the
+ * entries it goes between. One of theirs is taken if
+ * the key goes on with it, otherwise the bytes the key
+ * has in common with the closest of them are split out
+ * into a new prefix, so that the keys which go in next
+ * to it later can share them.
+ *
+ * Returns the prefix with a reference taken [NULL for none]
+ */
+static struct drum_key_prefix *
+index_prefix_pick(const struct index_key *k, struct drum_index_ent **near,
+    int nnear)
+{
+    char buf[DRUM_KEYLEN_MAX + 1];
+    struct drum_key_prefix *best = NULL, *p;
+    struct drum_index_ent *ent;
+    size_t len, common, want = 0;
+
+    if (k->len <= DRUM_KEY_INLINE) {
+        return NULL;
+    }
+
+    len = k->len - DRUM_KEY_INLINE;
+    for (int i = 0; i < nnear; ++i) {
+        ent = near[i];
+        if (ent == NULL || ent->keylen <= DRUM_KEY_INLINE ||
+            memcmp(ent->key, k->head, DRUM_KEY_INLINE) != 0) {
+            continue;
+        }
+
+        drum_index_key(ent, buf);
+        common = 0;
+        while (common < len && buf[DRUM_KEY_INLINE + common] != '\0' &&
+            buf[DRUM_KEY_INLINE + common] == k->tail[common]) {
+            ++common;
+        }
+
+        p = ent->prefix;
+        if (p != NULL && p->len <= common && (best == NULL ||
+            p->len > best->len)) {
+            best = p;
+        }
+
+        want = (common > want) ? common : want;
+    }
+
+    if (best != NULL) {
+        ++best->refs;
+        return best;
+    }
+
+    if (want < DRUM_KEY_SHARE_MIN) {
+        return NULL;
+    }
+
+    if ((p = malloc(sizeof(*p) + want)) == NULL) {
+        return NULL;
+    }
+
+    p->refs = 1;
+    p->len = want;
+    memcpy(p->data, k->tail, want);
+    return p;
+}
+
+/*
+ * Pick a level for a new entry [p = 1/4 per level]
+ */
+static uint8_t
+index_rand_level(struct drum_index *idx)
+{
+    uint8_t level = 1;
+    uint32_t x;
+
+    /* xorshift32 */
+    x = idx->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    idx->seed = x;
+
+    while ((x & 3) == 0 && level < DRUM_INDEX_LEVELS) {
+        ++level;
+        x >>= 2;
+    }
+
+    return level;
+}
+
+static struct drum_index_ent *
+index_ent_alloc(uint8_t nlevels, size_t suffix_len)
+{
+    struct drum_index_ent *ent;
+    size_t size;
+
+    size = sizeof(*ent) + (nlevels * sizeof(ent->next[0])) + suffix_len;
+    ent = calloc(1, size);
+    if (ent == NULL) {
+        return NULL;
+    }
+
+    ent->nlevels = nlevels;
+    ent->slot = DRUM_SLOT_NONE;
+    return ent;
+}
+
+/*
+ * Find the last entry before 'key' on every level,
+ * writing them to 'update'.
+ */
+static struct drum_index_ent *
+index_find(struct drum_index *idx, const struct index_key *key,
+    struct drum_index_ent **update)
+{
+    struct drum_index_ent *ent, *next;
+    int levels;
+
+    ent = idx->head;
+    levels = atomic_load_explicit(&idx->levels, memory_order_relaxed);
+    for (int i = levels - 1; i >= 0; --i) {
+        while ((next = atomic_load_explicit(&ent->next[i],
+            memory_order_acquire)) != NULL) {
+            if (index_keycmp(next, key) >= 0) {
+                break;
+            }
+            ent = next;
+        }
+
+        if (update != NULL) {
+            update[i] = ent;
+        }
+    }
+
+    return drum_index_next(ent);
+}
+
+int
+drum_index_init(struct drum_index **res)
+{
+    struct drum_index *idx;
+
+    if (res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    idx = malloc(sizeof(*idx));
+    if (idx == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    idx->head = index_ent_alloc(DRUM_INDEX_LEVELS, 0);
+    if (idx->head == NULL) {
+        free(idx);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    idx->levels = 1;
+    idx->count = 0;
+    idx->seed = 0x2545f491;
+    *res = idx;
+    return 0;
+}
+
+size_t
+drum_index_key(const struct drum_index_ent *ent, char *buf)
+{
+    size_t len, plen = 0;
+
+    len = MIN(ent->keylen, DRUM_KEY_INLINE);
+    memcpy(buf, ent->key, len);
+    if (ent->keylen > DRUM_KEY_INLINE) {
+        if (ent->prefix != NULL) {
+            plen = ent->prefix->len;
+            memcpy(buf + len, ent->prefix->data, plen);
+        }
+
+        memcpy(buf + len + plen, index_suffix(ent),
+            ent->keylen - len - plen);
+    }
+
+    buf[ent->keylen] = '\0';
+    return ent->keylen;
+}
+
+int
+drum_index_keycmp(const struct drum_index_ent *ent, const char *key)
+{
+    struct index_key k;
+
+    index_key_init(&k, key);
+    return index_keycmp(ent, &k);
+}
+
+struct drum_index_ent *
+drum_index_insert(struct drum_index *idx, const char *key,
+    const struct drum_version *v, int *added)
+{
+    struct drum_index_ent *update[DRUM_INDEX_LEVELS], *near[2];
+    struct drum_key_prefix *prefix;
+    struct drum_index_ent *ent;
+    struct index_key k;
+    size_t skip;
+    uint8_t level;
+
+    if (idx == NULL || key == NULL || v == NULL || added == NULL) {
+        errno = -EINVAL;
+        return NULL;
+    }
+
+    *added = 0;
+    index_key_init(&k, key);
+    ent = index_find(idx, &k, update);
+    if (ent != NULL && index_keycmp(ent, &k) == 0) {
+        return ent;
+    }
+
+    near[0] = (update[0] != idx->head) ? update[0] : NULL;
+    near[1] = ent;
+    prefix = index_prefix_pick(&k, near, 2);
+    skip = DRUM_KEY_INLINE + ((prefix != NULL) ? prefix->len : 0);
+
+    level = index_rand_level(idx);
+    ent = index_ent_alloc(level, (k.len > skip) ? k.len - skip : 0);
+    if (ent == NULL) {
+        index_prefix_put(prefix);
+        errno = -ENOMEM;
+        return NULL;
+    }
+
+    memcpy(ent->key, k.head, DRUM_KEY_INLINE);
+    ent->keylen = k.len;
+    ent->prefix = prefix;
+    if (k.len > skip) {
+        memcpy(index_suffix(ent), key + skip, k.len - skip);
+    }
+
+    ent->seq = v->seq;
+    ent->seg = v->seg;
+    ent->off = v->off;
+    ent->len = v->len;
+    ent->type = v->type;
+
+    for (int i = idx->levels; i < level; ++i) {
+        update[i] = idx->head;
+    }
+    if (level > idx->levels) {
+        atomic_store_explicit(&idx->levels, level, memory_order_relaxed);
+    }
+
+    /* Readers find it whole on whichever level they get to it */
+    for (int i = 0; i < level; ++i) {
+        atomic_store_explicit(&ent->next[i], update[i]->next[i],
+            memory_order_relaxed);
+        atomic_store_explicit(&update[i]->next[i], ent,
+            memory_order_release);
+    }
+
+    ++idx->count;
+    *added = 1;
+    return ent;
+}
+
+struct drum_index_ent *
+drum_index_lookup(struct drum_index *idx, const char *key)
+{
+    struct drum_index_ent *ent;
+    struct index_key k;
+
+    if (idx == NULL || key == NULL) {
+        return NULL;
+    }
+
+    index_key_init(&k, key);
+    ent = index_find(idx, &k, NULL);
+    if (ent == NULL || index_keycmp(ent, &k) != 0) {
+        return NULL;
+    }
+
+    return ent;
+}
+
+struct drum_index_ent *
+drum_index_seek(struct drum_index *idx, const char *key)
+{
+    struct index_key k;
+
+    if (idx == NULL || key == NULL) {
+        return NULL;
+    }
+
+    index_key_init(&k, key);
+    return index_find(idx, &k, NULL);
+}
+
+int
+drum_index_remove(struct drum_index *idx, const char *key)
+{
+    struct drum_index_ent *update[DRUM_INDEX_LEVELS];
+    struct drum_index_ent *ent;
+    struct index_key k;
+    uint8_t level;
+
+    if (idx == NULL || key == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    index_key_init(&k, key);
+    ent = index_find(idx, &k, update);
+    if (ent == NULL || index_keycmp(ent, &k) != 0) {
+        errno = -ENOENT;
+        return -1;
+    }
+
+    /* Its own links stay intact for readers standing on it */
+    for (int i = ent->nlevels - 1; i >= 0; --i) {
+        if (update[i]->next[i] == ent)
+            atomic_store_explicit(&update[i]->next[i], ent->next[i],
+                memory_order_release);
+    }
+
+    for (level = idx->levels; level > 1; --level) {
+        if (idx->head->next[level - 1] != NULL)
+            break;
+    }
+
+    atomic_store_explicit(&idx->levels, level, memory_order_relaxed);
+
+    --idx->count;
+    index_prefix_put(ent->prefix);
+    drum_epoch_retire(ent, free);
+    return 0;
+}
+
+void
+drum_index_write_begin(struct drum_index_ent *ent)
+{
+    uint32_t gen;
+
+    gen = atomic_load_explicit(&ent->gen, memory_order_relaxed);
+    atomic_store_explicit(&ent->gen, gen + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void
+drum_index_write_end(struct drum_index_ent *ent)
+{
+    uint32_t gen;
+
+    gen = atomic_load_explicit(&ent->gen, memory_order_relaxed);
+    atomic_store_explicit(&ent->gen, gen + 1, memory_order_release);
+}
+
+uint32_t
+drum_index_read_begin(const struct drum_index_ent *ent)
+{
+    uint32_t gen;
+
+    while ((gen = atomic_load_explicit(&ent->gen, memory_order_acquire)) & 1) {
+        ;
+    }
+
+    return gen;
+}
+
+int
+drum_index_read_retry(const struct drum_index_ent *ent, uint32_t gen)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&ent->gen, memory_order_relaxed) != gen;
+}
+
+void
+drum_index_free(struct drum_index *idx)
+{
+    struct drum_index_ent *ent, *next;
+
+    if (idx == NULL) {
+        return;
+    }
+
+    ent = idx->head;
+    while (ent != NULL) {
+        next = ent->next[0];
+        index_prefix_put(ent->prefix);
+        free(ent);
+        ent = next;
+    }
+
+    free(idx);
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "drum/mvcc.h"
+#include "drum/index.h"
+
+#define SNAP_MIN_CAP 8
+
+/*
+ * A held snapshot
+ *
+ * @seq: Sequence number the snapshot sees up to
+ * @refs: Number of holders
+ */
+struct snap_ref {
+    uint64_t seq;
+    uint32_t refs;
+};
+
+/* Zero is never handed out, it stands for no snapshot */
+static uint64_t last_seq = 1;
+static struct snap_ref *snaps = NULL;
+static size_t snap_count = 0;
+static size_t snap_cap = 0;
+
+/*
+ * Returns the index of the first snapshot at or
+ * after 'seq' [snapshots are kept sorted]
+ */
+static size_t
+snap_search(uint64_t seq)
+{
+    size_t lo = 0, hi = snap_count, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (snaps[mid].seq < seq) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+uint64_t
+drum_seq_next(void)
+{
+    return ++last_seq;
+}
+
+uint64_t
+drum_seq_last(void)
+{
+    return last_seq;
+}
+
+void
+drum_seq_observe(uint64_t seq)
+{
+    if (seq > last_seq) {
+        last_seq = seq;
+    }
+}
+
+uint64_t
+drum_snap_take(void)
+{
+    struct snap_ref *p;
+    size_t cap;
+
+    /* Snapshots only ever get taken at the newest sequence */
+    if (snap_count > 0 && snaps[snap_count - 1].seq == last_seq) {
+        ++snaps[snap_count - 1].refs;
+        return last_seq;
+    }
+
+    if (snap_count == snap_cap) {
+        cap = (snap_cap == 0) ? SNAP_MIN_CAP : snap_cap * 2;
+        if ((p = realloc(snaps, cap * sizeof(*p))) == NULL) {
+            errno = -ENOMEM;
+            return 0;
+        }
+
+        snaps = p;
+        snap_cap = cap;
+    }
+
+    snaps[snap_count].seq = last_seq;
+    snaps[snap_count].refs = 1;
+    ++snap_count;
+    return last_seq;
+}
+
+int
+drum_snap_release(uint64_t snap)
+{
+    size_t i;
+
+    i = snap_search(snap);
+    if (i == snap_count || snaps[i].seq != snap) {
+        errno = -ENOENT;
+        return -1;
+    }
+
+    if (--snaps[i].refs > 0) {
+        return 0;
+    }
+
+    memmove(&snaps[i], &snaps[i + 1], (snap_count - i - 1) * sizeof(*snaps));
+    --snap_count;
+    return 0;
+}
+
+size_t
+drum_snap_count(void)
+{
+    return snap_count;
+}
+
+int
+drum_snap_needs(uint64_t lo, uint64_t hi)
+{
+    size_t i;
+
+    i = snap_search(lo);
+    return i < snap_count && snaps[i].seq < hi;
+}
+
+int
+drum_version_of(const struct drum_index_ent *ent, uint64_t snap,
+    struct drum_version *res)
+{
+    const struct drum_version *v;
+    uint32_t gen;
+
+    if (ent == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* Take a copy the writer was not halfway through */
+    do {
+        gen = drum_index_read_begin(ent);
+        res->seq = ent->seq;
+        res->seg = ent->seg;
+        res->off = ent->off;
+        res->len = ent->len;
+        res->type = ent->type;
+        res->older = ent->older;
+    } while (drum_index_read_retry(ent, gen));
+
+    if (snap == 0 || res->seq <= snap) {
+        return 0;
+    }
+
+    /* Versions never change once on the chain */
+    for (v = res->older; v != NULL; v = v->older) {
+        if (v->seq <= snap) {
+            *res = *v;
+            return 0;
+        }
+    }
+
+    /* Written after the snapshot was taken */
+    errno = -ENOENT;
+    return -1;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "drum/pool.h"
+
+/*
+ * A buffer of the pool
+ *
+ * @owned: Set while a thread holds the buffer
+ * @buf: The buffer [allocated on first use]
+ */
+struct pool_slot {
+    _Atomic uint8_t owned;
+    void *_Atomic buf;
+};
+
+static struct pool_slot slots[DRUM_POOL_BUFS];
+
+void *
+drum_pool_get(void)
+{
+    struct pool_slot *slot;
+    uint8_t expect;
+    void *buf;
+
+    for (int i = 0; i < DRUM_POOL_BUFS; ++i) {
+        slot = &slots[i];
+        expect = 0;
+        if (!atomic_compare_exchange_strong(&slot->owned, &expect, 1))
+            continue;
+
+        if ((buf = atomic_load(&slot->buf)) == NULL) {
+            buf = aligned_alloc(DRUM_DIO_ALIGN, DRUM_POOL_BUFLEN);
+            atomic_store(&slot->buf, buf);
+        }
+
+        /* Leave the slot free to try again later */
+        if (buf == NULL) {
+            atomic_store(&slot->owned, 0);
+        }
+
+        return buf;
+    }
+
+    return aligned_alloc(DRUM_DIO_ALIGN, DRUM_POOL_BUFLEN);
+}
+
+void
+drum_pool_put(void *buf)
+{
+    if (buf == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < DRUM_POOL_BUFS; ++i) {
+        if (atomic_load(&slots[i].buf) == buf) {
+            atomic_store(&slots[i].owned, 0);
+            return;
+        }
+    }
+
+    free(buf);
+}
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Stress test for lock-free drum reads [see drum/epoch.h].
+ * One writer stores, removes, takes snapshots and runs
+ * GC while several reader threads look up keys, walk the
+ * index and read values. Built with ASan by 'make stress',
+ * so a retired object freed too early shows up as a
+ * use-after-free.
+ *
+ * usage: stress [seconds]
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "aci/datatype.h"
+#include "drum/drum.h"
+#include "drum/epoch.h"
+#include "drum/index.h"
+
+#define STRESS_KEYS     3000
+#define STRESS_READERS  8
+#define STRESS_WALK     30
+#define STRESS_VALMAX   2048
+
+static char keys[STRESS_KEYS][128];
+static struct drum drum;
+static atomic_int stop;
+static atomic_long reads, walked, bad;
+
+/*
+ * Look up a key and read its value, which starts with
+ * the key itself, then walk the index from another key
+ * checking that it stays in order
+ */
+static void
+stress_read(unsigned int *seed, char *buf)
+{
+    char key[DRUM_KEYLEN_MAX + 1], prev[DRUM_KEYLEN_MAX + 1];
+    struct drum_index_ent *ent;
+    struct drum_version v;
+    const char *want;
+    size_t key_len;
+    ssize_t n;
+
+    want = keys[rand_r(seed) % STRESS_KEYS];
+    key_len = strlen(want);
+    if ((ent = drum_index_lookup(drum.index, want)) != NULL) {
+        if (drum_version_of(ent, 0, &v) == 0 && v.len <= STRESS_VALMAX) {
+            n = drum_read_version(&drum, &v, buf);
+            if (n != (ssize_t)v.len || v.len < key_len ||
+                memcmp(buf, want, key_len) != 0)
+                ++bad;
+            ++reads;
+        }
+
+        drum_index_key(ent, key);
+        if (strcmp(key, want) != 0)
+            ++bad;
+    }
+
+    prev[0] = '\0';
+    ent = drum_index_seek(drum.index, keys[rand_r(seed) % STRESS_KEYS]);
+    for (int i = 0; ent != NULL && i < STRESS_WALK; ++i) {
+        drum_index_key(ent, key);
+        if (prev[0] != '\0' && strcmp(prev, key) >= 0)
+            ++bad;
+        strcpy(prev, key);
+        ++walked;
+        ent = drum_index_next(ent);
+    }
+}
+
+static void *
+stress_reader(void *arg)
+{
+    unsigned int seed = (unsigned int)(long)arg * 7919 + 1;
+    char buf[STRESS_VALMAX];
+
+    while (!stop) {
+        if (drum_epoch_enter() < 0) {
+            printf("fatal: out of reader slots\n");
+            exit(1);
+        }
+
+        stress_read(&seed, buf);
+        drum_epoch_exit();
+    }
+
+    drum_epoch_detach();
+    return NULL;
+}
+
+/*
+ * Make one random change to the drum
+ */
+static void
+stress_write(unsigned int *seed, char *val, uint64_t *snap)
+{
+    struct drum_index_ent *ent;
+    const char *key;
+    size_t key_len;
+    int op;
+
+    key = keys[rand_r(seed) % STRESS_KEYS];
+    key_len = strlen(key);
+    op = rand_r(seed) % 10;
+    if (op < 6) {
+        memcpy(val, key, key_len);
+        drum_store(&drum, key, ACI_TYPE_STRING, val,
+            key_len + rand_r(seed) % (STRESS_VALMAX - key_len), 0);
+    } else if (op < 9) {
+        if ((ent = drum_index_lookup(drum.index, key)) != NULL)
+            drum_remove(&drum, ent);
+    } else if (*snap != 0) {
+        drum_snap_release(*snap);
+        drum_gc(&drum);
+        *snap = 0;
+    } else {
+        *snap = drum_snap_take();
+    }
+}
+
+/*
+ * Remove the drum directory along with its segments
+ */
+static void
+stress_cleanup(const char *dir)
+{
+    char path[PATH_MAX];
+    struct dirent *d;
+    DIR *dp;
+
+    if ((dp = opendir(dir)) == NULL) {
+        return;
+    }
+
+    while ((d = readdir(dp)) != NULL) {
+        if (d->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, d->d_name);
+        unlink(path);
+    }
+
+    closedir(dp);
+    rmdir(dir);
+}
+
+int
+main(int argc, char **argv)
+{
+    char dir[] = "/tmp/odb-stress.XXXXXX";
+    pthread_t readers[STRESS_READERS];
+    char val[STRESS_VALMAX];
+    unsigned int seed = 1;
+    uint64_t snap = 0;
+    time_t end;
+    long ops = 0;
+
+    end = time(NULL) + ((argc > 1) ? atoi(argv[1]) : 5);
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    memset(&drum, 0, sizeof(drum));
+    strcpy(drum.name, "stress");
+    drum.path = dir;
+    if (drum_init(dir, 0) < 0 || drum_open(&drum) < 0) {
+        printf("fatal: failed to open drum in %s\n", dir);
+        return 1;
+    }
+
+    for (int i = 0; i < STRESS_KEYS; ++i) {
+        snprintf(keys[i], sizeof(keys[i]), "%s/%d/%s",
+            (i % 3) ? "user/profile/settings/section" : "k", i,
+            (i % 5) ? "tail-bytes-long-enough" : "x");
+        memcpy(val, keys[i], strlen(keys[i]));
+        drum_store(&drum, keys[i], ACI_TYPE_STRING, val,
+            strlen(keys[i]) + 10, 0);
+    }
+
+    for (long i = 0; i < STRESS_READERS; ++i) {
+        pthread_create(&readers[i], NULL, stress_reader, (void *)i);
+    }
+
+    while (time(NULL) < end) {
+        stress_write(&seed, val, &snap);
+        ++ops;
+    }
+
+    stop = 1;
+    for (int i = 0; i < STRESS_READERS; ++i) {
+        pthread_join(readers[i], NULL);
+    }
+
+    printf("writes=%ld reads=%ld walked=%ld bad=%ld pending=%zu\n",
+        ops, (long)reads, (long)walked, (long)bad, drum_epoch_reclaim());
+    drum_close(&drum);
+    stress_cleanup(dir);
+    return bad != 0;
+}
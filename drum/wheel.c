@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "drum/wheel.h"
+
+#define WHEEL_MASK (DRUM_WHEEL_SLOTS - 1)
+
+/* Ticks covered by one slot of a level */
+#define WHEEL_SPAN(level) (1ULL << (DRUM_WHEEL_BITS * (level)))
+
+static inline void
+timer_link(struct drum_timer **head, struct drum_timer *t)
+{
+    if ((t->next = *head) != NULL) {
+        t->next->pprev = &t->next;
+    }
+
+    *head = t;
+    t->pprev = head;
+}
+
+static inline void
+timer_unlink(struct drum_timer *t)
+{
+    if (t->next != NULL) {
+        t->next->pprev = t->pprev;
+    }
+
+    *t->pprev = t->next;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/*
+ * Hash a timer into the lowest level whose reach
+ * covers its deadline
+ */
+static void
+wheel_place(struct drum_wheel *w, struct drum_timer *t)
+{
+    uint64_t when, delta;
+    int level;
+
+    when = t->deadline;
+    if (when <= w->tick) {
+        when = w->tick + 1;
+    }
+
+    /* Park far off timers at the end of the top level */
+    delta = when - w->tick;
+    if (delta >= WHEEL_SPAN(DRUM_WHEEL_LEVELS)) {
+        delta = WHEEL_SPAN(DRUM_WHEEL_LEVELS) - 1;
+        when = w->tick + delta;
+    }
+
+    for (level = 0; level < DRUM_WHEEL_LEVELS - 1; ++level) {
+        if (delta < WHEEL_SPAN(level + 1))
+            break;
+    }
+
+    when >>= DRUM_WHEEL_BITS * level;
+    timer_link(&w->slots[level][when & WHEEL_MASK], t);
+}
+
+/*
+ * Returns the first tick after the current one at
+ * which a non-empty slot is run, UINT64_MAX if none
+ */
+static uint64_t
+wheel_next_tick(const struct drum_wheel *w)
+{
+    uint64_t base, tick, best = UINT64_MAX;
+    int shift;
+
+    for (int level = 0; level < DRUM_WHEEL_LEVELS; ++level) {
+        shift = DRUM_WHEEL_BITS * level;
+        base = w->tick >> shift;
+        for (uint64_t k = 1; k <= DRUM_WHEEL_SLOTS; ++k) {
+            if (w->slots[level][(base + k) & WHEEL_MASK] == NULL) {
+                continue;
+            }
+
+            tick = (base + k) << shift;
+            if (tick < best)
+                best = tick;
+            break;
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Run the slots belonging to the current tick; higher
+ * levels whose slot boundary this is are cascaded down
+ * before the lowest level fires.
+ */
+static void
+wheel_run(struct drum_wheel *w)
+{
+    struct drum_timer *t, *next;
+    uint64_t idx;
+
+    for (int level = 1; level < DRUM_WHEEL_LEVELS; ++level) {
+        if ((w->tick & (WHEEL_SPAN(level) - 1)) != 0) {
+            break;
+        }
+
+        idx = (w->tick >> (DRUM_WHEEL_BITS * level)) & WHEEL_MASK;
+        t = w->slots[level][idx];
+        w->slots[level][idx] = NULL;
+        for (; t != NULL; t = next) {
+            next = t->next;
+            wheel_place(w, t);
+        }
+    }
+
+    t = w->slots[0][w->tick & WHEEL_MASK];
+    w->slots[0][w->tick & WHEEL_MASK] = NULL;
+    for (; t != NULL; t = next) {
+        next = t->next;
+        if (t->deadline <= w->tick) {
+            timer_link(&w->due, t);
+        } else {
+            wheel_place(w, t);
+        }
+    }
+}
+
+void
+drum_wheel_init(struct drum_wheel *w, uint64_t now)
+{
+    memset(w, 0, sizeof(*w));
+    w->tick = now / DRUM_WHEEL_TICK;
+}
+
+void
+drum_wheel_add(struct drum_wheel *w, struct drum_timer *t, uint64_t when)
+{
+    /* Round up so a timer never fires early */
+    t->deadline = (when + DRUM_WHEEL_TICK - 1) / DRUM_WHEEL_TICK;
+    wheel_place(w, t);
+    ++w->count;
+}
+
+void
+drum_wheel_del(struct drum_wheel *w, struct drum_timer *t)
+{
+    if (!drum_timer_armed(t)) {
+        return;
+    }
+
+    timer_unlink(t);
+    --w->count;
+}
+
+void
+drum_wheel_advance(struct drum_wheel *w, uint64_t now)
+{
+    uint64_t target, next;
+
+    target = now / DRUM_WHEEL_TICK;
+    while (w->tick < target) {
+        if ((next = wheel_next_tick(w)) > target) {
+            w->tick = target;
+            break;
+        }
+
+        w->tick = next;
+        wheel_run(w);
+    }
+}
+
+struct drum_timer *
+drum_wheel_pop(struct drum_wheel *w)
+{
+    struct drum_timer *t;
+
+    if ((t = w->due) == NULL) {
+        return NULL;
+    }
+
+    timer_unlink(t);
+    --w->count;
+    return t;
+}
+
+uint64_t
+drum_wheel_next(const struct drum_wheel *w)
+{
+    uint64_t tick;
+
+    if (w->due != NULL) {
+        return 0;
+    }
+
+    if (w->count == 0) {
+        return UINT64_MAX;
+    }
+
+    tick = wheel_next_tick(w);
+    return (tick == UINT64_MAX) ? tick : tick * DRUM_WHEEL_TICK;
+}
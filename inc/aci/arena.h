@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ACI_ARENA_H
+#define ACI_ARENA_H 1
+
+#include <stddef.h>
+
+/* Size of the block an arena starts out with */
+#define ACI_ARENA_INIT (16 * 1024)
+
+/* Largest block an arena keeps between requests */
+#define ACI_ARENA_KEEP (1024 * 1024)
+
+/* Every allocation is aligned to this */
+#define ACI_ARENA_ALIGN 16
+
+struct aci_arena_spill;
+
+/*
+ * Bump allocator for the scratch memory of one request.
+ * Nothing is freed on its own; the whole arena is reset
+ * once the request has been handled. What does not fit
+ * in the block spills into its own allocation, and the
+ * block grows on reset to hold the largest request seen
+ * so far, up to ACI_ARENA_KEEP.
+ *
+ * @base: Block allocations are carved from [NULL until used]
+ * @size: Size of 'base'
+ * @used: Bytes of 'base' handed out
+ * @spill: Allocations that did not fit in 'base'
+ * @spilled: Bytes held in 'spill'
+ * @peak: Most bytes one request has used [high-water mark]
+ */
+struct aci_arena {
+    char *base;
+    size_t size;
+    size_t used;
+    struct aci_arena_spill *spill;
+    size_t spilled;
+    size_t peak;
+};
+
+/*
+ * Position in an arena to release back to, for
+ * requests that go through memory in rounds
+ *
+ * @used: Bytes of the block in use
+ * @spill: Newest spilled allocation
+ */
+struct aci_arena_mark {
+    size_t used;
+    struct aci_arena_spill *spill;
+};
+
+/*
+ * Allocate scratch memory that lives until the arena
+ * is next reset
+ *
+ * @arena: Arena to allocate from
+ * @len: Number of bytes
+ *
+ * Returns NULL on failure
+ */
+void *aci_arena_alloc(struct aci_arena *arena, size_t len);
+
+/*
+ * Returns the current position of an arena
+ */
+struct aci_arena_mark aci_arena_mark(const struct aci_arena *arena);
+
+/*
+ * Release what was allocated since 'mark' was taken,
+ * without waiting for the end of the request
+ */
+void aci_arena_release(struct aci_arena *arena, struct aci_arena_mark mark);
+
+/*
+ * Release everything allocated since the last reset and
+ * update the high-water mark. Constant time unless the
+ * request spilled.
+ */
+void aci_arena_reset(struct aci_arena *arena);
+
+/*
+ * Free the memory held by an arena
+ */
+void aci_arena_free(struct aci_arena *arena);
+
+#endif  /* !ACI_ARENA_H */
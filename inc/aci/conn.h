@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ACI_CONN_H
+#define ACI_CONN_H 1
+
+#include <sys/queue.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "aci/arena.h"
+#include "aci/shm.h"
+
+/* Max snapshots one connection may hold */
+#define ACI_CONN_SNAPS 8
+
+/* Queued reply bytes past which a client is not read from */
+#define ACI_CONN_HIWAT (1024 * 1024)
+
+/* Queued reply bytes under which reading resumes */
+#define ACI_CONN_LOWAT (256 * 1024)
+
+/* Size of each chunk of an output queue */
+#define ACI_OUTBUF_LEN 16384
+
+/* Input buffer kept around between packets, larger ones are freed */
+#define ACI_INBUF_KEEP (64 * 1024)
+
+struct aci_upload;
+struct aci_watcher;
+
+/*
+ * A chunk of reply bytes waiting for the socket to
+ * become writable
+ *
+ * @head: Offset of the first unsent byte
+ * @tail: Offset past the last queued byte
+ * @link: Queue link
+ * @data: Queued bytes
+ */
+struct aci_outbuf {
+    size_t head;
+    size_t tail;
+    TAILQ_ENTRY(aci_outbuf) link;
+    char data[ACI_OUTBUF_LEN];
+};
+
+/*
+ * Represents a client connection to the daemon
+ *
+ * @fd: Client socket
+ * @id: Unique ID, tags I/O queued on its behalf
+ * @shm: Shared-memory channel [NULL if unused]
+ * @snaps: Snapshots held by the client
+ * @nsnaps: Number of snapshots held
+ * @outq: Reply bytes the socket has not taken yet
+ * @backlog: Number of bytes in 'outq'
+ * @inbuf: Start of a packet that has not fully arrived
+ * @inlen: Number of bytes in 'inbuf'
+ * @incap: Size of 'inbuf'
+ * @upload: Chunked store in progress [NULL if none]
+ * @watch: What the client watches [NULL if nothing]
+ * @arena: Scratch memory of the request being handled
+ * @throttled: Set while input is not read [backlog too large]
+ * @writing: Set while waiting for the socket to be writable
+ * @stalled: Set while a stream waits for room in the socket
+ * @error: Set once the socket failed, the connection must close
+ */
+struct aci_conn {
+    int fd;
+    uint32_t id;
+    struct aci_shm *shm;
+    uint64_t snaps[ACI_CONN_SNAPS];
+    uint8_t nsnaps;
+    TAILQ_HEAD(aci_outq, aci_outbuf) outq;
+    size_t backlog;
+    char *inbuf;
+    size_t inlen;
+    size_t incap;
+    struct aci_upload *upload;
+    struct aci_watcher *watch;
+    struct aci_arena arena;
+    uint8_t throttled : 1;
+    uint8_t writing : 1;
+    uint8_t stalled : 1;
+    uint8_t error : 1;
+};
+
+/*
+ * Send reply bytes to a client, through shared memory
+ * if the connection has a channel. MSG_MORE in 'flags'
+ * holds back the consumer wakeup until the end of the
+ * reply. Whatever the socket or ring does not take
+ * right away is queued, to be sent by aci_conn_flush()
+ * once it is writable or the client drained its ring;
+ * this never blocks.
+ *
+ * @conn: Connection to send on
+ * @buf: Bytes to send
+ * @len: Number of bytes to send
+ * @flags: send() flags
+ *
+ * Returns the number of bytes sent, -1 on error
+ */
+ssize_t aci_conn_send(
+    struct aci_conn *conn, const void *buf,
+    size_t len, int flags
+);
+
+/*
+ * Send as much of the output queue of a connection as
+ * the socket or ring takes without blocking, once it
+ * has become writable or been drained
+ *
+ * Returns zero on success, -1 if the connection failed
+ */
+int aci_conn_flush(struct aci_conn *conn);
+
+/*
+ * Hold on to received bytes that do not make up a
+ * whole packet yet, until the rest arrives
+ *
+ * @conn: Connection the bytes came in on
+ * @buf: Bytes to append to 'inbuf'
+ * @len: Number of bytes
+ *
+ * Returns zero on success
+ */
+int aci_conn_stash(struct aci_conn *conn, const void *buf, size_t len);
+
+/*
+ * Drop the first 'len' bytes of the input buffer of
+ * a connection once they have been handled
+ */
+void aci_conn_consume(struct aci_conn *conn, size_t len);
+
+/*
+ * Set up the output queue of a new connection and
+ * make its socket non-blocking
+ *
+ * Returns zero on success
+ */
+int aci_conn_init(struct aci_conn *conn);
+
+/*
+ * Free everything still queued on a connection, in
+ * either direction, along with its arena
+ */
+void aci_conn_drop(struct aci_conn *conn);
+
+#endif  /* !ACI_CONN_H */
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ACI_HANDOFF_H
+#define ACI_HANDOFF_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include "aci/proto.h"
+
+/* Longest the old daemon waits for its clients to go idle [ms] */
+#define ACI_HANDOFF_DRAIN 2000
+
+/* Most descriptors one handoff passes */
+#define ACI_HANDOFF_FDS 64
+
+/*
+ * Send the reply to an ACI_CMD_HANDOFF packet along
+ * with the descriptors it hands over
+ *
+ * @fd: Socket of the new daemon
+ * @reply: Reply to send
+ * @fdv: Descriptors to pass
+ * @fdc: Number of descriptors [at most ACI_HANDOFF_FDS]
+ *
+ * Returns zero on success
+ */
+int aci_handoff_send(
+    int fd, const struct aci_handoff_reply *reply,
+    const int *fdv, int fdc
+);
+
+/*
+ * Ask the daemon listening on 'path' to hand itself
+ * over, blocking until it has drained
+ *
+ * @path: Path of the IPC socket of the running daemon
+ * @reply: Reply is written here
+ * @fdv: Descriptors passed are written here
+ * @max: Room in 'fdv'
+ *
+ * Returns the number of descriptors passed, -1 on error
+ */
+int aci_handoff_take(
+    const char *path, struct aci_handoff_reply *reply,
+    int *fdv, int max
+);
+
+#endif  /* !ACI_HANDOFF_H */
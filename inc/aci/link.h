@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ACI_LINK_H
+#define ACI_LINK_H 1
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "aci/shm.h"
+#include "defs.h"
+
+/* Link flags */
+#define ACI_LINK_SHM BIT(0)     /* Move packets through shared memory */
+
+/*
+ * A client side connection to the ACI daemon. The
+ * socket is always kept open, even when packets go
+ * through shared memory, so either side can tell when
+ * the other goes away.
+ *
+ * @sockfd: Socket connected to the daemon
+ * @shm: Shared-memory channel [NULL if unused]
+ */
+struct aci_link {
+    int sockfd;
+    struct aci_shm *shm;
+};
+
+/*
+ * Connect to the ACI daemon. If ACI_LINK_SHM is given
+ * but the daemon refuses the channel, the link falls
+ * back to the socket.
+ *
+ * @path: Path of the IPC socket
+ * @flags: Link flags
+ * @res: Result link is written here
+ *
+ * Returns zero on success
+ */
+int aci_link_open(const char *path, uint32_t flags, struct aci_link **res);
+
+/*
+ * Send a whole packet to the daemon
+ *
+ * @link: Link to send on
+ * @buf: Packet bytes
+ * @len: Length of the packet
+ *
+ * Returns the number of bytes sent, -1 on error
+ */
+ssize_t aci_link_send(struct aci_link *link, const void *buf, size_t len);
+
+/*
+ * Receive exactly 'len' bytes of a reply
+ *
+ * @link: Link to receive from
+ * @buf: Buffer to fill
+ * @len: Number of bytes wanted
+ *
+ * Returns 'len' on success, -1 on error or hangup
+ */
+ssize_t aci_link_recv(struct aci_link *link, void *buf, size_t len);
+
+/*
+ * Disconnect and free a link
+ */
+void aci_link_close(struct aci_link *link);
+
+#endif  /* !ACI_LINK_H */
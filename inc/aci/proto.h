@@ -33,6 +33,9 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "aci/datatype.h"
+#include "drum/drum.h"
+#include "drum/bucket.h"
+#include "defs.h"
 
 /*
  * Valid ACI commands
@@ -40,14 +43,140 @@
  * @ACI_CMD_NOP: No-operation [does nothing]
  * @ACI_CMD_STORE: Store a piece of data to a key
  * @ACI_CMD_QUERY: Query a key
+ * @ACI_CMD_CREATE: Create an object
+ * @ACI_CMD_GET: Fetch the data of a single key
+ * @ACI_CMD_SCAN: Stream keys starting with a prefix
+ * @ACI_CMD_RANGE: Stream keys within [start, end)
+ * @ACI_CMD_AGGREGATE: Aggregate a typed column of a drum
+ * @ACI_CMD_SHM: Move the connection to shared memory [see aci/link.h]
+ * @ACI_CMD_STORE_TTL: Store a piece of data that expires
+ * @ACI_CMD_SNAPSHOT: Take or release a snapshot for reads
+ * @ACI_CMD_STATS: Report the replication state of the daemon
+ * @ACI_CMD_ADOPT: Take over segments staged by odb-load
+ * @ACI_CMD_BACKUP: Copy drums to a directory of the daemon
+ * @ACI_CMD_EXPORT: Stream a copy of drums back to the client
+ * @ACI_CMD_STORE_BEGIN: Start storing a value in chunks
+ * @ACI_CMD_STORE_CHUNK: Next piece of the value being stored
+ * @ACI_CMD_STORE_COMMIT: Make the value stored in chunks visible
+ * @ACI_CMD_BATCH: Run several stores sent as one packet
+ * @ACI_CMD_INCR: Add to an integer value in place
+ * @ACI_CMD_APPEND: Add to the end of a string value in place
+ * @ACI_CMD_CAS: Store a value if the key is still at a version
+ * @ACI_CMD_WATCH: Have changes to a drum or key prefix pushed back
+ * @ACI_CMD_HANDOFF: Hand the daemon over to a new one [see odb.d -H]
  */
 typedef enum {
     ACI_CMD_NOP,
     ACI_CMD_STORE,
     ACI_CMD_QUERY,
-    ACI_CMD_CREATE
+    ACI_CMD_CREATE,
+    ACI_CMD_GET,
+    ACI_CMD_SCAN,
+    ACI_CMD_RANGE,
+    ACI_CMD_AGGREGATE,
+    ACI_CMD_SHM,
+    ACI_CMD_STORE_TTL,
+    ACI_CMD_SNAPSHOT,
+    ACI_CMD_STATS,
+    ACI_CMD_ADOPT,
+    ACI_CMD_BACKUP,
+    ACI_CMD_EXPORT,
+    ACI_CMD_STORE_BEGIN,
+    ACI_CMD_STORE_CHUNK,
+    ACI_CMD_STORE_COMMIT,
+    ACI_CMD_BATCH,
+    ACI_CMD_INCR,
+    ACI_CMD_APPEND,
+    ACI_CMD_CAS,
+    ACI_CMD_WATCH,
+    ACI_CMD_HANDOFF
 } aci_op_t;
 
+/* Largest payload of a packet, larger values go in chunks */
+#define ACI_PKT_MAX (1024 * 1024)
+
+/* Data per ACI_CMD_STORE_CHUNK, small enough for a shm ring */
+#define ACI_CHUNK_LEN (32 * 1024)
+
+/* Largest value stored in chunks, it lands in a single segment */
+#define ACI_UPLOAD_MAX (1024ULL * 1024 * 1024)
+
+/* Most stores an ACI_CMD_BATCH packet may carry */
+#define ACI_BATCH_OPS 1024
+
+/*
+ * Aggregate functions
+ *
+ * @ACI_AGG_COUNT: Number of values
+ * @ACI_AGG_SUM: Sum of values [true values for bools]
+ * @ACI_AGG_MIN: Smallest value [all true for bools]
+ * @ACI_AGG_MAX: Largest value [any true for bools]
+ */
+typedef enum {
+    ACI_AGG_COUNT,
+    ACI_AGG_SUM,
+    ACI_AGG_MIN,
+    ACI_AGG_MAX
+} aci_agg_t;
+
+/* Scan flags */
+#define ACI_SCAN_AFTER  BIT(0)  /* Resume after the 'after' key */
+
+/* Row flags */
+#define ACI_ROW_END     BIT(0)  /* Last row of a reply */
+#define ACI_ROW_MORE    BIT(1)  /* Limit reached, key is the resume token */
+#define ACI_ROW_NONE    BIT(2)  /* Key does not exist */
+#define ACI_ROW_DRUM    BIT(3)  /* Key is a drum name, its rows follow */
+
+/* Replication roles */
+#define ACI_ROLE_LEADER   0     /* Takes writes [possibly without followers] */
+#define ACI_ROLE_FOLLOWER 1     /* Applies the log of a leader, read-only */
+
+/* Stats flags */
+#define ACI_STATS_LINKED BIT(0) /* Follower is connected to its leader */
+
+/* Snapshot flags */
+#define ACI_SNAP_RELEASE BIT(0) /* Release 'snap' rather than take one */
+
+/* Watch flags */
+#define ACI_WATCH_CANCEL BIT(0) /* Stop watching rather than start */
+
+/* Handoff flags */
+#define ACI_HANDOFF_REPL BIT(0) /* Replication socket is passed too */
+#define ACI_HANDOFF_WATCH BIT(1) /* Watch filters are passed too */
+
+/* Events pushed to a watching connection */
+#define ACI_EVENT_WATCH  0      /* Reply to ACI_CMD_WATCH */
+#define ACI_EVENT_STORE  1      /* Key was stored */
+#define ACI_EVENT_CREATE 2      /* Drum was created */
+#define ACI_EVENT_LOST   3      /* Changes up to 'seq' were thrown away */
+
+/* Predicate flags */
+#define ACI_PRED_ROWS   BIT(0)  /* Return matching rows, not just drums */
+#define ACI_PRED_KEYS   BIT(1)  /* Leave the data out of each row */
+#define ACI_PRED_RESUME BIT(2)  /* Resume at the 'resume' key */
+
+/*
+ * Value comparisons used by predicates
+ *
+ * @ACI_CMP_NONE: Every value matches
+ * @ACI_CMP_EQ: Value equals operand
+ * @ACI_CMP_NE: Value differs from operand
+ * @ACI_CMP_LT: Value is less than operand
+ * @ACI_CMP_LE: Value is less than or equal to operand
+ * @ACI_CMP_GT: Value is greater than operand
+ * @ACI_CMP_GE: Value is greater than or equal to operand
+ */
+typedef enum {
+    ACI_CMP_NONE,
+    ACI_CMP_EQ,
+    ACI_CMP_NE,
+    ACI_CMP_LT,
+    ACI_CMP_LE,
+    ACI_CMP_GT,
+    ACI_CMP_GE
+} aci_cmp_t;
+
 /*
  * An access control interface packet
  *
@@ -63,6 +192,455 @@ struct aci_pkt {
     char data[];
 };
 
+/*
+ * Payload of ACI_CMD_CREATE
+ *
+ * @name: Name of the object
+ * @flags: Object flags [DRUM_F_* for drums]
+ */
+struct PACKED aci_create {
+    char name[DRUM_NAMELEN];
+    uint32_t flags;
+};
+
+/*
+ * Payload of ACI_CMD_STORE. Keys are sent as 'keylen'
+ * bytes without a NUL, and may not hold one.
+ *
+ * @drum: Name of the target drum
+ * @keylen: Length of the key [1 to DRUM_KEYLEN_MAX]
+ * @data: Key of the bucket followed by the data to store
+ */
+struct PACKED aci_store {
+    char drum[DRUM_NAMELEN];
+    uint8_t keylen;
+    char data[];
+};
+
+/*
+ * Payload of ACI_CMD_STORE_BEGIN. Values of any size are
+ * stored as a begin packet, ACI_CMD_STORE_CHUNK packets
+ * carrying 'length' bytes of data between them, and an
+ * ACI_CMD_STORE_COMMIT packet. The daemon writes each
+ * chunk to the drum as it comes in rather than holding
+ * the value. Begin and commit are answered by aci_status,
+ * chunks are not; the first chunk that fails fails the
+ * commit. A connection stores one value at a time this
+ * way, and the value only becomes visible on commit.
+ *
+ * @drum: Name of the target drum
+ * @length: Length of the value [1 to ACI_UPLOAD_MAX]
+ * @ttl: Time to live in milliseconds [zero for never]
+ * @keylen: Length of the key
+ * @key: Key of the bucket
+ */
+struct PACKED aci_store_begin {
+    char drum[DRUM_NAMELEN];
+    uint64_t length;
+    uint64_t ttl;
+    uint8_t keylen;
+    char key[];
+};
+
+/*
+ * Payload of ACI_CMD_GET
+ *
+ * @drum: Name of the target drum
+ * @snap: Snapshot to read from [zero for the latest]
+ * @keylen: Length of the key
+ * @key: Key of the bucket
+ */
+struct PACKED aci_get {
+    char drum[DRUM_NAMELEN];
+    uint64_t snap;
+    uint8_t keylen;
+    char key[];
+};
+
+/*
+ * Payload of ACI_CMD_SNAPSHOT. A snapshot is a fixed
+ * point in time across every drum; reads that name it
+ * see no store made after it was taken. Snapshots are
+ * owned by the connection that took them and released
+ * when it closes.
+ *
+ * @snap: Snapshot to release [ACI_SNAP_RELEASE]
+ * @flags: Snapshot flags
+ */
+struct PACKED aci_snap {
+    uint64_t snap;
+    uint8_t flags;
+};
+
+/*
+ * Reply to an ACI_CMD_SNAPSHOT packet
+ *
+ * @error: Zero on success, otherwise an errno value
+ * @snap: Handle of the snapshot taken
+ */
+struct PACKED aci_snap_reply {
+    int32_t error;
+    uint64_t snap;
+};
+
+/*
+ * Payload of ACI_CMD_ADOPT. The segments staged for the
+ * drum [see DRUM_STAGE_FMT] become part of it as if they
+ * were written by a single store, the drum is created
+ * first if it does not exist. Answered by aci_status.
+ *
+ * @drum: Name of the target drum
+ * @flags: Drum flags, if it is to be created
+ */
+struct PACKED aci_adopt {
+    char drum[DRUM_NAMELEN];
+    uint32_t flags;
+};
+
+/*
+ * Payload of ACI_CMD_BACKUP and ACI_CMD_EXPORT. Either
+ * copies drums as they were when the request came in,
+ * while the daemon goes on serving other requests. A
+ * backup is written by the daemon as drum directories
+ * under 'path', which must not hold the drums yet, and
+ * is answered by aci_status once complete. An export is
+ * streamed back as parts, each an aci_part header and
+ * its data, on a connection that is not on shared memory.
+ *
+ * @drum: Drum to copy [empty for every drum]
+ * @path: NUL terminated directory [ACI_CMD_BACKUP]
+ */
+struct PACKED aci_backup {
+    char drum[DRUM_NAMELEN];
+    char path[];
+};
+
+#define ACI_PART_META 0     /* Settings of a drum [struct drum_meta] */
+#define ACI_PART_SEG  1     /* A segment of a drum */
+#define ACI_PART_END  2     /* Last part of the stream */
+
+/*
+ * Header of a part of an ACI_CMD_EXPORT stream
+ *
+ * @drum: Drum the part belongs to
+ * @kind: Kind of part [ACI_PART_*]
+ * @seg: Segment number [ACI_PART_SEG]
+ * @error: Zero, or why the export failed [ACI_PART_END]
+ * @length: Bytes of data that follow
+ */
+struct PACKED aci_part {
+    char drum[DRUM_NAMELEN];
+    uint8_t kind;
+    uint32_t seg;
+    int32_t error;
+    uint64_t length;
+};
+
+/*
+ * Payload of ACI_CMD_STORE_TTL. The key is dropped
+ * once 'ttl' has passed, storing it again without a
+ * TTL makes it permanent.
+ *
+ * @drum: Name of the target drum
+ * @ttl: Time to live in milliseconds [zero for never]
+ * @keylen: Length of the key
+ * @data: Key of the bucket followed by the data to store
+ */
+struct PACKED aci_store_ttl {
+    char drum[DRUM_NAMELEN];
+    uint64_t ttl;
+    uint8_t keylen;
+    char data[];
+};
+
+/*
+ * Payload of ACI_CMD_INCR. 'delta' is added to the
+ * ACI_TYPE_INTEGER value of the key, a key that does not
+ * exist counts as zero. The key keeps any TTL it has.
+ * Answered by aci_update_reply with the new value.
+ *
+ * @drum: Name of the target drum
+ * @delta: Amount to add [negative to decrement]
+ * @keylen: Length of the key
+ * @key: Key of the bucket
+ */
+struct PACKED aci_incr {
+    char drum[DRUM_NAMELEN];
+    int64_t delta;
+    uint8_t keylen;
+    char key[];
+};
+
+/*
+ * Payload of ACI_CMD_CAS. The value is stored only if
+ * the newest version of the key is still 'seq', as handed
+ * out by a previous aci_update_reply; a 'seq' of zero
+ * only stores a key that does not exist. Otherwise the
+ * store is refused with ESTALE and the reply carries the
+ * current version and value, to retry against.
+ *
+ * @drum: Name of the target drum
+ * @seq: Version the key must be at
+ * @keylen: Length of the key
+ * @data: Key of the bucket followed by the data to store
+ */
+struct PACKED aci_cas {
+    char drum[DRUM_NAMELEN];
+    uint64_t seq;
+    uint8_t keylen;
+    char data[];
+};
+
+/*
+ * Payload of ACI_CMD_WATCH. From the first watch on,
+ * the connection is sent an aci_event for every change
+ * to what it watches, and takes no command other than
+ * ACI_CMD_WATCH; each of those is answered by an
+ * ACI_EVENT_WATCH event rather than a reply of its own.
+ * Watching is not available over shared memory.
+ *
+ * Changes a client is slow to take are coalesced, a key
+ * changed again only shows up once with its newest
+ * sequence number. If too many keys change before the
+ * client catches up, their events are replaced by one
+ * ACI_EVENT_LOST event and the client has to look at
+ * what it watches again.
+ *
+ * @drum: Drum to watch [empty for every drum]
+ * @flags: Watch flags
+ * @keylen: Length of the key prefix [zero for every key]
+ * @prefix: Prefix of the keys to watch
+ */
+struct PACKED aci_watch {
+    char drum[DRUM_NAMELEN];
+    uint8_t flags;
+    uint8_t keylen;
+    char prefix[];
+};
+
+/*
+ * A change pushed to a watching connection, followed
+ * by 'keylen' bytes of key
+ *
+ * @op: Kind of event [ACI_EVENT_*]
+ * @error: Result of the watch [ACI_EVENT_WATCH]
+ * @seq: Sequence number of the change [the newest one
+ *       stored, for ACI_EVENT_WATCH and ACI_EVENT_CREATE]
+ * @drum: Drum that changed
+ * @keylen: Length of the key
+ */
+struct PACKED aci_event {
+    uint8_t op;
+    int32_t error;
+    uint64_t seq;
+    char drum[DRUM_NAMELEN];
+    uint8_t keylen;
+};
+
+/*
+ * Reply to an ACI_CMD_HANDOFF packet, sent once the
+ * daemon has drained. On success it carries, in this
+ * order, the listening socket, a memfd holding an image
+ * of each drum [see drum_image_write()], the replication
+ * socket [ACI_HANDOFF_REPL], a memfd holding the watch
+ * filters of each client in the order of their sockets
+ * [ACI_HANDOFF_WATCH, see aci_watch_save()] and the
+ * client sockets the new daemon takes over.
+ *
+ * @error: Zero on success, otherwise an errno value
+ * @flags: Handoff flags
+ * @nconns: Number of client sockets passed
+ */
+struct PACKED aci_handoff_reply {
+    int32_t error;
+    uint8_t flags;
+    uint32_t nconns;
+};
+
+/*
+ * Payload of ACI_CMD_SCAN and ACI_CMD_RANGE
+ *
+ * For ACI_CMD_SCAN 'start' holds the key prefix and
+ * 'end' is unused. For ACI_CMD_RANGE, an empty 'end'
+ * means the range is unbounded. When ACI_SCAN_AFTER is
+ * set the scan resumes after the 'after' key, which is
+ * the token handed out by a previous ACI_ROW_MORE row.
+ * The keys are zero padded, a key of DRUM_KEYLEN_MAX
+ * bytes fills its field.
+ *
+ * @drum: Name of the target drum
+ * @start: Prefix or inclusive lower bound
+ * @end: Exclusive upper bound
+ * @after: Resume token
+ * @limit: Max rows to return [zero for no limit]
+ * @flags: Scan flags
+ * @snap: Snapshot to read from [zero for the latest]
+ */
+struct PACKED aci_scan {
+    char drum[DRUM_NAMELEN];
+    char start[DRUM_KEYLEN_MAX];
+    char end[DRUM_KEYLEN_MAX];
+    char after[DRUM_KEYLEN_MAX];
+    uint32_t limit;
+    uint8_t flags;
+    uint64_t snap;
+};
+
+/*
+ * Optional payload of ACI_CMD_QUERY. An empty payload
+ * lists every drum. Otherwise the predicate is evaluated
+ * by the daemon and only matching drums [and rows, with
+ * ACI_PRED_ROWS] are sent back as a stream of rows.
+ *
+ * Values are only compared when their datatype matches
+ * 'vtype'; the operand is an int64_t for ACI_TYPE_INTEGER,
+ * one byte for ACI_TYPE_BOOL and raw bytes for strings.
+ *
+ * Drums are visited in name order. Once 'limit' rows
+ * were sent, the final row has ACI_ROW_MORE set, the
+ * next matching key as its resume token and the name
+ * of the drum the key is in as its ACI_TYPE_DRUM data.
+ * With ACI_PRED_RESUME set, the query starts over at
+ * that key, skipping the drums before its own.
+ *
+ * @drum: Glob the drum name must match [empty matches all]
+ * @key: Glob the key must match [empty matches all]
+ * @start: Inclusive lower key bound
+ * @end: Exclusive upper key bound [empty is unbounded]
+ * @resume: Resume token [ACI_PRED_RESUME]
+ * @resume_drum: Drum of the resume token [ACI_PRED_RESUME]
+ * @limit: Max rows to return [zero for no limit]
+ * @flags: Predicate flags
+ * @cmp: Value comparison [aci_cmp_t]
+ * @vtype: Datatype of the operand
+ * @snap: Snapshot to read from [zero for the latest]
+ * @operand: Value to compare against
+ */
+struct PACKED aci_pred {
+    char drum[DRUM_NAMELEN];
+    char key[DRUM_KEYLEN_MAX];
+    char start[DRUM_KEYLEN_MAX];
+    char end[DRUM_KEYLEN_MAX];
+    char resume[DRUM_KEYLEN_MAX];
+    char resume_drum[DRUM_NAMELEN];
+    uint32_t limit;
+    uint8_t flags;
+    uint8_t cmp;
+    uint8_t vtype;
+    uint64_t snap;
+    char operand[];
+};
+
+/*
+ * A single row sent back to the client, followed by
+ * 'keylen' bytes of key and 'length' bytes of data.
+ * Every reply stream ends with a row that has
+ * ACI_ROW_END set.
+ *
+ * @length: Length of the data following the key
+ * @flags: Row flags
+ * @type: Datatype of the data
+ * @keylen: Length of the key [or resume token]
+ */
+struct PACKED aci_row {
+    uint32_t length;
+    uint8_t flags;
+    uint8_t type;
+    uint8_t keylen;
+};
+
+/*
+ * Payload of ACI_CMD_AGGREGATE, the packet type
+ * selects the column [ACI_TYPE_INTEGER or ACI_TYPE_BOOL]
+ *
+ * @drum: Name of the target drum
+ * @func: Aggregate function [aci_agg_t]
+ */
+struct PACKED aci_agg {
+    char drum[DRUM_NAMELEN];
+    uint8_t func;
+};
+
+/*
+ * Reply to an ACI_CMD_AGGREGATE packet
+ *
+ * @error: Zero on success, otherwise an errno value
+ * @count: Number of values aggregated
+ * @value: Result of the aggregate
+ */
+struct PACKED aci_agg_reply {
+    int32_t error;
+    uint64_t count;
+    int64_t value;
+};
+
+/*
+ * Reply to an ACI_CMD_STATS packet
+ *
+ * @role: Replication role [ACI_ROLE_*]
+ * @flags: Stats flags
+ * @followers: Followers being streamed to
+ * @seq: Newest sequence number stored or applied
+ * @leader_seq: Newest sequence number of the leader [follower]
+ * @lag: Age of the data served in ms [follower]
+ * @arena_peak: Most scratch bytes one request of this
+ *              connection has needed
+ */
+struct PACKED aci_stats {
+    uint8_t role;
+    uint8_t flags;
+    uint32_t followers;
+    uint64_t seq;
+    uint64_t leader_seq;
+    uint64_t lag;
+    uint64_t arena_peak;
+};
+
+/*
+ * Reply to an ACI_CMD_BATCH packet, whose payload is
+ * a run of whole ACI_CMD_STORE and ACI_CMD_STORE_TTL
+ * packets. The stores are made in order and 'count'
+ * results follow, one per store. A batch that is not
+ * well formed is refused as a whole with no results.
+ *
+ * @count: Number of results
+ * @error: Zero or an errno value, per store
+ */
+struct PACKED aci_batch_reply {
+    uint32_t count;
+    int32_t error[];
+};
+
+/*
+ * Reply to an ACI_CMD_INCR, ACI_CMD_APPEND or ACI_CMD_CAS
+ * packet, followed by 'length' bytes of value: the new
+ * value of an ACI_CMD_INCR, or the current value of a key
+ * an ACI_CMD_CAS failed on. ACI_CMD_APPEND takes the
+ * payload of ACI_CMD_STORE, and only appends to values
+ * of the ACI_TYPE_STRING it is sent as.
+ *
+ * @error: Zero on success, otherwise an errno value
+ * @seq: Version the key is now at [zero if it does not exist]
+ * @type: Datatype of the value that follows
+ * @length: Length of the value that follows
+ */
+struct PACKED aci_update_reply {
+    int32_t error;
+    uint64_t seq;
+    uint8_t type;
+    uint32_t length;
+};
+
+/*
+ * Reply to an ACI_CMD_STORE[_TTL|_BEGIN|_COMMIT] or
+ * ACI_CMD_SHM packet
+ *
+ * @error: Zero on success, otherwise an errno value
+ */
+struct PACKED aci_status {
+    int32_t error;
+};
+
 /*
  * Initialize an ACI packet
  *
@@ -85,4 +663,17 @@ int aci_pkt_init(
  */
 void aci_pkt_free(struct aci_pkt *pkt);
 
+/*
+ * Copy a key sent as 'keylen' bytes out of a packet
+ *
+ * @src: Key bytes within the packet
+ * @keylen: Length of the key
+ * @avail: Bytes of the packet left at 'src'
+ * @buf: Buffer of DRUM_KEYLEN_MAX + 1 bytes, the key is
+ *       written here NUL terminated
+ *
+ * Returns zero on success
+ */
+int aci_key_get(const char *src, size_t keylen, size_t avail, char *buf);
+
 #endif  /* !ACI_PROTO_H */
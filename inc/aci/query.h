@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ACI_QUERY_H
+#define ACI_QUERY_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include "aci/proto.h"
+
+/*
+ * A predicate unpacked from an ACI_CMD_QUERY
+ * packet, with NUL terminated globs.
+ *
+ * @drum: Drum name glob [empty matches all]
+ * @key: Key glob [empty matches all]
+ * @start: Inclusive lower key bound
+ * @end: Exclusive upper key bound [empty is unbounded]
+ * @resume: Key to resume at [ACI_PRED_RESUME]
+ * @resume_drum: Drum of 'resume' [ACI_PRED_RESUME]
+ * @limit: Max rows to return [zero for no limit]
+ * @flags: Predicate flags
+ * @cmp: Value comparison
+ * @vtype: Datatype of the operand
+ * @snap: Snapshot to read from [zero for the latest]
+ * @operand: Operand of the comparison
+ * @operand_len: Length of the operand
+ */
+struct aci_query {
+    char drum[DRUM_NAMELEN + 1];
+    char key[DRUM_KEYLEN_MAX + 1];
+    char start[DRUM_KEYLEN_MAX + 1];
+    char end[DRUM_KEYLEN_MAX + 1];
+    char resume[DRUM_KEYLEN_MAX + 1];
+    char resume_drum[DRUM_NAMELEN + 1];
+    uint32_t limit;
+    uint8_t flags;
+    aci_cmp_t cmp;
+    uint8_t vtype;
+    uint64_t snap;
+    const char *operand;
+    size_t operand_len;
+};
+
+/*
+ * Unpack and validate the predicate of a packet
+ *
+ * @pkt: ACI_CMD_QUERY packet
+ * @res: Query is written here
+ *
+ * Returns zero on success
+ */
+int aci_query_init(const struct aci_pkt *pkt, struct aci_query *res);
+
+/*
+ * Returns true if a drum name matches the query
+ */
+int aci_query_drum(const struct aci_query *q, const char *name);
+
+/*
+ * Returns true if a NUL terminated key matches the
+ * globs of the query. Returns -1 once the key is past
+ * the end of the key range, so callers can stop early.
+ */
+int aci_query_key(const struct aci_query *q, const char *key);
+
+/*
+ * Returns true if a value satisfies the comparison
+ * of the query
+ *
+ * @q: Query to test against
+ * @type: Datatype of the value
+ * @data: Raw value
+ * @len: Length of the value
+ */
+int aci_query_value(
+    const struct aci_query *q, uint8_t type,
+    const void *data, size_t len
+);
+
+#endif  /* !ACI_QUERY_H */
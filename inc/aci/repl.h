@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ACI_REPL_H
+#define ACI_REPL_H 1
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "aci/proto.h"
+#include "defs.h"
+
+/* Interval between heartbeats to idle followers [ms] */
+#define ACI_REPL_INTERVAL 250
+
+/* Largest record a frame may carry */
+#define ACI_REPL_DATA_MAX (16 * 1024 * 1024)
+
+/*
+ * Replication frame operations. A follower opens with
+ * ACI_REPL_HELLO, the leader answers with every record
+ * the follower lacks, ACI_REPL_SYNC, and from then on
+ * each record as it is stored.
+ *
+ * @ACI_REPL_HELLO: Follower wants records after 'seq'
+ * @ACI_REPL_CREATE: A drum was created with 'flags'
+ * @ACI_REPL_STORE: A bucket was stored
+ * @ACI_REPL_SYNC: Every record up to 'seq' has been sent
+ * @ACI_REPL_BEAT: Leader is alive and at 'seq'
+ */
+typedef enum {
+    ACI_REPL_HELLO,
+    ACI_REPL_CREATE,
+    ACI_REPL_STORE,
+    ACI_REPL_SYNC,
+    ACI_REPL_BEAT
+} aci_repl_op_t;
+
+/*
+ * A frame of the replication log. Store frames carry
+ * the bucket exactly as the leader appended it to its
+ * segment.
+ *
+ * @op: Frame operation [aci_repl_op_t]
+ * @type: Datatype of the data [ACI_REPL_STORE]
+ * @flags: Drum flags [ACI_REPL_CREATE]
+ * @seq: Sequence number of the record or position
+ * @stamp: Leader clock when the frame was made [ms]
+ * @expire: Expiry time of the bucket [ACI_REPL_STORE]
+ * @drum: Name of the drum
+ * @keylen: Length of the key following the frame [ACI_REPL_STORE]
+ * @length: Length of the data following the key
+ */
+struct PACKED aci_repl_frame {
+    uint8_t op;
+    uint8_t type;
+    uint32_t flags;
+    uint64_t seq;
+    uint64_t stamp;
+    uint64_t expire;
+    char drum[DRUM_NAMELEN];
+    uint8_t keylen;
+    uint32_t length;
+};
+
+/*
+ * Send a frame followed by its key and data
+ *
+ * @fd: Replication socket
+ * @frame: Frame to send, 'keylen' bytes of key and
+ *         'length' bytes of data follow
+ * @key: Key of the frame [NULL if 'keylen' is zero]
+ * @data: Data of the frame [NULL if 'length' is zero]
+ *
+ * Returns zero on success
+ */
+int aci_repl_send(
+    int fd, const struct aci_repl_frame *frame,
+    const char *key, const void *data
+);
+
+/*
+ * Receive a frame with its key and data, blocking until
+ * the whole frame is in
+ *
+ * @fd: Replication socket
+ * @frame: Frame is written here
+ * @key: Buffer of DRUM_KEYLEN_MAX + 1 bytes, the key of
+ *       the frame is written here NUL terminated
+ * @data: Data of the frame is written here, to be
+ *        free()'d by the caller [NULL if none]
+ *
+ * Returns zero on success
+ */
+int aci_repl_recv(
+    int fd, struct aci_repl_frame *frame,
+    char *key, void **data
+);
+
+#endif  /* !ACI_REPL_H */
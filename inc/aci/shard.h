@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ACI_SHARD_H
+#define ACI_SHARD_H 1
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "aci/link.h"
+#include "aci/proto.h"
+
+/* Most daemons a client can shard across */
+#define ACI_SHARDS_MAX 32
+
+/* Separates the endpoints of a shard list */
+#define ACI_SHARD_SEP ","
+
+/*
+ * A set of daemons that drums are sharded across. Every
+ * daemon holds every drum; each key of a drum lives on
+ * exactly one of them, picked by a consistent hash of
+ * the drum name and key. Endpoints must only ever be
+ * appended to the list, so that adding one moves just
+ * the keys that now belong to it.
+ *
+ * @links: Link to each daemon
+ * @paths: IPC socket path of each daemon
+ * @count: Number of daemons
+ */
+struct aci_shards {
+    struct aci_link *links[ACI_SHARDS_MAX];
+    char *paths[ACI_SHARDS_MAX];
+    size_t count;
+};
+
+/*
+ * A row of a reply held in memory
+ *
+ * @drum: Drum the row belongs to [zeroed if unknown]
+ * @group: Order of the drum among the merged rows
+ * @row: Row header
+ * @key: Key of the row, NUL terminated
+ * @data: Data of the row [NULL if none]
+ */
+struct aci_rowbuf {
+    char drum[DRUM_NAMELEN];
+    uint32_t group;
+    struct aci_row row;
+    char key[DRUM_KEYLEN_MAX + 1];
+    char *data;
+};
+
+/*
+ * Rows of a reply, possibly merged from several daemons
+ *
+ * @rows: Rows in order, without the final row
+ * @count: Number of rows
+ * @cap: Number of rows there is room for
+ * @flags: Flags of the final row
+ * @token: Key of the final row, NUL terminated [e.g., a
+ *         resume token]
+ * @token_drum: Drum of 'token' for replies spanning drums
+ *              [zeroed if none]
+ */
+struct aci_rowset {
+    struct aci_rowbuf *rows;
+    size_t count;
+    size_t cap;
+    uint8_t flags;
+    char token[DRUM_KEYLEN_MAX + 1];
+    char token_drum[DRUM_NAMELEN];
+};
+
+/*
+ * Connect to every daemon of a shard list
+ *
+ * @endpoints: IPC socket paths split by ACI_SHARD_SEP
+ * @flags: Link flags used for each of them
+ * @res: Result is written here
+ *
+ * Returns zero on success
+ */
+int aci_shards_open(
+    const char *endpoints, uint32_t flags,
+    struct aci_shards **res
+);
+
+/*
+ * Jump consistent hash, maps 'key' to one of 'buckets'
+ * so that growing the number of buckets by one only
+ * moves 1/buckets of the keys
+ */
+int32_t aci_jump_hash(uint64_t key, int32_t buckets);
+
+/*
+ * Returns the index of the daemon holding a key
+ *
+ * @shards: Daemons to pick from
+ * @drum: Drum name [NUL terminated or DRUM_NAMELEN long]
+ * @key: Key [NUL terminated]
+ */
+size_t aci_shard_of(
+    const struct aci_shards *shards,
+    const char *drum, const char *key
+);
+
+/*
+ * Receive a reply made up of rows from a single link
+ * and append its rows to a set. The flags and key of
+ * the final row are written to the set.
+ *
+ * Returns zero on success
+ */
+int aci_link_rows(struct aci_link *link, struct aci_rowset *set);
+
+/*
+ * Receive the row replies of every daemon to a request
+ * sent to each of them, and merge them in key order
+ * within each drum. The final row of the set has
+ * ACI_ROW_MORE set if any daemon had more rows, and
+ * ACI_ROW_NONE only if every daemon refused. For
+ * replies spanning drums [QUERY] the token is the first
+ * row left out and its drum, otherwise the last row
+ * kept. A daemon that had more rows but handed out no
+ * token fails the merge with EPROTO.
+ *
+ * @shards: Daemons the request went to
+ * @limit: Max rows kept [zero for no limit]
+ * @res: Merged rows are written here
+ *
+ * Returns zero on success
+ */
+int aci_shards_rows(
+    struct aci_shards *shards, uint32_t limit,
+    struct aci_rowset *res
+);
+
+/*
+ * Free the rows of a set
+ */
+void aci_rowset_free(struct aci_rowset *set);
+
+/*
+ * Disconnect from every daemon and free a shard list
+ */
+void aci_shards_close(struct aci_shards *shards);
+
+#endif  /* !ACI_SHARD_H */
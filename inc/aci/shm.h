@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ACI_SHM_H
+#define ACI_SHM_H 1
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Must be a power of two */
+#define ACI_RING_SIZE (64 * 1024)
+
+/* Spins before a consumer falls back to sleeping */
+#define ACI_RING_SPIN 4096
+
+/*
+ * A single-producer single-consumer byte ring living in
+ * shared memory. Frames are published with one store to
+ * 'head' so the consumer never sees half a frame.
+ *
+ * @head: Bytes ever written [producer owned]
+ * @tail: Bytes ever read [consumer owned]
+ * @waiting: Set while the consumer sleeps on its eventfd
+ * @full: Set while the producer waits for room
+ * @data: Ring storage
+ */
+struct aci_ring {
+    _Alignas(64) _Atomic uint32_t head;
+    _Alignas(64) _Atomic uint32_t tail;
+    _Alignas(64) _Atomic uint32_t waiting;
+    _Alignas(64) _Atomic uint32_t full;
+    _Alignas(64) char data[ACI_RING_SIZE];
+};
+
+/*
+ * Layout of the shared-memory region
+ *
+ * @tx: Client to daemon ring
+ * @rx: Daemon to client ring
+ */
+struct aci_shm_region {
+    struct aci_ring tx;
+    struct aci_ring rx;
+};
+
+/*
+ * A mapped shared-memory channel. The client creates
+ * it and hands the descriptors to the daemon over the
+ * socket with SCM_RIGHTS.
+ *
+ * @region: Mapped region
+ * @memfd: Descriptor backing the region
+ * @tx_efd: Eventfd the daemon sleeps on
+ * @rx_efd: Eventfd the client sleeps on
+ */
+struct aci_shm {
+    struct aci_shm_region *region;
+    int memfd;
+    int tx_efd;
+    int rx_efd;
+};
+
+/*
+ * Returns the number of bytes ready to be read
+ */
+size_t aci_ring_avail(struct aci_ring *ring);
+
+/*
+ * Returns true if the indices of a ring were left in
+ * a state no well-behaved peer produces, more bytes
+ * ready than the ring holds. Nothing more is put to or
+ * taken from such a ring.
+ */
+int aci_ring_broken(struct aci_ring *ring);
+
+/*
+ * Write 'len' bytes to a ring, either all of them or
+ * none of them.
+ *
+ * Returns 'len' on success, zero if the ring lacks room
+ */
+size_t aci_ring_put(struct aci_ring *ring, const void *buf, size_t len);
+
+/*
+ * Copy out up to 'len' ready bytes without consuming
+ * them
+ */
+size_t aci_ring_peek(struct aci_ring *ring, void *buf, size_t len);
+
+/*
+ * Read up to 'len' ready bytes
+ */
+size_t aci_ring_get(struct aci_ring *ring, void *buf, size_t len);
+
+/*
+ * Wake the consumer of a ring if it is asleep
+ *
+ * @ring: Ring that was written to
+ * @efd: Eventfd the consumer sleeps on
+ */
+void aci_ring_kick(struct aci_ring *ring, int efd);
+
+/*
+ * Announce that the consumer is about to sleep. Returns
+ * zero and stays awake if data raced in.
+ */
+int aci_ring_idle(struct aci_ring *ring);
+
+/*
+ * Announce that the producer is waiting for room and
+ * wants to be woken by aci_ring_drained(). Returns zero
+ * if room was made in the meantime.
+ */
+int aci_ring_full(struct aci_ring *ring);
+
+/*
+ * Wake the producer of a ring if it waits for room,
+ * called by the consumer after reading from it
+ *
+ * @ring: Ring that was read from
+ * @efd: Eventfd the producer sleeps on
+ */
+void aci_ring_drained(struct aci_ring *ring, int efd);
+
+/*
+ * Create and map a new channel
+ *
+ * @res: Result is written here
+ *
+ * Returns zero on success
+ */
+int aci_shm_create(struct aci_shm **res);
+
+/*
+ * Map a channel from descriptors received from a
+ * client. The descriptors are owned by the channel
+ * afterwards. The region must be sealed against
+ * shrinking [F_SEAL_SHRINK].
+ *
+ * @memfd: Region descriptor
+ * @tx_efd: Client to daemon eventfd
+ * @rx_efd: Daemon to client eventfd
+ * @res: Result is written here
+ *
+ * Returns zero on success
+ */
+int aci_shm_attach(int memfd, int tx_efd, int rx_efd, struct aci_shm **res);
+
+/*
+ * Unmap a channel and close its descriptors
+ */
+void aci_shm_free(struct aci_shm *shm);
+
+#endif  /* !ACI_SHM_H */
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ACI_URING_H
+#define ACI_URING_H 1
+
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* Size of the sparse registered file table */
+#define ACI_URING_FILES 1024
+
+/*
+ * An io_uring instance driven through the raw system
+ * calls. SQEs are queued locally and handed to the
+ * kernel in one batch by aci_uring_submit().
+ *
+ * @fd: Ring descriptor
+ * @features: IORING_FEAT_* the kernel offers
+ * @sq_head: Kernel owned submission head
+ * @sq_tail: Submission tail seen by the kernel
+ * @sq_mask: Submission ring mask
+ * @sq_array: Submission index array
+ * @sq_local: Submission tail including queued SQEs
+ * @cq_head: Completion head [consumer owned]
+ * @cq_tail: Kernel owned completion tail
+ * @cq_mask: Completion ring mask
+ * @sqes: Submission queue entries
+ * @cqes: Completion queue entries
+ * @map: Mapping of both rings
+ * @map_len: Length of the ring mapping
+ * @sqes_len: Length of the SQE mapping
+ * @files: Registered file table [indexed by fd]
+ * @br: Provided buffer ring [NULL if none]
+ * @pbufs: Storage of the provided buffers
+ * @pbuf_count: Number of provided buffers
+ * @pbuf_len: Length of each provided buffer
+ */
+struct aci_uring {
+    int fd;
+    uint32_t features;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_local;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *map;
+    size_t map_len;
+    size_t sqes_len;
+    int *files;
+    struct io_uring_buf_ring *br;
+    char *pbufs;
+    uint16_t pbuf_count;
+    uint32_t pbuf_len;
+};
+
+/*
+ * Set up a ring
+ *
+ * @ring: Ring to set up
+ * @entries: Number of submission entries
+ *
+ * Returns zero on success
+ */
+int aci_uring_init(struct aci_uring *ring, unsigned entries);
+
+/*
+ * Queue a zeroed SQE, flushing queued entries to the
+ * kernel first if the submission ring is full.
+ *
+ * Returns NULL on failure
+ */
+struct io_uring_sqe *aci_uring_sqe(struct aci_uring *ring);
+
+/*
+ * Hand every queued SQE to the kernel and wait for
+ * completions, all in one system call.
+ *
+ * @ring: Ring to submit on
+ * @wait_nr: Completions to wait for
+ *
+ * Returns the number of SQEs consumed, -1 on error
+ */
+int aci_uring_submit(struct aci_uring *ring, unsigned wait_nr);
+
+/*
+ * Hand every queued SQE to the kernel and wait for
+ * one completion, giving up after 'timeout' ms [-1 to
+ * wait forever]. Needs IORING_FEAT_EXT_ARG.
+ *
+ * Returns zero on success or timeout, -1 on error
+ */
+int aci_uring_wait(struct aci_uring *ring, int timeout);
+
+/*
+ * Returns the next completion without consuming it,
+ * or NULL if there is none
+ */
+struct io_uring_cqe *aci_uring_cqe(struct aci_uring *ring);
+
+/*
+ * Consume the completion returned by aci_uring_cqe()
+ */
+void aci_uring_seen(struct aci_uring *ring);
+
+/*
+ * Register fixed buffers to be used by READ_FIXED and
+ * WRITE_FIXED, by index into 'iov'.
+ *
+ * Returns zero on success
+ */
+int aci_uring_buffers(
+    struct aci_uring *ring,
+    const struct iovec *iov,
+    unsigned count
+);
+
+/*
+ * Register a descriptor in the fixed file table. Slots
+ * are indexed by descriptor number, so registering is
+ * only a system call the first time 'fd' is seen.
+ *
+ * Returns the fixed file slot, or -1 if 'fd' is not
+ * registrable and must be used as a plain descriptor
+ */
+int aci_uring_file(struct aci_uring *ring, int fd);
+
+/*
+ * Drop a descriptor from the fixed file table, which
+ * must be done before it is closed
+ */
+void aci_uring_forget(struct aci_uring *ring, int fd);
+
+/*
+ * Register a ring of provided buffers as buffer group
+ * zero, for receives queued with IOSQE_BUFFER_SELECT.
+ *
+ * @ring: Ring to register with
+ * @count: Number of buffers [power of two]
+ * @len: Length of each buffer
+ *
+ * Returns zero on success
+ */
+int aci_uring_pbuf_init(struct aci_uring *ring, uint16_t count, uint32_t len);
+
+/*
+ * Returns the provided buffer a completion landed in
+ */
+char *aci_uring_pbuf(struct aci_uring *ring, const struct io_uring_cqe *cqe);
+
+/*
+ * Give the provided buffer of a completion back to
+ * the kernel
+ */
+void aci_uring_pbuf_put(struct aci_uring *ring, const struct io_uring_cqe *cqe);
+
+/*
+ * Tear down a ring
+ */
+void aci_uring_free(struct aci_uring *ring);
+
+#endif  /* !ACI_URING_H */
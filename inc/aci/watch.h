@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ACI_WATCH_H
+#define ACI_WATCH_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include "drum/drum.h"
+
+/* Drums or key prefixes one connection may watch */
+#define ACI_WATCH_MAX 16
+
+/* Changes held back for a watcher that is not keeping up */
+#define ACI_WATCH_QUEUE 1024
+
+/* Queued reply bytes past which changes are held back */
+#define ACI_WATCH_HIWAT (64 * 1024)
+
+struct aci_conn;
+
+/*
+ * A drum and key prefix being watched
+ *
+ * @drum: Drum name [empty for every drum]
+ * @keylen: Length of the prefix [zero for every key]
+ * @prefix: Prefix keys must start with
+ */
+struct aci_watch_filter {
+    char drum[DRUM_NAMELEN];
+    uint8_t keylen;
+    char prefix[DRUM_KEYLEN_MAX];
+};
+
+/*
+ * A change that has not been sent to a watcher yet
+ *
+ * @op: Kind of change [ACI_EVENT_*]
+ * @keylen: Length of the key
+ * @seq: Sequence number of the change
+ * @drum: Drum that changed
+ * @key: Key that changed
+ */
+struct aci_watch_ev {
+    uint8_t op;
+    uint8_t keylen;
+    uint64_t seq;
+    char drum[DRUM_NAMELEN];
+    char key[DRUM_KEYLEN_MAX];
+};
+
+/*
+ * What a connection watches, along with the changes
+ * waiting to be sent to it. A key changed again before
+ * its last change went out keeps its place in the
+ * queue and takes the newer sequence number. Once the
+ * queue fills up with distinct keys, it is thrown away
+ * and the watcher is told it lost changes instead.
+ *
+ * @filters: Drums and prefixes watched
+ * @nfilters: Number of filters
+ * @queue: Changes in the order they first came in
+ * @count: Number of changes queued
+ * @slots: Hash of queued keys to their place in 'queue' plus one
+ * @lost_seq: Newest change thrown away [zero if none]
+ */
+struct aci_watcher {
+    struct aci_watch_filter filters[ACI_WATCH_MAX];
+    uint8_t nfilters;
+    struct aci_watch_ev queue[ACI_WATCH_QUEUE];
+    size_t count;
+    uint16_t slots[ACI_WATCH_QUEUE * 2];
+    uint64_t lost_seq;
+};
+
+/*
+ * Start watching a drum or key prefix, allocating the
+ * watcher on first use
+ *
+ * @wp: Watcher of the connection [may point to NULL]
+ * @drum: Drum name [empty for every drum]
+ * @prefix: Key prefix
+ * @len: Length of the prefix [zero for every key]
+ *
+ * Returns zero on success
+ */
+int aci_watch_add(
+    struct aci_watcher **wp, const char *drum,
+    const char *prefix, size_t len
+);
+
+/*
+ * Stop watching a drum or key prefix added with the
+ * same arguments
+ *
+ * Returns zero on success
+ */
+int aci_watch_del(
+    struct aci_watcher *w, const char *drum,
+    const char *prefix, size_t len
+);
+
+/*
+ * Queue a change if the watcher is interested in it
+ *
+ * @w: Watcher to tell
+ * @op: Kind of change [ACI_EVENT_*]
+ * @seq: Sequence number of the change
+ * @drum: Drum that changed
+ * @key: Key that changed [empty for ACI_EVENT_CREATE]
+ * @len: Length of the key
+ */
+void aci_watch_note(
+    struct aci_watcher *w, uint8_t op,
+    uint64_t seq, const char *drum,
+    const char *key, size_t len
+);
+
+/*
+ * Send every change queued for the watcher of a
+ * connection as aci_event frames, and empty the queue
+ *
+ * Returns zero on success
+ */
+int aci_watch_flush(struct aci_conn *conn);
+
+/*
+ * Returns true if a watcher has changes to send
+ */
+int aci_watch_pending(const struct aci_watcher *w);
+
+/*
+ * Append the filters of a watcher to 'fd', so that a
+ * new daemon taking over the connection goes on
+ * watching them [see aci_watch_load()]. Queued changes
+ * are not saved.
+ *
+ * @w: Watcher to save [NULL saves an empty one]
+ * @fd: Descriptor to write to
+ *
+ * Returns zero on success
+ */
+int aci_watch_save(const struct aci_watcher *w, int fd);
+
+/*
+ * Read back filters written by aci_watch_save()
+ *
+ * @wp: Watcher of the connection, allocated if any
+ *      filter was saved
+ * @p: Cursor into the saved filters, moved past them
+ * @end: End of the saved filters
+ *
+ * Returns zero on success
+ */
+int aci_watch_load(struct aci_watcher **wp, const char **p, const char *end);
+
+#endif  /* !ACI_WATCH_H */
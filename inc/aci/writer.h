@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ACI_WRITER_H
+#define ACI_WRITER_H 1
+
+#include <sys/queue.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "aci/link.h"
+#include "aci/proto.h"
+
+/* Default size a batch is sent at */
+#define ACI_WRITER_BYTES (32 * 1024)
+
+/* Default time a store may wait in a batch [ms] */
+#define ACI_WRITER_DELAY 2
+
+/* Batches sent but not answered before stores block */
+#define ACI_WRITER_INFLIGHT 8
+
+/*
+ * Called once the daemon has answered a store
+ *
+ * @arg: Argument given with the store
+ * @error: Zero on success, otherwise an errno value
+ */
+typedef void (*aci_writer_cb_t)(void *arg, int error);
+
+/*
+ * A store waiting for its result
+ *
+ * @cb: Callback to run [NULL for none]
+ * @arg: Argument of the callback
+ */
+struct aci_writer_op {
+    aci_writer_cb_t cb;
+    void *arg;
+};
+
+/*
+ * A batch that was sent and waits for its reply
+ *
+ * @link: Link on the list of batches in flight
+ * @count: Number of stores
+ * @ops: The stores, in the order they were made
+ */
+struct aci_writer_batch {
+    TAILQ_ENTRY(aci_writer_batch) link;
+    size_t count;
+    struct aci_writer_op ops[];
+};
+
+/*
+ * A buffered writer over a link. Stores from any number
+ * of threads are gathered into ACI_CMD_BATCH packets,
+ * which are sent once they reach 'max' bytes, once the
+ * oldest store in them has waited 'delay' ms, or when
+ * the writer is flushed. The result of each store is
+ * handed to its callback from a thread of the writer,
+ * in the order the stores were made. The link must not
+ * be used for anything else while the writer is open.
+ *
+ * @link: Link the batches go out on
+ * @lock: Protects everything below
+ * @cv: Signalled whenever the state below changes
+ * @buf: Batch being filled, led by its packet header
+ * @len: Bytes of 'buf' in use
+ * @max: Size a batch is sent at
+ * @ops: Stores in the batch being filled
+ * @nops: Number of stores in the batch being filled
+ * @delay: Time a store may wait in a batch [ms]
+ * @deadline: When the batch being filled is sent [ms]
+ * @inflight: Batches sent but not answered
+ * @ninflight: Number of batches in flight
+ * @error: Set once the link has failed [errno value]
+ * @closing: Set while the writer is being closed
+ * @flusher: Thread that sends batches on the timer
+ * @reader: Thread that takes the replies
+ */
+struct aci_writer {
+    struct aci_link *link;
+    pthread_mutex_t lock;
+    pthread_cond_t cv;
+    char *buf;
+    size_t len;
+    size_t max;
+    struct aci_writer_op ops[ACI_BATCH_OPS];
+    size_t nops;
+    uint32_t delay;
+    uint64_t deadline;
+    TAILQ_HEAD(, aci_writer_batch) inflight;
+    size_t ninflight;
+    int error;
+    int closing;
+    pthread_t flusher;
+    pthread_t reader;
+};
+
+/*
+ * Open a buffered writer over a link
+ *
+ * @link: Link to write to, owned by the caller
+ * @max: Size a batch is sent at [zero for ACI_WRITER_BYTES]
+ * @delay: Time a store may wait [zero for ACI_WRITER_DELAY]
+ * @res: Result is written here
+ *
+ * Returns zero on success
+ */
+int aci_writer_open(
+    struct aci_link *link, size_t max,
+    uint32_t delay, struct aci_writer **res
+);
+
+/*
+ * Add a store to the batch being filled. Blocks only
+ * while ACI_WRITER_INFLIGHT batches are unanswered.
+ * Callbacks run on a thread of the writer and must
+ * not call into it.
+ *
+ * @w: Writer to store through
+ * @drum: Name of the target drum [NUL terminated]
+ * @key: Key of the bucket [NUL terminated]
+ * @type: Datatype of the data
+ * @data: Data to store
+ * @len: Length of the data
+ * @ttl: Time to live in milliseconds [zero for never]
+ * @cb: Called with the result [NULL for none]
+ * @arg: Argument of the callback
+ *
+ * Returns zero once the store is queued
+ */
+int aci_writer_store(
+    struct aci_writer *w, const char *drum,
+    const char *key, aci_datatype_t type,
+    const void *data, size_t len, uint64_t ttl,
+    aci_writer_cb_t cb, void *arg
+);
+
+/*
+ * Send the batch being filled and wait for the result
+ * of every store made so far
+ *
+ * Returns zero on success, -1 if the link failed
+ */
+int aci_writer_flush(struct aci_writer *w);
+
+/*
+ * Flush and free a writer, the link stays open
+ */
+void aci_writer_close(struct aci_writer *w);
+
+#endif  /* !ACI_WRITER_H */
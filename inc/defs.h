@@ -31,5 +31,6 @@
 #define DEFS_H
 
 #define PACKED   __attribute__((packed))
+#define BIT(n)   (1U << (n))
 
 #endif  /* !DEFS_H */
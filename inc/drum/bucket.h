@@ -34,26 +34,57 @@
 #include <stddef.h>
 #include "defs.h"
 
-#define DRUM_KEYLEN_MAX 16
+/* Longest key, keys are bytes other than NUL */
+#define DRUM_KEYLEN_MAX 255
+
+/* Bytes of a key kept inline by the index [see drum_index_ent] */
+#define DRUM_KEY_INLINE 16
+
+/*
+ * Type of a bucket that carries no data, only the
+ * sequence number of the buckets after it that were
+ * written without one [see drum_adopt()]
+ */
+#define DRUM_BUCKET_SEQ 0xFF
+
+/*
+ * Type of a bucket whose data is still being written
+ * a piece at a time, or never was in full; replay skips
+ * it [see drum_upload_begin()]
+ */
+#define DRUM_BUCKET_PEND 0xFE
 
 /*
  * Represents a drum bucket header which sets above each
- * entry on disk.
+ * entry on disk. The key follows the header, without
+ * padding or a terminator, and the data follows the key.
  *
- * @name: Name of bucket
  * @record_len: Length of data stored
- * @data: Data raw bytes
+ * @type: Datatype of the data [aci_datatype_t]
+ * @expire: Expiry time [ms since the epoch, zero for never]
+ * @seq: Sequence number of the store that wrote it
+ * @key_len: Length of the key
+ * @data: Key then data raw bytes
  */
 struct PACKED drum_bucket {
-    char name[DRUM_KEYLEN_MAX];
     size_t record_len;
+    uint8_t type;
+    uint64_t expire;
+    uint64_t seq;
+    uint8_t key_len;
     char data[];
 };
 
+/*
+ * Returns the size a bucket takes up on disk
+ */
+#define DRUM_BUCKET_SIZE(b) \
+    (sizeof(struct drum_bucket) + (b)->key_len + (b)->record_len)
+
 /*
  * Initialize a drum bucket
  *
- * @name: Name of drum bucket
+ * @name: Key of the bucket [NUL terminated]
  * @data: Data to be carried by drum
  * @len: Length of data
  *
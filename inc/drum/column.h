@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DRUM_COLUMN_H
+#define DRUM_COLUMN_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct drum_index_ent;
+
+/*
+ * A dense column of typed values belonging to a drum.
+ * Values are kept packed with no holes so that the
+ * aggregate kernels can stream over them; removing a
+ * value moves the last one into its slot.
+ *
+ * @type: Datatype held by the column [aci_datatype_t]
+ * @ints: Values of an ACI_TYPE_INTEGER column
+ * @bits: Bitmap of an ACI_TYPE_BOOL column
+ * @owners: Index entry owning each slot
+ * @count: Number of values in the column
+ * @cap: Capacity of the column in values
+ */
+struct drum_column {
+    uint8_t type;
+    union {
+        int64_t *ints;
+        uint64_t *bits;
+    };
+    struct drum_index_ent **owners;
+    size_t count;
+    size_t cap;
+};
+
+/*
+ * Result of an aggregate over a column
+ *
+ * @count: Number of values the aggregate covers
+ * @value: Result of the aggregate
+ */
+struct drum_agg {
+    uint64_t count;
+    int64_t value;
+};
+
+/*
+ * Set the value of an index entry within a column,
+ * appending it if the entry has no slot yet.
+ *
+ * @col: Column to update
+ * @ent: Entry owning the value
+ * @value: Raw value [int64_t or uint8_t]
+ *
+ * Returns zero on success
+ */
+int drum_column_set(
+    struct drum_column *col,
+    struct drum_index_ent *ent,
+    const void *value
+);
+
+/*
+ * Copy the value of an index entry out of a column
+ *
+ * @col: Column to read from
+ * @ent: Entry owning the value
+ * @value: Raw value is written here [int64_t or uint8_t]
+ *
+ * Returns zero on success
+ */
+int drum_column_get(
+    const struct drum_column *col,
+    const struct drum_index_ent *ent,
+    void *value
+);
+
+/*
+ * Remove the value of an index entry from a column
+ *
+ * @col: Column to remove from
+ * @ent: Entry owning the value
+ */
+void drum_column_remove(
+    struct drum_column *col,
+    struct drum_index_ent *ent
+);
+
+/*
+ * Aggregate kernels. For ACI_TYPE_BOOL columns a
+ * sum counts true values, min is set if every value
+ * is true and max is set if any value is true.
+ *
+ * @col: Column to aggregate
+ * @res: Result is written here
+ */
+void drum_column_sum(const struct drum_column *col, struct drum_agg *res);
+void drum_column_min(const struct drum_column *col, struct drum_agg *res);
+void drum_column_max(const struct drum_column *col, struct drum_agg *res);
+
+/*
+ * Release the memory held by a column
+ *
+ * @col: Column to free
+ */
+void drum_column_free(struct drum_column *col);
+
+#endif  /* !DRUM_COLUMN_H */
@@ -31,22 +31,486 @@
 #define DRUM_DRUM_H 1
 
 #include <sys/queue.h>
+#include <sys/types.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stddef.h>
+#include "drum/bucket.h"
+#include "drum/column.h"
+#include "drum/wheel.h"
+#include "drum/mvcc.h"
+#include "defs.h"
 
 #define DRUM_NAMELEN 16
 
+/* Segment files are rotated once they grow past this */
+#define DRUM_SEG_MAX (64 * 1024 * 1024)
+#define DRUM_SEG_FMT "%s/%08u.seg"
+
+/* Blocks of the active segment are allocated this far ahead */
+#define DRUM_SEG_RESERVE (8 * 1024 * 1024)
+
+#define DRUM_META_FMT "%s/drum.meta"
+
+/* Segments built offline for a drum are staged here */
+#define DRUM_STAGE_FMT "%s/.stage-%s"
+#define DRUM_META_MAGIC 0x4D555244  /* 'DRUM' */
+#define DRUM_IMAGE_MAGIC 0x474D4944 /* 'DIMG' */
+
+/* Drum flags */
+#define DRUM_F_COLUMNAR BIT(0)      /* Keep typed values in columns */
+#define DRUM_F_COMPACT  BIT(1)      /* Reclaim overwritten buckets */
+#define DRUM_F_DIRECT   BIT(2)      /* Bypass the page cache [O_DIRECT] */
+
+/*
+ * A DRUM_F_COMPACT drum is compacted once this much of
+ * its segments is dead and the dead part is at least
+ * half of them
+ */
+#define DRUM_COMPACT_MIN (DRUM_SEG_MAX / 4)
+
+/*
+ * Per-drum settings, stored in the drum directory
+ *
+ * @magic: Must be DRUM_META_MAGIC
+ * @flags: Drum flags
+ */
+struct drum_meta {
+    uint32_t magic;
+    uint32_t flags;
+};
+
+/*
+ * Image of the index of a drum, see drum_image_write().
+ * The size of each segment follows the header, then
+ * 'nents' entries.
+ *
+ * @magic: Must be DRUM_IMAGE_MAGIC
+ * @name: Name of the drum
+ * @size: Bytes of the image, this header included
+ * @seq: Last sequence number handed out
+ * @seg_count: Number of segments
+ * @seg_tail: Oldest segment not emptied by compaction
+ * @nents: Number of entries
+ */
+struct PACKED drum_image {
+    uint32_t magic;
+    char name[DRUM_NAMELEN];
+    uint64_t size;
+    uint64_t seq;
+    uint32_t seg_count;
+    uint32_t seg_tail;
+    uint64_t nents;
+};
+
 /*
- * Represents a single drum
+ * An entry of a drum image. The key follows, then the
+ * value if it belongs in a column.
+ *
+ * @seq: Sequence number of the bucket
+ * @expire: Expiry time [ms since the epoch, zero for never]
+ * @off: Offset of the data within its segment
+ * @len: Length of the data
+ * @seg: Segment holding the bucket
+ * @type: Datatype of the data [aci_datatype_t]
+ * @keylen: Length of the key
+ */
+struct PACKED drum_image_ent {
+    uint64_t seq;
+    uint64_t expire;
+    uint64_t off;
+    uint64_t len;
+    uint32_t seg;
+    uint8_t type;
+    uint8_t keylen;
+    char data[];
+};
+
+struct drum_index;
+struct drum_index_ent;
+
+/*
+ * A value being written to a drum a piece at a time,
+ * see drum_upload_begin()
+ *
+ * @seg: Segment holding the reserved bucket
+ * @off: Offset of the bucket within the segment
+ * @data: Offset of the value within the segment
+ * @len: Length of the value
+ * @done: Bytes of the value written so far
+ * @type: Datatype of the value [aci_datatype_t]
+ * @expire: Expiry time [ms since the epoch, zero for never]
+ * @key: Key of the bucket
+ */
+struct drum_upload {
+    uint32_t seg;
+    off_t off;
+    off_t data;
+    size_t len;
+    size_t done;
+    uint8_t type;
+    uint64_t expire;
+    char key[DRUM_KEYLEN_MAX + 1];
+};
+
+/*
+ * Represents a single drum. There is one on-disk layout,
+ * a log of segments indexed in memory; drums that see
+ * many overwrites are kept in check with DRUM_F_COMPACT
+ * rather than by a layout of their own.
  *
  * @name: Name component of drum
  * @path: Path of drum
+ * @index: Ordered index over bucket keys
+ * @segs: Segment file descriptors [last one is active]
+ * @seg_count: Number of segments [published after 'segs']
+ * @seg_off: Write offset within the active segment
+ * @seg_resv: Offset the active segment has blocks allocated up to
+ * @dio: O_DIRECT descriptors of 'segs' [DRUM_F_DIRECT]
+ * @tail: Partial last block of the active segment [DRUM_F_DIRECT]
+ * @tail_off: Offset of 'tail' within the active segment
+ * @flags: Drum flags
+ * @live: Bytes of the buckets the index points at
+ * @disk: Bytes of all segments
+ * @uploads: Uploads begun and not yet committed or aborted
+ * @seg_tail: Oldest segment not yet emptied by compaction
+ * @compact_off: Offset compaction reached in 'seg_tail'
+ * @compact_seg: Active segment when compaction of 'seg_tail' began
+ * @ints: Column of ACI_TYPE_INTEGER values [DRUM_F_COLUMNAR]
+ * @bools: Column of ACI_TYPE_BOOL values [DRUM_F_COLUMNAR]
+ * @wheel: Expiry timers of keys stored with a TTL
+ * @versioned: Entries holding older versions for snapshots
  * @link: Queue link for ACI
  */
 struct drum {
     char name[DRUM_NAMELEN];
     const char *path;
+    struct drum_index *index;
+    int *_Atomic segs;
+    _Atomic uint32_t seg_count;
+    off_t seg_off;
+    off_t seg_resv;
+    int *_Atomic dio;
+    char *tail;
+    off_t tail_off;
+    uint32_t flags;
+    uint64_t live;
+    uint64_t disk;
+    uint32_t uploads;
+    uint32_t seg_tail;
+    off_t compact_off;
+    uint32_t compact_seg;
+    struct drum_column ints;
+    struct drum_column bools;
+    struct drum_wheel wheel;
+    LIST_HEAD(, drum_index_ent) versioned;
     TAILQ_ENTRY(drum) link;
 };
 
+/*
+ * Write the settings of a new drum to its
+ * directory
+ *
+ * @path: Path of the drum directory
+ * @flags: Drum flags
+ *
+ * Returns zero on success
+ */
+int drum_init(const char *path, uint32_t flags);
+
+/*
+ * Open the segments of a drum and rebuild its
+ * index from them.
+ *
+ * @drum: Drum to open
+ *
+ * Returns zero on success
+ */
+int drum_open(struct drum *drum);
+
+/*
+ * Append a bucket to the active segment of a drum
+ * and make it visible in the index.
+ *
+ * @drum: Drum to store to
+ * @key: Key of the bucket
+ * @type: Datatype of the data [aci_datatype_t]
+ * @data: Data to store
+ * @len: Length of data
+ * @expire: Expiry time [ms since the epoch, zero for never]
+ *
+ * Returns zero on success
+ */
+int drum_store(
+    struct drum *drum, const char *key,
+    uint8_t type, const void *data,
+    size_t len, uint64_t expire
+);
+
+/*
+ * Store a bucket that was already numbered by another
+ * daemon, such as one replicated from a leader. Takes
+ * the same arguments as drum_store() along with:
+ *
+ * @seq: Sequence number the bucket was stored with
+ *
+ * Returns zero on success
+ */
+int drum_apply(
+    struct drum *drum, const char *key,
+    uint8_t type, const void *data,
+    size_t len, uint64_t expire,
+    uint64_t seq
+);
+
+/*
+ * Reserve room for a value of 'len' bytes in the active
+ * segment, to be written with drum_upload_write() and
+ * made visible by drum_upload_commit(). Other stores may
+ * be appended in the meantime. The reserved bucket is
+ * DRUM_BUCKET_PEND until it is committed, so an upload
+ * that is given up on is skipped by replay; nothing has
+ * to be undone.
+ *
+ * @drum: Drum to store to
+ * @up: Upload to set up
+ * @key: Key of the bucket
+ * @type: Datatype of the value [aci_datatype_t]
+ * @len: Length of the value
+ * @expire: Expiry time [ms since the epoch, zero for never]
+ *
+ * Returns zero on success
+ */
+int drum_upload_begin(
+    struct drum *drum, struct drum_upload *up,
+    const char *key, uint8_t type,
+    size_t len, uint64_t expire
+);
+
+/*
+ * Write the next piece of an upload straight to its
+ * segment
+ *
+ * @drum: Drum of the upload
+ * @up: Upload to write to
+ * @buf: Next bytes of the value
+ * @len: Number of bytes, no more than are left
+ *
+ * Returns zero on success
+ */
+int drum_upload_write(
+    struct drum *drum, struct drum_upload *up,
+    const void *buf, size_t len
+);
+
+/*
+ * Number a fully written upload as a store of its own
+ * and make it visible in the index
+ *
+ * @drum: Drum of the upload
+ * @up: Upload to commit
+ *
+ * Returns zero on success
+ */
+int drum_upload_commit(struct drum *drum, struct drum_upload *up);
+
+/*
+ * Give up on an upload that will not be committed. Its
+ * reserved bucket stays behind for replay to skip.
+ *
+ * @drum: Drum of the upload
+ * @up: Upload to give up on
+ */
+void drum_upload_abort(struct drum *drum, struct drum_upload *up);
+
+/*
+ * Take over segments built outside of the daemon, such
+ * as by odb-load. Each staged segment must begin with a
+ * DRUM_BUCKET_SEQ bucket, which is stamped with 'seq'
+ * so that every staged bucket is numbered as one store.
+ * The segments are renamed in after the active one from
+ * the last to the first, so a drum reopened at any point
+ * sees either all of them or none; drum_open() puts back
+ * in the stage any that were renamed before a crash.
+ * Once renamed, the segments are part of the drum even
+ * if loading them fails, and the drum is reopened.
+ *
+ * @drum: Drum to adopt into
+ * @dir: Directory holding the staged segments
+ * @seq: Sequence number of the staged buckets
+ *
+ * Returns zero on success
+ */
+int drum_adopt(struct drum *drum, const char *dir, uint64_t seq);
+
+/*
+ * Write an image of the index of a drum to 'fd' at its
+ * current offset, for another process to open the drum
+ * from with drum_image_open() rather than replaying
+ * its segments. Older versions kept for snapshots are
+ * left out.
+ *
+ * @drum: Drum to write out
+ * @fd: File to write to
+ *
+ * Returns the number of bytes written
+ */
+ssize_t drum_image_write(struct drum *drum, int fd);
+
+/*
+ * Look up the image of a drum among images written
+ * back to back
+ *
+ * @buf: Images
+ * @len: Length of 'buf'
+ * @name: Name of the drum
+ *
+ * Returns NULL if there is no intact image of the drum
+ */
+const struct drum_image *drum_image_find(
+    const void *buf, size_t len,
+    const char *name
+);
+
+/*
+ * Open the segments of a drum and build its index from
+ * an image instead of replaying them. Fails with ESTALE
+ * if the segments are not as the image saw them; the
+ * drum is left closed then and may be opened with
+ * drum_open().
+ *
+ * @drum: Drum to open
+ * @img: Image of the drum, see drum_image_find()
+ *
+ * Returns zero on success
+ */
+int drum_image_open(struct drum *drum, const struct drum_image *img);
+
+/*
+ * Drop an entry from the index and columns of a drum.
+ * The bucket stays in its segment; replay skips it
+ * again if it has expired.
+ *
+ * @drum: Drum the entry belongs to
+ * @ent: Entry to drop
+ */
+void drum_remove(struct drum *drum, struct drum_index_ent *ent);
+
+/*
+ * Do up to 'budget' bytes of work compacting a
+ * DRUM_F_COMPACT drum. The live buckets of the oldest
+ * segment are appended again with the sequence numbers
+ * they were stored with, then the segment is emptied.
+ * Segments are only emptied oldest first, so replay can
+ * never find a bucket that a newer, emptied one used to
+ * hide. Compaction does not begin while an upload is in
+ * progress, and a segment is not emptied while a
+ * snapshot still sees a version in it.
+ *
+ * @drum: Drum to compact
+ * @budget: Max bytes of buckets to go through
+ *
+ * Returns the number of bytes gone through, zero if
+ * there is nothing to do for now
+ */
+ssize_t drum_compact(struct drum *drum, size_t budget);
+
+/*
+ * Reclaim keys whose TTL ran out by 'now', stopping
+ * after 'budget' of them so that a burst of expiries
+ * is spread over several calls.
+ *
+ * @drum: Drum to reclaim from
+ * @now: Current time [ms since the epoch]
+ * @budget: Max keys to reclaim
+ *
+ * Returns the number of keys reclaimed
+ */
+size_t drum_expire(struct drum *drum, uint64_t now, size_t budget);
+
+/*
+ * Returns the time [ms since the epoch] drum_expire()
+ * next has work to do, see drum_wheel_next()
+ */
+uint64_t drum_expire_next(struct drum *drum);
+
+/*
+ * Returns the current time in ms since the epoch, the
+ * clock expiry times are kept in
+ */
+uint64_t drum_clock(void);
+
+/*
+ * Returns the column holding values of 'type',
+ * or NULL if the drum keeps no such column.
+ *
+ * @drum: Drum to look in
+ * @type: Datatype [aci_datatype_t]
+ */
+struct drum_column *drum_column_of(struct drum *drum, uint8_t type);
+
+/*
+ * Reclaim the older versions of keys that no held
+ * snapshot can see anymore. Only entries that have
+ * older versions are visited.
+ *
+ * @drum: Drum to reclaim from
+ */
+void drum_gc(struct drum *drum);
+
+/*
+ * Resolve where the data of a version lives, for
+ * callers that issue their own I/O against the
+ * segment.
+ *
+ * @drum: Drum the version belongs to
+ * @v: Version to locate
+ * @fd: Segment descriptor is written here
+ * @off: Offset of the data is written here
+ *
+ * Returns zero on success
+ */
+int drum_locate(
+    struct drum *drum,
+    const struct drum_version *v,
+    int *fd, off_t *off
+);
+
+/*
+ * Read the data of a version of a key
+ *
+ * @drum: Drum the version belongs to
+ * @v: Version to read
+ * @buf: Buffer of at least v->len bytes
+ *
+ * Returns the number of bytes read
+ */
+ssize_t drum_read_version(
+    struct drum *drum,
+    const struct drum_version *v,
+    void *buf
+);
+
+/*
+ * Read the data of an indexed bucket
+ *
+ * @drum: Drum the entry belongs to
+ * @ent: Index entry to read
+ * @buf: Buffer of at least ent->len bytes
+ *
+ * Returns the number of bytes read
+ */
+ssize_t drum_read(
+    struct drum *drum,
+    const struct drum_index_ent *ent,
+    void *buf
+);
+
+/*
+ * Close the segments of a drum and free its index
+ *
+ * @drum: Drum to close
+ */
+void drum_close(struct drum *drum);
+
 #endif  /* !DRUM_DRUM_H */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DRUM_EPOCH_H
+#define DRUM_EPOCH_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Most threads that may read drums at once */
+#define DRUM_EPOCH_READERS 64
+
+/* Retired objects held back before a reclaim pass */
+#define DRUM_EPOCH_BATCH 64
+
+/*
+ * Drums have one writer thread, the one that stores to
+ * and removes from them. Other threads may look up keys
+ * and read values without any lock, between a call to
+ * drum_epoch_enter() and one to drum_epoch_exit(). What
+ * the writer takes out of an index while they may still
+ * be looking at it is retired rather than freed, and
+ * only freed once every reader that could have seen it
+ * has left.
+ *
+ * Readers may use drum_index_lookup(), drum_index_seek(),
+ * drum_index_next(), drum_index_key(), drum_index_keycmp(),
+ * drum_version_of(), drum_locate() and drum_read_version().
+ * Pointers they get must not be kept past the exit.
+ */
+
+/*
+ * Start a read-side critical section on the calling
+ * thread. Sections may nest.
+ *
+ * Returns zero on success, -1 if every reader slot is
+ * taken by other threads
+ */
+int drum_epoch_enter(void);
+
+/*
+ * End a read-side critical section
+ */
+void drum_epoch_exit(void);
+
+/*
+ * Give back the reader slot of the calling thread, for
+ * threads that are done reading for good
+ */
+void drum_epoch_detach(void);
+
+/*
+ * Free an object once no reader can still see it. The
+ * writer must have unlinked it from anything readers
+ * walk first. Writer thread only.
+ *
+ * @p: Object to free
+ * @fn: Frees the object
+ */
+void drum_epoch_retire(void *p, void (*fn)(void *));
+
+/*
+ * Free every retired object that no reader can still
+ * see. Writer thread only.
+ *
+ * Returns the number of objects still held back
+ */
+size_t drum_epoch_reclaim(void);
+
+#endif  /* !DRUM_EPOCH_H */
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DRUM_INDEX_H
+#define DRUM_INDEX_H 1
+
+#include <sys/queue.h>
+#include <sys/types.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "drum/bucket.h"
+#include "drum/wheel.h"
+#include "drum/mvcc.h"
+
+#define DRUM_INDEX_LEVELS 16
+#define DRUM_SLOT_NONE UINT32_MAX
+
+/* Fewest common bytes worth sharing between long keys */
+#define DRUM_KEY_SHARE_MIN 8
+
+/*
+ * Bytes that long keys near each other in the index
+ * have in common past their inline part. They are kept
+ * once and shared by every entry whose key goes on with
+ * them, so long keys with a common prefix cost little
+ * more than their distinct ends.
+ *
+ * @refs: Number of entries sharing it
+ * @len: Number of bytes
+ * @data: The bytes
+ */
+struct drum_key_prefix {
+    uint32_t refs;
+    uint8_t len;
+    char data[];
+};
+
+/*
+ * Represents a single key within a drum index. The first
+ * DRUM_KEY_INLINE bytes of a key are kept inline and zero
+ * padded, so that most comparisons are a single fixed-size
+ * memcmp(). The rest of a longer key is a shared prefix
+ * followed by a suffix of its own, which is stored past
+ * 'next' [see drum_index_key()].
+ *
+ * The key never changes once the entry is linked in.
+ * The fields of the current version are only written
+ * between drum_index_write_begin() and _end(), which
+ * readers on other threads use to take a consistent
+ * copy [see drum/epoch.h].
+ *
+ * @key: First bytes of the key
+ * @keylen: Length of the key
+ * @gen: Write generation [odd while being written]
+ * @prefix: Shared bytes past 'key' [NULL if none]
+ * @seg: Segment the bucket lives in
+ * @off: Offset of the bucket data within the segment
+ * @len: Length of the bucket record data
+ * @type: Datatype of the bucket data
+ * @slot: Slot within the drum column for 'type'
+ * @expire: Expiry time [ms since the epoch, zero for never]
+ * @timer: Expiry timer on the drum wheel
+ * @seq: Sequence number of the store that wrote it
+ * @older: Older versions kept for snapshots [NULL if none]
+ * @vlink: Link on the list of entries with older versions
+ * @nlevels: Number of forward links this entry has
+ * @next: Forward links [one per level]
+ */
+struct drum_index_ent {
+    char key[DRUM_KEY_INLINE];
+    uint8_t keylen;
+    _Atomic uint32_t gen;
+    struct drum_key_prefix *prefix;
+    uint32_t seg;
+    off_t off;
+    size_t len;
+    uint8_t type;
+    uint32_t slot;
+    uint64_t expire;
+    struct drum_timer timer;
+    uint64_t seq;
+    struct drum_version *older;
+    LIST_ENTRY(drum_index_ent) vlink;
+    uint8_t nlevels;
+    struct drum_index_ent *_Atomic next[];
+};
+
+/*
+ * An ordered per-drum index over bucket keys,
+ * implemented as a skiplist. Entries are linked in
+ * whole with release stores, so readers can walk it
+ * without a lock while the writer changes it.
+ *
+ * @head: Sentinel head entry
+ * @levels: Number of levels currently in use
+ * @count: Number of keys in the index
+ * @seed: Level generator state
+ */
+struct drum_index {
+    struct drum_index_ent *head;
+    _Atomic uint8_t levels;
+    size_t count;
+    uint32_t seed;
+};
+
+/*
+ * Returns the entry following 'ent' in key order
+ */
+#define drum_index_next(ent) \
+    atomic_load_explicit(&(ent)->next[0], memory_order_acquire)
+
+/*
+ * Returns true if an entry has expired by 'now'
+ * [ms since the epoch]
+ */
+#define drum_index_expired(ent, now) \
+    ((ent)->expire != 0 && (ent)->expire <= (now))
+
+/*
+ * Returns the entry a timer is embedded in
+ */
+#define drum_index_of_timer(t) ((struct drum_index_ent *) \
+    ((char *)(t) - offsetof(struct drum_index_ent, timer)))
+
+/*
+ * Allocate a new empty index
+ *
+ * @res: Result index is written here
+ *
+ * Returns zero on success
+ */
+int drum_index_init(struct drum_index **res);
+
+/*
+ * Copy the key of an entry out
+ *
+ * @ent: Entry to read the key of
+ * @buf: Buffer of DRUM_KEYLEN_MAX + 1 bytes, the key is
+ *       written here NUL terminated
+ *
+ * Returns the length of the key
+ */
+size_t drum_index_key(const struct drum_index_ent *ent, char *buf);
+
+/*
+ * Compare the key of an entry with a key, in the order
+ * of the index
+ *
+ * Returns less than, equal to or greater than zero as
+ * the key of 'ent' sorts before, with or after 'key'
+ */
+int drum_index_keycmp(const struct drum_index_ent *ent, const char *key);
+
+/*
+ * Find the entry of a key, adding one that refers to a
+ * version if the key is new. An entry that is already
+ * there is left as it is, for the caller to update.
+ *
+ * @idx: Index to insert into
+ * @key: Key to insert [NUL terminated]
+ * @v: Version a new entry starts out with
+ * @added: Set if the entry was added
+ *
+ * Returns the entry of the key, NULL on failure
+ */
+struct drum_index_ent *drum_index_insert(
+    struct drum_index *idx, const char *key,
+    const struct drum_version *v, int *added
+);
+
+/*
+ * Bracket changes to the current version of an entry
+ * that is linked into an index. Writer thread only.
+ */
+void drum_index_write_begin(struct drum_index_ent *ent);
+void drum_index_write_end(struct drum_index_ent *ent);
+
+/*
+ * Returns the write generation to pass to
+ * drum_index_read_retry() once the fields of an entry
+ * have been read
+ */
+uint32_t drum_index_read_begin(const struct drum_index_ent *ent);
+
+/*
+ * Returns true if the entry was written to while its
+ * fields were being read, which must then be read again
+ */
+int drum_index_read_retry(const struct drum_index_ent *ent, uint32_t gen);
+
+/*
+ * Look up an exact key
+ *
+ * @idx: Index to search
+ * @key: Key to look up
+ *
+ * Returns NULL if the key does not exist
+ */
+struct drum_index_ent *drum_index_lookup(
+    struct drum_index *idx,
+    const char *key
+);
+
+/*
+ * Find the first entry whose key is greater than
+ * or equal to 'key'
+ *
+ * @idx: Index to search
+ * @key: Lower bound key
+ *
+ * Returns NULL if no such entry exists
+ */
+struct drum_index_ent *drum_index_seek(
+    struct drum_index *idx,
+    const char *key
+);
+
+/*
+ * Remove a key from the index and retire its entry,
+ * which is freed once no reader can still see it
+ *
+ * @idx: Index to remove from
+ * @key: Key to remove
+ *
+ * Returns zero on success
+ */
+int drum_index_remove(struct drum_index *idx, const char *key);
+
+/*
+ * Release an index and all of its entries, which no
+ * reader may still be looking at
+ *
+ * @idx: Index to free
+ */
+void drum_index_free(struct drum_index *idx);
+
+#endif  /* !DRUM_INDEX_H */
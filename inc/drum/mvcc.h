@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DRUM_MVCC_H
+#define DRUM_MVCC_H 1
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
+
+struct drum_index_ent;
+
+/*
+ * A version of a key. The newest version lives in the
+ * index entry itself; versions a store superseded are
+ * kept on a chain only while some snapshot can still
+ * see them.
+ *
+ * @seq: Sequence number of the store that wrote it
+ * @seg: Segment the bucket lives in
+ * @off: Offset of the bucket data within the segment
+ * @len: Length of the bucket record data
+ * @type: Datatype of the bucket data
+ * @older: Next older version [NULL if none]
+ */
+struct drum_version {
+    uint64_t seq;
+    uint32_t seg;
+    off_t off;
+    size_t len;
+    uint8_t type;
+    struct drum_version *older;
+};
+
+/*
+ * Returns the sequence number for a new store. Numbers
+ * are shared by every drum so that one snapshot is a
+ * consistent view across all of them.
+ */
+uint64_t drum_seq_next(void);
+
+/*
+ * Returns the sequence number of the newest store
+ */
+uint64_t drum_seq_last(void);
+
+/*
+ * Make sure future sequence numbers come after 'seq',
+ * used when replaying segments
+ */
+void drum_seq_observe(uint64_t seq);
+
+/*
+ * Take a snapshot of every drum as of now
+ *
+ * Returns the snapshot handle, its sequence number
+ */
+uint64_t drum_snap_take(void);
+
+/*
+ * Drop a reference to a snapshot. Versions it kept
+ * alive are reclaimed by drum_gc().
+ *
+ * Returns zero on success
+ */
+int drum_snap_release(uint64_t snap);
+
+/*
+ * Returns the number of snapshots held
+ */
+size_t drum_snap_count(void);
+
+/*
+ * Returns true if a snapshot in [lo, hi) is held, which
+ * is what keeps a version written at 'lo' and replaced
+ * at 'hi' alive
+ */
+int drum_snap_needs(uint64_t lo, uint64_t hi);
+
+/*
+ * Resolve the version of an entry a snapshot sees
+ *
+ * @ent: Index entry of the key
+ * @snap: Snapshot handle [zero for the latest version]
+ * @res: Version is copied here
+ *
+ * Returns zero if the key is visible to the snapshot
+ */
+int drum_version_of(
+    const struct drum_index_ent *ent,
+    uint64_t snap,
+    struct drum_version *res
+);
+
+#endif  /* !DRUM_MVCC_H */
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DRUM_POOL_H
+#define DRUM_POOL_H 1
+
+#include <stddef.h>
+
+/*
+ * Offsets, lengths and buffers of O_DIRECT transfers
+ * are kept to multiples of this
+ */
+#define DRUM_DIO_ALIGN 4096
+
+/* Size of each buffer in the pool */
+#define DRUM_POOL_BUFLEN (256 * 1024)
+
+/* Buffers kept around for reuse */
+#define DRUM_POOL_BUFS 32
+
+/*
+ * Take a DRUM_POOL_BUFLEN byte buffer aligned to
+ * DRUM_DIO_ALIGN. Any thread may take and give back
+ * buffers; once every pooled one is out, further
+ * buffers are allocated and freed as they go.
+ *
+ * Returns NULL if out of memory
+ */
+void *drum_pool_get(void);
+
+/*
+ * Give back a buffer taken with drum_pool_get()
+ */
+void drum_pool_put(void *buf);
+
+#endif  /* !DRUM_POOL_H */
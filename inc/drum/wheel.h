@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DRUM_WHEEL_H
+#define DRUM_WHEEL_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include "defs.h"
+
+#define DRUM_WHEEL_BITS 6
+#define DRUM_WHEEL_SLOTS BIT(DRUM_WHEEL_BITS)
+#define DRUM_WHEEL_LEVELS 4
+#define DRUM_WHEEL_TICK 10      /* Milliseconds per tick */
+
+/*
+ * A timer embedded in whatever it expires
+ *
+ * @next: Next timer in the same slot
+ * @pprev: Link pointing at this timer [NULL if unarmed]
+ * @deadline: Tick at which the timer expires
+ */
+struct drum_timer {
+    struct drum_timer *next;
+    struct drum_timer **pprev;
+    uint64_t deadline;
+};
+
+/*
+ * A hashed hierarchical timer wheel. Each level has
+ * DRUM_WHEEL_SLOTS slots covering DRUM_WHEEL_SLOTS times
+ * the span of the level below; timers are hashed into
+ * the lowest level that reaches their deadline and are
+ * cascaded down as the wheel turns, so adding, removing
+ * and expiring a timer are all O(1).
+ *
+ * @tick: Last tick the wheel has run
+ * @count: Number of armed timers, including due ones
+ * @due: Expired timers waiting to be popped
+ * @slots: Timer lists per level and slot
+ */
+struct drum_wheel {
+    uint64_t tick;
+    size_t count;
+    struct drum_timer *due;
+    struct drum_timer *slots[DRUM_WHEEL_LEVELS][DRUM_WHEEL_SLOTS];
+};
+
+/*
+ * Returns true if a timer is on a wheel
+ */
+#define drum_timer_armed(t) ((t)->pprev != NULL)
+
+/*
+ * Set up an empty wheel
+ *
+ * @w: Wheel to set up
+ * @now: Current time [ms since the epoch]
+ */
+void drum_wheel_init(struct drum_wheel *w, uint64_t now);
+
+/*
+ * Arm a timer, it must not be armed already
+ *
+ * @w: Wheel to add to
+ * @t: Timer to arm
+ * @when: Expiry time [ms since the epoch]
+ */
+void drum_wheel_add(struct drum_wheel *w, struct drum_timer *t, uint64_t when);
+
+/*
+ * Disarm a timer if it is armed
+ */
+void drum_wheel_del(struct drum_wheel *w, struct drum_timer *t);
+
+/*
+ * Turn the wheel up to 'now', moving every timer that
+ * expired on the way to the due list. Stretches of
+ * ticks with nothing to do are skipped over.
+ *
+ * @w: Wheel to turn
+ * @now: Current time [ms since the epoch]
+ */
+void drum_wheel_advance(struct drum_wheel *w, uint64_t now);
+
+/*
+ * Disarm and return one due timer, NULL if none
+ */
+struct drum_timer *drum_wheel_pop(struct drum_wheel *w);
+
+/*
+ * Returns the time [ms since the epoch] at which the
+ * wheel next has work to do, zero if timers are due
+ * already and UINT64_MAX if the wheel is empty
+ */
+uint64_t drum_wheel_next(const struct drum_wheel *w);
+
+#endif  /* !DRUM_WHEEL_H */
@@ -0,0 +1,1497 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "aci/datatype.h"
+#include "aci/proto.h"
+#include "aci/link.h"
+#include "drum/bucket.h"
+#include "drum/drum.h"
+
+#define IPC_PATH "/tmp/odb.d"
+#define LOAD_VERSION "v0.0.1"
+
+/* Input formats */
+#define FMT_NDJSON "ndjson"
+#define FMT_CSV    "csv"
+#define FMT_BIN    "bin"
+
+/* Keys sampled per job to pick partition bounds */
+#define SAMPLES_PER_JOB 64
+#define JOBS_MAX 64
+
+/* Decoded values are carved out of chunks this large */
+#define ARENA_CHUNK (1024 * 1024)
+
+/* Segments are written through a buffer this large */
+#define WRITE_BUFLEN (1024 * 1024)
+
+/* Memory for records before they are sorted into a run [MiB] */
+#define MEM_DEFAULT 256
+
+#define VALUE_MAX (DRUM_SEG_MAX - sizeof(struct drum_bucket))
+
+typedef enum {
+    LOAD_NDJSON,
+    LOAD_CSV,
+    LOAD_BIN
+} load_fmt_t;
+
+/*
+ * A single record read from the input
+ *
+ * @key: Key bytes [within the input or the arena]
+ * @ord: Position in the input, the last of a key wins
+ * @data: Value bytes [within the input or the arena]
+ * @len: Length of the value
+ * @key_len: Length of the key
+ * @type: Datatype of the value [aci_datatype_t]
+ */
+struct load_rec {
+    const char *key;
+    uint64_t ord;
+    const char *data;
+    uint32_t len;
+    uint8_t key_len;
+    uint8_t type;
+};
+
+/*
+ * A chunk of memory holding decoded values
+ *
+ * @next: Chunk allocated before this one
+ * @used: Bytes handed out
+ * @size: Bytes available
+ */
+struct load_chunk {
+    struct load_chunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+/*
+ * A key range of the input, sorted and written to
+ * segments by its own thread
+ *
+ * @id: Partition number
+ * @recs: Records of the partition
+ * @count: Number of records
+ * @nkeys: Distinct keys written
+ * @nsegs: Segments written
+ * @error: Nonzero if writing failed
+ * @thread: Worker thread
+ */
+struct load_part {
+    uint32_t id;
+    struct load_rec *recs;
+    size_t count;
+    size_t nkeys;
+    uint32_t nsegs;
+    int error;
+    pthread_t thread;
+};
+
+/*
+ * Segment or run file being written
+ *
+ * @fd: Segment descriptor
+ * @off: Bytes written to the segment
+ * @buf: Bytes not written yet
+ * @buf_len: Number of bytes in 'buf'
+ */
+struct load_seg {
+    int fd;
+    off_t off;
+    char *buf;
+    size_t buf_len;
+};
+
+/*
+ * A sorted run written out while reading the input,
+ * read back one record at a time to be merged
+ *
+ * @fd: Run descriptor
+ * @buf: Bytes read ahead
+ * @len: Number of bytes in 'buf'
+ * @pos: Bytes of 'buf' consumed
+ * @cur: Key and value of the current record
+ * @cur_cap: Room in 'cur'
+ * @rec: Current record
+ * @done: Set once every record was read
+ */
+struct load_run {
+    int fd;
+    char *buf;
+    size_t len;
+    size_t pos;
+    char *cur;
+    size_t cur_cap;
+    struct load_rec rec;
+    int done;
+};
+
+/*
+ * Input being parsed
+ *
+ * @name: File name for diagnostics
+ * @p: Parse position
+ * @end: End of the input
+ * @line: Line of the parse position
+ */
+struct load_input {
+    const char *name;
+    const char *p;
+    const char *end;
+    size_t line;
+};
+
+static struct load_rec *recs = NULL;
+static size_t rec_count = 0;
+static size_t rec_cap = 0;
+static size_t rec_total = 0;
+static struct load_chunk *arena = NULL;
+static size_t arena_bytes = 0;
+static size_t mem_budget = MEM_DEFAULT * 1024 * 1024;
+static uint32_t nruns = 0;
+static const char *stage_tmp = NULL;
+static uint8_t default_type = ACI_TYPE_STRING;
+
+static void
+load_fail(struct load_input *in, const char *msg)
+{
+    fprintf(stderr, "%s:%zu: %s\n", in->name, in->line, msg);
+    exit(1);
+}
+
+/*
+ * Carve 'len' bytes out of the value arena
+ */
+static char *
+arena_alloc(size_t len)
+{
+    struct load_chunk *chunk = arena;
+    size_t size;
+
+    if (chunk == NULL || chunk->size - chunk->used < len) {
+        size = (len > ARENA_CHUNK) ? len : ARENA_CHUNK;
+        if ((chunk = malloc(sizeof(*chunk) + size)) == NULL) {
+            fprintf(stderr, "fatal: out of memory\n");
+            exit(1);
+        }
+
+        chunk->next = arena;
+        chunk->used = 0;
+        chunk->size = size;
+        arena = chunk;
+        arena_bytes += size;
+    }
+
+    chunk->used += len;
+    return &chunk->data[chunk->used - len];
+}
+
+/*
+ * Order the keys of two records the way the drum
+ * index does, shorter keys first on a common prefix
+ */
+static int
+rec_keycmp(const struct load_rec *ra, const struct load_rec *rb)
+{
+    size_t len;
+    int diff;
+
+    len = (ra->key_len < rb->key_len) ? ra->key_len : rb->key_len;
+    if ((diff = memcmp(ra->key, rb->key, len)) != 0) {
+        return diff;
+    }
+
+    return (ra->key_len > rb->key_len) - (ra->key_len < rb->key_len);
+}
+
+static int
+rec_cmp(const void *a, const void *b)
+{
+    const struct load_rec *ra = a, *rb = b;
+    int diff;
+
+    if ((diff = rec_keycmp(ra, rb)) != 0) {
+        return diff;
+    }
+
+    return (ra->ord > rb->ord) - (ra->ord < rb->ord);
+}
+
+static int
+seg_flush(struct load_seg *seg)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < seg->buf_len) {
+        n = write(seg->fd, seg->buf + done, seg->buf_len - done);
+        if (n < 0) {
+            return -1;
+        }
+
+        done += n;
+    }
+
+    seg->buf_len = 0;
+    return 0;
+}
+
+static int
+seg_put(struct load_seg *seg, const void *data, size_t len)
+{
+    size_t n;
+
+    while (len > 0) {
+        if (seg->buf_len == WRITE_BUFLEN && seg_flush(seg) < 0) {
+            return -1;
+        }
+
+        n = WRITE_BUFLEN - seg->buf_len;
+        n = (n > len) ? len : n;
+        memcpy(seg->buf + seg->buf_len, data, n);
+        seg->buf_len += n;
+        seg->off += n;
+        data = (const char *)data + n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/*
+ * Finish the segment being written, if any
+ */
+static int
+seg_close(struct load_seg *seg)
+{
+    int error = 0;
+
+    if (seg->fd < 0) {
+        return 0;
+    }
+
+    error = seg_flush(seg);
+    close(seg->fd);
+    seg->fd = -1;
+    return error;
+}
+
+/*
+ * Free every chunk of the value arena
+ */
+static void
+arena_reset(void)
+{
+    struct load_chunk *chunk;
+
+    while ((chunk = arena) != NULL) {
+        arena = chunk->next;
+        free(chunk);
+    }
+
+    arena_bytes = 0;
+}
+
+/*
+ * Write a record to a run, laid out like a record of
+ * the binary input format [see parse_bin()]
+ */
+static int
+run_put(struct load_seg *seg, const struct load_rec *rec)
+{
+    uint8_t hdr[6];
+
+    hdr[0] = rec->type;
+    hdr[1] = rec->key_len;
+    hdr[2] = rec->len & 0xFF;
+    hdr[3] = (rec->len >> 8) & 0xFF;
+    hdr[4] = (rec->len >> 16) & 0xFF;
+    hdr[5] = (rec->len >> 24) & 0xFF;
+    if (seg_put(seg, hdr, sizeof(hdr)) < 0 ||
+        seg_put(seg, rec->key, rec->key_len) < 0 ||
+        seg_put(seg, rec->data, rec->len) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Sort the records held in memory and write the last
+ * value of each key out as the next run, so that the
+ * memory can take the records that follow
+ */
+static void
+run_spill(void)
+{
+    struct load_seg seg;
+    char path[256];
+
+    qsort(recs, rec_count, sizeof(*recs), rec_cmp);
+    snprintf(path, sizeof(path), "%s/%08u.run", stage_tmp, nruns);
+    seg.fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    seg.off = 0;
+    seg.buf_len = 0;
+    if (seg.fd < 0 || (seg.buf = malloc(WRITE_BUFLEN)) == NULL) {
+        perror(path);
+        exit(1);
+    }
+
+    for (size_t i = 0; i < rec_count; ++i) {
+        if (i + 1 < rec_count && rec_keycmp(&recs[i], &recs[i + 1]) == 0)
+            continue;
+        if (run_put(&seg, &recs[i]) < 0) {
+            perror(path);
+            exit(1);
+        }
+    }
+
+    if (seg_close(&seg) < 0) {
+        perror(path);
+        exit(1);
+    }
+
+    free(seg.buf);
+    arena_reset();
+    rec_count = 0;
+    ++nruns;
+}
+
+/*
+ * Append a record, the key is checked against what
+ * a drum bucket can hold. Once the records use up the
+ * memory budget they are written out as a run.
+ */
+static void
+rec_push(struct load_input *in, const char *key, size_t key_len,
+    uint8_t type, const char *data, size_t len)
+{
+    struct load_rec *rec;
+    size_t next;
+
+    if (key_len == 0 || key_len > DRUM_KEYLEN_MAX) {
+        load_fail(in, "bad key length");
+    }
+
+    if (memchr(key, '\0', key_len) != NULL) {
+        load_fail(in, "NUL in key");
+    }
+
+    if (len == 0 || len > VALUE_MAX - key_len) {
+        load_fail(in, "bad value length");
+    }
+
+    if (rec_count == rec_cap) {
+        rec_cap = (rec_cap == 0) ? 4096 : rec_cap * 2;
+        recs = realloc(recs, rec_cap * sizeof(*recs));
+        if (recs == NULL) {
+            fprintf(stderr, "fatal: out of memory\n");
+            exit(1);
+        }
+    }
+
+    rec = &recs[rec_count++];
+    rec->key = key;
+    rec->key_len = key_len;
+    rec->ord = rec_total++;
+    rec->data = data;
+    rec->len = len;
+    rec->type = type;
+
+    /* Sorted out to a run before the next one would not fit */
+    next = (rec_count == rec_cap) ? rec_cap * 2 : rec_cap;
+    if (next * sizeof(*recs) + arena_bytes > mem_budget) {
+        run_spill();
+    }
+}
+
+/*
+ * Encode a scalar given as text into its binary form
+ * for 'type'. Strings are left as they are.
+ */
+static void
+value_encode(struct load_input *in, uint8_t type, const char **data,
+    size_t *len)
+{
+    char buf[32], *end, *p;
+    int64_t val;
+
+    switch (type) {
+    case ACI_TYPE_INTEGER:
+        if (*len == 0 || *len >= sizeof(buf)) {
+            load_fail(in, "bad integer");
+        }
+
+        memcpy(buf, *data, *len);
+        buf[*len] = '\0';
+        errno = 0;
+        val = strtoll(buf, &end, 10);
+        if (errno != 0 || *end != '\0') {
+            load_fail(in, "bad integer");
+        }
+
+        p = arena_alloc(sizeof(val));
+        memcpy(p, &val, sizeof(val));
+        *data = p;
+        *len = sizeof(val);
+        break;
+    case ACI_TYPE_BOOL:
+        p = arena_alloc(1);
+        if (*len == 4 && memcmp(*data, "true", 4) == 0) {
+            *p = 1;
+        } else if (*len == 5 && memcmp(*data, "false", 5) == 0) {
+            *p = 0;
+        } else if (*len == 1 && (**data == '0' || **data == '1')) {
+            *p = **data - '0';
+        } else {
+            load_fail(in, "bad bool");
+        }
+
+        *data = p;
+        *len = 1;
+        break;
+    }
+}
+
+/*
+ * Read one CSV field, quoted fields may hold commas,
+ * newlines and doubled quotes
+ */
+static void
+csv_field(struct load_input *in, const char **data, size_t *len)
+{
+    const char *start, *q;
+    char *out;
+    size_t n = 0;
+
+    if (in->p >= in->end || *in->p != '"') {
+        start = in->p;
+        while (in->p < in->end && *in->p != ',' && *in->p != '\n')
+            ++in->p;
+        *data = start;
+        *len = in->p - start;
+        if (*len > 0 && start[*len - 1] == '\r')
+            --*len;
+        return;
+    }
+
+    /* Copy out only if a quote needs undoubling */
+    start = ++in->p;
+    for (q = start; q < in->end; ++q) {
+        if (*q == '"' && (q + 1 >= in->end || q[1] != '"'))
+            break;
+        if (*q == '"')
+            ++q;
+        ++n;
+    }
+
+    if (q >= in->end) {
+        load_fail(in, "unterminated quote");
+    }
+
+    *len = n;
+    *data = start;
+    if (n != (size_t)(q - start)) {
+        out = arena_alloc(n);
+        *data = out;
+        for (const char *s = start; s < q; ++s) {
+            *out++ = *s;
+            if (*s == '"')
+                ++s;
+        }
+    }
+
+    for (const char *s = start; s < q; ++s) {
+        in->line += (*s == '\n');
+    }
+
+    in->p = q + 1;
+}
+
+/*
+ * Parse 'key,value' lines, the values are of the
+ * default type
+ */
+static void
+parse_csv(struct load_input *in)
+{
+    const char *key, *data;
+    size_t key_len, len;
+
+    while (in->p < in->end) {
+        if (*in->p == '\n') {
+            ++in->p;
+            ++in->line;
+            continue;
+        }
+
+        csv_field(in, &key, &key_len);
+        if (in->p >= in->end || *in->p != ',') {
+            load_fail(in, "expected 'key,value'");
+        }
+
+        ++in->p;
+        csv_field(in, &data, &len);
+        if (in->p < in->end && *in->p != '\n') {
+            load_fail(in, "trailing fields");
+        }
+
+        value_encode(in, default_type, &data, &len);
+        rec_push(in, key, key_len, default_type, data, len);
+    }
+}
+
+static void
+json_ws(struct load_input *in)
+{
+    while (in->p < in->end &&
+        (*in->p == ' ' || *in->p == '\t' || *in->p == '\r'))
+        ++in->p;
+}
+
+/*
+ * Returns the value of a hex digit, -1 if it is not one
+ */
+static int
+json_hex(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/*
+ * Read a JSON string, decoding escapes into the arena
+ * only when there are any
+ */
+static void
+json_string(struct load_input *in, const char **data, size_t *len)
+{
+    const char *start, *q;
+    uint32_t cp;
+    char *out;
+    int d;
+
+    if (in->p >= in->end || *in->p != '"') {
+        load_fail(in, "expected string");
+    }
+
+    start = ++in->p;
+    for (q = start; q < in->end && *q != '"' && *q != '\\'; ++q) {
+        if (*q == '\n')
+            load_fail(in, "unterminated string");
+    }
+
+    if (q < in->end && *q == '"') {
+        *data = start;
+        *len = q - start;
+        in->p = q + 1;
+        return;
+    }
+
+    /* Escapes never make a string longer */
+    out = arena_alloc(in->end - start);
+    *data = out;
+    for (q = start; q < in->end && *q != '"'; ++q) {
+        if (*q == '\n') {
+            load_fail(in, "unterminated string");
+        }
+
+        if (*q != '\\') {
+            *out++ = *q;
+            continue;
+        }
+
+        if (++q >= in->end) {
+            break;
+        }
+
+        switch (*q) {
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'u':
+            cp = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (++q >= in->end || (d = json_hex(*q)) < 0)
+                    load_fail(in, "bad \\u escape");
+                cp = (cp << 4) | d;
+            }
+
+            if (cp < 0x80) {
+                *out++ = cp;
+            } else if (cp < 0x800) {
+                *out++ = 0xC0 | (cp >> 6);
+                *out++ = 0x80 | (cp & 0x3F);
+            } else {
+                *out++ = 0xE0 | (cp >> 12);
+                *out++ = 0x80 | ((cp >> 6) & 0x3F);
+                *out++ = 0x80 | (cp & 0x3F);
+            }
+            break;
+        default:
+            *out++ = *q;
+            break;
+        }
+    }
+
+    if (q >= in->end) {
+        load_fail(in, "unterminated string");
+    }
+
+    *len = out - *data;
+    in->p = q + 1;
+}
+
+/*
+ * Step over a JSON value of any kind
+ */
+static void
+json_skip(struct load_input *in)
+{
+    const char *data;
+    size_t len;
+    int depth = 0;
+
+    for (;;) {
+        if (in->p >= in->end || *in->p == '\n') {
+            load_fail(in, "truncated value");
+        }
+
+        switch (*in->p) {
+        case '"':
+            json_string(in, &data, &len);
+            continue;
+        case '{':
+        case '[':
+            ++depth;
+            break;
+        case '}':
+        case ']':
+            if (depth == 0)
+                return;
+            --depth;
+            break;
+        case ',':
+            if (depth == 0)
+                return;
+            break;
+        }
+
+        ++in->p;
+    }
+}
+
+/*
+ * Read a JSON scalar as a value, its type follows
+ * from the JSON type
+ */
+static void
+json_value(struct load_input *in, uint8_t *type, const char **data,
+    size_t *len)
+{
+    const char *start;
+
+    json_ws(in);
+    if (in->p < in->end && *in->p == '"') {
+        json_string(in, data, len);
+        *type = ACI_TYPE_STRING;
+        return;
+    }
+
+    start = in->p;
+    while (in->p < in->end && strchr(",} \t\r\n", *in->p) == NULL)
+        ++in->p;
+
+    *data = start;
+    *len = in->p - start;
+    *type = ACI_TYPE_INTEGER;
+    if ((*len == 4 && memcmp(start, "true", 4) == 0) ||
+        (*len == 5 && memcmp(start, "false", 5) == 0)) {
+        *type = ACI_TYPE_BOOL;
+    }
+
+    value_encode(in, *type, data, len);
+}
+
+/*
+ * Parse one '{"key": ..., "value": ...}' object per
+ * line, other members are ignored
+ */
+static void
+parse_ndjson(struct load_input *in)
+{
+    const char *name, *key, *data;
+    size_t name_len, key_len, len;
+    uint8_t type;
+    int have;
+
+    while (in->p < in->end) {
+        json_ws(in);
+        if (in->p < in->end && *in->p == '\n') {
+            ++in->p;
+            ++in->line;
+            continue;
+        }
+
+        if (in->p >= in->end || *in->p++ != '{') {
+            load_fail(in, "expected object");
+        }
+
+        have = 0;
+        for (;;) {
+            json_ws(in);
+            if (in->p >= in->end || *in->p == '\n')
+                load_fail(in, "unterminated object");
+            if (*in->p == '}')
+                break;
+
+            json_string(in, &name, &name_len);
+            json_ws(in);
+            if (in->p >= in->end || *in->p++ != ':')
+                load_fail(in, "expected ':'");
+
+            json_ws(in);
+            if (name_len == 3 && memcmp(name, "key", 3) == 0) {
+                json_string(in, &key, &key_len);
+                have |= 1;
+            } else if (name_len == 5 && memcmp(name, "value", 5) == 0) {
+                json_value(in, &type, &data, &len);
+                have |= 2;
+            } else {
+                json_skip(in);
+            }
+
+            json_ws(in);
+            if (in->p < in->end && *in->p == ',')
+                ++in->p;
+        }
+
+        ++in->p;
+        if (have != 3) {
+            load_fail(in, "object lacks a key or value");
+        }
+
+        rec_push(in, key, key_len, type, data, len);
+    }
+}
+
+/*
+ * Parse binary records, each laid out as
+ *
+ *  uint8_t type;       [aci_datatype_t]
+ *  uint8_t key_len;
+ *  uint32_t len;       [little endian]
+ *  char key[key_len];
+ *  char data[len];
+ */
+static void
+parse_bin(struct load_input *in)
+{
+    const uint8_t *p;
+    uint32_t len;
+    uint8_t key_len;
+
+    while (in->p < in->end) {
+        ++in->line;
+        if (in->end - in->p < 6) {
+            load_fail(in, "truncated record");
+        }
+
+        p = (const uint8_t *)in->p;
+        key_len = p[1];
+        len = p[2] | (p[3] << 8) | (p[4] << 16) | ((uint32_t)p[5] << 24);
+        if ((size_t)(in->end - in->p) - 6 < (size_t)key_len + len) {
+            load_fail(in, "truncated record");
+        }
+
+        rec_push(in, in->p + 6, key_len, p[0], in->p + 6 + key_len, len);
+        in->p += 6 + key_len + len;
+    }
+}
+
+/*
+ * Copy an input that can't be mapped, such as standard
+ * input, to an unlinked file of the stage
+ *
+ * Returns the descriptor of the copy
+ */
+static int
+load_spool(int fd)
+{
+    static uint32_t nspools = 0;
+    char path[256], *buf;
+    ssize_t n, done, w;
+    int out;
+
+    snprintf(path, sizeof(path), "%s/%08u.in", stage_tmp, nspools++);
+    out = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (out < 0 || unlink(path) < 0 || (buf = malloc(WRITE_BUFLEN)) == NULL) {
+        perror(path);
+        exit(1);
+    }
+
+    while ((n = read(fd, buf, WRITE_BUFLEN)) > 0) {
+        for (done = 0; done < n; done += w) {
+            if ((w = write(out, buf + done, n - done)) < 0) {
+                perror(path);
+                exit(1);
+            }
+        }
+    }
+
+    if (n < 0) {
+        perror("read");
+        exit(1);
+    }
+
+    free(buf);
+    return out;
+}
+
+/*
+ * Map an input file [or standard input, spooled to
+ * disk first] and parse its records
+ */
+static void
+load_file(const char *path, load_fmt_t fmt)
+{
+    struct load_input in;
+    struct stat st;
+    char *buf;
+    size_t len;
+    int fd = STDIN_FILENO, spool;
+
+    if (path != NULL && (fd = open(path, O_RDONLY)) < 0) {
+        perror(path);
+        exit(1);
+    }
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        spool = load_spool(fd);
+        if (fd != STDIN_FILENO)
+            close(fd);
+        fd = spool;
+        if (fstat(fd, &st) < 0) {
+            perror("fstat");
+            exit(1);
+        }
+    }
+
+    len = st.st_size;
+    buf = mmap(NULL, len + 1, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (buf == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+
+    /* The mapping is kept, records point into it */
+    madvise(buf, len, MADV_SEQUENTIAL);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+
+    in.name = (path != NULL) ? path : "<stdin>";
+    in.p = buf;
+    in.end = buf + len;
+    in.line = (fmt == LOAD_BIN) ? 0 : 1;
+    switch (fmt) {
+    case LOAD_NDJSON:
+        parse_ndjson(&in);
+        break;
+    case LOAD_CSV:
+        parse_csv(&in);
+        break;
+    case LOAD_BIN:
+        parse_bin(&in);
+        break;
+    }
+}
+
+/*
+ * Start the next segment of a partition, led by the
+ * bucket the daemon stamps with a sequence number
+ */
+static int
+seg_open(struct load_part *part, struct load_seg *seg)
+{
+    struct drum_bucket hdr;
+    char path[256];
+
+    if (seg_close(seg) < 0) {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/%02u-%08u.part", stage_tmp,
+        part->id, part->nsegs);
+    seg->fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (seg->fd < 0) {
+        return -1;
+    }
+
+    ++part->nsegs;
+    seg->off = 0;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.type = DRUM_BUCKET_SEQ;
+    return seg_put(seg, &hdr, sizeof(hdr));
+}
+
+/*
+ * Write a record to the segments of a partition as a
+ * bucket, rotating segments like the daemon does
+ */
+static int
+part_put(struct load_part *part, struct load_seg *seg,
+    const struct load_rec *rec)
+{
+    struct drum_bucket hdr;
+
+    if (seg->off >= DRUM_SEG_MAX && seg_open(part, seg) < 0) {
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.record_len = rec->len;
+    hdr.type = rec->type;
+    hdr.key_len = rec->key_len;
+    if (seg_put(seg, &hdr, sizeof(hdr)) < 0 ||
+        seg_put(seg, rec->key, rec->key_len) < 0 ||
+        seg_put(seg, rec->data, rec->len) < 0) {
+        return -1;
+    }
+
+    ++part->nkeys;
+    return 0;
+}
+
+/*
+ * Sort a partition and write the last value of each
+ * key to segments
+ */
+static void *
+part_run(void *arg)
+{
+    struct load_part *part = arg;
+    struct load_seg seg;
+    struct load_rec *rec;
+
+    qsort(part->recs, part->count, sizeof(*part->recs), rec_cmp);
+    seg.fd = -1;
+    seg.off = DRUM_SEG_MAX;
+    seg.buf_len = 0;
+    if ((seg.buf = malloc(WRITE_BUFLEN)) == NULL) {
+        part->error = ENOMEM;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < part->count; ++i) {
+        rec = &part->recs[i];
+        if (i + 1 < part->count &&
+            rec_keycmp(rec, &rec[1]) == 0) {
+            continue;
+        }
+
+        if (part_put(part, &seg, rec) < 0) {
+            part->error = errno;
+            break;
+        }
+    }
+
+    if (seg_close(&seg) < 0 && part->error == 0) {
+        part->error = errno;
+    }
+
+    free(seg.buf);
+    return NULL;
+}
+
+/*
+ * Read up to 'len' bytes of a run
+ *
+ * Returns the number of bytes read, -1 on error
+ */
+static ssize_t
+run_read(struct load_run *run, void *buf, size_t len)
+{
+    size_t got = 0, n;
+    ssize_t r;
+
+    while (got < len) {
+        if (run->pos == run->len) {
+            if ((r = read(run->fd, run->buf, WRITE_BUFLEN)) < 0)
+                return -1;
+            if (r == 0)
+                break;
+            run->len = r;
+            run->pos = 0;
+        }
+
+        n = run->len - run->pos;
+        n = (n > len - got) ? len - got : n;
+        memcpy((char *)buf + got, run->buf + run->pos, n);
+        run->pos += n;
+        got += n;
+    }
+
+    return got;
+}
+
+/*
+ * Move a run on to its next record
+ *
+ * Returns zero on success, -1 if the run is broken
+ */
+static int
+run_next(struct load_run *run)
+{
+    uint8_t hdr[6];
+    size_t size;
+    ssize_t n;
+    char *p;
+
+    if ((n = run_read(run, hdr, sizeof(hdr))) == 0) {
+        run->done = 1;
+        return 0;
+    }
+
+    if (n != sizeof(hdr)) {
+        return -1;
+    }
+
+    run->rec.type = hdr[0];
+    run->rec.key_len = hdr[1];
+    run->rec.len = hdr[2] | (hdr[3] << 8) | (hdr[4] << 16) |
+        ((uint32_t)hdr[5] << 24);
+    size = run->rec.key_len + run->rec.len;
+    if (size > run->cur_cap) {
+        if ((p = realloc(run->cur, size)) == NULL)
+            return -1;
+        run->cur = p;
+        run->cur_cap = size;
+    }
+
+    if (run_read(run, run->cur, size) != (ssize_t)size) {
+        return -1;
+    }
+
+    run->rec.key = run->cur;
+    run->rec.data = run->cur + run->rec.key_len;
+    return 0;
+}
+
+/*
+ * Merge the runs into the segments of a partition. Of
+ * records with the same key, the one from the latest
+ * run wins, each run holds a key at most once.
+ */
+static void
+load_merge(struct load_part *part)
+{
+    struct load_run *runs, *best;
+    struct load_seg seg;
+    char path[256];
+
+    runs = calloc(nruns, sizeof(*runs));
+    seg.buf = malloc(WRITE_BUFLEN);
+    if (runs == NULL || seg.buf == NULL) {
+        fprintf(stderr, "fatal: out of memory\n");
+        exit(1);
+    }
+
+    for (uint32_t i = 0; i < nruns; ++i) {
+        snprintf(path, sizeof(path), "%s/%08u.run", stage_tmp, i);
+        runs[i].fd = open(path, O_RDONLY);
+        runs[i].buf = malloc(WRITE_BUFLEN);
+        if (runs[i].fd < 0 || runs[i].buf == NULL || unlink(path) < 0 ||
+            run_next(&runs[i]) < 0) {
+            perror(path);
+            exit(1);
+        }
+    }
+
+    seg.fd = -1;
+    seg.off = DRUM_SEG_MAX;
+    seg.buf_len = 0;
+    for (;;) {
+        best = NULL;
+        for (uint32_t i = 0; i < nruns; ++i) {
+            if (runs[i].done)
+                continue;
+            if (best == NULL || rec_keycmp(&runs[i].rec, &best->rec) <= 0)
+                best = &runs[i];
+        }
+
+        if (best == NULL) {
+            break;
+        }
+
+        if (part->error == 0 && part_put(part, &seg, &best->rec) < 0) {
+            part->error = errno;
+        }
+
+        /* The key 'best' holds must outlive the others moving on */
+        for (uint32_t i = 0; i < nruns; ++i) {
+            if (&runs[i] == best || runs[i].done ||
+                rec_keycmp(&runs[i].rec, &best->rec) != 0)
+                continue;
+            if (run_next(&runs[i]) < 0)
+                part->error = EIO;
+        }
+
+        if (run_next(best) < 0) {
+            part->error = EIO;
+        }
+
+        if (part->error != 0) {
+            break;
+        }
+    }
+
+    if (seg_close(&seg) < 0 && part->error == 0) {
+        part->error = errno;
+    }
+
+    for (uint32_t i = 0; i < nruns; ++i) {
+        close(runs[i].fd);
+        free(runs[i].buf);
+        free(runs[i].cur);
+    }
+
+    free(runs);
+    free(seg.buf);
+}
+
+/*
+ * Split the records into key ranges of about the same
+ * size, one per job. Every record of a key lands in the
+ * same range and the ranges are in key order.
+ *
+ * Returns the number of partitions
+ */
+static uint32_t
+load_partition(struct load_part *parts, uint32_t jobs)
+{
+    struct load_rec *samples, *bounds, *out;
+    size_t nsamples, *pos;
+    uint32_t p, lo, hi;
+
+    nsamples = jobs * SAMPLES_PER_JOB;
+    if (jobs == 1 || rec_count < nsamples) {
+        parts[0].recs = recs;
+        parts[0].count = rec_count;
+        return 1;
+    }
+
+    samples = malloc(nsamples * sizeof(*samples));
+    bounds = malloc(jobs * sizeof(*bounds));
+    pos = calloc(jobs + 1, sizeof(*pos));
+    out = malloc(rec_count * sizeof(*out));
+    if (samples == NULL || bounds == NULL || pos == NULL || out == NULL) {
+        fprintf(stderr, "fatal: out of memory\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < nsamples; ++i) {
+        samples[i] = recs[i * (rec_count / nsamples)];
+    }
+
+    qsort(samples, nsamples, sizeof(*samples), rec_cmp);
+    for (p = 1; p < jobs; ++p) {
+        bounds[p - 1] = samples[p * SAMPLES_PER_JOB];
+    }
+
+    /* Count then scatter, by the first bound above each key */
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t i = 0; i < rec_count; ++i) {
+            lo = 0;
+            hi = jobs - 1;
+            while (lo < hi) {
+                p = (lo + hi) / 2;
+                if (rec_keycmp(&recs[i], &bounds[p]) < 0)
+                    hi = p;
+                else
+                    lo = p + 1;
+            }
+
+            if (pass == 0)
+                ++pos[lo + 1];
+            else
+                out[pos[lo]++] = recs[i];
+        }
+
+        if (pass != 0) {
+            break;
+        }
+
+        for (p = 0; p < jobs; ++p) {
+            pos[p + 1] += pos[p];
+            parts[p].recs = &out[pos[p]];
+        }
+
+        for (p = 0; p < jobs; ++p) {
+            parts[p].count = pos[p + 1] - pos[p];
+        }
+    }
+
+    free(recs);
+    free(samples);
+    free(bounds);
+    free(pos);
+    recs = out;
+    return jobs;
+}
+
+/*
+ * Hand the staged segments to a running daemon
+ */
+static int
+load_adopt(const char *sock, const char *drum, uint32_t flags)
+{
+    struct aci_status status;
+    struct aci_adopt adopt;
+    struct aci_link *link;
+    struct aci_pkt *pkt;
+
+    memset(&adopt, 0, sizeof(adopt));
+    memcpy(adopt.drum, drum, strlen(drum));
+    adopt.flags = flags;
+    if (aci_link_open(sock, 0, &link) < 0) {
+        fprintf(stderr, "could not reach daemon at %s\n", sock);
+        return -1;
+    }
+
+    if (aci_pkt_init(ACI_CMD_ADOPT, ACI_TYPE_DRUM, sizeof(adopt), &adopt,
+        &pkt) != 0) {
+        aci_link_close(link);
+        return -1;
+    }
+
+    aci_link_send(link, pkt, sizeof(*pkt) + pkt->length);
+    aci_pkt_free(pkt);
+    if (aci_link_recv(link, &status, sizeof(status)) != sizeof(status)) {
+        status.error = EIO;
+    }
+
+    aci_link_close(link);
+    if (status.error != 0) {
+        fprintf(stderr, "adopt: %s\n", strerror(status.error));
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+usage(const char *argv0)
+{
+    printf("usage: %s [-f ndjson|csv|bin] [-t integer|bool|string] "
+        "[-j jobs] [-m MiB] [-c] [-C] [-D] [-p sock] <drum-dir> <drum> "
+        "[file...]\n", argv0);
+    printf("  -m: Memory for records before they are sorted out to disk "
+        "[default %d]\n", MEM_DEFAULT);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct load_part parts[JOBS_MAX];
+    char stage[256], tmp[264], from[320], to[320];
+    const char *sock = NULL, *drum_dir, *drum;
+    load_fmt_t fmt = LOAD_NDJSON;
+    uint32_t jobs, nparts, flags = 0, seg = 0;
+    size_t nkeys = 0;
+    long ncpu;
+    int opt;
+
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = (ncpu > 0 && ncpu < JOBS_MAX) ? ncpu : JOBS_MAX;
+    while ((opt = getopt(argc, argv, "f:t:j:m:cCDp:")) != -1) {
+        switch (opt) {
+        case 'f':
+            if (strcmp(optarg, FMT_NDJSON) == 0) {
+                fmt = LOAD_NDJSON;
+            } else if (strcmp(optarg, FMT_CSV) == 0) {
+                fmt = LOAD_CSV;
+            } else if (strcmp(optarg, FMT_BIN) == 0) {
+                fmt = LOAD_BIN;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 't':
+            if (strcmp(optarg, "integer") == 0) {
+                default_type = ACI_TYPE_INTEGER;
+            } else if (strcmp(optarg, "bool") == 0) {
+                default_type = ACI_TYPE_BOOL;
+            } else if (strcmp(optarg, "string") == 0) {
+                default_type = ACI_TYPE_STRING;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            jobs = (jobs < 1) ? 1 : (jobs > JOBS_MAX) ? JOBS_MAX : jobs;
+            break;
+        case 'm':
+            mem_budget = (size_t)atoi(optarg) * 1024 * 1024;
+            if (mem_budget == 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'c':
+            flags |= DRUM_F_COLUMNAR;
+            break;
+        case 'C':
+            flags |= DRUM_F_COMPACT;
+            break;
+        case 'D':
+            flags |= DRUM_F_DIRECT;
+            break;
+        case 'p':
+            sock = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (argc - optind < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    drum_dir = argv[optind++];
+    drum = argv[optind++];
+    if (strlen(drum) >= DRUM_NAMELEN || strchr(drum, '/') != NULL) {
+        fprintf(stderr, "bad drum name \"%s\"\n", drum);
+        return 1;
+    }
+
+    /* Built under another name, so the daemon never sees half */
+    snprintf(stage, sizeof(stage), DRUM_STAGE_FMT, drum_dir, drum);
+    snprintf(tmp, sizeof(tmp), "%s.part", stage);
+    if (access(stage, F_OK) == 0) {
+        fprintf(stderr, "%s: already staged, adopt it first\n", stage);
+        return 1;
+    }
+
+    if (mkdir(tmp, 0700) < 0) {
+        perror(tmp);
+        return 1;
+    }
+
+    stage_tmp = tmp;
+    if (optind == argc) {
+        load_file(NULL, fmt);
+    }
+
+    for (; optind < argc; ++optind) {
+        load_file(argv[optind], fmt);
+    }
+
+    memset(parts, 0, sizeof(parts));
+    if (nruns > 0) {
+        /* Too large to sort at once, merge the runs instead */
+        if (rec_count > 0)
+            run_spill();
+        nparts = 1;
+        load_merge(&parts[0]);
+    } else {
+        nparts = load_partition(parts, jobs);
+        for (uint32_t i = 0; i < nparts; ++i) {
+            parts[i].id = i;
+            if (pthread_create(&parts[i].thread, NULL, part_run,
+                    &parts[i]) != 0)
+                parts[i].error = errno;
+        }
+
+        for (uint32_t i = 0; i < nparts; ++i)
+            pthread_join(parts[i].thread, NULL);
+    }
+
+    for (uint32_t i = 0; i < nparts; ++i) {
+        if (parts[i].error != 0) {
+            fprintf(stderr, "write: %s\n", strerror(parts[i].error));
+            return 1;
+        }
+    }
+
+    /* Number the segments of each range in key order */
+    for (uint32_t i = 0; i < nparts; ++i) {
+        nkeys += parts[i].nkeys;
+        for (uint32_t j = 0; j < parts[i].nsegs; ++j) {
+            snprintf(from, sizeof(from), "%s/%02u-%08u.part", tmp, i, j);
+            snprintf(to, sizeof(to), DRUM_SEG_FMT, tmp, seg++);
+            if (rename(from, to) < 0) {
+                perror(from);
+                return 1;
+            }
+        }
+    }
+
+    if (rename(tmp, stage) < 0) {
+        perror(stage);
+        return 1;
+    }
+
+    printf("staged %zu keys from %zu records in %u segments at %s\n",
+        nkeys, rec_total, seg, stage);
+    if (sock != NULL) {
+        if (load_adopt(sock, drum, flags) < 0)
+            return 1;
+        printf("adopted by %s\n", sock);
+    }
+
+    return 0;
+}
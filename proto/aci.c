@@ -73,3 +73,27 @@ aci_pkt_free(struct aci_pkt *pkt)
 
     free(pkt);
 }
+
+int
+aci_key_get(const char *src, size_t keylen, size_t avail, char *buf)
+{
+    if (src == NULL || buf == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (keylen == 0 || keylen > DRUM_KEYLEN_MAX || keylen > avail) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* A NUL would cut the key short everywhere else */
+    if (memchr(src, '\0', keylen) != NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memcpy(buf, src, keylen);
+    buf[keylen] = '\0';
+    return 0;
+}
@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "aci/link.h"
+#include "aci/proto.h"
+
+/*
+ * Hand a shared-memory channel to the daemon. The
+ * descriptors ride along with an ACI_CMD_SHM packet.
+ */
+static int
+link_shm_setup(struct aci_link *link)
+{
+    char cbuf[CMSG_SPACE(3 * sizeof(int))];
+    struct aci_status status;
+    struct aci_pkt pkt;
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    struct aci_shm *shm;
+    int fds[3];
+
+    if (aci_shm_create(&shm) < 0) {
+        return -1;
+    }
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.op = ACI_CMD_SHM;
+    pkt.type = ACI_TYPE_NONE;
+    pkt.length = 0;
+
+    iov.iov_base = &pkt;
+    iov.iov_len = sizeof(pkt);
+    memset(&msg, 0, sizeof(msg));
+    memset(cbuf, 0, sizeof(cbuf));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+
+    fds[0] = shm->memfd;
+    fds[1] = shm->tx_efd;
+    fds[2] = shm->rx_efd;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(link->sockfd, &msg, 0) < 0) {
+        aci_shm_free(shm);
+        return -1;
+    }
+
+    if (recv(link->sockfd, &status, sizeof(status), MSG_WAITALL) !=
+        sizeof(status) || status.error != 0) {
+        aci_shm_free(shm);
+        return -1;
+    }
+
+    link->shm = shm;
+    return 0;
+}
+
+int
+aci_link_open(const char *path, uint32_t flags, struct aci_link **res)
+{
+    struct sockaddr_un un;
+    struct aci_link *link;
+    size_t path_len;
+
+    if (path == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(&un, 0, sizeof(un));
+    path_len = strlen(path);
+    if (path_len >= sizeof(un.sun_path)) {
+        errno = -ENAMETOOLONG;
+        return -1;
+    }
+
+    un.sun_family = AF_UNIX;
+    memcpy(un.sun_path, path, path_len);
+
+    link = malloc(sizeof(*link));
+    if (link == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    link->shm = NULL;
+    link->sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (link->sockfd < 0) {
+        free(link);
+        return -1;
+    }
+
+    if (connect(link->sockfd, (struct sockaddr *)&un, sizeof(un)) < 0) {
+        close(link->sockfd);
+        free(link);
+        return -1;
+    }
+
+    /* Stay on the socket if the channel can't be set up */
+    if (flags & ACI_LINK_SHM) {
+        link_shm_setup(link);
+    }
+
+    *res = link;
+    return 0;
+}
+
+ssize_t
+aci_link_send(struct aci_link *link, const void *buf, size_t len)
+{
+    struct aci_ring *ring;
+
+    if (link == NULL || buf == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (link->shm == NULL) {
+        return send(link->sockfd, buf, len, 0);
+    }
+
+    if (len > ACI_RING_SIZE) {
+        errno = -EMSGSIZE;
+        return -1;
+    }
+
+    ring = &link->shm->region->tx;
+    while (aci_ring_put(ring, buf, len) == 0) {
+        sched_yield();
+    }
+
+    aci_ring_kick(ring, link->shm->tx_efd);
+    return len;
+}
+
+/*
+ * Sleep until the daemon writes to the receive ring,
+ * or hangs up.
+ */
+static int
+link_shm_wait(struct aci_link *link)
+{
+    struct pollfd pfd[2];
+    uint64_t val;
+
+    pfd[0].fd = link->shm->rx_efd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = link->sockfd;
+    pfd[1].events = POLLIN;
+
+    if (poll(pfd, 2, -1) < 0) {
+        return -1;
+    }
+
+    if (pfd[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+        errno = -EPIPE;
+        return -1;
+    }
+
+    read(link->shm->rx_efd, &val, sizeof(val));
+    return 0;
+}
+
+ssize_t
+aci_link_recv(struct aci_link *link, void *buf, size_t len)
+{
+    struct aci_ring *ring;
+    size_t got = 0, n;
+    int spins = 0;
+
+    if (link == NULL || buf == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if (link->shm == NULL) {
+        return recv(link->sockfd, buf, len, MSG_WAITALL);
+    }
+
+    ring = &link->shm->region->rx;
+    while (got < len) {
+        n = aci_ring_get(ring, (char *)buf + got, len - got);
+        if (n > 0) {
+            /* The daemon may be holding replies until we make room */
+            aci_ring_drained(ring, link->shm->tx_efd);
+            got += n;
+        }
+
+        if (got == len) {
+            break;
+        }
+
+        /* Busy poll for a bit before going to sleep */
+        if (++spins < ACI_RING_SPIN) {
+            continue;
+        }
+
+        spins = 0;
+        if (aci_ring_idle(ring) && link_shm_wait(link) < 0) {
+            return -1;
+        }
+    }
+
+    return len;
+}
+
+void
+aci_link_close(struct aci_link *link)
+{
+    if (link == NULL) {
+        return;
+    }
+
+    aci_shm_free(link->shm);
+    close(link->sockfd);
+    free(link);
+}
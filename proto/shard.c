@@ -0,0 +1,476 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aci/shard.h"
+
+#define ROWSET_MIN_CAP 16
+
+/* 64-bit FNV-1a */
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME  0x100000001B3ULL
+
+static uint64_t
+shard_fnv(uint64_t hash, const char *buf, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (uint8_t)buf[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+int
+aci_shards_open(const char *endpoints, uint32_t flags,
+    struct aci_shards **res)
+{
+    struct aci_shards *shards;
+    char *list, *path, *save;
+
+    if (endpoints == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    if ((shards = calloc(1, sizeof(*shards))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    if ((list = strdup(endpoints)) == NULL) {
+        free(shards);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    path = strtok_r(list, ACI_SHARD_SEP, &save);
+    for (; path != NULL; path = strtok_r(NULL, ACI_SHARD_SEP, &save)) {
+        if (shards->count == ACI_SHARDS_MAX) {
+            errno = -E2BIG;
+            break;
+        }
+
+        shards->paths[shards->count] = strdup(path);
+        if (shards->paths[shards->count] == NULL) {
+            errno = -ENOMEM;
+            break;
+        }
+
+        if (aci_link_open(path, flags, &shards->links[shards->count]) < 0) {
+            free(shards->paths[shards->count]);
+            break;
+        }
+
+        ++shards->count;
+    }
+
+    /* All of them or none, keys would land on the wrong daemon */
+    if (path != NULL || shards->count == 0) {
+        if (shards->count == 0 && path == NULL)
+            errno = -EINVAL;
+        free(list);
+        aci_shards_close(shards);
+        return -1;
+    }
+
+    free(list);
+    *res = shards;
+    return 0;
+}
+
+int32_t
+aci_jump_hash(uint64_t key, int32_t buckets)
+{
+    int64_t b = -1, j = 0;
+
+    while (j < buckets) {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = (b + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1));
+    }
+
+    return b;
+}
+
+size_t
+aci_shard_of(const struct aci_shards *shards, const char *drum,
+    const char *key)
+{
+    uint64_t hash = FNV_OFFSET;
+
+    if (shards == NULL || shards->count <= 1) {
+        return 0;
+    }
+
+    /* Padding must not change where a key goes */
+    hash = shard_fnv(hash, drum, strnlen(drum, DRUM_NAMELEN));
+    hash = shard_fnv(hash, "", 1);
+    hash = shard_fnv(hash, key, strlen(key));
+    return aci_jump_hash(hash, shards->count);
+}
+
+/*
+ * Make room for one more row in a set
+ */
+static struct aci_rowbuf *
+rowset_push(struct aci_rowset *set)
+{
+    struct aci_rowbuf *p;
+    size_t cap;
+
+    if (set->count == set->cap) {
+        cap = (set->cap == 0) ? ROWSET_MIN_CAP : set->cap * 2;
+        if ((p = realloc(set->rows, cap * sizeof(*p))) == NULL) {
+            errno = -ENOMEM;
+            return NULL;
+        }
+
+        set->rows = p;
+        set->cap = cap;
+    }
+
+    return &set->rows[set->count++];
+}
+
+int
+aci_link_rows(struct aci_link *link, struct aci_rowset *set)
+{
+    char drum[DRUM_NAMELEN], key[DRUM_KEYLEN_MAX + 1];
+    struct aci_rowbuf *buf;
+    struct aci_row row;
+    char *data;
+
+    if (link == NULL || set == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(drum, 0, sizeof(drum));
+    for (;;) {
+        if (aci_link_recv(link, &row, sizeof(row)) != sizeof(row)) {
+            return -1;
+        }
+
+        if (row.keylen > 0 &&
+            aci_link_recv(link, key, row.keylen) != row.keylen) {
+            return -1;
+        }
+
+        key[row.keylen] = '\0';
+        data = NULL;
+        if (row.length > 0) {
+            if ((data = malloc(row.length)) == NULL) {
+                errno = -ENOMEM;
+                return -1;
+            }
+
+            if (aci_link_recv(link, data, row.length) != row.length) {
+                free(data);
+                return -1;
+            }
+        }
+
+        /* The final row of a reply spanning drums names one */
+        if ((row.flags & ACI_ROW_END) &&
+            (data == NULL || row.type == ACI_TYPE_DRUM)) {
+            set->flags = row.flags;
+            memcpy(set->token, key, row.keylen + 1);
+            memset(set->token_drum, 0, DRUM_NAMELEN);
+            if (data != NULL) {
+                memcpy(set->token_drum, data, (row.length < DRUM_NAMELEN) ?
+                    row.length : DRUM_NAMELEN);
+            }
+
+            free(data);
+            return 0;
+        }
+
+        /* Rows that follow a drum row belong to it */
+        if (row.flags & ACI_ROW_DRUM) {
+            strncpy(drum, key, DRUM_NAMELEN);
+        }
+
+        if ((buf = rowset_push(set)) == NULL) {
+            free(data);
+            return -1;
+        }
+
+        memcpy(buf->drum, drum, DRUM_NAMELEN);
+        buf->group = 0;
+        buf->row = row;
+        buf->row.flags &= ~ACI_ROW_END;
+        memcpy(buf->key, key, row.keylen + 1);
+        buf->data = data;
+
+        /* A final row may carry data of its own [e.g., GET] */
+        if (row.flags & ACI_ROW_END) {
+            set->flags = row.flags;
+            memcpy(set->token, key, row.keylen + 1);
+            return 0;
+        }
+    }
+}
+
+/*
+ * Order rows by drum, with the drum row first, then
+ * by key
+ */
+static int
+rowbuf_cmp(const void *a, const void *b)
+{
+    const struct aci_rowbuf *ra = a, *rb = b;
+    int da, db;
+
+    if (ra->group != rb->group) {
+        return (ra->group > rb->group) - (ra->group < rb->group);
+    }
+
+    da = (ra->row.flags & ACI_ROW_DRUM) != 0;
+    db = (rb->row.flags & ACI_ROW_DRUM) != 0;
+    if (da != db) {
+        return db - da;
+    }
+
+    return strcmp(ra->key, rb->key);
+}
+
+/*
+ * Compare two positions of a reply, drums going in
+ * name order [zeroed drums for a single drum]
+ */
+static int
+token_cmp(const char *drum_a, const char *key_a, const char *drum_b,
+    const char *key_b)
+{
+    int diff;
+
+    if ((diff = strncmp(drum_a, drum_b, DRUM_NAMELEN)) != 0) {
+        return diff;
+    }
+
+    return strcmp(key_a, key_b);
+}
+
+/*
+ * Returns true if a row sorts after the given drum
+ * and key
+ */
+static int
+rowbuf_past(const struct aci_rowbuf *buf, const char *drum, const char *key)
+{
+    return token_cmp(buf->drum, buf->key, drum, key) > 0;
+}
+
+/*
+ * Number the drums of a set in the order they were
+ * first seen and drop repeated drum rows, so merged
+ * drums come out in the order the first daemon gave
+ *
+ * Returns zero on success
+ */
+static int
+rowset_group(struct aci_rowset *set)
+{
+    char (*names)[DRUM_NAMELEN] = NULL, (*p)[DRUM_NAMELEN];
+    struct aci_rowbuf *buf;
+    uint32_t ngroups = 0, cap = 0, j;
+    size_t out = 0;
+
+    for (size_t i = 0; i < set->count; ++i) {
+        buf = &set->rows[i];
+        for (j = 0; j < ngroups; ++j) {
+            if (memcmp(names[j], buf->drum, DRUM_NAMELEN) == 0)
+                break;
+        }
+
+        if (j == ngroups) {
+            if (ngroups == cap) {
+                cap = (cap == 0) ? ROWSET_MIN_CAP : cap * 2;
+                if ((p = realloc(names, cap * sizeof(*p))) == NULL) {
+                    free(names);
+                    errno = -ENOMEM;
+                    return -1;
+                }
+                names = p;
+            }
+
+            memcpy(names[ngroups++], buf->drum, DRUM_NAMELEN);
+        } else if (buf->row.flags & ACI_ROW_DRUM) {
+            free(buf->data);
+            continue;
+        }
+
+        buf->group = j;
+        set->rows[out++] = *buf;
+    }
+
+    free(names);
+    set->count = out;
+    return 0;
+}
+
+int
+aci_shards_rows(struct aci_shards *shards, uint32_t limit,
+    struct aci_rowset *res)
+{
+    char bound[DRUM_KEYLEN_MAX + 1], bound_drum[DRUM_NAMELEN];
+    uint8_t more = 0, nnone = 0, bounded = 0, untold = 0;
+    struct aci_rowbuf *next = NULL;
+    size_t nrows = 0, i;
+    int error = 0;
+
+    if (shards == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memset(res, 0, sizeof(*res));
+    for (i = 0; i < shards->count; ++i) {
+        if ((error = aci_link_rows(shards->links[i], res)) < 0) {
+            break;
+        }
+
+        more |= res->flags & ACI_ROW_MORE;
+        nnone += (res->flags & ACI_ROW_NONE) != 0;
+        if (!(res->flags & ACI_ROW_MORE)) {
+            continue;
+        }
+
+        /* No telling where its page ends, still read the rest */
+        if (res->token[0] == '\0') {
+            untold = 1;
+            continue;
+        }
+
+        if (res->count == 0) {
+            continue;
+        }
+
+        /*
+         * A daemon may end a page early [e.g., a backlogged
+         * connection], keys past its token are not known to
+         * be complete on the other daemons.
+         */
+        if (!bounded || token_cmp(res->token_drum, res->token, bound_drum,
+                bound) < 0) {
+            strcpy(bound, res->token);
+            memcpy(bound_drum, res->token_drum, DRUM_NAMELEN);
+            bounded = 1;
+        }
+    }
+
+    if (error == 0 && untold) {
+        errno = -EPROTO;
+        error = -1;
+    }
+
+    if (error < 0 || rowset_group(res) < 0) {
+        aci_rowset_free(res);
+        return -1;
+    }
+
+    qsort(res->rows, res->count, sizeof(*res->rows), rowbuf_cmp);
+
+    /* Every daemon sent its first 'limit' rows, keep ours */
+    for (i = 0; i < res->count; ++i) {
+        if (res->rows[i].row.flags & ACI_ROW_DRUM) {
+            continue;
+        }
+
+        if (bounded && rowbuf_past(&res->rows[i], bound_drum, bound)) {
+            more = ACI_ROW_MORE;
+            break;
+        }
+
+        if (limit != 0 && nrows == limit) {
+            more = ACI_ROW_MORE;
+            next = &res->rows[i];
+            break;
+        }
+
+        strcpy(res->token, res->rows[i].key);
+        ++nrows;
+    }
+
+    /* Replies spanning drums resume at the first row left out */
+    memset(res->token_drum, 0, DRUM_NAMELEN);
+    if (next != NULL && next->drum[0] != '\0') {
+        strcpy(res->token, next->key);
+        memcpy(res->token_drum, next->drum, DRUM_NAMELEN);
+    } else if (bounded && bound_drum[0] != '\0') {
+        strcpy(res->token, bound);
+        memcpy(res->token_drum, bound_drum, DRUM_NAMELEN);
+    }
+
+    while (res->count > i) {
+        free(res->rows[--res->count].data);
+    }
+
+    res->flags = ACI_ROW_END | more;
+    if (nnone == shards->count) {
+        res->flags |= ACI_ROW_NONE;
+    }
+
+    return 0;
+}
+
+void
+aci_rowset_free(struct aci_rowset *set)
+{
+    if (set == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < set->count; ++i) {
+        free(set->rows[i].data);
+    }
+
+    free(set->rows);
+    set->rows = NULL;
+    set->count = 0;
+    set->cap = 0;
+}
+
+void
+aci_shards_close(struct aci_shards *shards)
+{
+    if (shards == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < shards->count; ++i) {
+        aci_link_close(shards->links[i]);
+        free(shards->paths[i]);
+    }
+
+    free(shards);
+}
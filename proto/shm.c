@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "aci/shm.h"
+
+#define RING_MASK (ACI_RING_SIZE - 1)
+
+size_t
+aci_ring_avail(struct aci_ring *ring)
+{
+    uint32_t head, tail;
+
+    head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    return head - tail;
+}
+
+int
+aci_ring_broken(struct aci_ring *ring)
+{
+    return aci_ring_avail(ring) > ACI_RING_SIZE;
+}
+
+size_t
+aci_ring_put(struct aci_ring *ring, const void *buf, size_t len)
+{
+    uint32_t head, tail, off;
+    size_t first;
+
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail > ACI_RING_SIZE || len > ACI_RING_SIZE - (head - tail)) {
+        return 0;
+    }
+
+    off = head & RING_MASK;
+    first = ACI_RING_SIZE - off;
+    if (first > len) {
+        first = len;
+    }
+
+    memcpy(&ring->data[off], buf, first);
+    memcpy(&ring->data[0], (const char *)buf + first, len - first);
+    atomic_store_explicit(&ring->head, head + len, memory_order_release);
+    return len;
+}
+
+size_t
+aci_ring_peek(struct aci_ring *ring, void *buf, size_t len)
+{
+    uint32_t head, tail, off;
+    size_t first;
+
+    head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (head - tail > ACI_RING_SIZE) {
+        return 0;
+    }
+
+    if (len > head - tail) {
+        len = head - tail;
+    }
+
+    off = tail & RING_MASK;
+    first = ACI_RING_SIZE - off;
+    if (first > len) {
+        first = len;
+    }
+
+    memcpy(buf, &ring->data[off], first);
+    memcpy((char *)buf + first, &ring->data[0], len - first);
+    return len;
+}
+
+size_t
+aci_ring_get(struct aci_ring *ring, void *buf, size_t len)
+{
+    uint32_t tail;
+
+    len = aci_ring_peek(ring, buf, len);
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+    return len;
+}
+
+void
+aci_ring_kick(struct aci_ring *ring, int efd)
+{
+    uint64_t one = 1;
+
+    /* Orders the head store before the check, pairs with aci_ring_idle() */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&ring->waiting, 0) != 0) {
+        write(efd, &one, sizeof(one));
+    }
+}
+
+int
+aci_ring_idle(struct aci_ring *ring)
+{
+    atomic_store(&ring->waiting, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (aci_ring_avail(ring) != 0) {
+        atomic_store(&ring->waiting, 0);
+        return 0;
+    }
+
+    return 1;
+}
+
+int
+aci_ring_full(struct aci_ring *ring)
+{
+    atomic_store(&ring->full, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (aci_ring_avail(ring) < ACI_RING_SIZE) {
+        atomic_store(&ring->full, 0);
+        return 0;
+    }
+
+    return 1;
+}
+
+void
+aci_ring_drained(struct aci_ring *ring, int efd)
+{
+    uint64_t one = 1;
+
+    /* Orders the tail store before the check, pairs with aci_ring_full() */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->full, memory_order_relaxed) != 0 &&
+        atomic_exchange(&ring->full, 0) != 0) {
+        write(efd, &one, sizeof(one));
+    }
+}
+
+int
+aci_shm_create(struct aci_shm **res)
+{
+    int memfd, tx_efd, rx_efd;
+
+    if (res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    memfd = memfd_create("odb-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd < 0) {
+        return -1;
+    }
+
+    /* The daemon only maps regions that can't shrink under it */
+    if (ftruncate(memfd, sizeof(struct aci_shm_region)) < 0 ||
+        fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+        close(memfd);
+        return -1;
+    }
+
+    tx_efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    rx_efd = eventfd(0, EFD_CLOEXEC);
+    if (tx_efd < 0 || rx_efd < 0) {
+        close(memfd);
+        close(tx_efd);
+        close(rx_efd);
+        return -1;
+    }
+
+    return aci_shm_attach(memfd, tx_efd, rx_efd, res);
+}
+
+int
+aci_shm_attach(int memfd, int tx_efd, int rx_efd, struct aci_shm **res)
+{
+    struct aci_shm *shm;
+    struct stat st;
+    int seals;
+    void *p;
+
+    if (res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* Touching a page past the end would raise SIGBUS */
+    if (fstat(memfd, &st) < 0 ||
+        st.st_size < (off_t)sizeof(struct aci_shm_region)) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    seals = fcntl(memfd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        errno = -EPERM;
+        return -1;
+    }
+
+    shm = malloc(sizeof(*shm));
+    if (shm == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    p = mmap(NULL, sizeof(struct aci_shm_region), PROT_READ | PROT_WRITE,
+        MAP_SHARED, memfd, 0);
+    if (p == MAP_FAILED) {
+        free(shm);
+        return -1;
+    }
+
+    shm->region = p;
+    shm->memfd = memfd;
+    shm->tx_efd = tx_efd;
+    shm->rx_efd = rx_efd;
+    *res = shm;
+    return 0;
+}
+
+void
+aci_shm_free(struct aci_shm *shm)
+{
+    if (shm == NULL) {
+        return;
+    }
+
+    munmap(shm->region, sizeof(struct aci_shm_region));
+    close(shm->memfd);
+    close(shm->tx_efd);
+    close(shm->rx_efd);
+    free(shm);
+}
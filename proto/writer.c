@@ -0,0 +1,414 @@
+/*
+ * Copyright (c) 2025 Ian Marco Moffett and the Osmora Team.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Hyra nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "aci/writer.h"
+
+/*
+ * Returns the monotonic clock in milliseconds
+ */
+static uint64_t
+writer_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Hand every store of a batch its result and free it,
+ * called without the lock held
+ */
+static void
+writer_finish(struct aci_writer_batch *batch, const int32_t *error,
+    int fallback)
+{
+    struct aci_writer_op *op;
+
+    for (size_t i = 0; i < batch->count; ++i) {
+        op = &batch->ops[i];
+        if (op->cb != NULL)
+            op->cb(op->arg, (error != NULL) ? error[i] : fallback);
+    }
+
+    free(batch);
+}
+
+/*
+ * Send the batch being filled, called with the lock
+ * held. Waits for room while too many batches are
+ * in flight.
+ *
+ * Returns zero on success
+ */
+static int
+writer_send(struct aci_writer *w)
+{
+    struct aci_writer_batch *batch;
+    struct aci_pkt pkt;
+    ssize_t n;
+    int error;
+
+    if (w->nops == 0) {
+        return 0;
+    }
+
+    while (w->ninflight >= ACI_WRITER_INFLIGHT && w->error == 0) {
+        pthread_cond_wait(&w->cv, &w->lock);
+    }
+
+    batch = malloc(sizeof(*batch) + w->nops * sizeof(batch->ops[0]));
+    if (batch == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    batch->count = w->nops;
+    memcpy(batch->ops, w->ops, w->nops * sizeof(batch->ops[0]));
+    w->nops = 0;
+
+    /* Nothing more goes out once the link is gone */
+    if ((error = w->error) != 0) {
+        w->len = sizeof(pkt);
+        pthread_mutex_unlock(&w->lock);
+        writer_finish(batch, NULL, error);
+        pthread_mutex_lock(&w->lock);
+        return 0;
+    }
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.op = ACI_CMD_BATCH;
+    pkt.type = ACI_TYPE_NONE;
+    pkt.length = w->len - sizeof(pkt);
+    memcpy(w->buf, &pkt, sizeof(pkt));
+
+    /* Queued first, the reply may beat send() back */
+    TAILQ_INSERT_TAIL(&w->inflight, batch, link);
+    ++w->ninflight;
+    pthread_cond_broadcast(&w->cv);
+    n = aci_link_send(w->link, w->buf, w->len);
+    if (n < 0 || (size_t)n != w->len) {
+        w->error = EPIPE;
+    }
+
+    w->len = sizeof(pkt);
+    return 0;
+}
+
+/*
+ * Send each batch once its oldest store has waited
+ * long enough
+ */
+static void *
+writer_flusher(void *arg)
+{
+    struct aci_writer *w = arg;
+    struct timespec ts;
+    uint64_t now;
+
+    pthread_mutex_lock(&w->lock);
+    while (!w->closing) {
+        if (w->nops == 0) {
+            pthread_cond_wait(&w->cv, &w->lock);
+            continue;
+        }
+
+        if ((now = writer_now()) >= w->deadline) {
+            writer_send(w);
+            continue;
+        }
+
+        ts.tv_sec = w->deadline / 1000;
+        ts.tv_nsec = (w->deadline % 1000) * 1000000;
+        pthread_cond_timedwait(&w->cv, &w->lock, &ts);
+    }
+
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+/*
+ * Take the reply to each batch in flight, in the order
+ * they were sent, and hand out the results
+ */
+static void *
+writer_reader(void *arg)
+{
+    int32_t error[ACI_BATCH_OPS];
+    struct aci_writer *w = arg;
+    struct aci_writer_batch *batch;
+    struct aci_batch_reply reply;
+    size_t len;
+    int fail;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (TAILQ_EMPTY(&w->inflight) && !w->closing) {
+            pthread_cond_wait(&w->cv, &w->lock);
+        }
+
+        if ((batch = TAILQ_FIRST(&w->inflight)) == NULL) {
+            break;
+        }
+
+        /* No reply is coming once the link is gone */
+        TAILQ_REMOVE(&w->inflight, batch, link);
+        fail = w->error;
+        pthread_mutex_unlock(&w->lock);
+        if (fail == 0) {
+            len = batch->count * sizeof(error[0]);
+            if (aci_link_recv(w->link, &reply, sizeof(reply)) !=
+                sizeof(reply)) {
+                fail = EPIPE;
+            } else if (reply.count != batch->count) {
+                /* Refused as a whole, nothing follows */
+                fail = (reply.count == 0) ? EPROTO : EPIPE;
+            } else if (aci_link_recv(w->link, error, len) != len) {
+                fail = EPIPE;
+            }
+        }
+
+        writer_finish(batch, (fail == 0) ? error : NULL, fail);
+        pthread_mutex_lock(&w->lock);
+        if (fail == EPIPE) {
+            w->error = EPIPE;
+        }
+
+        --w->ninflight;
+        pthread_cond_broadcast(&w->cv);
+    }
+
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+int
+aci_writer_open(struct aci_link *link, size_t max, uint32_t delay,
+    struct aci_writer **res)
+{
+    pthread_condattr_t attr;
+    struct aci_writer *w;
+    size_t limit;
+
+    if (link == NULL || res == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    /* A batch goes out as one packet */
+    limit = sizeof(struct aci_pkt) + ACI_PKT_MAX;
+    if (link->shm != NULL) {
+        limit = ACI_RING_SIZE;
+    }
+
+    if (max == 0) {
+        max = ACI_WRITER_BYTES;
+    }
+
+    if (max > limit) {
+        max = limit;
+    }
+
+    if ((w = calloc(1, sizeof(*w))) == NULL) {
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    if ((w->buf = malloc(max)) == NULL) {
+        free(w);
+        errno = -ENOMEM;
+        return -1;
+    }
+
+    w->link = link;
+    w->max = max;
+    w->len = sizeof(struct aci_pkt);
+    w->delay = (delay == 0) ? ACI_WRITER_DELAY : delay;
+    TAILQ_INIT(&w->inflight);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&w->cv, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&w->flusher, NULL, writer_flusher, w) != 0) {
+        goto fail;
+    }
+
+    if (pthread_create(&w->reader, NULL, writer_reader, w) != 0) {
+        pthread_mutex_lock(&w->lock);
+        w->closing = 1;
+        pthread_cond_broadcast(&w->cv);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->flusher, NULL);
+        goto fail;
+    }
+
+    *res = w;
+    return 0;
+fail:
+    pthread_cond_destroy(&w->cv);
+    pthread_mutex_destroy(&w->lock);
+    free(w->buf);
+    free(w);
+    errno = -EAGAIN;
+    return -1;
+}
+
+int
+aci_writer_store(struct aci_writer *w, const char *drum, const char *key,
+    aci_datatype_t type, const void *data, size_t len, uint64_t ttl,
+    aci_writer_cb_t cb, void *arg)
+{
+    struct aci_store_ttl hdr_ttl;
+    struct aci_store hdr;
+    struct aci_pkt pkt;
+    size_t key_len, hdr_len, size;
+    char *p;
+
+    if (w == NULL || drum == NULL || key == NULL || data == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    key_len = strlen(key);
+    if (strlen(drum) >= DRUM_NAMELEN || key_len == 0 ||
+        key_len > DRUM_KEYLEN_MAX) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    hdr_len = (ttl != 0) ? sizeof(hdr_ttl) : sizeof(hdr);
+    size = sizeof(pkt) + hdr_len + key_len + len;
+    if (sizeof(pkt) + size > w->max) {
+        errno = -EMSGSIZE;
+        return -1;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    if (w->len + size > w->max || w->nops == ACI_BATCH_OPS) {
+        if (writer_send(w) < 0) {
+            pthread_mutex_unlock(&w->lock);
+            return -1;
+        }
+    }
+
+    if (w->error != 0) {
+        pthread_mutex_unlock(&w->lock);
+        errno = -w->error;
+        return -1;
+    }
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.op = (ttl != 0) ? ACI_CMD_STORE_TTL : ACI_CMD_STORE;
+    pkt.type = type;
+    pkt.length = hdr_len + key_len + len;
+
+    /* Both payloads start with the drum, the key follows the header */
+    memset(&hdr_ttl, 0, sizeof(hdr_ttl));
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr_ttl.drum, drum, strlen(drum));
+    memcpy(hdr.drum, drum, strlen(drum));
+    hdr_ttl.ttl = ttl;
+    hdr_ttl.keylen = key_len;
+    hdr.keylen = key_len;
+
+    p = w->buf + w->len;
+    memcpy(p, &pkt, sizeof(pkt));
+    memcpy(p + sizeof(pkt), (ttl != 0) ? (void *)&hdr_ttl : (void *)&hdr,
+        hdr_len);
+    memcpy(p + sizeof(pkt) + hdr_len, key, key_len);
+    memcpy(p + sizeof(pkt) + hdr_len + key_len, data, len);
+    w->len += size;
+
+    w->ops[w->nops].cb = cb;
+    w->ops[w->nops].arg = arg;
+    if (w->nops++ == 0) {
+        w->deadline = writer_now() + w->delay;
+        pthread_cond_broadcast(&w->cv);
+    }
+
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+int
+aci_writer_flush(struct aci_writer *w)
+{
+    int error;
+
+    if (w == NULL) {
+        errno = -EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    if (writer_send(w) < 0) {
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+
+    while (w->ninflight > 0) {
+        pthread_cond_wait(&w->cv, &w->lock);
+    }
+
+    error = w->error;
+    pthread_mutex_unlock(&w->lock);
+    if (error != 0) {
+        errno = -error;
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+aci_writer_close(struct aci_writer *w)
+{
+    if (w == NULL) {
+        return;
+    }
+
+    aci_writer_flush(w);
+    pthread_mutex_lock(&w->lock);
+    w->closing = 1;
+    pthread_cond_broadcast(&w->cv);
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_join(w->flusher, NULL);
+    pthread_join(w->reader, NULL);
+    pthread_cond_destroy(&w->cv);
+    pthread_mutex_destroy(&w->lock);
+    free(w->buf);
+    free(w);
+}